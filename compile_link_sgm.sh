@@ -1,4 +1,18 @@
-g++ main.cpp semi_global_matching.cpp sgm_util.cpp -std=gnu++11 -o sgm_stereo_match \
+# libnuma可用时用于NUMA感知执行的线程绑定，否则退回sched_setaffinity
+NUMA_FLAGS=$(echo '#include <numa.h>' | g++ -E -x c++ - > /dev/null 2>&1 && echo "-DSGM_USE_LIBNUMA -lnuma")
+g++ main.cpp semi_global_matching.cpp sgm_util.cpp sgm_adaptive.cpp sgm_shm_ring.cpp sgm_perf.cpp sgm_trace.cpp sgm_numa.cpp sgm_scheduler.cpp sgm_pipeline.cpp sgm_range.cpp -std=gnu++11 -pthread -o sgm_stereo_match $NUMA_FLAGS \
     -I /home/yipeng/thirdlib/glog/include -I /home/yipeng/thirdlib/gflags/include -I /home/yipeng/thirdlib/opencv/include/ \
     -L /home/yipeng/thirdlib/glog/lib -L /home/yipeng/thirdlib/gflags/lib -L /home/yipeng/thirdlib/opencv/lib/ \
-    -lglog -lgflags -lopencv_highgui -lopencv_core -lopencv_imgproc -lopencv_imgcodecs
+    -lglog -lgflags -lopencv_highgui -lopencv_core -lopencv_imgproc -lopencv_imgcodecs -lrt
+g++ sgm_ring_client.cpp sgm_shm_ring.cpp -std=gnu++11 -o sgm_ring_client \
+    -I /home/yipeng/thirdlib/glog/include -I /home/yipeng/thirdlib/gflags/include \
+    -L /home/yipeng/thirdlib/glog/lib -L /home/yipeng/thirdlib/gflags/lib \
+    -lglog -lgflags -lrt
+g++ sgm_benchmark.cpp semi_global_matching.cpp sgm_util.cpp sgm_perf.cpp sgm_trace.cpp sgm_numa.cpp sgm_scheduler.cpp sgm_pipeline.cpp -std=gnu++11 -pthread -o sgm_benchmark $NUMA_FLAGS \
+    -I /home/yipeng/thirdlib/glog/include -I /home/yipeng/thirdlib/gflags/include -I /home/yipeng/thirdlib/opencv/include/ \
+    -L /home/yipeng/thirdlib/glog/lib -L /home/yipeng/thirdlib/gflags/lib -L /home/yipeng/thirdlib/opencv/lib/ \
+    -lglog -lgflags -lopencv_highgui -lopencv_core -lopencv_imgproc -lopencv_imgcodecs -lrt
+g++ sgm_unit_test.cpp semi_global_matching.cpp sgm_util.cpp sgm_perf.cpp sgm_trace.cpp sgm_numa.cpp sgm_scheduler.cpp sgm_range.cpp -std=gnu++11 -pthread -o sgm_unit_test $NUMA_FLAGS \
+    -I /home/yipeng/thirdlib/glog/include -I /home/yipeng/thirdlib/gflags/include \
+    -L /home/yipeng/thirdlib/glog/lib -L /home/yipeng/thirdlib/gflags/lib \
+    -lglog -lgflags -lrt
@@ -18,12 +18,22 @@
 
 #include <cstdio>
 #include <cstdint>
+#include <cstring>
 #include <iostream>
 #include <fstream>
 #include <vector>
 #include <chrono>
 #include <memory>
 #include <numeric>
+#include <algorithm>
+#include <string>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <iomanip>
+#include <sstream>
+#include <map>
 
 #include <glog/logging.h>
 #include <gflags/gflags.h>
@@ -33,6 +43,11 @@
 
 #include "sgm_util.h"
 #include "semi_global_matching.h"
+#include "sgm_adaptive.h"
+#include "sgm_shm_ring.h"
+#include "sgm_trace.h"
+#include "sgm_pipeline.h"
+#include "sgm_range.h"
 
 DEFINE_string(left_image,                   "data/cone/img0.png",           "left image path");
 DEFINE_string(right_image,                  "data/cone/img1.png",           "right image path");
@@ -42,9 +57,555 @@ DEFINE_string(output_filename,              "./tools/tmp_output.txt",       "out
 DEFINE_int32(min_disp,                      0,                              "min disparity");
 DEFINE_int32(max_disp,                      64,                             "min disparity");
 DEFINE_double(resolution_ratio,             1.0,                            "resolution ratio");
+DEFINE_int32(roi_x,                         0,                              "roi x (after resize)");
+DEFINE_int32(roi_y,                         0,                              "roi y (after resize)");
+DEFINE_int32(roi_width,                     0,                              "roi width, 0 means whole image");
+DEFINE_int32(roi_height,                    0,                              "roi height, 0 means whole image");
+DEFINE_string(valid_mask_image,             "",                             "valid mask image path, non-zero pixels are matched");
+DEFINE_double(target_latency_ms,            0.0,                            "target latency per frame(ms), 0 disables adaptive quality mode");
+DEFINE_bool(fixed_point_disp,               false,                          "compute disparity as 16-bit fixed point(disp * 16)");
+DEFINE_string(rectify_maps,                 "",                             "rectification maps yml(left_map_xy, left_map_frac, right_map_xy, right_map_frac from cv::convertMaps), inputs are unrectified");
+DEFINE_string(point_cloud_save_path,        "",                             "point cloud(x y z per line) save path, empty disables reprojection");
+DEFINE_double(focal_length,                 1.0,                            "focal length(pixel) used in reprojection");
+DEFINE_double(baseline,                     1.0,                            "baseline used in reprojection, point cloud unit follows it");
+DEFINE_string(extra_views,                  "",                             "multi-baseline: extra rectified secondary images as path:disparity_scale separated by ',', right_image has scale 1");
+DEFINE_bool(perf_counters,                  false,                          "report hardware performance counters(IPC, cache misses per pixel...) of each stage");
+DEFINE_bool(row_planar_cost,                false,                          "row planar cost volume layout(faster for small disparity ranges)");
+DEFINE_int32(num_threads,                    1,                              "number of threads aggregating paths in parallel");
+DEFINE_int32(num_paths,                     8,                              "aggregation paths: 8, 4, or 2(left/right) and 3(left/right/down) for the low-memory scanline mode");
+DEFINE_string(execution,                    "auto",                         "execution strategy: auto(chosen by memory budget), full, fused, striped, streaming or scanline(2/3 paths)");
+DEFINE_int32(memory_budget_mb,              0,                              "memory budget(MB) of sgm buffers, 0 means currently available memory");
+DEFINE_string(trace_path,                   "",                             "chrome trace json(chrome://tracing, perfetto) save path of stage/path/thread timeline, empty disables tracing");
+DEFINE_string(batch_manifest,               "",                             "batch mode: manifest file, one pair per line: left_path right_path [name]");
+DEFINE_string(batch_dir,                    "",                             "batch mode: directory with left/ and right/ subdirectories of same-named images");
+DEFINE_string(batch_output_dir,             "results",                      "batch mode: output directory of disparity maps");
+DEFINE_string(daemon_ring,                  "",                             "daemon mode: shared-memory ring name(e.g. /sgm_ring), frames come from producer processes");
+DEFINE_int32(daemon_height,                 375,                            "daemon mode: image height");
+DEFINE_int32(daemon_width,                  450,                            "daemon mode: image width");
+DEFINE_int32(daemon_slots,                  4,                              "daemon mode: number of ring slots");
+DEFINE_int32(batch_prefetch,                2,                              "batch mode: number of decoded pairs buffered ahead of matching");
+DEFINE_int32(pixel_bits,                    8,                              "input bit depth: 8, or 9~16 for 16-bit images(10/12-bit raw data) read with IMREAD_ANYDEPTH");
+DEFINE_bool(path_cost_16,                   false,                          "uint16 path costs instead of saturating uint8, allows larger P1/P2 at twice the path cost memory");
+DEFINE_bool(numa_aware,                     false,                          "numa-aware execution(full/fused, num_threads > 1): cost volumes first-touched and processed by row blocks on node-pinned workers");
+DEFINE_int32(pipeline_depth,                 0,                              "batch mode: frames in flight on the work-stealing task pipeline(1~8), 0 matches pairs one by one");
+DEFINE_int32(pipeline_workers,               4,                              "batch mode: worker threads of the task pipeline");
+DEFINE_string(confidence_save_path,         "",                             "per-pixel uint8 confidence map(peak ratio, curvature, lr agreement) save path, empty disables it");
+DEFINE_bool(auto_disp_range,               false,                          "estimate disparity range from a quick decimated pass, min_disp/max_disp bound the allowed range");
+DEFINE_int32(auto_range_decimation,         4,                              "image decimation(1~8) of the disparity range estimation pass");
+DEFINE_int32(output_stride,                 1,                              "output disparity every N-th row and column(1~8), maps are ceil(height/N) x ceil(width/N)");
 
 static constexpr float Invalid_Float = std::numeric_limits<float>::infinity();
 
+// 由命令行参数生成SGM匹配参数
+static SemiGlobalMatching::SGMOption MakeSGMOption() {
+    SemiGlobalMatching::SGMOption sgm_option;
+    // 聚合路径数
+    sgm_option.num_paths = static_cast<std::uint8_t>(FLAGS_num_paths);
+    // 候选视差范围
+    sgm_option.min_disparity = FLAGS_min_disp;
+    sgm_option.max_disparity = FLAGS_max_disp;
+    // census窗口类型
+    sgm_option.census_size = SemiGlobalMatching::Census5x5;
+    // 一致性检查
+    sgm_option.is_check_lr = true;
+    sgm_option.lr_check_thresh = 1.0f;
+    // 唯一性约束
+    sgm_option.is_check_unique = true;
+    sgm_option.uniqueness_ratio = 0.99;
+    // 剔除小连通区
+    sgm_option.is_remove_speckles = true;
+    sgm_option.min_speckle_aera = 50;
+    // 惩罚项P1、P2
+    sgm_option.p1 = 10;
+    sgm_option.p2_init = 150;
+    // 视差图填充 填充的值不准确(用领域像素填充了那些误匹配的像素值，保证了完整性) 
+    sgm_option.is_fill_holes = true;
+    // 感兴趣区域
+    sgm_option.roi_x = FLAGS_roi_x;
+    sgm_option.roi_y = FLAGS_roi_y;
+    sgm_option.roi_width = FLAGS_roi_width;
+    sgm_option.roi_height = FLAGS_roi_height;
+    // 并行聚合路径的线程数
+    sgm_option.num_threads = std::max(1, FLAGS_num_threads);
+    // 代价体内存布局
+    sgm_option.cost_layout = FLAGS_row_planar_cost ? SemiGlobalMatching::CostRowPlanar : SemiGlobalMatching::CostPixelMajor;
+    // 执行策略及内存预算
+    const std::string strategies[] = { "auto", "full", "fused", "striped", "streaming", "scanline" };
+    const auto strategy = std::find(std::begin(strategies), std::end(strategies), FLAGS_execution);
+    if (strategy == std::end(strategies)) {
+        LOG(WARNING) << "unknown execution strategy " << FLAGS_execution << ", use auto";
+    } else {
+        sgm_option.execution_strategy = static_cast<SemiGlobalMatching::ExecutionStrategy>(strategy - std::begin(strategies));
+    }
+    sgm_option.memory_budget = static_cast<std::size_t>(std::max(0, FLAGS_memory_budget_mb)) << 20;
+    // 影像位深
+    sgm_option.pixel_bits = FLAGS_pixel_bits;
+    // 路径代价类型
+    sgm_option.path_cost_type = FLAGS_path_cost_16 ? SemiGlobalMatching::PathCostUint16 : SemiGlobalMatching::PathCostUint8;
+    // NUMA感知执行
+    sgm_option.is_numa_aware = FLAGS_numa_aware;
+    // 输出步长
+    sgm_option.output_stride = FLAGS_output_stride;
+    return sgm_option;
+}
+
+// 视差图拉伸到0~255用于显示和保存，无效像素为0，并生成伪彩色图
+static void DisparityToImages(const float* disparity, const int& height, const int& width, 
+                              cv::Mat& disp_mat, cv::Mat& disp_color) {
+    disp_mat = cv::Mat(height, width, CV_8UC1);
+    float min_disp = width;
+    float max_disp = 0;
+    for (int i = 0; i < height; i++) {
+        for (int j = 0; j < width; j++) {
+            const float disp = disparity[i * width + j];
+            if (disp != Invalid_Float) {
+                min_disp = std::min(min_disp, disp);
+                max_disp = std::max(max_disp, disp);
+            }
+        }
+    }
+    // 视差图(x, y)d = (视差结果(x, y)d - min_d) / (max_d - min_d) * 255 
+    for (int i = 0; i < height; i++) {
+        for (int j = 0; j < width; j++) {
+            const float disp = disparity[i * width + j];
+            if (disp == Invalid_Float) {
+                disp_mat.data[i * width + j] = 0;
+            } else {
+                disp_mat.data[i * width + j] = static_cast<std::uint8_t>((disp - min_disp) / (max_disp - min_disp) * 255);
+            }
+        }
+    }
+
+    cv::applyColorMap(disp_mat, disp_color, cv::COLORMAP_JET);
+}
+
+// 自适应质量模式匹配，输出选用的配置及耗时
+static bool MatchAdaptive(const int& height, const int& width, const SemiGlobalMatching::SGMOption& sgm_option,
+                          const std::uint8_t* left_image, const std::uint8_t* right_image, float* disparity,
+                          std::ofstream& outfile) {
+    AdaptiveSGM::AdaptiveOption adaptive_option;
+    adaptive_option.target_latency = FLAGS_target_latency_ms;
+    adaptive_option.sgm_option = sgm_option;
+
+    AdaptiveSGM adaptive_sgm;
+    if (!adaptive_sgm.Initialize(height, width, adaptive_option)) {
+        LOG(ERROR) << "自适应SGM初始化失败！";
+        outfile << "自适应SGM初始化失败!\n";
+        return false;
+    }
+
+    AdaptiveSGM::FrameReport report;
+    if (!adaptive_sgm.Match(left_image, right_image, disparity, &report)) {
+        LOG(ERROR) << "自适应SGM匹配失败！";
+        outfile << "自适应SGM匹配失败!\n";
+        return false;
+    }
+
+    LOG(INFO) << "Adaptive SGM level " << report.level << ": scale = " << report.config.scale 
+              << ", paths = " << static_cast<int>(report.config.num_paths) 
+              << ", census = " << report.config.census_size 
+              << ", lr_check = " << report.config.is_check_lr 
+              << ", remove_speckles = " << report.config.is_remove_speckles 
+              << ", fill_holes = " << report.config.is_fill_holes 
+              << ", predicted = " << report.predicted_latency << "ms, latency = " << report.latency << "ms";
+    outfile << "Adaptive SGM level " << report.level << ": scale = " << report.config.scale 
+            << ", paths = " << static_cast<int>(report.config.num_paths) 
+            << ", latency = " << report.latency << "ms\n";
+    return true;
+}
+
+// 批处理中的一对影像
+struct BatchPair {
+    std::string left_path;
+    std::string right_path;
+    std::string name;           // 输出文件名前缀
+};
+
+// 解码后的一对影像
+struct DecodedPair {
+    int index;
+    int height;
+    int width;
+    std::vector<std::uint8_t> left;
+    std::vector<std::uint8_t> right;
+};
+
+// 待编码保存的视差图
+struct DisparityResult {
+    int index;
+    int height;
+    int width;
+    std::vector<float> disparity;
+};
+
+// 有界阻塞队列，队列满时Push阻塞，Close后Pop取完剩余元素返回false
+template <typename T>
+class BoundedQueue {
+public:
+    explicit BoundedQueue(const std::size_t& capacity) : capacity_(std::max<std::size_t>(1, capacity)), is_closed_(false) { }
+
+    void Push(T&& item) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        not_full_.wait(lock, [this] { return queue_.size() < capacity_; });
+        queue_.push_back(std::move(item));
+        not_empty_.notify_one();
+    }
+
+    bool Pop(T& item) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        not_empty_.wait(lock, [this] { return !queue_.empty() || is_closed_; });
+        if (queue_.empty()) {
+            return false;
+        }
+        item = std::move(queue_.front());
+        queue_.pop_front();
+        not_full_.notify_one();
+        return true;
+    }
+
+    void Close() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        is_closed_ = true;
+        not_empty_.notify_all();
+    }
+
+private:
+    std::size_t capacity_;
+    bool is_closed_;
+    std::deque<T> queue_;
+    std::mutex mutex_;
+    std::condition_variable not_empty_;
+    std::condition_variable not_full_;
+};
+
+// 文件名（不含目录和扩展名）
+static std::string FileStem(const std::string& path) {
+    const std::size_t slash = path.find_last_of("/\\");
+    std::string name = (slash == std::string::npos) ? path : path.substr(slash + 1);
+    const std::size_t dot = name.find_last_of('.');
+    return (dot == std::string::npos) ? name : name.substr(0, dot);
+}
+
+// 读取批处理影像对列表：清单文件每行"左影像 右影像 [输出名]"，或目录下left/、right/中的同名影像
+static bool LoadBatchPairs(std::vector<BatchPair>& pairs) {
+    pairs.clear();
+    if (!FLAGS_batch_manifest.empty()) {
+        std::ifstream manifest(FLAGS_batch_manifest);
+        if (!manifest.is_open()) {
+            LOG(ERROR) << "读取批处理清单失败！";
+            return false;
+        }
+        std::string line;
+        while (std::getline(manifest, line)) {
+            std::istringstream line_stream(line);
+            BatchPair pair;
+            if (line.empty() || line[0] == '#' || !(line_stream >> pair.left_path >> pair.right_path)) {
+                continue;
+            }
+            if (!(line_stream >> pair.name)) {
+                std::ostringstream name;
+                name << std::setw(6) << std::setfill('0') << pairs.size() << "_" << FileStem(pair.left_path);
+                pair.name = name.str();
+            }
+            pairs.push_back(pair);
+        }
+    } else {
+        std::vector<std::string> left_files;
+        cv::glob(FLAGS_batch_dir + "/left/*", left_files, false);
+        std::sort(left_files.begin(), left_files.end());
+        for (const auto& left_file : left_files) {
+            const std::string file_name = left_file.substr(left_file.find_last_of("/\\") + 1);
+            pairs.push_back({ left_file, FLAGS_batch_dir + "/right/" + file_name, FileStem(file_name) });
+        }
+    }
+    if (pairs.empty()) {
+        LOG(ERROR) << "批处理影像对为空！";
+        return false;
+    }
+    return true;
+}
+
+// 批处理的流水线匹配：多帧同时在途，各帧的任务图在同一个线程池上交错执行
+// 在途帧的影像和视差图保存到回调返回，回调按帧号顺序把视差图送往写出线程，返回匹配失败数
+static int MatchBatchPipelined(const std::vector<BatchPair>& pairs, const SemiGlobalMatching::SGMOption& sgm_option, 
+                               BoundedQueue<DecodedPair>& decoded_queue, BoundedQueue<DisparityResult>& result_queue, 
+                               double& mean_latency) {
+    struct InFlight {
+        DecodedPair decoded;
+        DisparityResult result;
+    };
+    std::mutex in_flight_mutex;
+    std::map<int, InFlight> in_flight;
+    int num_failed = 0;
+    int num_done = 0;
+    double latency_sum = 0;
+    const auto on_frame = [&](const int& frame, const bool& is_success, const double& latency) {
+        std::unique_lock<std::mutex> lock(in_flight_mutex);
+        auto iter = in_flight.find(frame);
+        DisparityResult result = std::move(iter->second.result);
+        const std::string name = pairs[iter->second.decoded.index].name;
+        in_flight.erase(iter);
+        latency_sum += latency;
+        num_done++;
+        if (!is_success) {
+            LOG(ERROR) << "batch: match failed for " << name;
+            num_failed++;
+            return;
+        }
+        lock.unlock();
+        result_queue.Push(std::move(result));
+    };
+
+    // 影像尺寸变化时等待在途帧完成后重新初始化
+    SGMPipeline pipeline;
+    int height = 0, width = 0;
+    int next_frame = 0;
+    DecodedPair decoded;
+    while (decoded_queue.Pop(decoded)) {
+        const BatchPair& pair = pairs[decoded.index];
+        if (decoded.height == 0) {
+            LOG(ERROR) << "batch: failed to read " << pair.left_path << " / " << pair.right_path;
+            std::lock_guard<std::mutex> lock(in_flight_mutex);
+            num_failed++;
+            continue;
+        }
+        if (decoded.height != height || decoded.width != width) {
+            height = decoded.height;
+            width = decoded.width;
+            if (!pipeline.Initialize(height, width, sgm_option, FLAGS_pipeline_workers, FLAGS_pipeline_depth, on_frame)) {
+                LOG(ERROR) << "batch: SGM pipeline initialize failed for " << width << "x" << height;
+                height = width = 0;
+                std::lock_guard<std::mutex> lock(in_flight_mutex);
+                num_failed++;
+                continue;
+            }
+            next_frame = 0;
+        }
+
+        // 先登记再提交（回调可能在Submit返回前发生），帧号自初始化起从0连续编号
+        std::unique_lock<std::mutex> lock(in_flight_mutex);
+        InFlight& frame = in_flight[next_frame];
+        frame.decoded = std::move(decoded);
+        frame.result.index = frame.decoded.index;
+        frame.result.height = (height + sgm_option.output_stride - 1) / sgm_option.output_stride;
+        frame.result.width = (width + sgm_option.output_stride - 1) / sgm_option.output_stride;
+        frame.result.disparity.resize(frame.result.height * frame.result.width);
+        lock.unlock();
+        if (pipeline.Submit(frame.decoded.left.data(), frame.decoded.right.data(), frame.result.disparity.data()) < 0) {
+            LOG(ERROR) << "batch: match failed for " << pair.name;
+            lock.lock();
+            in_flight.erase(next_frame);
+            num_failed++;
+            continue;
+        }
+        next_frame++;
+    }
+    pipeline.Flush();
+    mean_latency = latency_sum / std::max(num_done, 1);
+    return num_failed;
+}
+
+// 批处理：一个SGM实例依次处理所有影像对
+// 预读线程提前解码后续影像对，写出线程编码保存视差图，与当前影像对的匹配并行
+static int RunBatch(const SemiGlobalMatching::SGMOption& sgm_option) {
+    if (FLAGS_target_latency_ms > 0 || !FLAGS_rectify_maps.empty() || !FLAGS_valid_mask_image.empty()) {
+        LOG(ERROR) << "批处理模式不支持自适应质量模式、校正查找表和有效像素掩膜！";
+        return -1;
+    }
+
+    std::vector<BatchPair> pairs;
+    if (!LoadBatchPairs(pairs)) {
+        return -1;
+    }
+    LOG(INFO) << "batch: " << pairs.size() << " pairs";
+
+    const auto start = std::chrono::steady_clock::now();
+    BoundedQueue<DecodedPair> decoded_queue(FLAGS_batch_prefetch);
+    BoundedQueue<DisparityResult> result_queue(FLAGS_batch_prefetch);
+
+    // 预读线程：解码、缩放、转为灰度数据，解码失败的影像对尺寸为0
+    std::thread prefetch_thread([&] {
+        if (sgm_trace::IsEnabled()) {
+            sgm_trace::SetThreadName("batch prefetch");
+        }
+        for (int k = 0; k < static_cast<int>(pairs.size()); k++) {
+            sgm_trace::Scope trace("decode", k);
+            DecodedPair decoded;
+            decoded.index = k;
+            decoded.height = decoded.width = 0;
+            cv::Mat left_gray = cv::imread(pairs[k].left_path, cv::IMREAD_GRAYSCALE);
+            cv::Mat right_gray = cv::imread(pairs[k].right_path, cv::IMREAD_GRAYSCALE);
+            if (left_gray.data != nullptr && right_gray.data != nullptr 
+                    && left_gray.rows == right_gray.rows && left_gray.cols == right_gray.cols) {
+                if (FLAGS_resolution_ratio != 1.0) {
+                    const cv::Size size(left_gray.cols * FLAGS_resolution_ratio, left_gray.rows * FLAGS_resolution_ratio);
+                    cv::resize(left_gray, left_gray, size, 0, 0, cv::INTER_LINEAR);
+                    cv::resize(right_gray, right_gray, size, 0, 0, cv::INTER_LINEAR);
+                }
+                decoded.height = left_gray.rows;
+                decoded.width = left_gray.cols;
+                decoded.left.resize(decoded.height * decoded.width);
+                decoded.right.resize(decoded.height * decoded.width);
+                for (int i = 0; i < decoded.height; i++) {
+                    memcpy(decoded.left.data() + i * decoded.width, left_gray.ptr<std::uint8_t>(i), decoded.width);
+                    memcpy(decoded.right.data() + i * decoded.width, right_gray.ptr<std::uint8_t>(i), decoded.width);
+                }
+            }
+            decoded_queue.Push(std::move(decoded));
+        }
+        decoded_queue.Close();
+    });
+
+    // 写出线程：视差图拉伸、伪彩色编码并保存
+    int num_written = 0;
+    std::thread writer_thread([&] {
+        if (sgm_trace::IsEnabled()) {
+            sgm_trace::SetThreadName("batch writer");
+        }
+        DisparityResult result;
+        while (result_queue.Pop(result)) {
+            sgm_trace::Scope trace("encode", result.index);
+            cv::Mat disp_mat, disp_color;
+            DisparityToImages(result.disparity.data(), result.height, result.width, disp_mat, disp_color);
+            const std::string prefix = FLAGS_batch_output_dir + "/" + pairs[result.index].name;
+            if (cv::imwrite(prefix + "_disp.png", disp_mat) && cv::imwrite(prefix + "_disp_color.png", disp_color)) {
+                num_written++;
+            } else {
+                LOG(ERROR) << "batch: failed to write " << prefix;
+            }
+        }
+    });
+
+    // 流水线匹配
+    if (FLAGS_pipeline_depth > 0) {
+        double mean_latency = 0;
+        const int num_failed = MatchBatchPipelined(pairs, sgm_option, decoded_queue, result_queue, mean_latency);
+        result_queue.Close();
+        prefetch_thread.join();
+        writer_thread.join();
+
+        const double total_time = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        const int num_matched = static_cast<int>(pairs.size()) - num_failed;
+        LOG(INFO) << "batch done(pipeline depth " << FLAGS_pipeline_depth << ", " << FLAGS_pipeline_workers << " workers): " 
+                  << num_matched << " matched, " << num_failed << " failed, " << num_written << " written, total " 
+                  << total_time << "s, " << num_matched / std::max(total_time, 1e-9) << " pairs/s, mean latency " 
+                  << mean_latency << "ms";
+        return num_failed == 0 ? 0 : -1;
+    }
+
+    // 匹配：影像尺寸变化时重新初始化
+    SemiGlobalMatching sgm;
+    std::ofstream null_stream;
+    int height = 0, width = 0;
+    int num_failed = 0;
+    double match_time = 0;
+    DecodedPair decoded;
+    while (decoded_queue.Pop(decoded)) {
+        const BatchPair& pair = pairs[decoded.index];
+        if (decoded.height == 0) {
+            LOG(ERROR) << "batch: failed to read " << pair.left_path << " / " << pair.right_path;
+            num_failed++;
+            continue;
+        }
+        if (decoded.height != height || decoded.width != width) {
+            height = decoded.height;
+            width = decoded.width;
+            if (!sgm.Reset(height, width, sgm_option)) {
+                LOG(ERROR) << "batch: SGM initialize failed for " << width << "x" << height;
+                height = width = 0;
+                num_failed++;
+                continue;
+            }
+            if (FLAGS_perf_counters) {
+                sgm.EnablePerfCounters(true);
+            }
+        }
+
+        DisparityResult result;
+        result.index = decoded.index;
+        result.height = sgm.OutputHeight();
+        result.width = sgm.OutputWidth();
+        result.disparity.resize(result.height * result.width);
+        const auto match_start = std::chrono::steady_clock::now();
+        if (!sgm.Match(decoded.left.data(), decoded.right.data(), result.disparity.data(), null_stream)) {
+            LOG(ERROR) << "batch: match failed for " << pair.name;
+            num_failed++;
+            continue;
+        }
+        match_time += std::chrono::duration<double>(std::chrono::steady_clock::now() - match_start).count();
+        result_queue.Push(std::move(result));
+    }
+    result_queue.Close();
+    prefetch_thread.join();
+    writer_thread.join();
+
+    const double total_time = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    const int num_matched = static_cast<int>(pairs.size()) - num_failed;
+    LOG(INFO) << "batch done: " << num_matched << " matched, " << num_failed << " failed, " 
+              << num_written << " written, total " << total_time << "s, " 
+              << num_matched / std::max(total_time, 1e-9) << " pairs/s (match only " 
+              << num_matched / std::max(match_time, 1e-9) << " pairs/s)";
+    return num_failed == 0 ? 0 : -1;
+}
+
+// 守护进程：保持已初始化的SGM实例，从共享内存环形缓冲区按槽位顺序取帧匹配，视差图直接写回槽位
+static int RunDaemon(const SemiGlobalMatching::SGMOption& sgm_option) {
+    if (FLAGS_target_latency_ms > 0 || !FLAGS_rectify_maps.empty() || !FLAGS_valid_mask_image.empty() 
+            || sgm_option.output_stride != 1) {
+        LOG(ERROR) << "守护进程模式不支持自适应质量模式、校正查找表、有效像素掩膜和输出步长！";
+        return -1;
+    }
+
+    SharedFrameRing ring;
+    if (!ring.Create(FLAGS_daemon_ring, FLAGS_daemon_height, FLAGS_daemon_width, FLAGS_daemon_slots)) {
+        LOG(ERROR) << "创建共享内存环形缓冲区失败！";
+        return -1;
+    }
+    SemiGlobalMatching sgm;
+    if (!sgm.Initialize(ring.Height(), ring.Width(), sgm_option)) {
+        LOG(ERROR) << "SGM初始化失败！";
+        return -1;
+    }
+    if (FLAGS_perf_counters) {
+        sgm.EnablePerfCounters(true);
+    }
+    LOG(INFO) << "daemon: ring " << FLAGS_daemon_ring << " ready, " << ring.Width() << "x" << ring.Height() 
+              << ", " << ring.NumSlots() << " slots";
+
+    std::ofstream null_stream;
+    std::uint64_t num_frames = 0;
+    double match_time = 0;
+    const auto start = std::chrono::steady_clock::now();
+    // 生产者按槽位顺序提交，守护进程按同样的顺序处理，一直等待直到收到退出请求
+    for (int slot = 0; ring.WaitState(slot, SharedFrameRing::Slot_Ready, -1); slot = (slot + 1) % ring.NumSlots()) {
+        ring.SetState(slot, SharedFrameRing::Slot_Matching);
+        auto header = ring.Header(slot);
+        const auto match_start = std::chrono::steady_clock::now();
+        header->is_matched = sgm.Match(ring.LeftImage(slot), ring.RightImage(slot), ring.Disparity(slot), null_stream) ? 1 : 0;
+        header->match_time = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - match_start).count();
+        match_time += header->match_time;
+        num_frames++;
+        ring.SetState(slot, SharedFrameRing::Slot_Done);
+    }
+
+    const double total_time = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    LOG(INFO) << "daemon exit: " << num_frames << " frames in " << total_time << "s, average match " 
+              << (num_frames > 0 ? match_time / num_frames : 0.0) << "ms";
+    return 0;
+}
+
+// 导出时间线跟踪
+static void DumpTrace() {
+    if (FLAGS_trace_path.empty()) {
+        return;
+    }
+    if (sgm_trace::DumpChromeTrace(FLAGS_trace_path)) {
+        LOG(INFO) << "trace saved to " << FLAGS_trace_path;
+    } else {
+        LOG(ERROR) << "保存跟踪文件失败：" << FLAGS_trace_path;
+    }
+}
+
 int main(int argc, char* argv[]) {
     google::ParseCommandLineFlags(&argc, &argv, true);
     google::InitGoogleLogging(argv[0]);
@@ -52,6 +613,29 @@ int main(int argc, char* argv[]) {
     FLAGS_stderrthreshold = google::GLOG_INFO;
     FLAGS_colorlogtostderr = true;
 
+    // 时间线跟踪，程序结束时导出
+    if (!FLAGS_trace_path.empty()) {
+        sgm_trace::Enable(true);
+        sgm_trace::SetThreadName("main");
+    }
+
+    // 批处理模式、守护进程模式
+    if (!FLAGS_batch_manifest.empty() || !FLAGS_batch_dir.empty() || !FLAGS_daemon_ring.empty()) {
+        if (FLAGS_pixel_bits != 8) {
+            LOG(ERROR) << "批处理及守护进程模式只支持8位影像！";
+            return -1;
+        }
+        if (FLAGS_auto_disp_range) {
+            LOG(ERROR) << "批处理及守护进程模式不支持自动估计视差范围，各帧使用同一视差范围！";
+            return -1;
+        }
+        const int ret = FLAGS_daemon_ring.empty() ? RunBatch(MakeSGMOption()) : RunDaemon(MakeSGMOption());
+        DumpTrace();
+        google::ShutDownCommandLineFlags();
+        google::ShutdownGoogleLogging();
+        return ret;
+    }
+
     // 读取左图右图
     std::string left_path = FLAGS_left_image;
     std::string right_path = FLAGS_right_image;
@@ -71,121 +655,297 @@ int main(int argc, char* argv[]) {
         return -1;
     }
 
+    // 高位深影像按原始位深读取，8位灰度影像只用于检查尺寸
+    const bool is_pixel_16 = FLAGS_pixel_bits > 8;
+    cv::Mat left_raw_image, right_raw_image;
+    if (is_pixel_16) {
+        if (FLAGS_target_latency_ms > 0 || !FLAGS_extra_views.empty()) {
+            LOG(ERROR) << "高位深影像不支持自适应质量模式和多基线匹配！";
+            return -1;
+        }
+        left_raw_image = cv::imread(left_path, cv::IMREAD_ANYDEPTH);
+        right_raw_image = cv::imread(right_path, cv::IMREAD_ANYDEPTH);
+        if (left_raw_image.type() != CV_16UC1 || right_raw_image.type() != CV_16UC1) {
+            LOG(ERROR) << "读取16位图片失败！";
+            return -1;
+        }
+    }
+
+    // 校正查找表，设置后输入影像为未校正的原始影像，校正在census变换时完成，视差图为查找表尺寸
+    cv::Mat left_map_xy, left_map_frac, right_map_xy, right_map_frac;
+    const bool is_rectify = !FLAGS_rectify_maps.empty();
+    if (is_rectify) {
+        cv::FileStorage map_file(FLAGS_rectify_maps, cv::FileStorage::READ);
+        if (!map_file.isOpened()) {
+            LOG(ERROR) << "读取校正查找表失败！";
+            return -1;
+        }
+        map_file["left_map_xy"] >> left_map_xy;
+        map_file["left_map_frac"] >> left_map_frac;
+        map_file["right_map_xy"] >> right_map_xy;
+        map_file["right_map_frac"] >> right_map_frac;
+        if (left_map_xy.type() != CV_16SC2 || right_map_xy.type() != CV_16SC2 
+                || left_map_frac.type() != CV_16UC1 || right_map_frac.type() != CV_16UC1
+                || left_map_xy.size() != left_map_frac.size() || left_map_xy.size() != right_map_xy.size()
+                || left_map_xy.size() != right_map_frac.size()) {
+            LOG(ERROR) << "校正查找表格式错误！";
+            return -1;
+        }
+        if (FLAGS_resolution_ratio != 1.0 || FLAGS_target_latency_ms > 0) {
+            LOG(ERROR) << "校正模式不支持缩放及自适应质量模式！";
+            return -1;
+        }
+    }
+
     // resize
+    const cv::Size input_size = left_gray_image.size();
     auto resize_w = left_gray_image.cols * FLAGS_resolution_ratio;
     auto resize_h = left_gray_image.rows * FLAGS_resolution_ratio;
     cv::resize(left_gray_image, left_gray_image, cv::Size(resize_w, resize_h), 0, 0, cv::INTER_LINEAR);
     cv::resize(right_gray_image, right_gray_image, cv::Size(resize_w, resize_h), 0, 0, cv::INTER_LINEAR);
+    if (is_pixel_16) {
+        cv::resize(left_raw_image, left_raw_image, cv::Size(resize_w, resize_h), 0, 0, cv::INTER_LINEAR);
+        cv::resize(right_raw_image, right_raw_image, cv::Size(resize_w, resize_h), 0, 0, cv::INTER_LINEAR);
+    }
 
-    const int height = static_cast<int>(left_gray_image.rows);
-    const int width = static_cast<int>(left_gray_image.cols);
+    // 输入影像尺寸，及匹配（校正后）影像尺寸
+    const int src_height = static_cast<int>(left_gray_image.rows);
+    const int src_width = static_cast<int>(left_gray_image.cols);
+    const int height = is_rectify ? left_map_xy.rows : src_height;
+    const int width = is_rectify ? left_map_xy.cols : src_width;
     const int image_size = height * width;
 
+    // 有效像素掩膜
+    std::shared_ptr<std::uint8_t> valid_mask_data;
+    if (!FLAGS_valid_mask_image.empty()) {
+        cv::Mat mask_image = cv::imread(FLAGS_valid_mask_image, cv::IMREAD_GRAYSCALE);
+        if (mask_image.data == nullptr) {
+            LOG(ERROR) << "读取掩膜图片失败！";
+            return -1;
+        }
+        cv::resize(mask_image, mask_image, cv::Size(width, height), 0, 0, cv::INTER_NEAREST);
+        valid_mask_data = std::shared_ptr<std::uint8_t>(new std::uint8_t[image_size], 
+                                                        [](std::uint8_t* data) { delete []data; });
+        for (int i = 0; i < height; i++) {
+            for (int j = 0; j < width; j++) {
+                valid_mask_data.get()[i * width + j] = mask_image.at<std::uint8_t>(i, j);
+            }
+        }
+    }
+
     // 打开输出文件
     std::ofstream outfile(FLAGS_output_filename, std::ios::out);
 
     // 左右影像的灰度数据
-    auto left_image_data = std::shared_ptr<std::uint8_t>(new std::uint8_t[image_size], 
+    auto left_image_data = std::shared_ptr<std::uint8_t>(new std::uint8_t[src_height * src_width], 
                                                          [](std::uint8_t* data) { delete []data; });
-    auto right_image_data = std::shared_ptr<std::uint8_t>(new std::uint8_t[image_size], 
+    auto right_image_data = std::shared_ptr<std::uint8_t>(new std::uint8_t[src_height * src_width], 
                                                           [](std::uint8_t* data) { delete []data; });
-    for (int i = 0; i < height; i++) {
-        for (int j = 0; j < width; j++) {
-            left_image_data.get()[i * width + j] = left_gray_image.at<std::uint8_t>(i, j);
-            right_image_data.get()[i * width + j] = right_gray_image.at<std::uint8_t>(i, j);
+    for (int i = 0; i < src_height; i++) {
+        for (int j = 0; j < src_width; j++) {
+            left_image_data.get()[i * src_width + j] = left_gray_image.at<std::uint8_t>(i, j);
+            right_image_data.get()[i * src_width + j] = right_gray_image.at<std::uint8_t>(i, j);
+        }
+    }
+
+    // 高位深影像的数据
+    std::vector<std::uint16_t> left_raw_data, right_raw_data;
+    if (is_pixel_16) {
+        left_raw_data.resize(src_height * src_width);
+        right_raw_data.resize(src_height * src_width);
+        for (int i = 0; i < src_height; i++) {
+            memcpy(left_raw_data.data() + i * src_width, left_raw_image.ptr<std::uint16_t>(i), src_width * sizeof(std::uint16_t));
+            memcpy(right_raw_data.data() + i * src_width, right_raw_image.ptr<std::uint16_t>(i), src_width * sizeof(std::uint16_t));
+        }
+    }
+
+    // 多基线匹配的其他次影像：与右影像同样缩放，视差比例为相对右影像的基线长度之比
+    std::vector<std::vector<std::uint8_t>> extra_images;
+    std::vector<float> extra_scales;
+    if (!FLAGS_extra_views.empty()) {
+        if (is_rectify || FLAGS_target_latency_ms > 0 || FLAGS_fixed_point_disp) {
+            LOG(ERROR) << "多基线匹配不支持校正查找表、自适应质量模式和定点视差！";
+            return -1;
+        }
+        std::stringstream views_stream(FLAGS_extra_views);
+        std::string item;
+        while (std::getline(views_stream, item, ',')) {
+            const std::size_t colon = item.rfind(':');
+            const float scale = (colon == std::string::npos) ? 0.0f : static_cast<float>(atof(item.c_str() + colon + 1));
+            cv::Mat view_image = (colon == std::string::npos) 
+                                 ? cv::Mat() : cv::imread(item.substr(0, colon), cv::IMREAD_GRAYSCALE);
+            if (view_image.data == nullptr || scale == 0.0f || view_image.size() != input_size) {
+                LOG(ERROR) << "读取多基线次影像失败：" << item;
+                return -1;
+            }
+            cv::resize(view_image, view_image, cv::Size(resize_w, resize_h), 0, 0, cv::INTER_LINEAR);
+            extra_images.emplace_back(src_height * src_width);
+            for (int i = 0; i < src_height; i++) {
+                memcpy(extra_images.back().data() + i * src_width, view_image.ptr<std::uint8_t>(i), src_width);
+            }
+            extra_scales.push_back(scale);
         }
     }
 
     // SGM匹配参数设计
-    SemiGlobalMatching::SGMOption sgm_option;
-    // 聚合路径数
-    sgm_option.num_paths = 8;
-    // 候选视差范围
-    sgm_option.min_disparity = FLAGS_min_disp;
-    sgm_option.max_disparity = FLAGS_max_disp;
-    // census窗口类型
-    sgm_option.census_size = SemiGlobalMatching::Census5x5;
-    // 一致性检查
-    sgm_option.is_check_lr = true;
-    sgm_option.lr_check_thresh = 1.0f;
-    // 唯一性约束
-    sgm_option.is_check_unique = true;
-    sgm_option.uniqueness_ratio = 0.99;
-    // 剔除小连通区
-    sgm_option.is_remove_speckles = true;
-    sgm_option.min_speckle_aera = 50;
-    // 惩罚项P1、P2
-    sgm_option.p1 = 10;
-    sgm_option.p2_init = 150;
-    // 视差图填充 填充的值不准确(用领域像素填充了那些误匹配的像素值，保证了完整性) 
-    sgm_option.is_fill_holes = true;
+    SemiGlobalMatching::SGMOption sgm_option = MakeSGMOption();
+
+    // 自动估计视差范围：在缩小的影像上以min_disp~max_disp快速匹配，取有效视差的范围加余量
+    if (FLAGS_auto_disp_range) {
+        if (is_rectify) {
+            LOG(ERROR) << "自动估计视差范围需输入核线影像，不支持校正查找表！";
+            return -1;
+        }
+        sgm_range::RangeOption range_option;
+        range_option.sgm_option = sgm_option;
+        range_option.sgm_option.pixel_bits = 8;
+        range_option.decimation = FLAGS_auto_range_decimation;
+        range_option.margin = std::max(range_option.margin, 2 * FLAGS_auto_range_decimation);
+        sgm_range::RangeEstimate range;
+        if (sgm_range::EstimateDisparityRange(left_image_data.get(), right_image_data.get(), height, width, range_option, &range)) {
+            sgm_option.min_disparity = range.min_disparity;
+            sgm_option.max_disparity = range.max_disparity;
+        }
+        LOG(INFO) << "auto disparity range: [" << range.min_disparity << ", " << range.max_disparity << ") of allowed ["
+                  << FLAGS_min_disp << ", " << FLAGS_max_disp << "), valid " << range.valid_ratio * 100 << "%, " 
+                  << range.time << "ms";
+        outfile << "auto disparity range: [" << range.min_disparity << ", " << range.max_disparity << ") of allowed ["
+                << FLAGS_min_disp << ", " << FLAGS_max_disp << "), valid " << range.valid_ratio * 100 << "%, " 
+                << range.time << "ms\n";
+    }
 
     LOG(INFO) << "w = " << width << ", h = " << height << ", " << "d = [" 
               << sgm_option.min_disparity << ", " << sgm_option.max_disparity << "]\n";
     outfile << "w = " << width << ", h = " << height << ", " << "d = [" 
             << sgm_option.min_disparity << ", " << sgm_option.max_disparity << "]\n";
 
-    // 定义SGM匹配类实例
-    SemiGlobalMatching sgm;
-    // 初始化
-	LOG(INFO) << "SGM Initializing...";
-    outfile << "SGM Initializing...\n";
-    auto start = std::chrono::steady_clock::now();
-    if (!sgm.Initialize(height, width, sgm_option)) {
-        LOG(ERROR) << "SGM初始化失败！";
-        outfile << "SGM初始化失败!\n";
-        return -1;
-    }
-    auto end = std::chrono::steady_clock::now();
-    auto cost_time = std::chrono::duration_cast<std::chrono::milliseconds>(end - start);
-    LOG(INFO) << "SGM Initializing Done! Timing : " << cost_time.count() / 1000.0 << "s";
-    outfile << "SGM Initializing Done! Timing : " << cost_time.count() / 1000.0 << "s\n";
+    // 输出视差图尺寸，输出步长大于1时只输出行列号为步长整数倍的像素
+    const int out_height = (height + sgm_option.output_stride - 1) / sgm_option.output_stride;
+    const int out_width = (width + sgm_option.output_stride - 1) / sgm_option.output_stride;
+    const int out_size = out_height * out_width;
 
-    // 匹配
-	LOG(INFO) << "SGM Matching...";
-	outfile << "SGM Matching...\n";
-    start = std::chrono::steady_clock::now();
     // disparity数组保存子像素的视差结果
     auto disparity = std::shared_ptr<float>(new float[image_size], [](float* data) { delete []data; });
-    if (!sgm.Match(left_image_data.get(), right_image_data.get(), disparity.get(), outfile)) {
-        LOG(ERROR) << "SGM匹配失败！";
-        outfile << "SGM匹配失败!\n";
-        return -1;
-    }
-    end = std::chrono::steady_clock::now();
-    cost_time = std::chrono::duration_cast<std::chrono::milliseconds>(end - start);
-    LOG(INFO) << "SGM Matching...Done! Timing : " << cost_time.count() / 1000.0 << "s";
-    outfile << "SGM Matching...Done! Timing : " << cost_time.count() / 1000.0 << "s\n";
-    outfile.close();
 
-	// 显示视差图
-    // 注意，计算点云不能用disp_mat的数据，它是用来显示和保存结果用的。计算点云要用上面的disparity数组里的数据，是子像素浮点数
-    cv::Mat disp_mat = cv::Mat(height, width, CV_8UC1);
-    float min_disp = width;
-    float max_disp = 0;
-    for (int i = 0; i < height; i++) {
-        for (int j = 0; j < width; j++) {
-            const float disp = disparity.get()[i * width + j];
-            if (disp != Invalid_Float) {
-                min_disp = std::min(min_disp, disp);
-                max_disp = std::max(max_disp, disp);
+    if (FLAGS_target_latency_ms > 0) {
+        // 自适应质量模式：按目标耗时逐帧选择缩放系数、路径数、census窗口类型和后处理阶段
+        if (!MatchAdaptive(height, width, sgm_option, left_image_data.get(), right_image_data.get(), 
+                           disparity.get(), outfile)) {
+            return -1;
+        }
+    } else {
+        // 定义SGM匹配类实例
+        SemiGlobalMatching sgm;
+        // 初始化
+        LOG(INFO) << "SGM Initializing...";
+        outfile << "SGM Initializing...\n";
+        auto start = std::chrono::steady_clock::now();
+        if (!sgm.Initialize(height, width, sgm_option)) {
+            LOG(ERROR) << "SGM初始化失败！";
+            outfile << "SGM初始化失败!\n";
+            return -1;
+        }
+        auto end = std::chrono::steady_clock::now();
+        auto cost_time = std::chrono::duration_cast<std::chrono::milliseconds>(end - start);
+        LOG(INFO) << "SGM Initializing Done! Timing : " << cost_time.count() / 1000.0 << "s";
+        outfile << "SGM Initializing Done! Timing : " << cost_time.count() / 1000.0 << "s\n";
+
+        if (FLAGS_perf_counters) {
+            sgm.EnablePerfCounters(true);
+        }
+
+        if (is_rectify) {
+            SemiGlobalMatching::RectifyMap left_map, right_map;
+            left_map.map_xy = left_map_xy.ptr<std::int16_t>();
+            left_map.map_frac = left_map_frac.ptr<std::uint16_t>();
+            right_map.map_xy = right_map_xy.ptr<std::int16_t>();
+            right_map.map_frac = right_map_frac.ptr<std::uint16_t>();
+            if (!sgm.SetRectification(left_map, right_map, src_height, src_width)) {
+                LOG(ERROR) << "SGM设置校正查找表失败！";
+                return -1;
             }
         }
-    }
-    // 视差图(x, y)d = (视差结果(x, y)d - min_d) / (max_d - min_d) * 255 
-    for (int i = 0; i < height; i++) {
-        for (int j = 0; j < width; j++) {
-            const float disp = disparity.get()[i * width + j];
-            if (disp == Invalid_Float) {
-                disp_mat.data[i * width + j] = 0;
-            } else {
-                disp_mat.data[i * width + j] = static_cast<std::uint8_t>((disp - min_disp) / (max_disp - min_disp) * 255);
+
+        // 重投影：在输出视差图的同时计算点云
+        // Q = [1 0 0 -cx; 0 1 0 -cy; 0 0 0 f; 0 0 1/B 0]，Z = f * B / d
+        std::vector<SemiGlobalMatching::CloudPoint> points;
+        if (!FLAGS_point_cloud_save_path.empty()) {
+            SemiGlobalMatching::Reprojection reprojection;
+            reprojection.q_matrix[0] = 1.0f;
+            reprojection.q_matrix[3] = -0.5f * width;
+            reprojection.q_matrix[5] = 1.0f;
+            reprojection.q_matrix[7] = -0.5f * height;
+            reprojection.q_matrix[11] = FLAGS_focal_length;
+            reprojection.q_matrix[14] = 1.0f / FLAGS_baseline;
+            reprojection.points = &points;
+            sgm.SetReprojection(reprojection);
+        }
+
+        // 置信度图：在视差计算和一致性检查中同时得到
+        cv::Mat confidence_mat;
+        if (!FLAGS_confidence_save_path.empty()) {
+            confidence_mat.create(out_height, out_width, CV_8UC1);
+            sgm.SetConfidenceOutput(confidence_mat.ptr<std::uint8_t>());
+        }
+
+        // 匹配
+        LOG(INFO) << "SGM Matching...";
+        outfile << "SGM Matching...\n";
+        start = std::chrono::steady_clock::now();
+        bool is_matched = false;
+        if (FLAGS_fixed_point_disp) {
+            // 16位定点视差，转换为浮点视差用于显示和计算点云
+            std::vector<std::int16_t> disparity_16(out_size);
+            is_matched = is_pixel_16 
+                         ? sgm.Match(left_raw_data.data(), right_raw_data.data(), disparity_16.data(), outfile, valid_mask_data.get())
+                         : sgm.Match(left_image_data.get(), right_image_data.get(), disparity_16.data(), outfile, valid_mask_data.get());
+            for (int i = 0; i < out_size; i++) {
+                disparity.get()[i] = (disparity_16[i] == sgm_util::Invalid_Int16) 
+                                     ? Invalid_Float : static_cast<float>(disparity_16[i]) / sgm_util::Disp_Scale;
             }
+        } else if (!extra_images.empty()) {
+            // 多基线：右影像及其他次影像的代价融合后一次聚合
+            std::vector<SemiGlobalMatching::MatchView> views(1 + extra_images.size());
+            views[0].image = right_image_data.get();
+            views[0].disparity_scale = 1.0f;
+            for (std::size_t k = 0; k < extra_images.size(); k++) {
+                views[k + 1].image = extra_images[k].data();
+                views[k + 1].disparity_scale = extra_scales[k];
+            }
+            is_matched = sgm.MatchMultiBaseline(left_image_data.get(), views, disparity.get(), outfile, valid_mask_data.get());
+        } else if (is_pixel_16) {
+            is_matched = sgm.Match(left_raw_data.data(), right_raw_data.data(), disparity.get(), outfile, valid_mask_data.get());
+        } else {
+            is_matched = sgm.Match(left_image_data.get(), right_image_data.get(), disparity.get(), outfile, valid_mask_data.get());
+        }
+        if (!is_matched) {
+            LOG(ERROR) << "SGM匹配失败！";
+            outfile << "SGM匹配失败!\n";
+            return -1;
+        }
+        end = std::chrono::steady_clock::now();
+        cost_time = std::chrono::duration_cast<std::chrono::milliseconds>(end - start);
+        LOG(INFO) << "SGM Matching...Done! Timing : " << cost_time.count() / 1000.0 << "s";
+        outfile << "SGM Matching...Done! Timing : " << cost_time.count() / 1000.0 << "s\n";
+
+        if (!FLAGS_point_cloud_save_path.empty()) {
+            std::ofstream cloud_file(FLAGS_point_cloud_save_path);
+            for (const auto& point : points) {
+                cloud_file << point.x << " " << point.y << " " << point.z << "\n";
+            }
+            LOG(INFO) << "point cloud: " << points.size() << " points saved to " << FLAGS_point_cloud_save_path;
+        }
+        if (!FLAGS_confidence_save_path.empty()) {
+            cv::imwrite(FLAGS_confidence_save_path, confidence_mat);
         }
     }
+    outfile.close();
 
-    cv::Mat disp_color;
-    cv::applyColorMap(disp_mat, disp_color, cv::COLORMAP_JET);
+	// 显示视差图
+    // 注意，计算点云不能用disp_mat的数据，它是用来显示和保存结果用的。计算点云要用上面的disparity数组里的数据，是子像素浮点数
+    // （或通过SetReprojection在匹配时直接输出点云）
+    cv::Mat disp_mat, disp_color;
+    DisparityToImages(disparity.get(), out_height, out_width, disp_mat, disp_color);
     //cv::imshow("left image", left_image);
     //cv::imshow("right image", right_image);
     //cv::imshow("disparity map", disp_mat);
@@ -196,6 +956,8 @@ int main(int argc, char* argv[]) {
     cv::imwrite(FLAGS_disp_map_color_save_path, disp_color);
     //cv::waitKey(0);
 
+    DumpTrace();
+
     google::ShutDownCommandLineFlags();
     google::ShutdownGoogleLogging();
 
@@ -20,21 +20,185 @@
 
 #include <cassert>
 #include <cmath>
+#include <cstring>
 #include <fstream>
 #include <vector>
 #include <chrono>
+#include <future>
+#include <thread>
+#include <atomic>
 #include <numeric>
 #include <algorithm>
+#include <climits>
+#include <new>
+#include <sstream>
+#include <iomanip>
 
 #include <glog/logging.h>
 
 #include "sgm_util.h"
+#include "sgm_trace.h"
+#include "sgm_numa.h"
+#include "sgm_scheduler.h"
 
 static constexpr float Invalid_Float = std::numeric_limits<float>::infinity();
 
+// 处理窗口相对ROI的外扩像素数，不小于最大census窗口半径（11x11）
+static constexpr int Census_Margin = 5;
+
+// 视差图数据类型相关的常量和子像素视差计算
+// float：以像素为单位，无效值为无穷大
+// int16：定点数，视差*Disp_Scale，无效值为Invalid_Int16
+template <typename T>
+struct DispTraits;
+
+template <>
+struct DispTraits<float> {
+    static constexpr int Scale = 1;
+    static float Invalid() { return Invalid_Float; }
+    // 解一元二次曲线极值 d_sub = d + (c1 - c2) / 2(c1 + c2 - 2c0)
+    static float SubPixel(const int& best_disparity, const std::uint16_t& cost_1, const std::uint16_t& cost_2, const std::uint16_t& denom) {
+        return static_cast<float>(best_disparity) + static_cast<float>(cost_1 - cost_2) / (denom * 2.0f);
+    }
+};
+
+template <>
+struct DispTraits<std::int16_t> {
+    static constexpr int Scale = sgm_util::Disp_Scale;
+    static std::int16_t Invalid() { return sgm_util::Invalid_Int16; }
+    // 同上，子像素偏移按定点数四舍五入
+    // 右影像视差计算中邻近视差的代价可能为UINT16_MAX，denom溢出，偏移限制在半个像素内
+    static std::int16_t SubPixel(const int& best_disparity, const std::uint16_t& cost_1, const std::uint16_t& cost_2, const std::uint16_t& denom) {
+        const int divisor = 2 * std::max<int>(1, denom);
+        const int numerator = (cost_1 - cost_2) * Scale;
+        int offset = (numerator >= 0 ? numerator + divisor / 2 : numerator - divisor / 2) / divisor;
+        offset = std::max(-Scale / 2, std::min(Scale / 2, offset));
+        return static_cast<std::int16_t>(best_disparity * Scale + offset);
+    }
+};
+
+constexpr int DispTraits<float>::Scale;
+constexpr int DispTraits<std::int16_t>::Scale;
+
+// 距start的耗时（毫秒）
+static double ElapsedMs(const std::chrono::steady_clock::time_point& start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// 只有稠密9x7窗口的census值需要64位存储，其余窗口均为32位
+static bool IsCensus64(const SemiGlobalMatching::CensusSize& census_size) {
+    return census_size == SemiGlobalMatching::Census9x7;
+}
+
+// census窗口的行半径
+static int CensusRadiusRow(const SemiGlobalMatching::CensusSize& census_size) {
+    return census_size == SemiGlobalMatching::Census5x5 ? 2 
+           : (census_size == SemiGlobalMatching::CensusSparse11x11 ? 5 : 4);
+}
+
+// census窗口的列半径
+static int CensusRadiusCol(const SemiGlobalMatching::CensusSize& census_size) {
+    return census_size == SemiGlobalMatching::Census5x5 ? 2 
+           : (census_size == SemiGlobalMatching::CensusSparse11x11 ? 5 : 3);
+}
+
+// 定点视差需在int16范围内表示视差范围
+static bool IsFixedPointRange(const SemiGlobalMatching::SGMOption& option) {
+    return option.max_disparity * sgm_util::Disp_Scale < sgm_util::Invalid_Int16 
+           && option.min_disparity * sgm_util::Disp_Scale > INT16_MIN;
+}
+
+// uint16路径代价之和需在uint16范围内，每条路径的代价不超过初始代价上限(255) + max(P1, P2)
+static bool IsPathCostInRange(const SemiGlobalMatching::SGMOption& option) {
+    return option.path_cost_type != SemiGlobalMatching::PathCostUint16 
+           || option.num_paths * (UINT8_MAX + std::max(option.p1, option.p2_init)) <= UINT16_MAX;
+}
+
+// 把num_paths个路径代价体（按字节传入，代价类型为A）累加到cost_aggr，is_accumulate为false时先清零
+template <typename A>
+static void SumPathCosts(const std::uint8_t* const* path_bytes, const int& num_paths, const int& data_size, 
+                         const bool& is_accumulate, std::uint16_t* cost_aggr) {
+    const A* path_costs[8];
+    for (int k = 0; k < num_paths; k++) {
+        path_costs[k] = reinterpret_cast<const A*>(path_bytes[k]);
+    }
+    for (int i = 0; i < data_size; i++) {
+        std::uint16_t cost = is_accumulate ? cost_aggr[i] : 0;
+        for (int k = 0; k < num_paths; k++) {
+            cost += path_costs[k][i];
+        }
+        cost_aggr[i] = cost;
+    }
+}
+
+// 校正与census变换的分块行数
+static constexpr int Rectify_Tile_Rows = 32;
+
+// 任务图的行块行数
+static constexpr int Graph_Block_Rows = 32;
+
+// 输出步长上限
+static constexpr int Max_Output_Stride = 8;
+
+// 条带执行：条带上下各外扩的重叠行数，条带输出行数的下限，不限预算时的条带行数，流式执行的条带行数
+static constexpr int Stripe_Overlap = 32;
+static constexpr int Min_Stripe_Rows = 2 * Stripe_Overlap;
+static constexpr int Default_Stripe_Rows = 256;
+static constexpr int Stream_Rows = 16;
+
+// ROI未设置时为整幅影像，超出影像时返回false
+static bool NormalizeRoi(const int& height, const int& width, SemiGlobalMatching::SGMOption* option) {
+    if (option->roi_width <= 0 || option->roi_height <= 0) {
+        option->roi_x = 0;
+        option->roi_y = 0;
+        option->roi_width = width;
+        option->roi_height = height;
+        return true;
+    }
+    return option->roi_x >= 0 && option->roi_y >= 0 
+           && option->roi_x + option->roi_width <= width 
+           && option->roi_y + option->roi_height <= height;
+}
+
+// 处理窗口：ROI四周外扩census窗口半径，左侧(右侧)再外扩最大(最小)视差，保证ROI边缘像素的同名点仍在窗口内
+static void GetWorkWindow(const int& height, const int& width, const SemiGlobalMatching::SGMOption& option,
+                          int* work_x, int* work_y, int* work_height, int* work_width) {
+    *work_x = std::max(0, option.roi_x - std::max(0, option.max_disparity) - Census_Margin);
+    *work_y = std::max(0, option.roi_y - Census_Margin);
+    *work_width = std::min(width, option.roi_x + option.roi_width + std::max(0, -option.min_disparity) + Census_Margin) - *work_x;
+    *work_height = std::min(height, option.roi_y + option.roi_height + Census_Margin) - *work_y;
+}
+
+// 系统当前可用内存（/proc/meminfo中的MemAvailable），无法获取时为0
+static std::size_t AvailableMemory() {
+#ifdef __linux__
+    std::ifstream meminfo("/proc/meminfo");
+    std::string key, rest;
+    std::size_t value = 0;
+    while (meminfo >> key >> value) {
+        std::getline(meminfo, rest);
+        if (key == "MemAvailable:") {
+            return value * 1024;
+        }
+    }
+#endif
+    return 0;
+}
+
+static const char* StrategyName(const SemiGlobalMatching::ExecutionStrategy& strategy) {
+    static const char* names[] = { "auto", "full", "fused", "striped", "streaming", "scanline" };
+    return names[strategy];
+}
+
 SemiGlobalMatching::SemiGlobalMatching()
-    : height_(0), width_(0), 
+    : image_height_(0), image_width_(0),
+      height_(0), width_(0), work_x_(0), work_y_(0),
+      grid_row0_(0), grid_col0_(0), disp_height_(0), disp_width_(0), census_row_begin_(0), census_row_end_(0),
       left_image_(nullptr), right_image_(nullptr),
+      left_work_image_(nullptr), right_work_image_(nullptr),
+      is_rectify_(false), source_height_(0), source_width_(0),
+      left_source_(nullptr), right_source_(nullptr),
+      valid_mask_(nullptr), is_masked_(false),
       left_census_(nullptr), right_census_(nullptr),
       cost_init_(nullptr), cost_aggr_(nullptr),
       cost_aggr_1_(nullptr), cost_aggr_2_(nullptr),
@@ -42,7 +206,10 @@ SemiGlobalMatching::SemiGlobalMatching()
       cost_aggr_5_(nullptr), cost_aggr_6_(nullptr),
       cost_aggr_7_(nullptr), cost_aggr_8_(nullptr),
       left_disp_(nullptr), right_disp_(nullptr),
-      is_initialized_(false) {
+      left_disp_16_(nullptr), right_disp_16_(nullptr),
+      num_path_buffers_(0), is_initialized_(false), is_perf_enabled_(false), is_reproject_(false),
+      confidence_output_(nullptr), lr_class_(nullptr), is_lr_classified_(false) {
+    stage_timing_ = StageTiming();
 }
 
 
@@ -53,59 +220,228 @@ SemiGlobalMatching::~SemiGlobalMatching() {
 
 bool SemiGlobalMatching::Initialize(const int& height, const int& width, const SGMOption& option) {
 	// 影像尺寸
-    height_ = height;
-    width_ = width;
+    image_height_ = height;
+    image_width_ = width;
     // SGM参数
     option_ = option;
-
-    if (height == 0 || width == 0) {
+    // 校正查找表与影像尺寸相关，重新初始化后需重新设置
+    ClearRectification();
+
+    // 内存规划，预算放不下时不分配
+    MemoryPlan plan;
+    if (!PlanMemory(height, width, option, &plan)) {
+        if (plan.Total() == 0) {
+            LOG(ERROR) << "SGM初始化失败：影像尺寸、ROI、视差范围、线程数、路径数、执行策略、影像位深、路径代价类型或输出步长无效";
+        } else {
+            LOG(ERROR) << "SGM初始化失败：内存预算不足，" << FormatMemoryPlan(plan);
+        }
         return false;
     }
+    memory_plan_ = plan;
+    num_path_buffers_ = plan.num_path_buffers;
+    LOG(INFO) << "SGM内存规划：" << FormatMemoryPlan(plan);
+
+    // ROI，未设置时为整幅影像
+    NormalizeRoi(height, width, &option_);
+    // 处理窗口
+    GetWorkWindow(height, width, option_, &work_x_, &work_y_, &height_, &width_);
+    // 输出网格：影像行列号为输出步长整数倍的像素
+    const int stride = option_.output_stride;
+    grid_row0_ = (stride - work_y_ % stride) % stride;
+    grid_col0_ = (stride - work_x_ % stride) % stride;
+    disp_height_ = std::max(0, height_ - grid_row0_ + stride - 1) / stride;
+    disp_width_ = std::max(0, width_ - grid_col0_ + stride - 1) / stride;
+    grid_mask_.assign(stride > 1 ? static_cast<std::size_t>(disp_height_) * disp_width_ : 0, 0);
+    // census值有效的行：处理窗口上下各census窗口行半径的行没有census值
+    const int census_radius = CensusRadiusRow(option_.census_size);
+    census_row_begin_ = census_radius;
+    census_row_end_ = std::max(census_radius, height_ - census_radius);
+
+    const int image_size = width_ * height_;
+    const int disp_range = option.max_disparity - option.min_disparity;
+    try {
+        // census值（左右影像）
+        if (IsCensus64(option.census_size)) {
+            left_census_ = new std::uint64_t[image_size]();
+            right_census_ = new std::uint64_t[image_size]();
+        } else {
+            left_census_ = new std::uint32_t[image_size]();
+            right_census_ = new std::uint32_t[image_size]();
+        }
 
-    // census值（左右影像）
-    const int image_size = width * height;
-    if (option.census_size == Census5x5) {
-        left_census_ = new std::uint32_t[image_size]();
-        right_census_ = new std::uint32_t[image_size]();
-    } else {
-        left_census_ = new std::uint64_t[image_size]();
-        right_census_ = new std::uint64_t[image_size]();
-    }
+        // 处理窗口小于影像时，拷贝窗口内的影像数据
+        if (height_ != height || width_ != width) {
+            left_work_image_ = new std::uint8_t[image_size * PixelBytes()]();
+            right_work_image_ = new std::uint8_t[image_size * PixelBytes()]();
+        }
+        valid_mask_ = new std::uint8_t[image_size]();
+
+        // 匹配代价（初始/聚合），条带执行时只覆盖一个条带窗口
+        // NUMA感知执行时分配后不清零，由各节点的工作线程首次访问
+        const int data_size = plan.cost_rows * width_ * disp_range;
+        const bool is_numa = IsNumaAware();
+        cost_init_   = is_numa ? new std::uint8_t[data_size] : new std::uint8_t[data_size]();
+        cost_aggr_   = is_numa ? new std::uint16_t[data_size] : new std::uint16_t[data_size]();
+        std::uint8_t** const path_costs[8] = { &cost_aggr_1_, &cost_aggr_2_, &cost_aggr_3_, &cost_aggr_4_,
+                                               &cost_aggr_5_, &cost_aggr_6_, &cost_aggr_7_, &cost_aggr_8_ };
+        for (int k = 0; k < num_path_buffers_; k++) {
+            *path_costs[k] = is_numa ? new std::uint8_t[data_size * PathCostBytes()] : new std::uint8_t[data_size * PathCostBytes()]();
+        }
+        if (is_numa) {
+            FirstTouchVolumes();
+        }
 
-    // 视差范围
-    const int disp_range = option.max_disparity - option.min_disparity;
-    if (disp_range <= 0) {
+        // 视差图
+        left_disp_ = new float[image_size]();
+        right_disp_ = new float[image_size]();
+        left_disp_16_ = new std::int16_t[image_size]();
+        right_disp_16_ = new std::int16_t[image_size]();
+        lr_class_ = new std::uint8_t[height_ * sgm_util::LRClassStride(width_)]();
+        lr_codes_.assign(static_cast<std::size_t>(option.num_threads) * width_, 0);
+    } catch (const std::bad_alloc&) {
+        LOG(ERROR) << "SGM初始化失败：内存分配失败，" << FormatMemoryPlan(plan);
+        Release();
         return false;
     }
 
-    // 匹配代价（初始/聚合）
-    const int data_size = width * height * disp_range;
-    cost_init_   = new std::uint8_t[data_size]();
-    cost_aggr_   = new std::uint16_t[data_size]();
-    cost_aggr_1_ = new std::uint8_t[data_size]();
-    cost_aggr_2_ = new std::uint8_t[data_size]();
-    cost_aggr_3_ = new std::uint8_t[data_size]();
-    cost_aggr_4_ = new std::uint8_t[data_size]();
-    cost_aggr_5_ = new std::uint8_t[data_size]();
-    cost_aggr_6_ = new std::uint8_t[data_size]();
-    cost_aggr_7_ = new std::uint8_t[data_size]();
-    cost_aggr_8_ = new std::uint8_t[data_size]();
-
-    // 视差图
-    left_disp_ = new float[image_size]();
-    right_disp_ = new float[image_size]();
-
     is_initialized_ = left_census_ && right_census_ 
                         && cost_init_ && cost_aggr_ && left_disp_;
 
     return is_initialized_;
 }
 
+bool SemiGlobalMatching::PlanMemory(const int& height, const int& width, const SGMOption& option, MemoryPlan* plan) {
+    *plan = MemoryPlan();
+    SGMOption roi_option = option;
+    const int disp_range = option.max_disparity - option.min_disparity;
+    if (height <= 0 || width <= 0 || disp_range <= 0 || option.num_threads < 1
+            || option.pixel_bits < 8 || option.pixel_bits > 16 || !IsPathCostInRange(option)
+            || option.output_stride < 1 || option.output_stride > Max_Output_Stride
+            || !NormalizeRoi(height, width, &roi_option)) {
+        return false;
+    }
+    // 2/3路径只能按扫描线执行，4/8路径不能
+    const bool is_scanline = option.num_paths == 2 || option.num_paths == 3;
+    if (is_scanline) {
+        if (option.execution_strategy != ExecutionAuto && option.execution_strategy != ExecutionScanline) {
+            return false;
+        }
+    } else if ((option.num_paths != 4 && option.num_paths != 8) || option.execution_strategy == ExecutionScanline) {
+        return false;
+    }
+    int work_x = 0, work_y = 0, work_height = 0, work_width = 0;
+    GetWorkWindow(height, width, roi_option, &work_x, &work_y, &work_height, &work_width);
+
+    // 与代价体行数无关的缓存
+    const std::size_t pixels = static_cast<std::size_t>(work_height) * work_width;
+    const bool is_copy_window = work_height != height || work_width != width;
+    plan->census = 2 * pixels * (IsCensus64(option.census_size) ? sizeof(std::uint64_t) : sizeof(std::uint32_t));
+    // 处理窗口影像按像素类型存储，掩膜为uint8
+    const std::size_t pixel_bytes = option.pixel_bits > 8 ? sizeof(std::uint16_t) : sizeof(std::uint8_t);
+    plan->images = pixels * (is_copy_window ? 2 * pixel_bytes + 1 : 1);
+    plan->disparity = 2 * pixels * (sizeof(float) + sizeof(std::int16_t)) 
+                      + static_cast<std::size_t>(work_height) * sgm_util::LRClassStride(work_width)
+                      + static_cast<std::size_t>(option.num_threads) * work_width;
+    plan->budget = option.memory_budget > 0 ? option.memory_budget : AvailableMemory();
+    const std::size_t fixed_bytes = plan->Total();
+
+    // 代价体一行的元素数，代价体下标为int，元素数不能超过INT_MAX
+    const std::size_t row_elements = static_cast<std::size_t>(work_width) * disp_range;
+    const int max_cost_rows = static_cast<int>(std::min<std::size_t>(work_height, INT_MAX / row_elements));
+    // 融合/条带执行的路径代价体个数与线程数相同，不超过路径数
+    const int num_thread_buffers = std::min(option.num_threads, option.num_paths == 4 ? 4 : 8);
+    // 路径代价体元素的字节数
+    const std::size_t path_cost_bytes = option.path_cost_type == PathCostUint16 ? sizeof(std::uint16_t) : sizeof(std::uint8_t);
+
+    // 按策略填写代价体相关的缓存，返回是否放得下
+    auto plan_buffers = [&](const ExecutionStrategy& strategy, const int& stripe_rows, const int& cost_rows, 
+                            const int& num_path_buffers) {
+        plan->strategy = strategy;
+        plan->stripe_rows = stripe_rows;
+        plan->cost_rows = cost_rows;
+        plan->num_path_buffers = num_path_buffers;
+        const std::size_t volume = static_cast<std::size_t>(plan->cost_rows) * row_elements;
+        plan->cost_init = volume * sizeof(std::uint8_t);
+        plan->cost_aggr = volume * sizeof(std::uint16_t);
+        plan->path_costs = volume * num_path_buffers * path_cost_bytes;
+        return plan->cost_rows <= max_cost_rows && (plan->budget == 0 || plan->Total() <= plan->budget);
+    };
+    auto plan_strategy = [&](const ExecutionStrategy& strategy, const int& stripe_rows, const int& num_path_buffers) {
+        return plan_buffers(strategy, stripe_rows, std::min(work_height, stripe_rows + 2 * Stripe_Overlap), num_path_buffers);
+    };
+
+    // 扫描线模式：2路径每个线程一行行缓存；3路径单线程，上->下路径需保留上一行，行缓存为2行
+    if (is_scanline) {
+        const int lines = option.num_paths == 2 ? std::min(option.num_threads, work_height) : 2;
+        return plan_buffers(ExecutionScanline, 1, lines, option.num_paths);
+    }
+
+    // 条带执行时预算允许的最大条带输出行数
+    int striped_rows = Default_Stripe_Rows;
+    if (plan->budget > 0) {
+        const std::size_t row_bytes = row_elements * (sizeof(std::uint8_t) + sizeof(std::uint16_t) + num_thread_buffers * path_cost_bytes);
+        const std::size_t budget_rows = plan->budget > fixed_bytes ? (plan->budget - fixed_bytes) / row_bytes : 0;
+        striped_rows = static_cast<int>(std::min<std::size_t>(budget_rows, work_height + 2 * Stripe_Overlap)) - 2 * Stripe_Overlap;
+    }
+    if (max_cost_rows < work_height) {
+        striped_rows = std::min(striped_rows, max_cost_rows - 2 * Stripe_Overlap);
+    }
+    striped_rows = std::min(striped_rows, work_height);
+    striped_rows = std::max(striped_rows, std::min(work_height, Min_Stripe_Rows));
+
+    switch (option.execution_strategy) {
+    case ExecutionFull:
+        return plan_strategy(ExecutionFull, work_height, 8);
+    case ExecutionFused:
+        return plan_strategy(ExecutionFused, work_height, num_thread_buffers);
+    case ExecutionStriped:
+        return plan_strategy(ExecutionStriped, striped_rows, num_thread_buffers);
+    case ExecutionStreaming:
+        return plan_strategy(ExecutionStreaming, std::min(work_height, Stream_Rows), 1);
+    default:
+        return plan_strategy(ExecutionFull, work_height, 8)
+               || plan_strategy(ExecutionFused, work_height, num_thread_buffers)
+               || plan_strategy(ExecutionStriped, striped_rows, num_thread_buffers)
+               || plan_strategy(ExecutionStreaming, std::min(work_height, Stream_Rows), 1);
+    }
+}
+
+std::string SemiGlobalMatching::FormatMemoryPlan(const MemoryPlan& plan) {
+    std::ostringstream stream;
+    stream << std::fixed << std::setprecision(1);
+    auto mb = [](const std::size_t& bytes) { return bytes / (1024.0 * 1024.0); };
+    stream << "strategy " << StrategyName(plan.strategy);
+    if (plan.strategy == ExecutionStriped || plan.strategy == ExecutionStreaming) {
+        stream << " (" << plan.stripe_rows << " rows per stripe, " << plan.cost_rows << " cost rows)";
+    } else if (plan.strategy == ExecutionScanline) {
+        stream << " (" << plan.cost_rows << " line buffers)";
+    }
+    stream << ", total " << mb(plan.Total()) << "MB";
+    if (plan.budget > 0) {
+        stream << " / budget " << mb(plan.budget) << "MB";
+    }
+    stream << ": census " << mb(plan.census) << "MB, images " << mb(plan.images) 
+           << "MB, cost_init " << mb(plan.cost_init) << "MB, cost_aggr " << mb(plan.cost_aggr) 
+           << "MB, path_costs " << mb(plan.path_costs) << "MB(" << plan.num_path_buffers 
+           << "), disparity " << mb(plan.disparity) << "MB";
+    return stream.str();
+}
+
 
 void SemiGlobalMatching::Release() {
-    // 释放内存
-    SAFE_DELETE(left_census_);
-    SAFE_DELETE(right_census_);
+    // 释放内存（census数组按实际类型释放）
+    if (IsCensus64(option_.census_size)) {
+        delete[] static_cast<std::uint64_t*>(left_census_);
+        delete[] static_cast<std::uint64_t*>(right_census_);
+    } else {
+        delete[] static_cast<std::uint32_t*>(left_census_);
+        delete[] static_cast<std::uint32_t*>(right_census_);
+    }
+    left_census_ = nullptr;
+    right_census_ = nullptr;
+    SAFE_DELETE(left_work_image_);
+    SAFE_DELETE(right_work_image_);
+    SAFE_DELETE(valid_mask_);
     SAFE_DELETE(cost_init_);
     SAFE_DELETE(cost_aggr_);
     SAFE_DELETE(cost_aggr_1_);
@@ -118,84 +454,1033 @@ void SemiGlobalMatching::Release() {
     SAFE_DELETE(cost_aggr_8_);
     SAFE_DELETE(left_disp_);
     SAFE_DELETE(right_disp_);
+    SAFE_DELETE(left_disp_16_);
+    SAFE_DELETE(right_disp_16_);
+    SAFE_DELETE(lr_class_);
+}
+
+bool SemiGlobalMatching::Match(const std::uint8_t* left_image, const std::uint8_t* right_image, float* left_disp, std::ofstream& outfile,
+                               const std::uint8_t* valid_mask) {
+    if (IsPixel16()) {
+        LOG(ERROR) << "影像位深为" << option_.pixel_bits << "，需输入uint16影像";
+        return false;
+    }
+    return MatchImpl(left_image, right_image, left_disp, left_disp_, right_disp_, outfile, valid_mask);
+}
+
+bool SemiGlobalMatching::Match(const std::uint8_t* left_image, const std::uint8_t* right_image, std::int16_t* left_disp, std::ofstream& outfile,
+                               const std::uint8_t* valid_mask) {
+    if (IsPixel16()) {
+        LOG(ERROR) << "影像位深为" << option_.pixel_bits << "，需输入uint16影像";
+        return false;
+    }
+    if (!IsFixedPointRange(option_)) {
+        return false;
+    }
+    return MatchImpl(left_image, right_image, left_disp, left_disp_16_, right_disp_16_, outfile, valid_mask);
+}
+
+bool SemiGlobalMatching::Match(const std::uint16_t* left_image, const std::uint16_t* right_image, float* left_disp, std::ofstream& outfile,
+                               const std::uint8_t* valid_mask) {
+    if (!IsPixel16()) {
+        LOG(ERROR) << "影像位深为8，需输入uint8影像";
+        return false;
+    }
+    return MatchImpl(reinterpret_cast<const std::uint8_t*>(left_image), reinterpret_cast<const std::uint8_t*>(right_image), 
+                     left_disp, left_disp_, right_disp_, outfile, valid_mask);
+}
+
+bool SemiGlobalMatching::Match(const std::uint16_t* left_image, const std::uint16_t* right_image, std::int16_t* left_disp, std::ofstream& outfile,
+                               const std::uint8_t* valid_mask) {
+    if (!IsPixel16()) {
+        LOG(ERROR) << "影像位深为8，需输入uint8影像";
+        return false;
+    }
+    if (!IsFixedPointRange(option_)) {
+        return false;
+    }
+    return MatchImpl(reinterpret_cast<const std::uint8_t*>(left_image), reinterpret_cast<const std::uint8_t*>(right_image), 
+                     left_disp, left_disp_16_, right_disp_16_, outfile, valid_mask);
+}
+
+template <typename T>
+bool SemiGlobalMatching::MatchImpl(const std::uint8_t* left_image, const std::uint8_t* right_image, T* left_disp,
+                                   T* left_disp_buffer, T* right_disp_buffer, std::ofstream& outfile,
+                                   const std::uint8_t* valid_mask) {
+    if (!is_initialized_) {
+        return false;
+    }
+    if (left_image == nullptr 
+            || right_image == nullptr) {
+        return false;
+    }
+
+    SetInputImages(left_image, right_image, valid_mask);
+
+    // 条带/扫描线执行：代价计算、聚合和视差计算逐条带（逐行）进行
+    if (IsStriped()) {
+        if (IsScanline()) {
+            MatchScanlines(left_disp_buffer, right_disp_buffer, outfile);
+        } else {
+            MatchStripes(left_disp_buffer, right_disp_buffer, outfile);
+        }
+        ComputeAndRefineDisparity(left_disp_buffer, right_disp_buffer, outfile);
+        OutputDisparity(left_disp_buffer, left_disp);
+        LogStagePerf(outfile);
+        return true;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    BeginStage("cost");
+    // census变换
+    CensusTransform();
+    // 代价计算
+    ComputeCost();
+    stage_timing_.cost = ElapsedMs(start);
+    EndStage("cost", &stage_perf_.cost);
+    LOG(INFO) << "1.computing cost!(计算代价: census变换、代价计算) timing : " 
+              << stage_timing_.cost / 1000.0 << "s";
+    outfile << "1.computing cost!(计算代价: census变换、代价计算) timing : " 
+            << stage_timing_.cost / 1000.0 << "s\n";
+
+    start = std::chrono::steady_clock::now();
+    BeginStage("aggregation");
+    // 代价聚合
+    CostAggregation();
+    stage_timing_.aggregation = ElapsedMs(start);
+    EndStage("aggregation", &stage_perf_.aggregation);
+    LOG(INFO) << "2.cost aggregating!(代价聚合: 4路聚合(左->右,右->左,上->下,下->上)) timing : " 
+              << stage_timing_.aggregation / 1000.0 << "s";
+    outfile << "2.cost aggregating!(代价聚合: 4路聚合(左->右,右->左,上->下,下->上)) timing : " 
+            << stage_timing_.aggregation / 1000.0 << "s\n";
+
+    // 视差计算、视差优化
+    ComputeAndRefineDisparity(left_disp_buffer, right_disp_buffer, outfile);
+
+    // 输出视差图
+    OutputDisparity(left_disp_buffer, left_disp);
+
+    LogStagePerf(outfile);
+
+	return true;
+}
+
+bool SemiGlobalMatching::MatchProgressive(const std::uint8_t* left_image, const std::uint8_t* right_image, 
+                                          float* provisional_disp, float* left_disp, std::ofstream& outfile,
+                                          const ProgressCallback& callback, const std::uint8_t* valid_mask) {
+    if (!is_initialized_) {
+        return false;
+    }
+    if (IsPixel16()) {
+        LOG(ERROR) << "渐进式匹配只支持8位影像";
+        return false;
+    }
+    if (left_image == nullptr 
+            || right_image == nullptr
+            || left_disp == nullptr) {
+        return false;
+    }
+    // 4路径及扫描线模式没有对角线路径，初步结果即为最终结果
+    if (option_.num_paths != 8) {
+        if (!Match(left_image, right_image, left_disp, outfile, valid_mask)) {
+            return false;
+        }
+        if (callback) {
+            callback(left_disp, true);
+        }
+        return true;
+    }
+    if (provisional_disp == nullptr) {
+        return false;
+    }
+    // 对角线路径与初步视差计算并行，需要保留全部路径代价体
+    if (memory_plan_.strategy != ExecutionFull) {
+        LOG(ERROR) << "渐进式匹配需要full执行策略，当前为" << StrategyName(memory_plan_.strategy);
+        return false;
+    }
+
+    SetInputImages(left_image, right_image, valid_mask);
+
+    auto start = std::chrono::steady_clock::now();
+    BeginStage("cost");
+    // census变换、代价计算
+    CensusTransform();
+    ComputeCost();
+    stage_timing_.cost = ElapsedMs(start);
+    EndStage("cost", &stage_perf_.cost);
+    LOG(INFO) << "1.computing cost!(计算代价: census变换、代价计算) timing : " 
+              << stage_timing_.cost / 1000.0 << "s";
+    outfile << "1.computing cost!(计算代价: census变换、代价计算) timing : " 
+            << stage_timing_.cost / 1000.0 << "s\n";
+
+    // 左右、上下4条路径聚合
+    start = std::chrono::steady_clock::now();
+    BeginStage("aggregation");
+    AggregatePaths(1, 4);
+    SumAggregatedPaths(1, 4, false);
+    // 开启性能计数时对角线路径也在本阶段内聚合：计数器由阶段内创建的线程继承，跨阶段运行的后台线程的计数会计入初步视差计算
+    if (is_perf_enabled_) {
+        AggregatePaths(5, 8);
+    }
+    stage_timing_.aggregation = ElapsedMs(start);
+    EndStage("aggregation", &stage_perf_.aggregation);
+    LOG(INFO) << "2.1.cost aggregating!(代价聚合: 4路聚合(左->右,右->左,上->下,下->上)) timing : " 
+              << stage_timing_.aggregation / 1000.0 << "s";
+    outfile << "2.1.cost aggregating!(代价聚合: 4路聚合(左->右,右->左,上->下,下->上)) timing : " 
+            << stage_timing_.aggregation / 1000.0 << "s\n";
+
+    // 对角线4条路径在后台线程聚合，只读初始代价、写各自的路径代价，与初步视差计算互不影响
+    start = std::chrono::steady_clock::now();
+    std::future<void> diagonal_aggregation;
+    if (!is_perf_enabled_) {
+        diagonal_aggregation = std::async(std::launch::async, [this]() {
+            if (sgm_trace::IsEnabled()) {
+                sgm_trace::SetThreadName("sgm diagonal aggregation");
+            }
+            AggregatePaths(5, 8);
+        });
+    }
+
+    // 4路径的初步视差图
+    ComputeAndRefineDisparity(left_disp_, right_disp_, outfile);
+    OutputDisparity(left_disp_, provisional_disp, false);
+    if (callback) {
+        callback(provisional_disp, false);
+    }
+
+    // 累加对角线路径后计算最终视差图
+    if (diagonal_aggregation.valid()) {
+        diagonal_aggregation.wait();
+    }
+    SumAggregatedPaths(5, 8, true);
+    const double diagonal_time = ElapsedMs(start);
+    stage_timing_.aggregation += diagonal_time;
+    LOG(INFO) << "2.2.cost aggregating!(代价聚合: 对角线4路聚合，与初步视差计算并行) timing : " 
+              << diagonal_time / 1000.0 << "s";
+    outfile << "2.2.cost aggregating!(代价聚合: 对角线4路聚合，与初步视差计算并行) timing : " 
+            << diagonal_time / 1000.0 << "s\n";
+
+    ComputeAndRefineDisparity(left_disp_, right_disp_, outfile);
+    OutputDisparity(left_disp_, left_disp);
+    LogStagePerf(outfile);
+    if (callback) {
+        callback(left_disp, true);
+    }
+
+    return true;
+}
+
+bool SemiGlobalMatching::MatchMultiBaseline(const std::uint8_t* left_image, const std::vector<MatchView>& views,
+                                            float* left_disp, std::ofstream& outfile, const std::uint8_t* valid_mask) {
+    if (!is_initialized_ || is_rectify_) {
+        return false;
+    }
+    if (IsPixel16()) {
+        LOG(ERROR) << "多基线匹配只支持8位影像";
+        return false;
+    }
+    // 累加缓存需覆盖整个代价体
+    if (IsStriped()) {
+        LOG(ERROR) << "多基线匹配不支持条带执行，当前为" << StrategyName(memory_plan_.strategy);
+        return false;
+    }
+    // 累加代价为uint16，每个次影像最多累加(UINT8_MAX / 2) << Multi_Cost_Frac_Bits
+    const int max_views = UINT16_MAX / ((UINT8_MAX / 2) << sgm_util::Multi_Cost_Frac_Bits);
+    if (left_image == nullptr 
+            || left_disp == nullptr
+            || views.empty() 
+            || static_cast<int>(views.size()) > max_views) {
+        return false;
+    }
+    for (const auto& view : views) {
+        if (view.image == nullptr || view.disparity_scale == 0.0f) {
+            return false;
+        }
+    }
+
+    SetInputImages(left_image, views[0].image, valid_mask);
+
+    auto start = std::chrono::steady_clock::now();
+    BeginStage("cost");
+    // 参考影像census只计算一次，各次影像依次在右影像census缓存中变换，
+    // 按各自的基线比例把代价累加到公共视差（逆深度）轴上，聚合代价缓存此时未使用，借作累加缓存
+    CensusTransformImage(left_image_, left_census_, height_);
+    const bool is_census_64 = IsCensus64(option_.census_size);
+    const int census_radius = CensusRadiusCol(option_.census_size);
+    const sgm_util::CensusRegion region = { census_row_begin_, census_row_end_, census_radius, width_ - census_radius };
+    for (int k = 0; k < static_cast<int>(views.size()); k++) {
+        if (k > 0) {
+            SetRightImage(views[k].image);
+        }
+        CensusTransformImage(right_image_, right_census_, height_);
+        if (is_census_64) {
+            sgm_util::AccumulateCensusCost(static_cast<const std::uint64_t*>(left_census_), static_cast<const std::uint64_t*>(right_census_),
+                                           height_, width_, option_.min_disparity, option_.max_disparity, views[k].disparity_scale,
+                                           cost_aggr_, k == 0, region, IsRowPlanar(), ValidMask());
+        } else {
+            sgm_util::AccumulateCensusCost(static_cast<const std::uint32_t*>(left_census_), static_cast<const std::uint32_t*>(right_census_),
+                                           height_, width_, option_.min_disparity, option_.max_disparity, views[k].disparity_scale,
+                                           cost_aggr_, k == 0, region, IsRowPlanar(), ValidMask());
+        }
+    }
+    sgm_util::AverageAccumulatedCost(cost_aggr_, static_cast<int>(views.size()),
+                                     height_ * width_ * (option_.max_disparity - option_.min_disparity), cost_init_);
+    stage_timing_.cost = ElapsedMs(start);
+    EndStage("cost", &stage_perf_.cost);
+    LOG(INFO) << "1.computing cost!(计算代价: 多基线census变换、代价计算, " << views.size() << "个次影像) timing : " 
+              << stage_timing_.cost / 1000.0 << "s";
+    outfile << "1.computing cost!(计算代价: 多基线census变换、代价计算, " << views.size() << "个次影像) timing : " 
+            << stage_timing_.cost / 1000.0 << "s\n";
+
+    start = std::chrono::steady_clock::now();
+    BeginStage("aggregation");
+    CostAggregation();
+    stage_timing_.aggregation = ElapsedMs(start);
+    EndStage("aggregation", &stage_perf_.aggregation);
+    LOG(INFO) << "2.cost aggregating!(代价聚合) timing : " 
+              << stage_timing_.aggregation / 1000.0 << "s";
+    outfile << "2.cost aggregating!(代价聚合) timing : " 
+            << stage_timing_.aggregation / 1000.0 << "s\n";
+
+    // 融合代价体没有对应的右视图，不做左右一致性检查
+    const bool is_check_lr = option_.is_check_lr;
+    option_.is_check_lr = false;
+    ComputeAndRefineDisparity(left_disp_, right_disp_, outfile);
+    option_.is_check_lr = is_check_lr;
+
+    OutputDisparity(left_disp_, left_disp);
+    LogStagePerf(outfile);
+
+    return true;
 }
 
-bool SemiGlobalMatching::Match(const std::uint8_t* left_image, const std::uint8_t* right_image, float* left_disp, std::ofstream& outfile) {
+bool SemiGlobalMatching::EnablePerfCounters(const bool& is_enable) {
+    if (!is_enable) {
+        perf_counters_.Close();
+        is_perf_enabled_ = false;
+        return true;
+    }
+    if (!perf_counters_.IsOpen() && !perf_counters_.Open()) {
+        LOG(WARNING) << "硬件性能计数器不可用（perf_event_open失败），只统计耗时";
+        is_perf_enabled_ = false;
+        return false;
+    }
+    is_perf_enabled_ = true;
+    return true;
+}
+
+void SemiGlobalMatching::BeginStage(const char* stage) {
+    sgm_trace::Begin(stage);
+    if (is_perf_enabled_) {
+        perf_counters_.Start();
+    }
+}
+
+void SemiGlobalMatching::EndStage(const char* stage, PerfCounters::Sample* sample) {
+    if (is_perf_enabled_) {
+        perf_counters_.Stop(sample);
+    }
+    sgm_trace::End(stage);
+}
+
+void SemiGlobalMatching::LogStagePerf(std::ofstream& outfile) const {
+    if (!is_perf_enabled_) {
+        return;
+    }
+    const double pixels = static_cast<double>(height_) * width_;
+    const std::pair<const char*, const PerfCounters::Sample*> stages[] = {
+        { "cost", &stage_perf_.cost }, { "aggregation", &stage_perf_.aggregation },
+        { "disparity", &stage_perf_.disparity }, { "lr_check", &stage_perf_.lr_check },
+        { "remove_speckles", &stage_perf_.remove_speckles }, { "fill_holes", &stage_perf_.fill_holes },
+        { "median_filter", &stage_perf_.median_filter }
+    };
+    for (const auto& stage : stages) {
+        const std::string report = PerfCounters::Format(*stage.second, pixels);
+        LOG(INFO) << "perf " << stage.first << ": " << report;
+        outfile << "perf " << stage.first << ": " << report << "\n";
+    }
+}
+
+void SemiGlobalMatching::SetInputImages(const std::uint8_t* left_image, const std::uint8_t* right_image, 
+                                        const std::uint8_t* valid_mask) {
+    if (is_rectify_) {
+        // 原始影像在census变换时校正，右影像的校正结果只存在于分块缓存中
+        left_source_ = left_image;
+        right_source_ = right_image;
+        left_image_ = rectified_image_.data();
+        right_image_ = nullptr;
+    } else if (left_work_image_ != nullptr) {
+        // 拷贝处理窗口内的影像数据
+        for (int i = 0; i < height_; i++) {
+            const int offset = (work_y_ + i) * image_width_ + work_x_;
+            memcpy(left_work_image_ + i * width_ * PixelBytes(), left_image + offset * PixelBytes(), width_ * PixelBytes());
+        }
+        left_image_ = left_work_image_;
+        SetRightImage(right_image);
+    } else {
+        left_image_ = left_image;
+        right_image_ = right_image;
+    }
+    is_masked_ = UpdateValidMask(valid_mask);
+    if (confidence_output_ != nullptr) {
+        confidence_.resize(static_cast<std::size_t>(disp_height_) * disp_width_);
+    }
+}
+
+void SemiGlobalMatching::SetRightImage(const std::uint8_t* right_image) {
+    if (left_work_image_ == nullptr) {
+        right_image_ = right_image;
+        return;
+    }
+    for (int i = 0; i < height_; i++) {
+        const int offset = (work_y_ + i) * image_width_ + work_x_;
+        memcpy(right_work_image_ + i * width_ * PixelBytes(), right_image + offset * PixelBytes(), width_ * PixelBytes());
+    }
+    right_image_ = right_work_image_;
+}
+
+template <typename T>
+void SemiGlobalMatching::ComputeAndRefineDisparity(T* left_disp, T* right_disp, std::ofstream& outfile) {
+    // 条带执行时左右视差图已在各条带中计算
+    auto start = std::chrono::steady_clock::now();
+    if (!IsStriped()) {
+        BeginStage("disparity");
+        // 视差计算，NUMA感知执行时各行块在所属节点计算
+        if (IsNumaAware()) {
+            RunRowBlocks([&](const int& first_row, const int& last_row) { 
+                ComputeDisparity(left_disp, Confidence(), first_row, last_row); 
+            });
+        } else {
+            ComputeDisparity(left_disp, Confidence(), 0, height_);
+        }
+        stage_timing_.disparity = ElapsedMs(start);
+        EndStage("disparity", &stage_perf_.disparity);
+        LOG(INFO) << "3.computing disparities!(计算视差: WTA赢家通吃、唯一性约束、子像素拟合) timing : " 
+                  << stage_timing_.disparity / 1000.0 << "s";
+        outfile << "3.computing disparities!(计算视差: WTA赢家通吃、唯一性约束、子像素拟合) timing : " 
+                << stage_timing_.disparity / 1000.0 << "s\n";
+    }
+
+    // 左右一致性检查
+    start = std::chrono::steady_clock::now();
+    BeginStage("lr_check");
+    is_lr_classified_ = false;
+    if (option_.is_check_lr) {
+        // 视差计算（右影像）
+        if (IsNumaAware()) {
+            RunRowBlocks([&](const int& first_row, const int& last_row) { ComputeDisparityRight(right_disp, first_row, last_row); });
+        } else if (!IsStriped()) {
+            ComputeDisparityRight(right_disp, 0, height_);
+        }
+        // 一致性检查
+        LRCheck(left_disp, right_disp);
+    }
+    stage_timing_.lr_check = ElapsedMs(start);
+    EndStage("lr_check", &stage_perf_.lr_check);
+
+    RefineDisparity(left_disp, right_disp, outfile);
+}
+
+template <typename T>
+void SemiGlobalMatching::RefineDisparity(T* left_disp, T* right_disp, std::ofstream& outfile) {
+    // 移除小连通区
+    auto start = std::chrono::steady_clock::now();
+    BeginStage("remove_speckles");
+    if (option_.is_remove_speckles) {
+        // 网格上相邻像素相距输出步长个像素，连通阈值随步长放大，面积阈值按网格像素数缩小
+        const int stride = option_.output_stride;
+        sgm_util::RemoveSpeckles(left_disp, disp_height_, disp_width_, DispTraits<T>::Scale * stride, 
+                                 std::max(1, option_.min_speckle_aera / (stride * stride)), DispTraits<T>::Invalid());
+        // 被剔除后又填充的像素置信度为0，未填充的在输出时置0
+        std::uint8_t* confidence = Confidence();
+        if (confidence != nullptr && option_.is_fill_holes) {
+            const int size = disp_height_ * disp_width_;
+            for (int k = 0; k < size; k++) {
+                confidence[k] = (left_disp[k] == DispTraits<T>::Invalid()) ? 0 : confidence[k];
+            }
+        }
+    }
+    stage_timing_.remove_speckles = ElapsedMs(start);
+    EndStage("remove_speckles", &stage_perf_.remove_speckles);
+
+    // 视差填充
+    start = std::chrono::steady_clock::now();
+    BeginStage("fill_holes");
+	if (option_.is_fill_holes) {
+		// 右影像视差图在一致性检查后不再使用，作为填充值缓存
+		FillHolesInDispMap(left_disp, right_disp);
+	}
+    stage_timing_.fill_holes = ElapsedMs(start);
+    EndStage("fill_holes", &stage_perf_.fill_holes);
+
+    // 中值滤波
+    start = std::chrono::steady_clock::now();
+    BeginStage("median_filter");
+    sgm_util::MedianFilter(left_disp, left_disp, disp_height_, disp_width_, 3);
+    stage_timing_.median_filter = ElapsedMs(start);
+    EndStage("median_filter", &stage_perf_.median_filter);
+
+    const double postprocess_time = stage_timing_.lr_check + stage_timing_.remove_speckles 
+                                    + stage_timing_.fill_holes + stage_timing_.median_filter;
+    LOG(INFO) << "4.postprocessing!(视差优化: 左右一致性检查(减少遮挡和错误的误匹配)、剔除小连通区域、视差填充、中值滤波) timing : " 
+              << postprocess_time / 1000.0 << "s";
+    outfile << "4.postprocessing!(视差优化: 左右一致性检查(减少遮挡和错误的误匹配)、剔除小连通区域、视差填充、中值滤波) timing : " 
+            << postprocess_time / 1000.0 << "s\n";
+}
+
+template <typename T>
+void SemiGlobalMatching::MatchStripes(T* left_disp, T* right_disp, std::ofstream& outfile) {
+    // census变换在整个处理窗口上进行
+    auto start = std::chrono::steady_clock::now();
+    BeginStage("cost");
+    CensusTransform();
+    stage_timing_.cost = ElapsedMs(start);
+    EndStage("cost", &stage_perf_.cost);
+    stage_timing_.aggregation = 0;
+    stage_timing_.disparity = 0;
+
+    // 处理窗口的行数和各行指针，逐条带切换后恢复
+    const int height = height_;
+    const std::uint8_t* left_image = left_image_;
+    std::uint8_t* valid_mask = valid_mask_;
+    auto left_census = static_cast<std::uint8_t*>(left_census_);
+    auto right_census = static_cast<std::uint8_t*>(right_census_);
+    const std::size_t census_bytes = IsCensus64(option_.census_size) ? sizeof(std::uint64_t) : sizeof(std::uint32_t);
+    const int census_row_begin = census_row_begin_;
+    const int census_row_end = census_row_end_;
+    const int stripe_rows = memory_plan_.stripe_rows;
+    std::uint8_t* confidence = Confidence();
+
+    BeginStage("aggregation");
+    int num_stripes = 0;
+    for (int first_row = 0; first_row < height; first_row += stripe_rows) {
+        // 条带窗口：条带输出行上下各外扩Stripe_Overlap行，窗口边缘行的路径代价不完整，只输出条带行的视差
+        const int last_row = std::min(height, first_row + stripe_rows);
+        const int window_first = std::max(0, first_row - Stripe_Overlap);
+        const int window_last = std::min(height, last_row + Stripe_Overlap);
+        sgm_trace::Scope trace("stripe", first_row);
+        height_ = window_last - window_first;
+        left_image_ = ImageRow(left_image, window_first);
+        valid_mask_ = valid_mask + window_first * width_;
+        left_census_ = left_census + window_first * width_ * census_bytes;
+        right_census_ = right_census + window_first * width_ * census_bytes;
+        census_row_begin_ = census_row_begin - window_first;
+        census_row_end_ = census_row_end - window_first;
+
+        auto stripe_start = std::chrono::steady_clock::now();
+        ComputeCost();
+        stage_timing_.cost += ElapsedMs(stripe_start);
+
+        stripe_start = std::chrono::steady_clock::now();
+        CostAggregation();
+        stage_timing_.aggregation += ElapsedMs(stripe_start);
+
+        stripe_start = std::chrono::steady_clock::now();
+        ComputeDisparity(left_disp, confidence, first_row, last_row, window_first);
+        if (option_.is_check_lr) {
+            ComputeDisparityRight(right_disp, first_row, last_row, window_first);
+        }
+        stage_timing_.disparity += ElapsedMs(stripe_start);
+        num_stripes++;
+    }
+    height_ = height;
+    left_image_ = left_image;
+    valid_mask_ = valid_mask;
+    left_census_ = left_census;
+    right_census_ = right_census;
+    census_row_begin_ = census_row_begin;
+    census_row_end_ = census_row_end;
+    EndStage("aggregation", &stage_perf_.aggregation);
+
+    LOG(INFO) << "1-3.computing cost, aggregating and disparities in " << num_stripes 
+              << " stripes!(条带执行: 代价计算、代价聚合、视差计算) timing : " 
+              << stage_timing_.cost / 1000.0 << "s, " << stage_timing_.aggregation / 1000.0 << "s, " 
+              << stage_timing_.disparity / 1000.0 << "s";
+    outfile << "1-3.computing cost, aggregating and disparities in " << num_stripes 
+            << " stripes!(条带执行: 代价计算、代价聚合、视差计算) timing : " 
+            << stage_timing_.cost / 1000.0 << "s, " << stage_timing_.aggregation / 1000.0 << "s, " 
+            << stage_timing_.disparity / 1000.0 << "s\n";
+}
+
+template <typename T>
+void SemiGlobalMatching::MatchScanlines(T* left_disp, T* right_disp, std::ofstream& outfile) {
+    // census变换在整个处理窗口上进行
+    auto start = std::chrono::steady_clock::now();
+    BeginStage("cost");
+    CensusTransform();
+    stage_timing_.cost = ElapsedMs(start);
+    EndStage("cost", &stage_perf_.cost);
+    stage_timing_.disparity = 0;
+
+    const int height = height_;
+    const int width = width_;
+    const int disp_range = option_.max_disparity - option_.min_disparity;
+    const int row_size = width * disp_range;
+    const auto mask = ValidMask();
+    // 3路径时上->下路径逐行递推，只能单线程；2路径时每个线程使用一行行缓存
+    const bool is_down = option_.num_paths == 3;
+    const int num_workers = is_down ? 1 : std::max(1, std::min(option_.num_threads, memory_plan_.cost_rows));
+
+    // 第line行行缓存上计算第i行：代价、左右聚合、（上下聚合）、累加、左右视差
+    // 路径代价行缓存一行的字节数
+    const int path_row_bytes = row_size * PathCostBytes();
+    std::uint8_t* confidence = Confidence();
+    auto match_row = [&](const int& i, const int& line, std::uint16_t* cost_local) {
+        std::uint8_t* cost_init = cost_init_ + line * row_size;
+        std::uint8_t* cost_left = cost_aggr_1_ + line * path_row_bytes;
+        std::uint8_t* cost_right = cost_aggr_2_ + line * path_row_bytes;
+        std::uint16_t* cost_aggr = cost_aggr_ + line * row_size;
+        const std::uint8_t* mask_row = (mask != nullptr) ? mask + i * width : nullptr;
+        // 上->下路径在2行行缓存间交替，上一行的聚合代价作为递推的输入
+        std::uint8_t* cost_down = is_down ? cost_aggr_3_ + (i % 2) * path_row_bytes : nullptr;
+        const std::uint8_t* cost_down_last = (is_down && i > 0) ? cost_aggr_3_ + ((i - 1) % 2) * path_row_bytes : nullptr;
+
+        ComputeCostRows(i, 1, cost_init);
+        if (IsPixel16()) {
+            if (IsPathCost16()) {
+                AggregateScanline<std::uint16_t, std::uint16_t>(i, cost_init, cost_left, cost_right, cost_down_last, cost_down, cost_aggr);
+            } else {
+                AggregateScanline<std::uint16_t, std::uint8_t>(i, cost_init, cost_left, cost_right, cost_down_last, cost_down, cost_aggr);
+            }
+        } else {
+            if (IsPathCost16()) {
+                AggregateScanline<std::uint8_t, std::uint16_t>(i, cost_init, cost_left, cost_right, cost_down_last, cost_down, cost_aggr);
+            } else {
+                AggregateScanline<std::uint8_t, std::uint8_t>(i, cost_init, cost_left, cost_right, cost_down_last, cost_down, cost_aggr);
+            }
+        }
+
+        // 只有网格行输出视差
+        if (!IsGridRow(i)) {
+            return;
+        }
+        const int row = GridRows(i);
+        ComputeDisparityRow(cost_aggr, mask_row, left_disp + row * disp_width_, cost_local, 
+                            confidence != nullptr ? confidence + row * disp_width_ : nullptr);
+        if (option_.is_check_lr) {
+            ComputeDisparityRightRow(cost_aggr, mask_row, right_disp + row * disp_width_, cost_local);
+        }
+    };
+
+    // 各线程处理连续的一块行
+    start = std::chrono::steady_clock::now();
+    BeginStage("aggregation");
+    auto match_rows = [&](const int& worker) {
+        std::vector<std::uint16_t> cost_local(disp_range);
+        const int first_row = static_cast<int>(static_cast<long long>(height) * worker / num_workers);
+        const int last_row = static_cast<int>(static_cast<long long>(height) * (worker + 1) / num_workers);
+        sgm_trace::Scope trace("scanlines", first_row);
+        for (int i = first_row; i < last_row; i++) {
+            // 2路径时各行互不依赖，网格行之外的行不用计算
+            if (!is_down && !IsGridRow(i)) {
+                continue;
+            }
+            match_row(i, worker, cost_local.data());
+        }
+    };
+    std::vector<std::thread> workers;
+    for (int k = 1; k < num_workers; k++) {
+        workers.emplace_back([&, k]() {
+            if (sgm_trace::IsEnabled()) {
+                sgm_trace::SetThreadName("sgm scanline worker " + std::to_string(k));
+            }
+            match_rows(k);
+        });
+    }
+    match_rows(0);
+    for (auto& thread : workers) {
+        thread.join();
+    }
+    stage_timing_.aggregation = ElapsedMs(start);
+    EndStage("aggregation", &stage_perf_.aggregation);
+
+    LOG(INFO) << "1-3.computing cost, aggregating and disparities by scanline!(扫描线模式: " << static_cast<int>(option_.num_paths) 
+              << "路径逐行代价计算、代价聚合、视差计算) timing : " << stage_timing_.cost / 1000.0 << "s, " 
+              << stage_timing_.aggregation / 1000.0 << "s";
+    outfile << "1-3.computing cost, aggregating and disparities by scanline!(扫描线模式: " << static_cast<int>(option_.num_paths) 
+            << "路径逐行代价计算、代价聚合、视差计算) timing : " << stage_timing_.cost / 1000.0 << "s, " 
+            << stage_timing_.aggregation / 1000.0 << "s\n";
+}
+
+template <typename P, typename A>
+void SemiGlobalMatching::AggregateScanline(const int& i, const std::uint8_t* cost_init, std::uint8_t* cost_left, std::uint8_t* cost_right,
+                                           const std::uint8_t* cost_down_last, std::uint8_t* cost_down, std::uint16_t* cost_aggr) const {
+    const int& width = width_;
+    const auto& P1 = option_.p1;
+    const auto& P2_Int = option_.p2_init;
+    const int gray_shift = GrayShift();
+    const int row_size = width * (option_.max_disparity - option_.min_disparity);
+    const P* img_row = reinterpret_cast<const P*>(ImageRow(left_image_, i));
+    const std::uint8_t* mask_row = (ValidMask() != nullptr) ? ValidMask() + i * width : nullptr;
+    A* left = reinterpret_cast<A*>(cost_left);
+    A* right = reinterpret_cast<A*>(cost_right);
+    A* down = reinterpret_cast<A*>(cost_down);
+
+    if (IsRowPlanar()) {
+        sgm_util::CostAggregateLeftRightRowPlanar(img_row, 1, width, option_.min_disparity, option_.max_disparity, P1, P2_Int, cost_init, left, true, mask_row, gray_shift);
+        sgm_util::CostAggregateLeftRightRowPlanar(img_row, 1, width, option_.min_disparity, option_.max_disparity, P1, P2_Int, cost_init, right, false, mask_row, gray_shift);
+    } else {
+        sgm_util::CostAggregateLeftRight(img_row, 1, width, option_.min_disparity, option_.max_disparity, P1, P2_Int, cost_init, left, true, mask_row, gray_shift);
+        sgm_util::CostAggregateLeftRight(img_row, 1, width, option_.min_disparity, option_.max_disparity, P1, P2_Int, cost_init, right, false, mask_row, gray_shift);
+    }
+    if (down == nullptr) {
+        for (int k = 0; k < row_size; k++) {
+            cost_aggr[k] = static_cast<std::uint16_t>(left[k] + right[k]);
+        }
+        return;
+    }
+
+    sgm_util::CostAggregateDownRow(img_row, (i > 0) ? img_row - width : nullptr, width, 
+                                   option_.min_disparity, option_.max_disparity, P1, P2_Int,
+                                   cost_init, reinterpret_cast<const A*>(cost_down_last), down, IsRowPlanar(),
+                                   mask_row, (mask_row != nullptr && i > 0) ? mask_row - width : nullptr, gray_shift);
+    for (int k = 0; k < row_size; k++) {
+        cost_aggr[k] = static_cast<std::uint16_t>(left[k] + right[k] + down[k]);
+    }
+}
+
+template <typename T>
+void SemiGlobalMatching::OutputDisparity(const T* disparity, T* left_disp, const bool& is_final) {
+    sgm_trace::Scope trace("output disparity");
+    if (is_final) {
+        OutputConfidence(disparity);
+    }
+    const int out_height = OutputHeight();
+    const int out_width = OutputWidth();
+    // ROI在输出视差图中的范围
+    const int stride = option_.output_stride;
+    const int row_begin = (option_.roi_y + stride - 1) / stride;
+    const int row_end = (option_.roi_y + option_.roi_height + stride - 1) / stride;
+    const int col_begin = (option_.roi_x + stride - 1) / stride;
+    const int col_end = (option_.roi_x + option_.roi_width + stride - 1) / stride;
+    const bool is_reproject_frame = is_final && is_reproject_;
+    if (is_reproject_frame) {
+        // ROI外输出无效的深度/三维坐标（处理窗口为整幅影像时ROI也可能小于输出视差图），点云每帧重新生成
+        const int out_size = out_height * out_width;
+        const bool is_roi_smaller = row_begin > 0 || row_end < out_height || col_begin > 0 || col_end < out_width;
+        if (is_roi_smaller && reprojection_.depth != nullptr) {
+            std::fill(reprojection_.depth, reprojection_.depth + out_size, Invalid_Float);
+        }
+        if (is_roi_smaller && reprojection_.xyz != nullptr) {
+            std::fill(reprojection_.xyz, reprojection_.xyz + out_size * 3, Invalid_Float);
+        }
+        if (reprojection_.points != nullptr) {
+            reprojection_.points->clear();
+        }
+    }
+
+    // ROI外及掩膜内的无效像素输出无效值
+    // 处理窗口即整幅影像时网格与输出视差图一致
+    const auto mask = GridMask();
+    if (mask == nullptr && left_work_image_ == nullptr) {
+        if (!is_reproject_frame) {
+            memcpy(left_disp, disparity, disp_height_ * disp_width_ * sizeof(T));
+            return;
+        }
+        // 逐行输出并重投影，无需再遍历一次视差图
+        for (int i = 0; i < disp_height_; i++) {
+            memcpy(left_disp + i * disp_width_, disparity + i * disp_width_, disp_width_ * sizeof(T));
+            ReprojectRow(left_disp, i);
+        }
+        return;
+    }
+
+    // 网格行列号为输出行列号减去处理窗口首个网格行列的输出行列号
+    const int grid_row_offset = (work_y_ + grid_row0_) / stride;
+    const int grid_col_offset = (work_x_ + grid_col0_) / stride;
+    std::fill(left_disp, left_disp + out_height * out_width, DispTraits<T>::Invalid());
+    for (int i = row_begin; i < row_end; i++) {
+        for (int j = col_begin; j < col_end; j++) {
+            const int idx = (i - grid_row_offset) * disp_width_ + j - grid_col_offset;
+            if (mask == nullptr || mask[idx]) {
+                left_disp[i * out_width + j] = disparity[idx];
+            }
+        }
+        if (is_reproject_frame) {
+            ReprojectRow(left_disp, i);
+        }
+    }
+}
+
+template <typename T>
+void SemiGlobalMatching::ReprojectRow(const T* left_disp, const int& row) {
+    const int stride = option_.output_stride;
+    const int out_width = OutputWidth();
+    const int col_begin = (option_.roi_x + stride - 1) / stride;
+    const int col_end = (option_.roi_x + option_.roi_width + stride - 1) / stride;
+    const T* disp_row = left_disp + row * out_width;
+    float* depth_row = reprojection_.depth ? reprojection_.depth + row * out_width : nullptr;
+    float* xyz_row = reprojection_.xyz ? reprojection_.xyz + row * out_width * 3 : nullptr;
+    auto points = reprojection_.points;
+    if (points != nullptr && xyz_row == nullptr) {
+        // 只要求输出点云时，三维坐标写入行缓存
+        if (reproject_row_.size() < static_cast<std::size_t>(out_width * 3)) {
+            reproject_row_.resize(out_width * 3);
+        }
+        xyz_row = reproject_row_.data();
+    }
+
+    // 输出步长大于1时，Q矩阵的行列两列乘以步长，输入网格行列号即得到影像行列号处的坐标
+    float q_matrix[16];
+    memcpy(q_matrix, reprojection_.q_matrix, sizeof(q_matrix));
+    for (int k = 0; k < 4; k++) {
+        q_matrix[k * 4] *= stride;
+        q_matrix[k * 4 + 1] *= stride;
+    }
+    sgm_util::ReprojectRow(disp_row, row, col_begin, col_end, q_matrix, 
+                           DispTraits<T>::Scale, DispTraits<T>::Invalid(), depth_row, xyz_row);
+
+    // 有效点追加到紧凑点云
+    if (points != nullptr) {
+        for (int j = col_begin; j < col_end; j++) {
+            const float* point = xyz_row + j * 3;
+            if (point[2] != Invalid_Float) {
+                points->push_back({ point[0], point[1], point[2], row * out_width + j });
+            }
+        }
+    }
+}
+
+template <typename T>
+void SemiGlobalMatching::OutputConfidence(const T* disparity) {
+    if (confidence_output_ == nullptr || confidence_.empty()) {
+        return;
+    }
+    // 无效视差（含中值滤波后无效的像素）及ROI外为0
+    const std::uint8_t* confidence = confidence_.data();
+    if (left_work_image_ == nullptr) {
+        const int size = disp_height_ * disp_width_;
+        for (int k = 0; k < size; k++) {
+            confidence_output_[k] = (disparity[k] == DispTraits<T>::Invalid()) ? 0 : confidence[k];
+        }
+        return;
+    }
+    const int stride = option_.output_stride;
+    const int out_width = OutputWidth();
+    const int row_begin = (option_.roi_y + stride - 1) / stride;
+    const int row_end = (option_.roi_y + option_.roi_height + stride - 1) / stride;
+    const int col_begin = (option_.roi_x + stride - 1) / stride;
+    const int col_end = (option_.roi_x + option_.roi_width + stride - 1) / stride;
+    const int grid_row_offset = (work_y_ + grid_row0_) / stride;
+    const int grid_col_offset = (work_x_ + grid_col0_) / stride;
+    memset(confidence_output_, 0, static_cast<std::size_t>(OutputHeight()) * out_width);
+    for (int i = row_begin; i < row_end; i++) {
+        for (int j = col_begin; j < col_end; j++) {
+            const int idx = (i - grid_row_offset) * disp_width_ + j - grid_col_offset;
+            confidence_output_[i * out_width + j] = (disparity[idx] == DispTraits<T>::Invalid()) ? 0 : confidence[idx];
+        }
+    }
+}
+
+void SemiGlobalMatching::SetConfidenceOutput(std::uint8_t* confidence) {
+    confidence_output_ = confidence;
+    if (confidence_output_ == nullptr) {
+        confidence_.clear();
+    }
+}
+
+void SemiGlobalMatching::ClearConfidenceOutput() {
+    SetConfidenceOutput(nullptr);
+}
+
+void SemiGlobalMatching::SetReprojection(const Reprojection& reprojection) {
+    reprojection_ = reprojection;
+    is_reproject_ = reprojection.depth != nullptr || reprojection.xyz != nullptr || reprojection.points != nullptr;
+}
+
+void SemiGlobalMatching::ClearReprojection() {
+    reprojection_ = Reprojection();
+    is_reproject_ = false;
+}
+
+bool SemiGlobalMatching::UpdateValidMask(const std::uint8_t* valid_mask) {
+    // ROI在处理窗口中的范围
+    const int roi_row_begin = option_.roi_y - work_y_;
+    const int roi_row_end = roi_row_begin + option_.roi_height;
+    const int roi_col_begin = option_.roi_x - work_x_;
+    const int roi_col_end = roi_col_begin + option_.roi_width;
+
+    bool is_masked = false;
+    for (int i = 0; i < height_; i++) {
+        const std::uint8_t* mask_row = (valid_mask != nullptr) ? valid_mask + (work_y_ + i) * image_width_ + work_x_ : nullptr;
+        for (int j = 0; j < width_; j++) {
+            const bool is_valid = i >= roi_row_begin && i < roi_row_end 
+                                  && j >= roi_col_begin && j < roi_col_end
+                                  && (mask_row == nullptr || mask_row[j] != 0);
+            valid_mask_[i * width_ + j] = is_valid ? 1 : 0;
+            is_masked = is_masked || !is_valid;
+        }
+    }
+
+    // 网格像素的掩膜
+    const int stride = option_.output_stride;
+    if (is_masked && stride > 1) {
+        for (int i = 0; i < disp_height_; i++) {
+            const std::uint8_t* mask_row = valid_mask_ + (grid_row0_ + i * stride) * width_ + grid_col0_;
+            for (int j = 0; j < disp_width_; j++) {
+                grid_mask_[i * disp_width_ + j] = mask_row[j * stride];
+            }
+        }
+    }
+
+    return is_masked;
+}
+
+bool SemiGlobalMatching::UpdateOption(const SGMOption& option) {
     if (!is_initialized_) {
         return false;
     }
-    if (left_image == nullptr 
-            || right_image == nullptr) {
+    // 视差范围和census窗口类型决定了内存分配，修改需重新初始化
+    if (option.min_disparity != option_.min_disparity 
+            || option.max_disparity != option_.max_disparity 
+            || option.census_size != option_.census_size) {
+        return false;
+    }
+    // 处理窗口影像按像素类型分配，位深只能在9~16之间修改；路径代价体按路径代价类型分配
+    if (option.pixel_bits < 8 || option.pixel_bits > 16 || (option.pixel_bits > 8) != IsPixel16()
+            || option.path_cost_type != option_.path_cost_type || !IsPathCostInRange(option)) {
+        return false;
+    }
+    if (option.num_paths != 4 && option.num_paths != 8) {
+        // 扫描线模式的行缓存按路径数分配，路径数不能修改
+        if (!IsScanline() || option.num_paths != option_.num_paths) {
+            return false;
+        }
+    } else if (IsScanline()) {
+        return false;
+    }
+    if (option.num_threads < 1) {
+        return false;
+    }
+
+    // ROI、执行策略和内存预算沿用初始化时的设置
+    const SGMOption last_option = option_;
+    option_ = option;
+    option_.roi_x = last_option.roi_x;
+    option_.roi_y = last_option.roi_y;
+    option_.roi_width = last_option.roi_width;
+    option_.roi_height = last_option.roi_height;
+    option_.execution_strategy = last_option.execution_strategy;
+    option_.memory_budget = last_option.memory_budget;
+    option_.output_stride = last_option.output_stride;
+
+    return true;
+}
+
+bool SemiGlobalMatching::BuildMatchGraph(const std::uint8_t* left_image, const std::uint8_t* right_image, float* left_disp,
+                                         const std::uint8_t* valid_mask, TaskGraph* graph, bool* is_success) {
+    if (!is_initialized_ || graph == nullptr) {
+        return false;
+    }
+    if (left_image == nullptr || right_image == nullptr || left_disp == nullptr) {
+        return false;
+    }
+    if (IsPixel16()) {
+        LOG(ERROR) << "流水线匹配只支持8位影像";
         return false;
     }
-
-    left_image_ = left_image;
-    right_image_ = right_image;
-
-    auto start = std::chrono::steady_clock::now();
-    // census变换
-    CensusTransform();
-    // 代价计算
-    ComputeCost();
-    auto end = std::chrono::steady_clock::now();
-    auto cost_time = std::chrono::duration_cast<std::chrono::milliseconds>(end - start);
-    LOG(INFO) << "1.computing cost!(计算代价: census变换、代价计算) timing : " 
-              << cost_time.count() / 1000.0 << "s";
-    outfile << "1.computing cost!(计算代价: census变换、代价计算) timing : " 
-            << cost_time.count() / 1000.0 << "s\n";
-
-    start = std::chrono::steady_clock::now();
-    // 代价聚合
-    CostAggregation();
-    end = std::chrono::steady_clock::now();
-    cost_time = std::chrono::duration_cast<std::chrono::milliseconds>(end - start);
-    LOG(INFO) << "2.cost aggregating!(代价聚合: 4路聚合(左->右,右->左,上->下,下->上)) timing : " 
-              << cost_time.count() / 1000.0 << "s";
-    outfile << "2.cost aggregating!(代价聚合: 4路聚合(左->右,右->左,上->下,下->上)) timing : " 
-            << cost_time.count() / 1000.0 << "s\n";
-
-    start = std::chrono::steady_clock::now();
-    // 视差计算
-    ComputeDisparity();
-    end = std::chrono::steady_clock::now();
-    cost_time = std::chrono::duration_cast<std::chrono::milliseconds>(end - start);
-    LOG(INFO) << "3.computing disparities!(计算视差: WTA赢家通吃、唯一性约束、子像素拟合) timing : " 
-              << cost_time.count() / 1000.0 << "s";
-    outfile << "3.computing disparities!(计算视差: WTA赢家通吃、唯一性约束、子像素拟合) timing : " 
-            << cost_time.count() / 1000.0 << "s\n";
-
-    start = std::chrono::steady_clock::now();
-    // 左右一致性检查
-    if (option_.is_check_lr) {
-        // 视差计算（右影像）
-        ComputeDisparityRight();
-        // 一致性检查
-        LRCheck();
+    if (is_success != nullptr) {
+        *is_success = true;
     }
 
-    // 移除小连通区
-    if (option_.is_remove_speckles) {
-        sgm_util::RemoveSpeckles(left_disp_, height_, width_, 1, option_.min_speckle_aera, Invalid_Float);
+    // 路径代价体不能同时保存所有路径、或预处理不能按行块拆分时，整帧作为一个任务
+    if (memory_plan_.strategy != ExecutionFull || is_rectify_ || IsNumaAware()) {
+        graph->AddTask("match", -1, [=]() {
+            std::ofstream null_stream;
+            const bool is_matched = Match(left_image, right_image, left_disp, null_stream, valid_mask);
+            if (is_success != nullptr) {
+                *is_success = is_matched;
+            }
+        });
+        return true;
     }
 
-    // 视差填充
-	if (option_.is_fill_holes) {
-		FillHolesInDispMap();
-	}
-
-    // 中值滤波
-    sgm_util::MedianFilter(left_disp_, left_disp_, height_, width_, 3);
-    end = std::chrono::steady_clock::now();
-    cost_time = std::chrono::duration_cast<std::chrono::milliseconds>(end - start);
-    LOG(INFO) << "4.postprocessing!(视差优化: 左右一致性检查(减少遮挡和错误的误匹配)、剔除小连通区域、视差填充、中值滤波) timing : " 
-              << cost_time.count() / 1000.0 << "s";
-    outfile << "4.postprocessing!(视差优化: 左右一致性检查(减少遮挡和错误的误匹配)、剔除小连通区域、视差填充、中值滤波) timing : " 
-            << cost_time.count() / 1000.0 << "s\n";
+    // 行块：剩余行数不足两块时并入最后一块，使每块census变换的行数都足够
+    const int height = height_;
+    const int row_size = width_ * (option_.max_disparity - option_.min_disparity);
+    const int num_paths = option_.num_paths;
+    const bool is_check_lr = option_.is_check_lr;
+    std::vector<int> block_rows;
+    for (int row = 0; row < height; ) {
+        block_rows.push_back(row);
+        row = (height - row < 2 * Graph_Block_Rows) ? height : row + Graph_Block_Rows;
+    }
+    block_rows.push_back(height);
+    const int num_blocks = static_cast<int>(block_rows.size()) - 1;
+
+    // 输入影像拷贝到处理窗口
+    const int input = graph->AddTask("input", -1, [=]() {
+        stage_timing_ = StageTiming();
+        is_lr_classified_ = false;
+        SetInputImages(left_image, right_image, valid_mask);
+    });
+
+    // 各行块的census变换、代价计算和左右路径聚合
+    std::vector<int> costs(num_blocks), horizontals(num_blocks);
+    for (int k = 0; k < num_blocks; k++) {
+        const int first_row = block_rows[k];
+        const int last_row = block_rows[k + 1];
+        const int census = graph->AddTask("census", first_row, [=]() { CensusTransformRows(first_row, last_row); });
+        costs[k] = graph->AddTask("cost", first_row, [=]() {
+            ComputeCostRows(first_row, last_row - first_row, cost_init_ + first_row * row_size);
+        });
+        horizontals[k] = graph->AddTask("left/right paths", first_row, [=]() {
+            AggregatePath(1, first_row, last_row - first_row);
+            AggregatePath(2, first_row, last_row - first_row);
+        });
+        graph->AddDependency(input, census);
+        graph->AddDependency(census, costs[k]);
+        graph->AddDependency(costs[k], horizontals[k]);
+    }
 
-    // 输出视差图
-    memcpy(left_disp, left_disp_, height_ * width_ * sizeof(float));
+    // 其余路径跨越所有行块，需所有行块的代价
+    std::vector<int> cross_paths;
+    for (int path = 3; path <= num_paths; path++) {
+        const int task = graph->AddTask("path", path, [=]() { AggregatePath(path, 0, height); });
+        for (const int& cost : costs) {
+            graph->AddDependency(cost, task);
+        }
+        cross_paths.push_back(task);
+    }
 
-	return true;
+    // 各行块的路径累加、左右视差和一致性检查，右视差与左视差并行
+    const int refine = graph->AddTask("refine", -1, [=]() {
+        is_lr_classified_ = is_check_lr;
+        std::ofstream null_stream;
+        RefineDisparity(left_disp_, right_disp_, null_stream);
+        OutputDisparity(left_disp_, left_disp);
+    });
+    for (int k = 0; k < num_blocks; k++) {
+        const int first_row = block_rows[k];
+        const int last_row = block_rows[k + 1];
+        const int sum = graph->AddTask("sum paths", first_row, [=]() {
+            SumAggregatedPathRows(1, num_paths, false, first_row, last_row);
+        });
+        const int disparity = graph->AddTask("disparity", first_row, [=]() { 
+            ComputeDisparity(left_disp_, Confidence(), first_row, last_row); 
+        });
+        graph->AddDependency(horizontals[k], sum);
+        for (const int& path : cross_paths) {
+            graph->AddDependency(path, sum);
+        }
+        graph->AddDependency(sum, disparity);
+        if (!is_check_lr) {
+            graph->AddDependency(disparity, refine);
+            continue;
+        }
+        const int disparity_right = graph->AddTask("disparity right", first_row, [=]() { 
+            ComputeDisparityRight(right_disp_, first_row, last_row); 
+        });
+        const int lr_check = graph->AddTask("lr check", first_row, [=]() {
+            std::vector<std::uint8_t> class_codes(disp_width_);
+            LRCheckRows(left_disp_, right_disp_, GridRows(first_row), GridRows(last_row), class_codes.data(), Confidence());
+        });
+        graph->AddDependency(sum, disparity_right);
+        graph->AddDependency(disparity, lr_check);
+        graph->AddDependency(disparity_right, lr_check);
+        graph->AddDependency(lr_check, refine);
+    }
+    return true;
 }
 
 bool SemiGlobalMatching::Reset(const std::uint32_t& height, const std::uint32_t& width, const SGMOption& option) {
@@ -209,18 +1494,162 @@ bool SemiGlobalMatching::Reset(const std::uint32_t& height, const std::uint32_t&
     return Initialize(height, width, option);
 }
 
-void SemiGlobalMatching::CensusTransform() const {
+void SemiGlobalMatching::CensusTransform() {
+    if (is_rectify_) {
+        RectifyAndCensusTransform();
+        return;
+    }
 	// 左右影像census变换
-    if (option_.census_size == Census5x5) {
-        sgm_util::census_transform_5x5(left_image_, static_cast<std::uint32_t*>(left_census_), height_, width_);
-        sgm_util::census_transform_5x5(right_image_, static_cast<std::uint32_t*>(right_census_), height_, width_);
+    CensusTransformImage(left_image_, left_census_, height_);
+    CensusTransformImage(right_image_, right_census_, height_);
+}
+
+void SemiGlobalMatching::CensusTransformRows(const int& first_row, const int& last_row) {
+    // 按行块外扩census窗口半径变换，census值与影像行对齐，外扩的行只作为邻域，各行块写入的census行互不重叠
+    const int radius = CensusRadiusRow(option_.census_size);
+    const int first = std::max(0, first_row - radius);
+    const int last = std::min(height_, last_row + radius);
+    if (last - first <= 2 * radius) {
+        return;
+    }
+    const std::size_t census_bytes = IsCensus64(option_.census_size) ? sizeof(std::uint64_t) : sizeof(std::uint32_t);
+    const std::size_t census_offset = static_cast<std::size_t>(first) * width_ * census_bytes;
+    CensusTransformImage(ImageRow(left_image_, first), static_cast<std::uint8_t*>(left_census_) + census_offset, last - first);
+    CensusTransformImage(ImageRow(right_image_, first), static_cast<std::uint8_t*>(right_census_) + census_offset, last - first);
+}
+
+void SemiGlobalMatching::CensusTransformImage(const std::uint8_t* image, void* census, const int& height) const {
+    sgm_trace::Scope trace("census transform", height);
+    if (IsPixel16()) {
+        CensusTransformPixels(reinterpret_cast<const std::uint16_t*>(image), census, height);
     } else {
-        sgm_util::census_transform_9x7(left_image_, static_cast<std::uint64_t*>(left_census_), height_, width_);
-        sgm_util::census_transform_9x7(right_image_, static_cast<std::uint64_t*>(right_census_), height_, width_);
+        CensusTransformPixels(image, census, height);
+    }
+}
+
+template <typename P>
+void SemiGlobalMatching::CensusTransformPixels(const P* image, void* census, const int& height) const {
+    auto census_32 = static_cast<std::uint32_t*>(census);
+    switch (option_.census_size) {
+    case Census5x5:
+        sgm_util::census_transform_5x5(image, census_32, height, width_);
+        break;
+    case Census9x7:
+        sgm_util::census_transform_9x7(image, static_cast<std::uint64_t*>(census), height, width_);
+        break;
+    case CensusCS9x7:
+        sgm_util::census_transform_cs_9x7(image, census_32, height, width_);
+        break;
+    case CensusSparse9x7:
+        sgm_util::census_transform_sparse_9x7(image, census_32, height, width_);
+        break;
+    case CensusSparse11x11:
+        sgm_util::census_transform_sparse_11x11(image, census_32, height, width_);
+        break;
+    }
+}
+
+void SemiGlobalMatching::RectifyAndCensusTransform() {
+    sgm_trace::Scope trace("rectify and census transform");
+    const int radius = CensusRadiusRow(option_.census_size);
+    const std::size_t census_bytes = IsCensus64(option_.census_size) ? sizeof(std::uint64_t) : sizeof(std::uint32_t);
+    auto left_census = static_cast<std::uint8_t*>(left_census_);
+    auto right_census = static_cast<std::uint8_t*>(right_census_);
+    std::uint8_t* left_image = rectified_image_.data();
+    std::uint8_t* right_tile = rectify_tile_.data();
+    // 影像一行的字节数
+    const int row_bytes = width_ * PixelBytes();
+    // 按像素类型重采样一行
+    auto remap_row = [this](const std::uint8_t* src, const RectifyMap& map, const int& map_offset, std::uint8_t* dst) {
+        if (IsPixel16()) {
+            sgm_util::RemapRow(reinterpret_cast<const std::uint16_t*>(src), source_height_, source_width_, 
+                               map.map_xy + map_offset * 2, map.map_frac + map_offset,
+                               width_, reinterpret_cast<std::uint16_t*>(dst));
+        } else {
+            sgm_util::RemapRow(src, source_height_, source_width_, 
+                               map.map_xy + map_offset * 2, map.map_frac + map_offset, width_, dst);
+        }
+    };
+
+    // 逐块校正，每块校正完后立即计算上下census窗口都已就绪的行
+    // 左影像校正结果写入处理窗口影像（代价聚合需要），右影像只保留在分块缓存中
+    // 分块缓存的第一行对应处理窗口的tile_first行，只保留下一块census仍需要的行
+    int tile_first = 0;
+    int census_begin = radius;
+    for (int row = 0; row < height_; ) {
+        // 剩余行数不足一块时并入最后一块，使每次census变换的行数都足够
+        const int row_end = (height_ - row < 2 * Rectify_Tile_Rows) ? height_ : row + Rectify_Tile_Rows;
+
+        const int keep_first = std::max(0, census_begin - radius);
+        if (keep_first > tile_first) {
+            memmove(right_tile, right_tile + (keep_first - tile_first) * row_bytes, (row - keep_first) * row_bytes);
+            tile_first = keep_first;
+        }
+
+        for (int i = row; i < row_end; i++) {
+            const int map_offset = (work_y_ + i) * image_width_ + work_x_;
+            remap_row(left_source_, left_rectify_map_, map_offset, left_image + i * row_bytes);
+            remap_row(right_source_, right_rectify_map_, map_offset, right_tile + (i - tile_first) * row_bytes);
+        }
+
+        // census值写到与影像行对齐的位置，窗口上下radius行只作为邻域
+        const int census_end = (row_end == height_) ? height_ - radius : row_end - radius;
+        if (census_end > census_begin) {
+            const int first = census_begin - radius;
+            const int rows = census_end - census_begin + 2 * radius;
+            CensusTransformImage(left_image + first * row_bytes, left_census + first * width_ * census_bytes, rows);
+            CensusTransformImage(right_tile + (first - tile_first) * row_bytes, right_census + first * width_ * census_bytes, rows);
+            census_begin = census_end;
+        }
+        row = row_end;
+    }
+}
+
+bool SemiGlobalMatching::SetRectification(const RectifyMap& left_map, const RectifyMap& right_map, 
+                                          const int& src_height, const int& src_width) {
+    if (!is_initialized_) {
+        return false;
     }
+    if (left_map.map_xy == nullptr || left_map.map_frac == nullptr 
+            || right_map.map_xy == nullptr || right_map.map_frac == nullptr
+            || src_height <= 0 || src_width <= 0) {
+        return false;
+    }
+
+    left_rectify_map_ = left_map;
+    right_rectify_map_ = right_map;
+    source_height_ = src_height;
+    source_width_ = src_width;
+    rectified_image_.resize(height_ * width_ * PixelBytes());
+    rectify_tile_.resize((2 * Rectify_Tile_Rows + 2 * Census_Margin) * width_ * PixelBytes());
+    is_rectify_ = true;
+
+    return true;
+}
+
+void SemiGlobalMatching::ClearRectification() {
+    is_rectify_ = false;
+    left_rectify_map_ = RectifyMap();
+    right_rectify_map_ = RectifyMap();
+    left_source_ = nullptr;
+    right_source_ = nullptr;
+    std::vector<std::uint8_t>().swap(rectified_image_);
+    std::vector<std::uint8_t>().swap(rectify_tile_);
 }
 
 void SemiGlobalMatching::ComputeCost() const {
+    if (IsNumaAware()) {
+        // 各行块的代价在所属节点计算
+        const int row_size = width_ * (option_.max_disparity - option_.min_disparity);
+        RunRowBlocks([&](const int& first_row, const int& last_row) {
+            ComputeCostRows(first_row, last_row - first_row, cost_init_ + first_row * row_size);
+        });
+        return;
+    }
+    ComputeCostRows(0, height_, cost_init_);
+}
+
+void SemiGlobalMatching::ComputeCostRows(const int& first_row, const int& num_rows, std::uint8_t* cost_init) const {
     const int& min_disparity = option_.min_disparity;
     const int& max_disparity = option_.max_disparity;
     const int disp_range = max_disparity - min_disparity;
@@ -228,29 +1657,28 @@ void SemiGlobalMatching::ComputeCost() const {
         return;
     }
 
+    const int offset = first_row * width_;
+    const auto mask = ValidMask() != nullptr ? ValidMask() + offset : nullptr;
+    // census值有效的区域，行号相对于first_row
+    const int census_radius = CensusRadiusCol(option_.census_size);
+    const sgm_util::CensusRegion region = { census_row_begin_ - first_row, census_row_end_ - first_row, 
+                                            census_radius, width_ - census_radius };
 	// 计算代价（基于Hamming距离）
-    for (int i = 0; i < height_; i++) {
-        for (int j = 0; j < width_; j++) {
-            // 逐视差计算代价值
-        	for (int d = min_disparity; d < max_disparity; d++) {
-                auto& cost = cost_init_[i * width_ * disp_range + j * disp_range + (d - min_disparity)];
-                if (j - d < 0 || j - d >= width_) {
-                    cost = UINT8_MAX / 2;
-                    continue;
-                }
-                if (option_.census_size == Census5x5) {
-                    // 左影像census值
-                    const auto& left_census_val = static_cast<std::uint32_t*>(left_census_)[i * width_ + j];
-                    // 右影像对应像点的census值
-                    const auto& right_census_val = static_cast<std::uint32_t*>(right_census_)[i * width_ + j - d];
-                    // 计算匹配代价
-                    cost = sgm_util::HammingDistance(left_census_val, right_census_val);
-                } else {
-                    const auto& left_census_val = static_cast<std::uint64_t*>(left_census_)[i * width_ + j];
-                    const auto& right_census_val = static_cast<std::uint64_t*>(right_census_)[i * width_ + j - d];
-                    cost = sgm_util::HammingDistance(left_census_val, right_census_val);
-                }
-            }
+    if (IsCensus64(option_.census_size)) {
+        auto left_census = static_cast<const std::uint64_t*>(left_census_) + offset;
+        auto right_census = static_cast<const std::uint64_t*>(right_census_) + offset;
+        if (IsRowPlanar()) {
+            sgm_util::ComputeCensusCostRowPlanar(left_census, right_census, num_rows, width_, min_disparity, max_disparity, cost_init, region);
+        } else {
+            sgm_util::ComputeCensusCost(left_census, right_census, num_rows, width_, min_disparity, max_disparity, cost_init, region, mask);
+        }
+    } else {
+        auto left_census = static_cast<const std::uint32_t*>(left_census_) + offset;
+        auto right_census = static_cast<const std::uint32_t*>(right_census_) + offset;
+        if (IsRowPlanar()) {
+            sgm_util::ComputeCensusCostRowPlanar(left_census, right_census, num_rows, width_, min_disparity, max_disparity, cost_init, region);
+        } else {
+            sgm_util::ComputeCensusCost(left_census, right_census, num_rows, width_, min_disparity, max_disparity, cost_init, region, mask);
         }
     }
 }
@@ -266,361 +1694,598 @@ void SemiGlobalMatching::CostAggregation() const {
     // →    ←	 1    2
     // ↗ ↑ ↖   8  4  6
     //
-    const auto& min_disparity = option_.min_disparity;
-    const auto& max_disparity = option_.max_disparity;
-    assert(max_disparity > min_disparity);
+    if (option_.num_paths != 4 && option_.num_paths != 8) {
+        return;
+    }
+    // 把各方向加起来，路径代价体少于路径数时（融合/条带执行）每组聚合完立即累加，下一组复用路径代价体
+    const int num_paths = option_.num_paths;
+    for (int first_path = 1; first_path <= num_paths; first_path += num_path_buffers_) {
+        const int last_path = std::min(num_paths, first_path + num_path_buffers_ - 1);
+        AggregatePaths(first_path, last_path);
+        SumAggregatedPaths(first_path, last_path, first_path > 1);
+    }
+}
 
-    const int data_size = height_ * width_ * (max_disparity - min_disparity);
-    if (data_size <= 0) {
+void SemiGlobalMatching::AggregatePaths(const int& first_path, const int& last_path) const {
+    if (IsNumaAware()) {
+        // 左右路径各行互不依赖，按行块在所属节点聚合
+        RunRowBlocks([&](const int& first_row, const int& last_row) {
+            for (int path = first_path; path <= std::min(last_path, 2); path++) {
+                AggregatePath(path, first_row, last_row - first_row);
+            }
+        });
+        // 其余路径跨越所有行块，由各节点的工作线程依次领取，跨节点访问均匀分布在各节点上
+        const int first_cross_path = std::max(first_path, 3);
+        if (first_cross_path > last_path) {
+            return;
+        }
+        std::atomic<int> next_path(first_cross_path);
+        RunNumaWorkers(std::min(option_.num_threads, last_path - first_cross_path + 1), [&](const int&) {
+            for (int path = next_path++; path <= last_path; path = next_path++) {
+                AggregatePath(path, 0, height_);
+            }
+        });
+        return;
+    }
+
+    const int num_workers = std::min(option_.num_threads, last_path - first_path + 1);
+    if (num_workers <= 1) {
+        for (int path = first_path; path <= last_path; path++) {
+            AggregatePath(path, 0, height_);
+        }
         return;
     }
 
+    // 各路径只读初始代价、写各自的路径代价，工作线程按编号依次领取路径，调用线程也参与聚合
+    std::atomic<int> next_path(first_path);
+    auto aggregate = [&]() {
+        for (int path = next_path++; path <= last_path; path = next_path++) {
+            AggregatePath(path, 0, height_);
+        }
+    };
+    std::vector<std::thread> workers;
+    for (int k = 1; k < num_workers; k++) {
+        workers.emplace_back([&, k]() {
+            if (sgm_trace::IsEnabled()) {
+                sgm_trace::SetThreadName("sgm aggregation worker " + std::to_string(k));
+            }
+            aggregate();
+        });
+    }
+    aggregate();
+    for (auto& thread : workers) {
+        thread.join();
+    }
+}
+
+void SemiGlobalMatching::RunNumaWorkers(const int& num_workers, const std::function<void(const int& worker)>& task) const {
+    const int num_nodes = std::min(sgm_numa::NumNodes(), num_workers);
+    std::vector<std::thread> workers;
+    for (int k = 0; k < num_workers; k++) {
+        workers.emplace_back([&, k]() {
+            const int node = sgm_numa::WorkerNode(k, num_workers, num_nodes);
+            sgm_numa::BindThreadToNode(node);
+            if (sgm_trace::IsEnabled()) {
+                sgm_trace::SetThreadName("sgm numa worker " + std::to_string(k) + " (node " + std::to_string(node) + ")");
+            }
+            task(k);
+        });
+    }
+    for (auto& thread : workers) {
+        thread.join();
+    }
+}
+
+void SemiGlobalMatching::RunRowBlocks(const std::function<void(const int& first_row, const int& last_row)>& task) const {
+    // 各阶段使用相同的行块划分，第k个行块总由绑定到同一节点的第k个工作线程处理
+    const int height = height_;
+    const int num_workers = std::max(1, std::min(option_.num_threads, height));
+    RunNumaWorkers(num_workers, [&](const int& worker) {
+        task(height * worker / num_workers, height * (worker + 1) / num_workers);
+    });
+}
+
+void SemiGlobalMatching::FirstTouchVolumes() const {
+    const std::size_t row_size = static_cast<std::size_t>(width_) * (option_.max_disparity - option_.min_disparity);
+    RunRowBlocks([&](const int& first_row, const int& last_row) {
+        const std::size_t offset = first_row * row_size;
+        const std::size_t count = (last_row - first_row) * row_size;
+        memset(cost_init_ + offset, 0, count * sizeof(std::uint8_t));
+        memset(cost_aggr_ + offset, 0, count * sizeof(std::uint16_t));
+        for (int k = 0; k < num_path_buffers_; k++) {
+            memset(PathCost(k + 1) + offset * PathCostBytes(), 0, count * PathCostBytes());
+        }
+    });
+}
+
+std::uint8_t* SemiGlobalMatching::PathCost(const int& path) const {
+    std::uint8_t* const path_costs[8] = { cost_aggr_1_, cost_aggr_2_, cost_aggr_3_, cost_aggr_4_,
+                                          cost_aggr_5_, cost_aggr_6_, cost_aggr_7_, cost_aggr_8_ };
+    assert(path >= 1 && path <= 8);
+    return path_costs[(path - 1) % num_path_buffers_];
+}
+
+void SemiGlobalMatching::AggregatePath(const int& path, const int& first_row, const int& num_rows) const {
+    static const char* const Path_Names[8] = { "path 1 (left->right)", "path 2 (right->left)",
+                                               "path 3 (up->down)", "path 4 (down->up)",
+                                               "path 5 (upleft->downright)", "path 6 (downright->upleft)",
+                                               "path 7 (upright->downleft)", "path 8 (downleft->upright)" };
+    sgm_trace::Scope trace(Path_Names[path - 1], path);
+    if (IsPixel16()) {
+        if (IsPathCost16()) {
+            AggregatePathTyped<std::uint16_t, std::uint16_t>(path, first_row, num_rows);
+        } else {
+            AggregatePathTyped<std::uint16_t, std::uint8_t>(path, first_row, num_rows);
+        }
+    } else {
+        if (IsPathCost16()) {
+            AggregatePathTyped<std::uint8_t, std::uint16_t>(path, first_row, num_rows);
+        } else {
+            AggregatePathTyped<std::uint8_t, std::uint8_t>(path, first_row, num_rows);
+        }
+    }
+}
+
+template <typename P, typename A>
+void SemiGlobalMatching::AggregatePathTyped(const int& path, const int& first_row, const int& num_rows) const {
+    const auto& min_disparity = option_.min_disparity;
+    const auto& max_disparity = option_.max_disparity;
+    assert(max_disparity > min_disparity);
+
     const auto& P1 = option_.p1;
     const auto& P2_Int = option_.p2_init;
+    const int gray_shift = GrayShift();
+    // 只有左右路径可按行分块聚合
+    assert(path <= 2 || (first_row == 0 && num_rows == height_));
+    const std::size_t offset = static_cast<std::size_t>(first_row) * width_ * (max_disparity - min_disparity);
+    const auto mask = ValidMask() != nullptr ? ValidMask() + first_row * width_ : nullptr;
+    const P* img_data = reinterpret_cast<const P*>(ImageRow(left_image_, first_row));
+    const std::uint8_t* cost_init = cost_init_ + offset;
+    // 奇数编号为正方向，偶数编号为反方向
+    const bool is_forward = (path % 2 == 1);
+    A* cost_aggr = reinterpret_cast<A*>(PathCost(path)) + offset;
+
+    if (IsRowPlanar()) {
+        switch (path) {
+        case 1: case 2:
+            sgm_util::CostAggregateLeftRightRowPlanar(img_data, num_rows, width_, min_disparity, max_disparity, P1, P2_Int, cost_init, cost_aggr, is_forward, mask, gray_shift);
+            break;
+        case 3: case 4:
+            sgm_util::CostAggregateUpDownRowPlanar(img_data, num_rows, width_, min_disparity, max_disparity, P1, P2_Int, cost_init, cost_aggr, is_forward, mask, gray_shift);
+            break;
+        case 5: case 6:
+            sgm_util::CostAggregateDagonal_1RowPlanar(img_data, num_rows, width_, min_disparity, max_disparity, P1, P2_Int, cost_init, cost_aggr, is_forward, mask, gray_shift);
+            break;
+        case 7: case 8:
+            sgm_util::CostAggregateDagonal_2RowPlanar(img_data, num_rows, width_, min_disparity, max_disparity, P1, P2_Int, cost_init, cost_aggr, is_forward, mask, gray_shift);
+            break;
+        default:
+            break;
+        }
+        return;
+    }
 
-    if (option_.num_paths == 4) {
-        // 左右聚合
-        sgm_util::CostAggregateLeftRight(left_image_, height_, width_, min_disparity, max_disparity, P1, P2_Int, cost_init_, cost_aggr_1_, true);
-        sgm_util::CostAggregateLeftRight(left_image_, height_, width_, min_disparity, max_disparity, P1, P2_Int, cost_init_, cost_aggr_2_, false);
-        // 上下聚合
-		sgm_util::CostAggregateUpDown(left_image_, height_, width_, min_disparity, max_disparity, P1, P2_Int, cost_init_, cost_aggr_3_, true);
-        sgm_util::CostAggregateUpDown(left_image_, height_, width_, min_disparity, max_disparity, P1, P2_Int, cost_init_, cost_aggr_4_, false);
-    } else if (option_.num_paths == 8) {
+    switch (path) {
+    case 1: case 2:
         // 左右聚合
-        sgm_util::CostAggregateLeftRight(left_image_, height_, width_, min_disparity, max_disparity, P1, P2_Int, cost_init_, cost_aggr_1_, true);
-        sgm_util::CostAggregateLeftRight(left_image_, height_, width_, min_disparity, max_disparity, P1, P2_Int, cost_init_, cost_aggr_2_, false);
+        sgm_util::CostAggregateLeftRight(img_data, num_rows, width_, min_disparity, max_disparity, P1, P2_Int, cost_init, cost_aggr, is_forward, mask, gray_shift);
+        break;
+    case 3: case 4:
         // 上下聚合
-		sgm_util::CostAggregateUpDown(left_image_, height_, width_, min_disparity, max_disparity, P1, P2_Int, cost_init_, cost_aggr_3_, true);
-        sgm_util::CostAggregateUpDown(left_image_, height_, width_, min_disparity, max_disparity, P1, P2_Int, cost_init_, cost_aggr_4_, false);
+        sgm_util::CostAggregateUpDown(img_data, num_rows, width_, min_disparity, max_disparity, P1, P2_Int, cost_init, cost_aggr, is_forward, mask, gray_shift);
+        break;
+    case 5: case 6:
         // 对角线1聚合
-        sgm_util::CostAggregateDagonal_1(left_image_, height_, width_, min_disparity, max_disparity, P1, P2_Int, cost_init_, cost_aggr_5_, true);
-        sgm_util::CostAggregateDagonal_1(left_image_, height_, width_, min_disparity, max_disparity, P1, P2_Int, cost_init_, cost_aggr_6_, false);
+        sgm_util::CostAggregateDagonal_1(img_data, num_rows, width_, min_disparity, max_disparity, P1, P2_Int, cost_init, cost_aggr, is_forward, mask, gray_shift);
+        break;
+    case 7: case 8:
         // 对角线2聚合
-        sgm_util::CostAggregateDagonal_2(left_image_, height_, width_, min_disparity, max_disparity, P1, P2_Int, cost_init_, cost_aggr_7_, true);
-        sgm_util::CostAggregateDagonal_2(left_image_, height_, width_, min_disparity, max_disparity, P1, P2_Int, cost_init_, cost_aggr_8_, false);
+        sgm_util::CostAggregateDagonal_2(img_data, num_rows, width_, min_disparity, max_disparity, P1, P2_Int, cost_init, cost_aggr, is_forward, mask, gray_shift);
+        break;
+    default:
+        break;
     }
+}
 
-    // 把4/8个方向加起来
-    for (int i = 0; i < data_size; i++) {
-        if (option_.num_paths == 4) {
-            cost_aggr_[i] = cost_aggr_1_[i] + cost_aggr_2_[i] + cost_aggr_3_[i] + cost_aggr_4_[i];
-        } else if (option_.num_paths == 8) {
-            cost_aggr_[i] = cost_aggr_1_[i] + cost_aggr_2_[i] + cost_aggr_3_[i] + cost_aggr_4_[i] +
-                            cost_aggr_5_[i] + cost_aggr_6_[i] + cost_aggr_7_[i] + cost_aggr_8_[i];
-        }
+void SemiGlobalMatching::SumAggregatedPaths(const int& first_path, const int& last_path, bool is_accumulate) const {
+    sgm_trace::Scope trace("sum paths");
+    if (IsNumaAware()) {
+        // 各行块在所属节点累加
+        RunRowBlocks([&](const int& first_row, const int& last_row) {
+            SumAggregatedPathRows(first_path, last_path, is_accumulate, first_row, last_row);
+        });
+        return;
     }
+    SumAggregatedPathRows(first_path, last_path, is_accumulate, 0, height_);
 }
 
-void SemiGlobalMatching::ComputeDisparity() const {
-    const int& min_disparity = option_.min_disparity;
-    const int& max_disparity = option_.max_disparity;
-    const int disp_range = max_disparity - min_disparity;
+void SemiGlobalMatching::SumAggregatedPathRows(const int& first_path, const int& last_path, bool is_accumulate,
+                                               const int& first_row, const int& last_row) const {
+    const int row_size = width_ * (option_.max_disparity - option_.min_disparity);
+    const int data_size = (last_row - first_row) * row_size;
+    if (data_size <= 0) {
+        return;
+    }
+
+    const std::uint8_t* path_costs[8];
+    const int num_paths = last_path - first_path + 1;
+    for (int k = 0; k < num_paths; k++) {
+        path_costs[k] = PathCost(first_path + k) + first_row * row_size * PathCostBytes();
+    }
+
+    std::uint16_t* cost_aggr = cost_aggr_ + first_row * row_size;
+    if (IsPathCost16()) {
+        SumPathCosts<std::uint16_t>(path_costs, num_paths, data_size, is_accumulate, cost_aggr);
+    } else {
+        SumPathCosts<std::uint8_t>(path_costs, num_paths, data_size, is_accumulate, cost_aggr);
+    }
+}
+
+template <typename T>
+void SemiGlobalMatching::ComputeDisparity(T* disparity, std::uint8_t* confidence, const int& first_row, const int& last_row, 
+                                          const int& cost_first_row) const {
+    const int disp_range = option_.max_disparity - option_.min_disparity;
     if (disp_range <= 0) {
         return;
     }
 
-    // 左影像视差图
-    float* disparity = left_disp_;
 	// 左影像聚合代价数组
 	const auto cost_ptr = cost_aggr_;
 	//const auto cost_ptr = cost_init_;
 
-    const int height = height_;
     const int width = width_;
-    const bool is_check_unique = option_.is_check_unique;
-	const float uniqueness_ratio = option_.uniqueness_ratio;
+    const auto mask = ValidMask();
 
 	// 为了加快读取效率，把单个像素的所有代价值存储到局部数组里
     std::vector<std::uint16_t> cost_local(disp_range);
     
-	// ---逐像素计算最优视差
-	for (int i = 0; i < height; i++) {
-        for (int j = 0; j < width; j++) {
-            std::uint16_t min_cost = UINT16_MAX;
-            std::uint16_t sec_min_cost = UINT16_MAX;
-            int best_disparity = 0;
-
-            // ---遍历视差范围内的所有代价值，输出最小代价值及对应的视差值
-            for (int d = min_disparity; d < max_disparity; d++) {
-	            const int d_idx = d - min_disparity;
-                const auto& cost = cost_ptr[i * width * disp_range + j * disp_range + d_idx];
-                cost_local[d_idx] = cost; 
-                if (cost < min_cost) {
-                    min_cost = cost;
-                    best_disparity = d;
-                }
+	// ---逐网格行计算最优视差
+	for (int row = GridRows(first_row); row < GridRows(last_row); row++) {
+        const int i = grid_row0_ + row * option_.output_stride - cost_first_row;
+        ComputeDisparityRow(cost_ptr + i * width * disp_range, (mask != nullptr) ? mask + i * width : nullptr, 
+                            disparity + row * disp_width_, cost_local.data(), 
+                            confidence != nullptr ? confidence + row * disp_width_ : nullptr);
+    }
+}
+
+template <typename T>
+void SemiGlobalMatching::ComputeDisparityRow(const std::uint16_t* cost_row, const std::uint8_t* mask_row, T* disp_row, 
+                                             std::uint16_t* cost_local, std::uint8_t* conf_row) const {
+    const int& min_disparity = option_.min_disparity;
+    const int& max_disparity = option_.max_disparity;
+    const int disp_range = max_disparity - min_disparity;
+
+    const int width = width_;
+    const bool is_check_unique = option_.is_check_unique;
+	const float uniqueness_ratio = option_.uniqueness_ratio;
+    // 代价体中相邻像素、相邻视差的间隔
+    const int pixel_stride = IsRowPlanar() ? 1 : disp_range;
+    const int disp_stride = IsRowPlanar() ? width : 1;
+    // 只计算网格列，输出步长为1时为所有列
+    const int stride = option_.output_stride;
+
+	// ---逐网格像素计算最优视差
+    for (int k = 0; k < disp_width_; k++) {
+        const int j = grid_col0_ + k * stride;
+        // 无效像素不计算视差
+        if (mask_row != nullptr && !mask_row[j]) {
+            disp_row[k] = DispTraits<T>::Invalid();
+            if (conf_row != nullptr) {
+                conf_row[k] = 0;
+            }
+            continue;
+        }
+        std::uint16_t min_cost = UINT16_MAX;
+        std::uint16_t sec_min_cost = UINT16_MAX;
+        int best_disparity = 0;
+
+        // ---遍历视差范围内的所有代价值，输出最小代价值及对应的视差值
+        for (int d = min_disparity; d < max_disparity; d++) {
+            const int d_idx = d - min_disparity;
+            const auto& cost = cost_row[j * pixel_stride + d_idx * disp_stride];
+            cost_local[d_idx] = cost; 
+            if (cost < min_cost) {
+                min_cost = cost;
+                best_disparity = d;
             }
+        }
 
-            if (is_check_unique) {
-                // 再遍历一次，输出次最小代价值
-                for (int d = min_disparity; d < max_disparity; d++) {
-                    if (d == best_disparity) {
-                        // 跳过最小代价值
-                        continue;
-                    }
-                    const auto& cost = cost_local[d - min_disparity];
-                    sec_min_cost = std::min(sec_min_cost, cost);
-                }
+        // 无效视差的置信度为0
+        if (conf_row != nullptr) {
+            conf_row[k] = 0;
+        }
 
-                // 判断唯一性约束 若最优的视差值不是唯一的 比如最优视差有相同或相近的值 则直接为无效估计
-                if (sec_min_cost - min_cost <= static_cast<std::uint16_t>(min_cost * (1 - uniqueness_ratio))) {
-                    disparity[i * width + j] = Invalid_Float;
+        if (is_check_unique || conf_row != nullptr) {
+            // 再遍历一次，输出次最小代价值
+            for (int d = min_disparity; d < max_disparity; d++) {
+                if (d == best_disparity) {
+                    // 跳过最小代价值
                     continue;
                 }
+                const auto& cost = cost_local[d - min_disparity];
+                sec_min_cost = std::min(sec_min_cost, cost);
             }
 
-            // 子像素拟合 整数视差值通过前一个和后一个视差值拟合一元二次曲线 曲线的极值点就是视差值子像素
-            if (best_disparity == min_disparity 
-                    || best_disparity == max_disparity - 1) {
-                disparity[i * width + j] = Invalid_Float;
+            // 判断唯一性约束 若最优的视差值不是唯一的 比如最优视差有相同或相近的值 则直接为无效估计
+            if (is_check_unique && sec_min_cost - min_cost <= static_cast<std::uint16_t>(min_cost * (1 - uniqueness_ratio))) {
+                disp_row[k] = DispTraits<T>::Invalid();
                 continue;
             }
-            // 最优视差前一个视差的代价值cost_1，后一个视差的代价值cost_2
-            const int idx_1 = best_disparity - 1 - min_disparity;
-            const int idx_2 = best_disparity + 1 - min_disparity;
-            const std::uint16_t cost_1 = cost_local[idx_1];
-            const std::uint16_t cost_2 = cost_local[idx_2];
-            // 解一元二次曲线极值 d_sub = d + (c1 - c2) / 2(c1 + c2 - 2c0)
-            const std::uint16_t denom = std::max(1, cost_1 + cost_2 - 2 * min_cost);
-            disparity[i * width + j] = static_cast<float>(best_disparity) + static_cast<float>(cost_1 - cost_2) / (denom * 2.0f);
+        }
+
+        // 子像素拟合 整数视差值通过前一个和后一个视差值拟合一元二次曲线 曲线的极值点就是视差值子像素
+        if (best_disparity == min_disparity 
+                || best_disparity == max_disparity - 1) {
+            disp_row[k] = DispTraits<T>::Invalid();
+            continue;
+        }
+        // 最优视差前一个视差的代价值cost_1，后一个视差的代价值cost_2
+        const int idx_1 = best_disparity - 1 - min_disparity;
+        const int idx_2 = best_disparity + 1 - min_disparity;
+        const std::uint16_t cost_1 = cost_local[idx_1];
+        const std::uint16_t cost_2 = cost_local[idx_2];
+        // 解一元二次曲线极值 d_sub = d + (c1 - c2) / 2(c1 + c2 - 2c0)
+        const std::uint16_t denom = std::max(1, cost_1 + cost_2 - 2 * min_cost);
+        disp_row[k] = DispTraits<T>::SubPixel(best_disparity, cost_1, cost_2, denom);
+
+        // 置信度：峰值比(sec-c0)/sec与抛物线曲率(c1+c2-2c0)/(c1+c2)的几何平均
+        if (conf_row != nullptr) {
+            const float peak_ratio = static_cast<float>(sec_min_cost - min_cost) / std::max<int>(1, sec_min_cost);
+            const float curvature = static_cast<float>(cost_1 + cost_2 - 2 * min_cost) / std::max(1, cost_1 + cost_2);
+            conf_row[k] = static_cast<std::uint8_t>(255.0f * std::sqrt(peak_ratio * curvature) + 0.5f);
         }
     }
 }
 
-void SemiGlobalMatching::ComputeDisparityRight() const {
-    const int& min_disparity = option_.min_disparity;
-    const int& max_disparity = option_.max_disparity;
-    const int disp_range = max_disparity - min_disparity;
+template <typename T>
+void SemiGlobalMatching::ComputeDisparityRight(T* disparity, const int& first_row, const int& last_row, 
+                                               const int& cost_first_row) const {
+    const int disp_range = option_.max_disparity - option_.min_disparity;
     if (disp_range <= 0) {
         return;
     }
 
-    // 右影像视差图
-    float* disparity = right_disp_;
     // 左影像聚合代价数组
 	const auto cost_ptr = cost_aggr_;
 
     const int width = width_;
-    const int height = height_;
-    const bool is_check_unique = option_.is_check_unique;
-    const float uniqueness_ratio = option_.uniqueness_ratio;
+    const auto mask = ValidMask();
 
     // 为了加快读取效率，把单个像素的所有代价值存储到局部数组里
     std::vector<std::uint16_t> cost_local(disp_range);
 
-    // ---逐像素计算最优视差
+    // ---逐网格行计算最优视差
+    for (int row = GridRows(first_row); row < GridRows(last_row); row++) {
+        const int i = grid_row0_ + row * option_.output_stride - cost_first_row;
+        ComputeDisparityRightRow(cost_ptr + i * width * disp_range, (mask != nullptr) ? mask + i * width : nullptr, 
+                                 disparity + row * disp_width_, cost_local.data());
+    }
+}
+
+template <typename T>
+void SemiGlobalMatching::ComputeDisparityRightRow(const std::uint16_t* cost_row, const std::uint8_t* mask_row, T* disp_row, 
+                                                  std::uint16_t* cost_local) const {
+    const int& min_disparity = option_.min_disparity;
+    const int& max_disparity = option_.max_disparity;
+    const int disp_range = max_disparity - min_disparity;
+
+    const int width = width_;
+    const bool is_check_unique = option_.is_check_unique;
+    const float uniqueness_ratio = option_.uniqueness_ratio;
+    const int pixel_stride = IsRowPlanar() ? 1 : disp_range;
+    const int disp_stride = IsRowPlanar() ? width : 1;
+    const int stride = option_.output_stride;
+
+    // ---逐网格像素计算最优视差
     // 通过左影像的代价，获取右影像的代价
     // 右cost(xr,yr,d) = 左cost(xr+d,yl,d)
-    for (int i = 0; i < height; i++) {
-        for (int j = 0; j < width; j++) {
-            std::uint16_t min_cost = UINT16_MAX;
-            std::uint16_t sec_min_cost = UINT16_MAX;
-            int best_disparity = 0;
-
-            // ---统计候选视差下的代价值
-        	for (int d = min_disparity; d < max_disparity; d++) {
-                const int d_idx = d - min_disparity;
-        		const int col_left = j + d;
-        		if (col_left >= 0 && col_left < width) {
-                    const auto& cost = cost_ptr[i * width * disp_range + col_left * disp_range + d_idx];
-                    cost_local[d_idx] = cost;
-                    if (cost < min_cost) {
-                        min_cost = cost;
-                        best_disparity = d;
-                    }
-        		} else {
-                    cost_local[d_idx] = UINT16_MAX;
+    for (int k = 0; k < disp_width_; k++) {
+        const int j = grid_col0_ + k * stride;
+        std::uint16_t min_cost = UINT16_MAX;
+        std::uint16_t sec_min_cost = UINT16_MAX;
+        int best_disparity = 0;
+
+        // ---统计候选视差下的代价值
+        for (int d = min_disparity; d < max_disparity; d++) {
+            const int d_idx = d - min_disparity;
+            const int col_left = j + d;
+            if (col_left >= 0 && col_left < width 
+                    && (mask_row == nullptr || mask_row[col_left])) {
+                const auto& cost = cost_row[col_left * pixel_stride + d_idx * disp_stride];
+                cost_local[d_idx] = cost;
+                if (cost < min_cost) {
+                    min_cost = cost;
+                    best_disparity = d;
                 }
+            } else {
+                cost_local[d_idx] = UINT16_MAX;
             }
+        }
 
-            if (is_check_unique) {
-                // 再遍历一次，输出次最小代价值
-                for (int d = min_disparity; d < max_disparity; d++) {
-                    if (d == best_disparity) {
-                        // 跳过最小代价值
-                        continue;
-                    }
-                    const auto& cost = cost_local[d - min_disparity];
-                    sec_min_cost = std::min(sec_min_cost, cost);
-                }
-
-                // 判断唯一性约束
-                // 若(min-sec)/min < min*(1-uniquness)，则为无效估计
-                if (sec_min_cost - min_cost <= static_cast<std::uint16_t>(min_cost * (1 - uniqueness_ratio))) {
-                    disparity[i * width + j] = Invalid_Float;
+        if (is_check_unique) {
+            // 再遍历一次，输出次最小代价值
+            for (int d = min_disparity; d < max_disparity; d++) {
+                if (d == best_disparity) {
+                    // 跳过最小代价值
                     continue;
                 }
+                const auto& cost = cost_local[d - min_disparity];
+                sec_min_cost = std::min(sec_min_cost, cost);
             }
-            
-            // ---子像素拟合
-            if (best_disparity == min_disparity || best_disparity == max_disparity - 1) {
-                disparity[i * width + j] = Invalid_Float;
+
+            // 判断唯一性约束
+            // 若(min-sec)/min < min*(1-uniquness)，则为无效估计
+            if (sec_min_cost - min_cost <= static_cast<std::uint16_t>(min_cost * (1 - uniqueness_ratio))) {
+                disp_row[k] = DispTraits<T>::Invalid();
                 continue;
             }
-
-            // 最优视差前一个视差的代价值cost_1，后一个视差的代价值cost_2
-            const int idx_1 = best_disparity - 1 - min_disparity;
-            const int idx_2 = best_disparity + 1 - min_disparity;
-            const std::uint16_t cost_1 = cost_local[idx_1];
-            const std::uint16_t cost_2 = cost_local[idx_2];
-            // 解一元二次曲线极值
-            const std::uint16_t denom = std::max(1, cost_1 + cost_2 - 2 * min_cost);
-            disparity[i * width + j] = static_cast<float>(best_disparity) + static_cast<float>(cost_1 - cost_2) / (denom * 2.0f);
         }
+        
+        // ---子像素拟合
+        if (best_disparity == min_disparity || best_disparity == max_disparity - 1) {
+            disp_row[k] = DispTraits<T>::Invalid();
+            continue;
+        }
+
+        // 最优视差前一个视差的代价值cost_1，后一个视差的代价值cost_2
+        const int idx_1 = best_disparity - 1 - min_disparity;
+        const int idx_2 = best_disparity + 1 - min_disparity;
+        const std::uint16_t cost_1 = cost_local[idx_1];
+        const std::uint16_t cost_2 = cost_local[idx_2];
+        // 解一元二次曲线极值
+        const std::uint16_t denom = std::max(1, cost_1 + cost_2 - 2 * min_cost);
+        disp_row[k] = DispTraits<T>::SubPixel(best_disparity, cost_1, cost_2, denom);
     }
 }
 
-void SemiGlobalMatching::LRCheck() {
-    const int height = height_;
-    const int width = width_;
-
-    const float& threshold = option_.lr_check_thresh;
-
-	// 遮挡区像素和误匹配区像素
-	auto& occlusions = occlusions_;
-	auto& mismatches = mismatches_;
-	occlusions.clear();
-	mismatches.clear();
-
-    // ---左右一致性检查
-    for (int i = 0; i < height; i++) {
-        for (int j = 0; j < width; j++) {
-            // 左影像视差值
-        	auto& disp = left_disp_[i * width + j];
-			if (disp == Invalid_Float){
-				mismatches.emplace_back(i, j);
-				continue;
-			}
+template <typename T>
+void SemiGlobalMatching::LRCheckRows(T* left_disp, const T* right_disp, const int& first_row, const int& last_row, 
+                                     std::uint8_t* class_codes, std::uint8_t* confidence) const {
+    const int width = disp_width_;
+    // 阈值换算到视差图的单位
+    const float threshold = option_.lr_check_thresh * DispTraits<T>::Scale;
+    // 视差以全分辨率像素为单位，同名点列号按网格列计算
+    const int disp_scale = DispTraits<T>::Scale * option_.output_stride;
+    const auto mask = GridMask();
+    const int class_stride = sgm_util::LRClassStride(width);
+    for (int i = first_row; i < last_row; i++) {
+        sgm_util::LRCheckRow(left_disp + i * width, right_disp + i * width, mask ? mask + i * width : nullptr, width,
+                             threshold, disp_scale, DispTraits<T>::Invalid(),
+                             class_codes, lr_class_ + i * class_stride, confidence != nullptr ? confidence + i * width : nullptr);
+    }
+}
 
-            // 根据视差值找到右影像上对应的同名像素
-        	const auto col_right = static_cast<int>(j - disp + 0.5);
-            
-        	if (col_right >= 0 && col_right < width) {
-                // 右影像上同名像素的视差值
-                const auto& disp_r = right_disp_[i * width + col_right];
-                
-        		// 判断两个视差值是否一致（差值在阈值内）
-        		if (abs(disp - disp_r) > threshold) {
-					// 区分遮挡区和误匹配区
-					// 通过右影像视差算出在左影像的匹配像素，并获取视差disp_rl
-					// if(disp_rl > disp) 
-        			//		pixel in occlusions
-					// else 
-        			//		pixel in mismatches
-					const int col_rl = static_cast<int>(col_right + disp_r + 0.5);
-					if (col_rl > 0 && col_rl < width){
-					    const auto& disp_l = left_disp_[i*width + col_rl];
-						if (disp_l > disp) {
-							occlusions.emplace_back(i, j);
-						} else {
-							mismatches.emplace_back(i, j);
-						}
-					} else {
-						mismatches.emplace_back(i, j);
-					}
+template <typename T>
+void SemiGlobalMatching::LRCheck(T* left_disp, const T* right_disp) {
+    const int height = disp_height_;
+    const int width = disp_width_;
 
-                    // 让视差值无效
-					disp = Invalid_Float;
-                }
-            } else {
-                // 通过视差值在右影像上找不到同名像素（超出影像范围）
-                disp = Invalid_Float;
-				mismatches.emplace_back(i, j);
+    // ---左右一致性检查，各行互不依赖，按行分块并行，每个线程使用自己的一行类别缓存
+    const int num_workers = std::max(1, std::min(option_.num_threads, height));
+    if (lr_codes_.size() < static_cast<std::size_t>(num_workers) * width) {
+        lr_codes_.resize(static_cast<std::size_t>(num_workers) * width);
+    }
+    std::uint8_t* confidence = Confidence();
+    auto check_rows = [&](const int& worker) {
+        LRCheckRows(left_disp, right_disp, height * worker / num_workers, height * (worker + 1) / num_workers, 
+                    lr_codes_.data() + worker * width, confidence);
+    };
+    std::vector<std::thread> workers;
+    for (int k = 1; k < num_workers; k++) {
+        workers.emplace_back([&, k]() {
+            if (sgm_trace::IsEnabled()) {
+                sgm_trace::SetThreadName("sgm lr check worker " + std::to_string(k));
             }
-        }
+            check_rows(k);
+        });
+    }
+    check_rows(0);
+    for (auto& thread : workers) {
+        thread.join();
     }
+    is_lr_classified_ = true;
 }
 
-void SemiGlobalMatching::FillHolesInDispMap() {
-	const int height = height_;
-	const int width = width_;
-
-	std::vector<float> disp_collects;
+template <typename T>
+void SemiGlobalMatching::FillHolesInDispMap(T* disp_ptr, T* fill_disps) {
+	const int height = disp_height_;
+	const int width = disp_width_;
+	// 待填充像素来自本帧一致性检查的类别掩膜
+	if (!is_lr_classified_) {
+		return;
+	}
 
-	// 定义8个方向
+	// 8个方向的单位步长
 	const float pi = 3.1415926f;
-	float angle1[8] = { pi, 3 * pi / 4, pi / 2, pi / 4, 0, 7 * pi / 4, 3 * pi / 2, 5 * pi / 4 };
-	float angle2[8] = { pi, 5 * pi / 4, 3 * pi / 2, 7 * pi / 4, 0, pi / 4, pi / 2, 3 * pi / 4 };
-	float *angle = angle1;
-    // 最大搜索行程，没有必要搜索过远的像素
-    const int max_search_length = 1.0 * std::max(abs(option_.max_disparity), abs(option_.min_disparity));
-
-	float* disp_ptr = left_disp_;
-	for (int k = 0; k < 3; k++) {
-		// 第一次循环处理遮挡区，第二次循环处理误匹配区
-		auto& trg_pixels = (k == 0) ? occlusions_ : mismatches_;
-        if (trg_pixels.empty()) {
-            continue;
-        }
-		std::vector<float> fill_disps(trg_pixels.size());
-		std::vector<std::pair<int, int>> inv_pixels;
+	const float angles[8] = { pi, 3 * pi / 4, pi / 2, pi / 4, 0, 7 * pi / 4, 3 * pi / 2, 5 * pi / 4 };
+	float sin_angles[8], cos_angles[8];
+	for (int s = 0; s < 8; s++) {
+		sin_angles[s] = float(std::sin(angles[s]));
+		cos_angles[s] = float(std::cos(angles[s]));
+	}
+    // 最大搜索行程，没有必要搜索过远的像素（按网格像素计）
+    const int stride = option_.output_stride;
+    const int max_search_length = (std::max(abs(option_.max_disparity), abs(option_.min_disparity)) + stride - 1) / stride;
+
+    const auto mask = GridMask();
+	const int class_stride = sgm_util::LRClassStride(width);
+	// 第k次循环的待处理像素：第一次为遮挡区，第二次为误匹配区，第三次为前两次没有处理干净的像素（含剔除小连通区产生的无效像素）
+	auto is_target = [&](const int& k, const int& i, const int& j) {
 		if (k == 2) {
-			//  第三次循环处理前两次没有处理干净的像素
-			for (int i = 0; i < height; i++) {
-				for (int j = 0; j < width; j++) {
-					if (disp_ptr[i * width + j] == Invalid_Float) {
-						inv_pixels.emplace_back(i, j);
-					}
-				}
-			}
-			trg_pixels = inv_pixels;
+			return disp_ptr[i * width + j] == DispTraits<T>::Invalid() && (mask == nullptr || mask[i * width + j]);
 		}
+		return sgm_util::LRClass(lr_class_ + i * class_stride, j) == (k == 0 ? sgm_util::LR_Occluded : sgm_util::LR_Mismatch);
+	};
+	// 类别掩膜一个字节内4个像素都不是遮挡/误匹配时整体跳过
+	auto is_group_skipped = [&](const int& k, const int& i, const int& j) {
+		return k < 2 && (j & 3) == 0 && lr_class_[i * class_stride + (j >> 2)] == 0;
+	};
 
-		// 遍历待处理像素
-        for (auto n = 0u; n < trg_pixels.size(); n++) {
-            auto& pix = trg_pixels[n];
-            const int y = pix.first;
-            const int x = pix.second;
-
-			if (y == height / 2) {
-				angle = angle2; 
-			}
+	for (int k = 0; k < 3; k++) {
+		// 先按本次循环开始时的视差图计算所有待处理像素的填充值，再统一写回
+		for (int y = 0; y < height; y++) {
+			for (int x = 0; x < width; x++) {
+				if (is_group_skipped(k, y, x)) {
+					x += 3;
+					continue;
+				}
+				if (!is_target(k, y, x)) {
+					continue;
+				}
 
-			// 收集8个方向上遇到的首个有效视差值
-			disp_collects.clear();
-			for (int s = 0; s < 8; s++) {
-				const float ang = angle[s];
-				const float sina = float(std::sin(ang));
-				const float cosa = float(std::cos(ang));
-				for (int m = 1; m < max_search_length; m++) {
-					const int yy = lround(y + m * sina);
-					const int xx = lround(x + m * cosa);
-					if (yy<0 || yy >= height || xx<0 || xx >= width) {
-						break;
-					}
-					const auto& disp = *(disp_ptr + yy*width + xx);
-					if (disp != Invalid_Float) {
-						disp_collects.push_back(disp);
-						break;
+				// 收集8个方向上遇到的首个有效视差值
+				T disp_collects[8];
+				int num_collects = 0;
+				for (int s = 0; s < 8; s++) {
+					for (int m = 1; m < max_search_length; m++) {
+						const int yy = lround(y + m * sin_angles[s]);
+						const int xx = lround(x + m * cos_angles[s]);
+						if (yy<0 || yy >= height || xx<0 || xx >= width) {
+							break;
+						}
+						const auto& disp = *(disp_ptr + yy*width + xx);
+						if (disp != DispTraits<T>::Invalid()) {
+							disp_collects[num_collects++] = disp;
+							break;
+						}
 					}
 				}
-			}
-			if (disp_collects.empty()) {
-				continue;
-			}
-
-			std::sort(disp_collects.begin(), disp_collects.end());
+				// 8个方向都没有有效视差时填0
+				if (num_collects == 0) {
+					fill_disps[y * width + x] = T();
+					continue;
+				}
 
-			// 如果是遮挡区，则选择第二小的视差值
-			// 如果是误匹配区，则选择中值
-			if (k == 0) {
-				if (disp_collects.size() > 1) {
-                    fill_disps[n] = disp_collects[1];
+				// 插入排序，最多8个值
+				for (int m = 1; m < num_collects; m++) {
+					const T disp = disp_collects[m];
+					int n = m;
+					for (; n > 0 && disp_collects[n - 1] > disp; n--) {
+						disp_collects[n] = disp_collects[n - 1];
+					}
+					disp_collects[n] = disp;
 				}
-				else {
-                    fill_disps[n] = disp_collects[0];
+
+				// 如果是遮挡区，则选择第二小的视差值
+				// 如果是误匹配区，则选择中值
+				if (k == 0) {
+					fill_disps[y * width + x] = disp_collects[num_collects > 1 ? 1 : 0];
+				} else {
+					fill_disps[y * width + x] = disp_collects[num_collects / 2];
 				}
 			}
-			else{
-                fill_disps[n] = disp_collects[disp_collects.size() / 2];
+		}
+		for (int y = 0; y < height; y++) {
+			for (int x = 0; x < width; x++) {
+				if (is_group_skipped(k, y, x)) {
+					x += 3;
+					continue;
+				}
+				if (is_target(k, y, x)) {
+					disp_ptr[y * width + x] = fill_disps[y * width + x];
+				}
 			}
 		}
-        for (auto n = 0u; n < trg_pixels.size(); n++) {
-            auto& pix = trg_pixels[n];
-            const int y = pix.first;
-            const int x = pix.second;
-            disp_ptr[y * width + x] = fill_disps[n];
-        }
 	}
 }
 
@@ -20,8 +20,14 @@
 #include <cstdint>
 #include <cstddef>
 #include <fstream>
+#include <functional>
+#include <string>
 #include <vector>
 
+#include "sgm_perf.h"
+
+class TaskGraph;
+
 class SemiGlobalMatching {
 public:
 	SemiGlobalMatching();
@@ -30,12 +36,37 @@ public:
 	/** \brief Census窗口尺寸类型 */
 	enum CensusSize {
 		Census5x5 = 0,
-		Census9x7
+		Census9x7,
+		CensusCS9x7,		// 中心对称census 9x7，31位
+		CensusSparse9x7,	// 棋盘格采样census 9x7，32位
+		CensusSparse11x11	// 棋盘格采样+中心对称census 11x11，30位
+	};
+
+	/** \brief 代价体内存布局 */
+	enum CostLayout {
+		CostPixelMajor = 0,	// 按像素：[i * width * disp_range + j * disp_range + d]，沿视差向量化，视差范围较大时高效
+		CostRowPlanar		// 行平面：[i * width * disp_range + d * width + j]，上下、对角线路径沿列向量化，视差范围较小时高效
+	};
+
+	/** \brief 执行策略，决定代价体占用的内存 */
+	enum ExecutionStrategy {
+		ExecutionAuto = 0,	// 按内存预算依次选择Full、Fused、Striped、Streaming中第一个放得下的，2/3路径时为Scanline
+		ExecutionFull,		// 保留全部8个路径代价体，渐进式匹配需要
+		ExecutionFused,		// 路径代价体个数与线程数相同，路径聚合完成后立即累加、复用，结果与Full一致
+		ExecutionStriped,	// 代价体只覆盖一个行条带，条带上下各重叠32行，竖直/对角路径在条带边界重新开始，结果为近似
+		ExecutionStreaming,	// 最小条带（16行）、单个路径代价体，内存最少
+		ExecutionScanline	// 2/3路径的扫描线模式：逐行计算代价、聚合、视差，只需每线程一行的行缓存
+	};
+
+	/** \brief 路径聚合代价的存储类型 */
+	enum PathCostType {
+		PathCostUint8 = 0,	// uint8，超过255时饱和，内存与带宽最小，P2与census代价之和不超过255时结果精确
+		PathCostUint16		// uint16，可使用大的P2及64位census，路径代价体内存加倍、聚合变慢
 	};
 
 	/** \brief SGM参数结构体 */
 	struct SGMOption {
-		std::uint8_t	num_paths;	// 聚合路径数 4 and 8
+		std::uint8_t	num_paths;	// 聚合路径数 4 and 8，2(→ ←)和3(→ ← ↓)为扫描线模式
 		int    min_disparity;		// 最小视差
 		int	max_disparity;		    // 最大视差
 
@@ -57,14 +88,138 @@ public:
 		int  p1;			// 惩罚项参数P1
 		int  p2_init;		// 惩罚项参数P2
 
+		// 感兴趣区域（影像坐标），宽或高为0时为整幅影像
+		// 代价体只按ROI外扩census窗口和视差搜索范围后的处理窗口分配，ROI外的视差输出为无效值
+		int  roi_x;			// ROI左上角列号
+		int  roi_y;			// ROI左上角行号
+		int  roi_width;		// ROI宽
+		int  roi_height;	// ROI高
+
+		int  num_threads;	// 代价聚合的线程数，各路径分配到线程并行聚合
+
+		CostLayout cost_layout;	// 代价体内存布局
+
+		ExecutionStrategy execution_strategy;	// 执行策略
+		std::size_t memory_budget;				// 内存预算（字节），0为系统当前可用内存（无法获取时不限）
+
+		// 影像位深，8为uint8影像，9~16为uint16影像（10/12/16位相机原始数据），需调用对应类型的Match
+		// 高位深时灰度差按pixel_bits-8右移后再计算P2，P2_init与8位影像通用
+		int  pixel_bits;
+
+		// 路径聚合代价类型，uint16时需满足 路径数 * (255 + max(p1, p2_init)) <= 65535
+		PathCostType path_cost_type;
+
+		// NUMA感知执行，full/fused策略且多线程时生效：代价体按行块由绑定到各节点的工作线程首次访问（页面分配在所属节点），
+		// 代价计算、左右路径聚合、路径累加和视差计算按行块在所属节点执行，其余路径均匀分配到各节点
+		bool is_numa_aware;
+
+		// 输出步长（1~8），代价聚合为全分辨率，视差计算、一致性检查和视差优化只在影像行列号为步长整数倍的网格像素上进行，
+		// 输出视差图为 ceil(影像高/步长) x ceil(影像宽/步长)（见OutputHeight/OutputWidth），视差仍以全分辨率像素为单位
+		int  output_stride;
+
 		SGMOption(): num_paths(8), min_disparity(0), max_disparity(64), census_size(Census5x5),
 		             is_check_unique(true), uniqueness_ratio(0.95f),
 		             is_check_lr(true), lr_check_thresh(1.0f),
 		             is_remove_speckles(true), min_speckle_aera(20),
 		             is_fill_holes(true),
-		             p1(10), p2_init(150) { }
+		             p1(10), p2_init(150),
+		             roi_x(0), roi_y(0), roi_width(0), roi_height(0),
+		             num_threads(1), cost_layout(CostPixelMajor),
+		             execution_strategy(ExecutionAuto), memory_budget(0), pixel_bits(8),
+		             path_cost_type(PathCostUint8), is_numa_aware(false), output_stride(1) { }
+	};
+
+	/** \brief 最近一次匹配的各阶段耗时（毫秒） */
+	struct StageTiming {
+		double cost;			// census变换、代价计算
+		double aggregation;		// 代价聚合
+		double disparity;		// 左影像视差计算
+		double lr_check;		// 右影像视差计算、左右一致性检查
+		double remove_speckles;	// 剔除小连通区
+		double fill_holes;		// 视差填充
+		double median_filter;	// 中值滤波
+
+		StageTiming(): cost(0), aggregation(0), disparity(0), lr_check(0),
+		               remove_speckles(0), fill_holes(0), median_filter(0) { }
+	};
+
+	/** \brief 点云中的一个有效点 */
+	struct CloudPoint {
+		float x, y, z;			// 三维坐标
+		std::int32_t pixel;		// 像素索引（行*输出视差图宽+列）
+	};
+
+	/**
+	 * \brief 视差图重投影参数，在输出视差图的同一遍扫描中计算深度/三维坐标
+	 *        [X Y Z W]^T = Q * [col row disp 1]^T，三维坐标为(X/W, Y/W, Z/W)
+	 *        col、row为影像（全分辨率）行列号，输出步长大于1时深度/三维坐标图与输出视差图等尺寸，点云的像素索引为输出视差图的索引
+	 */
+	struct Reprojection {
+		float q_matrix[16];					// 4x4 Q矩阵，行优先（与cv::stereoRectify输出的Q一致）
+		float* depth;						// 输出，深度图（Z），与输出视差图等尺寸，无效像素为无穷大，可为nullptr
+		float* xyz;							// 输出，三维坐标图（XYZ交错），输出视差图尺寸*3，无效像素为无穷大，可为nullptr
+		std::vector<CloudPoint>* points;	// 输出，只包含有效像素的紧凑点云，可为nullptr
+
+		Reprojection(): q_matrix(), depth(nullptr), xyz(nullptr), points(nullptr) { }
+	};
+
+	/**
+	 * \brief 校正定点查找表（与cv::convertMaps输出的CV_16SC2 + CV_16UC1映射一致），与校正后影像等尺寸
+	 */
+	struct RectifyMap {
+		const std::int16_t* map_xy;			// 每个校正后像素在原始影像中的整数坐标(x, y)交错
+		const std::uint16_t* map_frac;		// 坐标小数部分，(y小数 << 5) + x小数
+
+		RectifyMap(): map_xy(nullptr), map_frac(nullptr) { }
+	};
+
+	/** \brief 最近一次匹配的各阶段硬件计数，只统计调用线程，未开启或不可用的计数为-1 */
+	struct StagePerf {
+		PerfCounters::Sample cost;
+		PerfCounters::Sample aggregation;
+		PerfCounters::Sample disparity;
+		PerfCounters::Sample lr_check;
+		PerfCounters::Sample remove_speckles;
+		PerfCounters::Sample fill_holes;
+		PerfCounters::Sample median_filter;
 	};
 
+	/** \brief 内存规划：执行策略及各缓存的字节数 */
+	struct MemoryPlan {
+		ExecutionStrategy strategy;	// 规划的执行策略
+		int stripe_rows;			// 每个条带输出的行数，非条带执行时为处理窗口高
+		int cost_rows;				// 代价体覆盖的行数（条带加上下重叠行），扫描线模式为行缓存行数
+		int num_path_buffers;		// 路径代价体个数
+		std::size_t budget;			// 规划时的内存预算，0为不限
+
+		std::size_t census;			// 左右影像census值
+		std::size_t images;			// 处理窗口影像拷贝、有效像素掩膜
+		std::size_t cost_init;		// 初始代价体
+		std::size_t cost_aggr;		// 聚合代价和
+		std::size_t path_costs;		// 路径代价体
+		std::size_t disparity;		// 左右视差图（float及int16）、一致性检查类别掩膜
+
+		MemoryPlan(): strategy(ExecutionAuto), stripe_rows(0), cost_rows(0), num_path_buffers(0), budget(0),
+		              census(0), images(0), cost_init(0), cost_aggr(0), path_costs(0), disparity(0) { }
+
+		/** \brief 总字节数 */
+		std::size_t Total() const { return census + images + cost_init + cost_aggr + path_costs + disparity; }
+	};
+
+	/** \brief 多基线匹配的一个次影像 */
+	struct MatchView {
+		const std::uint8_t* image;		// 次影像数据，与参考影像等尺寸且已核线校正到同一行
+		float disparity_scale;			// 次影像视差与参考视差之比（基线长度之比），次影像在参考影像左侧时为负
+
+		MatchView(): image(nullptr), disparity_scale(1.0f) { }
+	};
+
+	/**
+	 * \brief 渐进式匹配的视差图回调
+	 *        disparity为本次输出的视差图，is_final为false时是4路径的初步结果，为true时是最终结果
+	 */
+	typedef std::function<void(const float* disparity, bool is_final)> ProgressCallback;
+
 public:
 	/**
 	 * \brief 类的初始化，完成一些内存的预分配、参数的预设置等
@@ -74,13 +229,75 @@ public:
 	 */
 	bool Initialize(const int& height, const int& width, const SGMOption& option);
 
+	/**
+	 * \brief 内存规划：计算给定尺寸和参数下各缓存的字节数，执行策略为ExecutionAuto时按内存预算选择策略
+	 *        不分配内存；校正查找表相关的缓存（SetRectification时分配）不计入
+	 *        Initialize按此规划分配内存，预算放不下时初始化失败
+	 * \param height	输入，核线像对影像高
+	 * \param width		输入，核线像对影像宽
+	 * \param option	输入，SemiGlobalMatching参数
+	 * \param plan		输出，内存规划，预算放不下时为指定策略或最省内存的策略的规划，参数无效时各项为0
+	 */
+	static bool PlanMemory(const int& height, const int& width, const SGMOption& option, MemoryPlan* plan);
+
+	/** \brief 内存规划的可读描述（策略、条带、各缓存的MB数） */
+	static std::string FormatMemoryPlan(const MemoryPlan& plan);
+
 	/**
 	 * \brief 执行匹配
 	 * \param left_image	输入，左影像数据指针 
 	 * \param right_image	输入，右影像数据指针
-	 * \param left_disp	输出，左影像视差图指针，预先分配和影像等尺寸的内存空间
+	 * \param left_disp	输出，左影像视差图指针，预先分配OutputHeight() x OutputWidth()（输出步长为1时与影像等尺寸）的内存空间
+	 * \param valid_mask	输入，有效像素掩膜指针（与影像等尺寸，非0为有效），无效像素不计算代价、不输出视差，可为nullptr
 	 */
-	bool Match(const std::uint8_t* left_image, const std::uint8_t* right_image, float* left_disp, std::ofstream& outfile);
+	bool Match(const std::uint8_t* left_image, const std::uint8_t* right_image, float* left_disp, std::ofstream& outfile,
+	           const std::uint8_t* valid_mask = nullptr);
+
+	/**
+	 * \brief 执行匹配，输出16位定点视差图（视差*sgm_util::Disp_Scale，无效像素为sgm_util::Invalid_Int16）
+	 *        视差计算和全部视差优化均在定点视差图上进行
+	 * \param left_image	输入，左影像数据指针 
+	 * \param right_image	输入，右影像数据指针
+	 * \param left_disp	输出，左影像定点视差图指针，预先分配OutputHeight() x OutputWidth()（输出步长为1时与影像等尺寸）的内存空间
+	 * \param valid_mask	输入，有效像素掩膜指针，可为nullptr
+	 */
+	bool Match(const std::uint8_t* left_image, const std::uint8_t* right_image, std::int16_t* left_disp, std::ofstream& outfile,
+	           const std::uint8_t* valid_mask = nullptr);
+
+	/**
+	 * \brief 执行匹配，输入uint16影像（pixel_bits为9~16时），参数同uint8影像
+	 */
+	bool Match(const std::uint16_t* left_image, const std::uint16_t* right_image, float* left_disp, std::ofstream& outfile,
+	           const std::uint8_t* valid_mask = nullptr);
+	bool Match(const std::uint16_t* left_image, const std::uint16_t* right_image, std::int16_t* left_disp, std::ofstream& outfile,
+	           const std::uint8_t* valid_mask = nullptr);
+
+	/**
+	 * \brief 渐进式匹配：先以左右、上下4条路径聚合得到初步视差图并回调，
+	 *        对角线4条路径在后台线程同时聚合，完成后输出最终视差图并再次回调
+	 *        聚合路径数为4时只输出最终视差图，为8时需要ExecutionFull执行策略
+	 * \param left_image		输入，左影像数据指针 
+	 * \param right_image		输入，右影像数据指针
+	 * \param provisional_disp	输出，初步视差图指针，预先分配OutputHeight() x OutputWidth()的内存空间，最终结果计算过程中保持不变
+	 * \param left_disp			输出，最终视差图指针，预先分配OutputHeight() x OutputWidth()的内存空间
+	 * \param callback			输入，视差图回调，在调用线程中执行，可为空
+	 * \param valid_mask		输入，有效像素掩膜指针，可为nullptr
+	 */
+	bool MatchProgressive(const std::uint8_t* left_image, const std::uint8_t* right_image, 
+	                      float* provisional_disp, float* left_disp, std::ofstream& outfile,
+	                      const ProgressCallback& callback, const std::uint8_t* valid_mask = nullptr);
+
+	/**
+	 * \brief 多基线匹配：参考影像的census只计算一次，与各次影像按各自的基线比例计算代价，
+	 *        在公共视差（逆深度）轴上取平均后只做一次代价聚合和视差计算
+	 *        视差以disparity_scale为1的基线为单位；融合代价没有对应的右视图，不做左右一致性检查；不支持校正查找表和条带执行
+	 * \param left_image	输入，参考影像数据指针
+	 * \param views			输入，次影像及其基线比例，最多32个
+	 * \param left_disp		输出，参考影像视差图指针，预先分配OutputHeight() x OutputWidth()（输出步长为1时与影像等尺寸）的内存空间
+	 * \param valid_mask	输入，有效像素掩膜指针，可为nullptr
+	 */
+	bool MatchMultiBaseline(const std::uint8_t* left_image, const std::vector<MatchView>& views,
+	                        float* left_disp, std::ofstream& outfile, const std::uint8_t* valid_mask = nullptr);
 
 	/**
 	 * \brief 重设
@@ -90,46 +307,384 @@ public:
 	 */
 	bool Reset(const std::uint32_t& height, const std::uint32_t& width, const SGMOption& option);
 
+	/**
+	 * \brief 修改不影响内存分配的参数（聚合路径数、唯一性/一致性检查、后处理开关、惩罚项等），无需重新初始化
+	 *        视差范围、census窗口类型、影像类型（8位/高位深）与初始化时不同则返回false，ROI、执行策略、内存预算和输出步长沿用初始化时的设置
+	 * \param option	输入，SemiGlobalMatching参数
+	 */
+	bool UpdateOption(const SGMOption& option);
+
+	/**
+	 * \brief 设置校正查找表，此后匹配输入的是未校正的原始影像，
+	 *        校正重采样与census变换在同一遍按行分块的扫描中完成，右影像的校正结果不落地
+	 * \param left_map		输入，左影像校正查找表，需在匹配期间保持有效
+	 * \param right_map		输入，右影像校正查找表，需在匹配期间保持有效
+	 * \param src_height	输入，原始影像高
+	 * \param src_width		输入，原始影像宽
+	 */
+	bool SetRectification(const RectifyMap& left_map, const RectifyMap& right_map, 
+	                      const int& src_height, const int& src_width);
+
+	/** \brief 取消校正，匹配输入恢复为已校正的核线影像 */
+	void ClearRectification();
+
+	/**
+	 * \brief 设置重投影，此后的匹配在输出视差图时同时输出深度/三维坐标，渐进式匹配只对最终视差图重投影
+	 * \param reprojection	输入，重投影参数，其中的输出缓存需在匹配期间保持有效
+	 */
+	void SetReprojection(const Reprojection& reprojection);
+
+	/** \brief 取消重投影 */
+	void ClearReprojection();
+
+	/**
+	 * \brief 设置置信度输出，此后的匹配在输出视差图时同时输出每像素uint8置信度（与输出视差图等尺寸），渐进式匹配只输出最终视差图的置信度
+	 *        置信度在视差计算（WTA）和一致性检查的同一遍扫描中得到：
+	 *        255 * sqrt(峰值比 * 曲率) * 左右一致度，峰值比为(次最小代价-最小代价)/次最小代价，
+	 *        曲率为子像素抛物线的(c1+c2-2c0)/(c1+c2)，左右一致度为1-0.5*|左右视差差|/一致性阈值（不做一致性检查时为1）
+	 *        无效视差（含剔除小连通区、视差填充的像素）及ROI外的置信度为0
+	 * \param confidence	输入，与输出视差图等尺寸的置信度图，需在匹配期间保持有效
+	 */
+	void SetConfidenceOutput(std::uint8_t* confidence);
+
+	/** \brief 取消置信度输出 */
+	void ClearConfidenceOutput();
+
+	/**
+	 * \brief 把一帧匹配（8位影像）建成任务图，由TaskScheduler与其他帧的任务图交错执行（见SGMPipeline）
+	 *        census/代价、左右路径、路径累加、左右视差和一致性检查按行块拆分，跨行路径各为一个任务，后处理和输出为一个任务；
+	 *        条带/扫描线/融合执行、校正查找表或NUMA感知执行时整帧为一个任务
+	 *        任务图执行完之前不能再调用本实例的其他匹配函数，输入影像、掩膜和视差图需保持有效
+	 * \param left_image	输入，左影像数据指针
+	 * \param right_image	输入，右影像数据指针
+	 * \param left_disp		输出，左影像视差图指针，预先分配OutputHeight() x OutputWidth()（输出步长为1时与影像等尺寸）的内存空间
+	 * \param valid_mask	输入，有效像素掩膜指针，可为nullptr
+	 * \param graph			输出，添加了本帧任务的任务图
+	 * \param is_success	输出，任务图执行完后为匹配是否成功，可为nullptr
+	 */
+	bool BuildMatchGraph(const std::uint8_t* left_image, const std::uint8_t* right_image, float* left_disp,
+	                     const std::uint8_t* valid_mask, TaskGraph* graph, bool* is_success);
+
+	/** \brief 获取SGM参数 */
+	const SGMOption& GetOption() const { return option_; }
+
+	/** \brief 输出视差图（及置信度图、深度/三维坐标图）的高，输出步长为1时等于影像高 */
+	int OutputHeight() const { return (image_height_ + option_.output_stride - 1) / option_.output_stride; }
+
+	/** \brief 输出视差图的宽 */
+	int OutputWidth() const { return (image_width_ + option_.output_stride - 1) / option_.output_stride; }
+
+	/** \brief 获取初始化时的内存规划 */
+	const MemoryPlan& GetMemoryPlan() const { return memory_plan_; }
+
+	/** \brief 获取最近一次匹配的各阶段耗时 */
+	const StageTiming& GetStageTiming() const { return stage_timing_; }
+
+	/**
+	 * \brief 开关各阶段的硬件性能计数（IPC、每像素缓存缺失字节等），开启后每次匹配结束时输出到日志
+	 *        计数器不可用时返回false，匹配不受影响
+	 *        计数器由阶段内创建的工作线程继承；开启后渐进式匹配的对角线路径在聚合阶段内完成，不再与初步视差计算并行
+	 * \param is_enable	输入，是否开启
+	 */
+	bool EnablePerfCounters(const bool& is_enable);
+
+	/** \brief 获取最近一次匹配的各阶段硬件计数 */
+	const StagePerf& GetStagePerf() const { return stage_perf_; }
+
 private:
 	/** \brief Census变换 */
-	void CensusTransform() const;
+	void CensusTransform();
+
+	/** \brief 对处理窗口first_row~last_row-1行做census变换，各行块可并行（census窗口外扩的行只读） */
+	void CensusTransformRows(const int& first_row, const int& last_row);
+
+	/** \brief 对height行影像做census变换，census与影像的行对齐 */
+	void CensusTransformImage(const std::uint8_t* image, void* census, const int& height) const;
+
+	/** \brief 按像素类型（uint8/uint16）做census变换 */
+	template <typename P>
+	void CensusTransformPixels(const P* image, void* census, const int& height) const;
+
+	/** \brief 按行分块校正左右影像并立即做census变换 */
+	void RectifyAndCensusTransform();
 
 	/** \brief 代价计算	 */
 	void ComputeCost() const;
 
-	/** \brief 代价聚合	 */
+	/** \brief 代价聚合，路径代价体少于路径数时分组聚合并立即累加	 */
 	void CostAggregation() const;
 
-	/** \brief 视差计算	 */
-	void ComputeDisparity() const;
+	/** \brief 聚合编号first_path~last_path的路径，num_threads大于1时各路径在多个线程中并行聚合 */
+	void AggregatePaths(const int& first_path, const int& last_path) const;
+
+	/**
+	 * \brief 单条路径聚合，路径编号1~8对应cost_aggr_1_~cost_aggr_8_
+	 *        只聚合自first_row行起的num_rows行，各行互不依赖的左右路径（1、2）可分块聚合，其余路径需覆盖所有行
+	 */
+	void AggregatePath(const int& path, const int& first_row, const int& num_rows) const;
+
+	/** \brief 按像素类型P（uint8/uint16）和路径代价类型A（uint8/uint16）聚合单条路径 */
+	template <typename P, typename A>
+	void AggregatePathTyped(const int& path, const int& first_row, const int& num_rows) const;
+
+	/** \brief 把编号first_path~last_path的路径代价累加到cost_aggr_，is_accumulate为false时先清零 */
+	void SumAggregatedPaths(const int& first_path, const int& last_path, bool is_accumulate) const;
+
+	/** \brief 只累加first_row~last_row-1行的路径代价 */
+	void SumAggregatedPathRows(const int& first_path, const int& last_path, bool is_accumulate,
+	                           const int& first_row, const int& last_row) const;
+
+	/**
+	 * \brief NUMA感知执行：num_workers个工作线程按编号连续绑定到各节点后执行task(worker)
+	 *        调用线程只等待，自身的CPU亲和性不变
+	 */
+	void RunNumaWorkers(const int& num_workers, const std::function<void(const int& worker)>& task) const;
+
+	/** \brief NUMA感知执行：处理窗口按行均分给num_threads个工作线程，task(first_row, last_row)处理[first_row, last_row)行 */
+	void RunRowBlocks(const std::function<void(const int& first_row, const int& last_row)>& task) const;
 
-	/** \brief 视差计算	 */
-	void ComputeDisparityRight() const;
+	/** \brief 代价体按行块由各节点的工作线程首次访问（清零），页面分配在处理该行块的节点上 */
+	void FirstTouchVolumes() const;
 
-	/** \brief 一致性检查	 */
-	void LRCheck();
+	/** \brief 路径编号对应的路径聚合代价，路径代价体少于8个时按编号循环复用 */
+	std::uint8_t* PathCost(const int& path) const;
 
-	/** \brief 视差图填充 */
-	void FillHolesInDispMap();
+	/** \brief 设置输入影像：拷贝处理窗口内的影像数据（每像素PixelBytes字节）、更新有效像素掩膜 */
+	void SetInputImages(const std::uint8_t* left_image, const std::uint8_t* right_image, const std::uint8_t* valid_mask);
+
+	/** \brief 设置右影像（拷贝处理窗口内的影像数据） */
+	void SetRightImage(const std::uint8_t* right_image);
+
+	/** \brief 开始一个阶段：记录跟踪事件、开始硬件计数 */
+	void BeginStage(const char* stage);
+
+	/** \brief 结束一个阶段：停止硬件计数、记录跟踪事件 */
+	void EndStage(const char* stage, PerfCounters::Sample* sample);
+
+	/** \brief 输出各阶段的硬件计数 */
+	void LogStagePerf(std::ofstream& outfile) const;
+
+	/** \brief 由聚合代价计算视差并做视差优化（一致性检查、剔除小连通区、视差填充、中值滤波） */
+	template <typename T>
+	void ComputeAndRefineDisparity(T* left_disp, T* right_disp, std::ofstream& outfile);
+
+	/** \brief 一致性检查之后的视差优化：剔除小连通区、视差填充（右视差图作为填充值缓存）、中值滤波 */
+	template <typename T>
+	void RefineDisparity(T* left_disp, T* right_disp, std::ofstream& outfile);
+
+	/**
+	 * \brief 把处理窗口内的视差图输出到影像尺寸的视差图，
+	 *        is_final为true时为最终结果，设置了重投影、置信度输出时同时输出深度/三维坐标、置信度图
+	 */
+	template <typename T>
+	void OutputDisparity(const T* disparity, T* left_disp, const bool& is_final = true);
+
+	/** \brief 把处理窗口内的置信度输出到影像尺寸的置信度图，disparity为处理窗口内的视差图，无效视差的置信度输出为0 */
+	template <typename T>
+	void OutputConfidence(const T* disparity);
+
+	/** \brief 输出视差图的一行并重投影（行号为影像坐标） */
+	template <typename T>
+	void ReprojectRow(const T* left_disp, const int& row);
+
+	/** \brief 计算自first_row行起num_rows行的初始代价，写入cost_init（首行为first_row行） */
+	void ComputeCostRows(const int& first_row, const int& num_rows, std::uint8_t* cost_init) const;
+
+	/**
+	 * \brief 视差计算，只计算first_row~last_row-1行中的网格行，视差图及置信度按网格存储（每行disp_width_个像素）
+	 * \param confidence		输出，置信度，为nullptr时不计算
+	 * \param cost_first_row	输入，聚合代价及有效像素掩膜首行对应的行号（条带执行时为条带窗口首行）
+	 */
+	template <typename T>
+	void ComputeDisparity(T* disparity, std::uint8_t* confidence, const int& first_row, const int& last_row, 
+	                      const int& cost_first_row = 0) const;
+
+	/** \brief 视差计算（右影像），只计算first_row~last_row-1行中的网格行，参数同ComputeDisparity	 */
+	template <typename T>
+	void ComputeDisparityRight(T* disparity, const int& first_row, const int& last_row, const int& cost_first_row = 0) const;
+
+	/**
+	 * \brief 一行的视差计算，只计算网格列
+	 * \param cost_row	输入，该行的聚合代价
+	 * \param mask_row	输入，该行的有效像素掩膜，为nullptr时全部有效
+	 * \param disp_row	输出，该行网格列的视差
+	 * \param cost_local	输入，视差范围大小的临时缓存
+	 * \param conf_row	输出，该行的置信度（峰值比与曲率），可为nullptr
+	 */
+	template <typename T>
+	void ComputeDisparityRow(const std::uint16_t* cost_row, const std::uint8_t* mask_row, T* disp_row, std::uint16_t* cost_local,
+	                         std::uint8_t* conf_row) const;
+
+	/** \brief 一行的视差计算（右影像），参数同ComputeDisparityRow，mask_row为左影像该行的掩膜 */
+	template <typename T>
+	void ComputeDisparityRightRow(const std::uint16_t* cost_row, const std::uint8_t* mask_row, T* disp_row, std::uint16_t* cost_local) const;
+
+	/**
+	 * \brief 条带执行：census变换后逐条带计算代价、聚合、计算左右视差图的条带输出行
+	 *        条带处理期间处理窗口的行数和各行指针临时指向条带窗口
+	 *        各条带的代价计算和视差计算计入对应阶段耗时，硬件计数合并计入aggregation
+	 */
+	template <typename T>
+	void MatchStripes(T* left_disp, T* right_disp, std::ofstream& outfile);
+
+	/**
+	 * \brief 扫描线模式：census变换后逐行计算代价、左右（上下）聚合、左右视差图，代价只保存在行缓存中
+	 *        2路径时各行互不依赖，按行分块在多个线程中并行；3路径的上->下路径逐行递推，单线程执行
+	 *        代价计算、聚合和视差计算合并计入aggregation
+	 */
+	template <typename T>
+	void MatchScanlines(T* left_disp, T* right_disp, std::ofstream& outfile);
+
+	/**
+	 * \brief 扫描线模式第i行的左右（上下）聚合并累加到cost_aggr，按像素类型P和路径代价类型A计算
+	 *        路径代价行缓存按字节传入；cost_down为nullptr时只聚合左右路径，cost_down_last为上一行的上->下路径代价，第0行为nullptr
+	 */
+	template <typename P, typename A>
+	void AggregateScanline(const int& i, const std::uint8_t* cost_init, std::uint8_t* cost_left, std::uint8_t* cost_right,
+	                       const std::uint8_t* cost_down_last, std::uint8_t* cost_down, std::uint16_t* cost_aggr) const;
+
+	/** \brief 一致性检查，不一致的视差置为无效，遮挡/误匹配类别写入lr_class_	 */
+	template <typename T>
+	void LRCheck(T* left_disp, const T* right_disp);
+
+	/** \brief 只检查first_row~last_row-1网格行，class_codes为一行的类别缓存，confidence不为nullptr时按左右一致度修正置信度 */
+	template <typename T>
+	void LRCheckRows(T* left_disp, const T* right_disp, const int& first_row, const int& last_row, 
+	                 std::uint8_t* class_codes, std::uint8_t* confidence) const;
+
+	/** \brief 视差图填充，按lr_class_依次填充遮挡区、误匹配区和其余无效像素，fill_disps为与视差图等尺寸的缓存 */
+	template <typename T>
+	void FillHolesInDispMap(T* disp_ptr, T* fill_disps);
+
+	/** \brief 执行匹配，视差图类型为float或int16定点数，影像按字节传入，像素类型由pixel_bits决定 */
+	template <typename T>
+	bool MatchImpl(const std::uint8_t* left_image, const std::uint8_t* right_image, T* left_disp,
+	               T* left_disp_buffer, T* right_disp_buffer, std::ofstream& outfile,
+	               const std::uint8_t* valid_mask);
 
 	/** \brief 内存释放	 */
 	void Release();
 
+	/** \brief 更新处理窗口的有效像素掩膜，返回窗口内是否存在无效像素 */
+	bool UpdateValidMask(const std::uint8_t* valid_mask);
+
+	/** \brief 是否按条带执行（扫描线模式为单行、无重叠的条带），代价体不覆盖整个处理窗口 */
+	bool IsStriped() const { 
+		return memory_plan_.strategy == ExecutionStriped || memory_plan_.strategy == ExecutionStreaming 
+		       || memory_plan_.strategy == ExecutionScanline; 
+	}
+
+	/** \brief 是否为扫描线模式 */
+	bool IsScanline() const { return memory_plan_.strategy == ExecutionScanline; }
+
+	/** \brief 输入是否为uint16影像 */
+	bool IsPixel16() const { return option_.pixel_bits > 8; }
+
+	/** \brief 每像素字节数 */
+	int PixelBytes() const { return IsPixel16() ? 2 : 1; }
+
+	/** \brief 高位深影像灰度差的右移位数 */
+	int GrayShift() const { return IsPixel16() ? option_.pixel_bits - 8 : 0; }
+
+	/** \brief 处理窗口影像第row行的首地址 */
+	const std::uint8_t* ImageRow(const std::uint8_t* image, const int& row) const { 
+		return image + static_cast<std::size_t>(row) * width_ * PixelBytes(); 
+	}
+
+	/** \brief 路径代价是否为uint16 */
+	bool IsPathCost16() const { return option_.path_cost_type == PathCostUint16; }
+
+	/** \brief 路径代价的字节数 */
+	int PathCostBytes() const { return IsPathCost16() ? 2 : 1; }
+
+	/** \brief 是否按NUMA节点分块执行（代价体覆盖整个处理窗口且多线程） */
+	bool IsNumaAware() const { return option_.is_numa_aware && !IsStriped() && option_.num_threads > 1; }
+
+	/** \brief 代价体是否为行平面布局 */
+	bool IsRowPlanar() const { return option_.cost_layout == CostRowPlanar; }
+
+	/** \brief 行号不小于row的首个网格行的网格行号（即row之前的网格行数），输出步长为1时为row */
+	int GridRows(const int& row) const { return (row - grid_row0_ + option_.output_stride - 1) / option_.output_stride; }
+
+	/** \brief 是否为网格行 */
+	bool IsGridRow(const int& row) const { return row >= grid_row0_ && (row - grid_row0_) % option_.output_stride == 0; }
+
+	/** \brief 网格像素的有效像素掩膜（disp_height_ x disp_width_），全部有效时为nullptr */
+	const std::uint8_t* GridMask() const { 
+		return is_masked_ ? (option_.output_stride > 1 ? grid_mask_.data() : valid_mask_) : nullptr; 
+	}
+
+	/** \brief 处理窗口内的置信度，未设置置信度输出时为nullptr */
+	std::uint8_t* Confidence() { return confidence_output_ != nullptr ? confidence_.data() : nullptr; }
+
+	/** \brief 当前的有效像素掩膜，全部有效时为nullptr */
+	const std::uint8_t* ValidMask() const { return is_masked_ ? valid_mask_ : nullptr; }
+
 private:
 	/** \brief SGM参数	 */
 	SGMOption option_;
 
 	/** \brief 影像高	 */
-	int height_;
+	int image_height_;
 
 	/** \brief 影像宽	 */
+	int image_width_;
+
+	/** \brief 处理窗口高（ROI外扩后的区域，无ROI时等于影像高）	 */
+	int height_;
+
+	/** \brief 处理窗口宽	 */
 	int width_;
 
-	/** \brief 左影像数据	 */
+	/** \brief 处理窗口左上角在影像中的列号	 */
+	int work_x_;
+
+	/** \brief 处理窗口左上角在影像中的行号	 */
+	int work_y_;
+
+	/** \brief 输出网格（影像行列号为输出步长整数倍的像素）在处理窗口中的首行、首列	 */
+	int grid_row0_, grid_col0_;
+
+	/** \brief 处理窗口内网格的行数、列数，即视差图、类别掩膜和置信度的高、宽（输出步长为1时等于处理窗口高、宽）	 */
+	int disp_height_, disp_width_;
+
+	/** \brief 网格像素的有效像素掩膜（输出步长大于1时使用）	 */
+	std::vector<std::uint8_t> grid_mask_;
+
+	/** \brief census值有效的行范围（相对于left_census_/right_census_首行，条带执行时随条带窗口切换）	 */
+	int census_row_begin_, census_row_end_;
+
+	/** \brief 左影像数据（按字节存储，uint16影像每像素2字节）	 */
 	const std::uint8_t* left_image_;
 
 	/** \brief 右影像数据	 */
 	const std::uint8_t* right_image_;
+
+	/** \brief 处理窗口内的左影像数据（处理窗口小于影像时才分配）	 */
+	std::uint8_t* left_work_image_;
+
+	/** \brief 处理窗口内的右影像数据	 */
+	std::uint8_t* right_work_image_;
+
+	/** \brief 是否校正输入影像	 */
+	bool is_rectify_;
+	/** \brief 左右影像校正查找表	 */
+	RectifyMap left_rectify_map_, right_rectify_map_;
+	/** \brief 原始影像高、宽	 */
+	int source_height_, source_width_;
+	/** \brief 未校正的左右原始影像	 */
+	const std::uint8_t* left_source_;
+	const std::uint8_t* right_source_;
+	/** \brief 处理窗口内校正后的左影像（代价聚合需要）	 */
+	std::vector<std::uint8_t> rectified_image_;
+	/** \brief 右影像校正分块缓存（分块行数+census窗口上下边缘）	 */
+	std::vector<std::uint8_t> rectify_tile_;
+
+	/** \brief 处理窗口内的有效像素掩膜（ROI内且输入掩膜非0为有效）	 */
+	std::uint8_t* valid_mask_;
+
+	/** \brief 处理窗口内是否存在无效像素	 */
+	bool is_masked_;
 	
 	/** \brief 左影像census值	*/
 	void* left_census_;
@@ -146,6 +701,7 @@ private:
 	// ↘ ↓ ↙   5  3  7
 	// →    ←	 1    2
 	// ↗ ↑ ↖   8  4  6
+	// 按字节存储，路径代价为uint16时每个代价2字节
 	/** \brief 聚合匹配代价-方向1	*/
     std::uint8_t* cost_aggr_1_;
 	/** \brief 聚合匹配代价-方向2	*/
@@ -167,14 +723,48 @@ private:
 	float* left_disp_;
 	/** \brief 右影像视差图	*/
 	float* right_disp_;
+	/** \brief 左影像定点视差图	*/
+	std::int16_t* left_disp_16_;
+	/** \brief 右影像定点视差图	*/
+	std::int16_t* right_disp_16_;
+
+	/** \brief 路径代价体个数（cost_aggr_1_起依次分配）	*/
+	int num_path_buffers_;
+
+	/** \brief 内存规划	*/
+	MemoryPlan memory_plan_;
 
 	/** \brief 是否初始化标志	*/
 	bool is_initialized_;
 
-	/** \brief 遮挡区像素集	*/
-	std::vector<std::pair<int, int>> occlusions_;
-	/** \brief 误匹配区像素集	*/
-	std::vector<std::pair<int, int>> mismatches_;
+	/** \brief 最近一次匹配的各阶段耗时	*/
+	StageTiming stage_timing_;
+
+	/** \brief 硬件性能计数器	*/
+	PerfCounters perf_counters_;
+	/** \brief 是否统计硬件计数	*/
+	bool is_perf_enabled_;
+	/** \brief 最近一次匹配的各阶段硬件计数	*/
+	StagePerf stage_perf_;
+
+	/** \brief 重投影参数	*/
+	Reprojection reprojection_;
+	/** \brief 是否重投影	*/
+	bool is_reproject_;
+	/** \brief 重投影一行的三维坐标缓存（未要求输出三维坐标图而要求输出点云时使用）	*/
+	std::vector<float> reproject_row_;
+
+	/** \brief 置信度输出（影像尺寸），nullptr为不输出	*/
+	std::uint8_t* confidence_output_;
+	/** \brief 处理窗口内的置信度，设置置信度输出后按处理窗口分配	*/
+	std::vector<std::uint8_t> confidence_;
+
+	/** \brief 一致性检查的像素类别掩膜（每像素2位，每行sgm_util::LRClassStride(width_)字节）	*/
+	std::uint8_t* lr_class_;
+	/** \brief 一致性检查各线程的一行类别缓存	*/
+	std::vector<std::uint8_t> lr_codes_;
+	/** \brief 本帧是否做了一致性检查（类别掩膜有效）	*/
+	bool is_lr_classified_;
 };
 
 
@@ -0,0 +1,306 @@
+/*
+ * =====================================================================================
+ *
+ *       Filename:  sgm_adaptive.cpp
+ *
+ *    Description:  deadline-aware adaptive quality sgm impl
+ *
+ *        Version:  1.0
+ *        Created:  10/19/2026 10:12:40 AM
+ *       Revision:  none
+ *       Compiler:  g++
+ *
+ *         Author:  yipeng
+ *   Organization:
+ *
+ * =====================================================================================
+ */
+
+#include "sgm_adaptive.h"
+
+#include <cmath>
+#include <chrono>
+#include <limits>
+#include <algorithm>
+
+#include <glog/logging.h>
+
+#include "sgm_util.h"
+
+static constexpr float Invalid_Float = std::numeric_limits<float>::infinity();
+
+// 距start的耗时（毫秒）
+static double ElapsedMs(const std::chrono::steady_clock::time_point& start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// 滑动平均更新，history为负值时直接取本次测量值
+static void UpdateHistory(double& history, const double& value, const double& weight) {
+    history = (history < 0) ? value : (1.0 - weight) * history + weight * value;
+}
+
+AdaptiveSGM::AdaptiveSGM()
+    : height_(0), width_(0),
+      aggregation_per_unit_(-1), disparity_per_unit_(-1), lr_check_per_unit_(-1),
+      remove_speckles_per_unit_(-1), fill_holes_per_unit_(-1), median_filter_per_unit_(-1),
+      resize_per_unit_(-1), is_initialized_(false) {
+}
+
+AdaptiveSGM::~AdaptiveSGM() {
+}
+
+bool AdaptiveSGM::Initialize(const int& height, const int& width, const AdaptiveOption& option) {
+    height_ = height;
+    width_ = width;
+    option_ = option;
+    is_initialized_ = false;
+
+    if (height <= 0 || width <= 0 || option.target_latency <= 0) {
+        return false;
+    }
+    // 各档位在4/8路径间切换，扫描线模式的行缓存不支持修改路径数
+    if (option.sgm_option.num_paths != 4 && option.sgm_option.num_paths != 8) {
+        return false;
+    }
+    // 各档位的缩放影像为uint8
+    if (option.sgm_option.pixel_bits != 8) {
+        return false;
+    }
+    // 缩放档位的视差图放大回原分辨率，不支持步长输出
+    if (option.sgm_option.output_stride != 1) {
+        return false;
+    }
+
+    // 质量档位，由高到低
+    // 先减少路径数和后处理，再缩小影像，最低档位换用最便宜的5x5 census并只保留中值滤波
+    const auto& sgm_option = option.sgm_option;
+    const auto base_census = sgm_option.census_size;
+    const auto cheap_census = SemiGlobalMatching::Census5x5;
+    const bool lr = sgm_option.is_check_lr;
+    const bool speckles = sgm_option.is_remove_speckles;
+    const bool fill = sgm_option.is_fill_holes;
+    levels_ = {
+        { 1.0f,  8, base_census,  lr,    speckles, fill  },
+        { 1.0f,  4, base_census,  lr,    speckles, fill  },
+        { 1.0f,  4, base_census,  lr,    speckles, false },
+        { 0.5f,  8, base_census,  lr,    speckles, fill  },
+        { 0.5f,  4, base_census,  lr,    speckles, fill  },
+        { 0.5f,  4, cheap_census, false, false,    false },
+        { 0.25f, 4, cheap_census, false, false,    false },
+    };
+
+    // 为每个缩放系数/census窗口类型预分配SGM实例
+    engines_.clear();
+    for (const auto& level : levels_) {
+        if (FindEngine(level) != nullptr) {
+            continue;
+        }
+        std::unique_ptr<Engine> engine(new Engine());
+        engine->scale = level.scale;
+        engine->census_size = level.census_size;
+        engine->height = std::max(1, static_cast<int>(std::lround(height * level.scale)));
+        engine->width = std::max(1, static_cast<int>(std::lround(width * level.scale)));
+
+        // 视差范围和ROI随影像等比例缩放
+        SemiGlobalMatching::SGMOption engine_option = sgm_option;
+        engine_option.census_size = level.census_size;
+        engine_option.min_disparity = static_cast<int>(std::floor(sgm_option.min_disparity * level.scale));
+        engine_option.max_disparity = std::max(engine_option.min_disparity + 3,
+                                               static_cast<int>(std::ceil(sgm_option.max_disparity * level.scale)));
+        engine_option.roi_x = static_cast<int>(sgm_option.roi_x * level.scale);
+        engine_option.roi_y = static_cast<int>(sgm_option.roi_y * level.scale);
+        engine_option.roi_width = std::min(static_cast<int>(sgm_option.roi_width * level.scale), engine->width - engine_option.roi_x);
+        engine_option.roi_height = std::min(static_cast<int>(sgm_option.roi_height * level.scale), engine->height - engine_option.roi_y);
+        if (!engine->sgm.Initialize(engine->height, engine->width, engine_option)) {
+            return false;
+        }
+
+        if (level.scale != 1.0f) {
+            const int image_size = engine->height * engine->width;
+            engine->left_image.resize(image_size);
+            engine->right_image.resize(image_size);
+            engine->disparity.resize(image_size);
+        }
+        engines_.push_back(std::move(engine));
+    }
+
+    cost_per_unit_.assign(SemiGlobalMatching::CensusSparse11x11 + 1, -1);
+
+    is_initialized_ = true;
+    return true;
+}
+
+bool AdaptiveSGM::Match(const std::uint8_t* left_image, const std::uint8_t* right_image, float* left_disp, FrameReport* report) {
+    if (!is_initialized_) {
+        return false;
+    }
+    if (left_image == nullptr || right_image == nullptr || left_disp == nullptr) {
+        return false;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+
+    // 选择档位，尚无耗时历史时以最低档位运行全部阶段，获取各阶段的耗时
+    double predicted_latency = 0;
+    int level_idx = ChooseLevel(&predicted_latency);
+    QualityLevel level = levels_[level_idx];
+    if (aggregation_per_unit_ < 0) {
+        level_idx = static_cast<int>(levels_.size()) - 1;
+        level = levels_[level_idx];
+        level.num_paths = option_.sgm_option.num_paths;
+        level.is_check_lr = option_.sgm_option.is_check_lr;
+        level.is_remove_speckles = option_.sgm_option.is_remove_speckles;
+        level.is_fill_holes = option_.sgm_option.is_fill_holes;
+    }
+    Engine* engine = FindEngine(level);
+
+    SemiGlobalMatching::SGMOption sgm_option = engine->sgm.GetOption();
+    sgm_option.num_paths = level.num_paths;
+    sgm_option.is_check_lr = level.is_check_lr;
+    sgm_option.is_remove_speckles = level.is_remove_speckles;
+    sgm_option.is_fill_holes = level.is_fill_holes;
+    if (!engine->sgm.UpdateOption(sgm_option)) {
+        return false;
+    }
+
+    // 缩放影像后匹配，视差图还原至原始尺寸
+    double resize_time = 0;
+    if (level.scale != 1.0f) {
+        auto resize_start = std::chrono::steady_clock::now();
+        sgm_util::ResizeImage(left_image, height_, width_, engine->left_image.data(), engine->height, engine->width);
+        sgm_util::ResizeImage(right_image, height_, width_, engine->right_image.data(), engine->height, engine->width);
+        resize_time += ElapsedMs(resize_start);
+
+        if (!engine->sgm.Match(engine->left_image.data(), engine->right_image.data(), engine->disparity.data(), null_stream_)) {
+            return false;
+        }
+
+        resize_start = std::chrono::steady_clock::now();
+        sgm_util::ResizeDisparity(engine->disparity.data(), engine->height, engine->width, left_disp, height_, width_, Invalid_Float);
+        resize_time += ElapsedMs(resize_start);
+    } else if (!engine->sgm.Match(left_image, right_image, left_disp, null_stream_)) {
+        return false;
+    }
+
+    const double latency = ElapsedMs(start);
+    UpdateModel(*engine, level, engine->sgm.GetStageTiming(), resize_time);
+
+    if (latency > option_.target_latency) {
+        LOG(WARNING) << "adaptive sgm: frame latency " << latency << "ms exceeds target "
+                     << option_.target_latency << "ms at level " << level_idx;
+    }
+
+    if (report != nullptr) {
+        report->level = level_idx;
+        report->config = level;
+        report->predicted_latency = predicted_latency;
+        report->latency = latency;
+        report->stage_timing = engine->sgm.GetStageTiming();
+    }
+
+    return true;
+}
+
+int AdaptiveSGM::ChooseLevel(double* predicted_latency) const {
+    const double budget = option_.target_latency * (1.0 - option_.safety_margin);
+    const int num_levels = static_cast<int>(levels_.size());
+
+    for (int i = 0; i < num_levels; i++) {
+        const double latency = PredictLatency(levels_[i]);
+        if (latency >= 0 && latency <= budget) {
+            *predicted_latency = latency;
+            return i;
+        }
+    }
+
+    // 所有档位都无法满足目标耗时，选用最低档位
+    *predicted_latency = std::max(0.0, PredictLatency(levels_[num_levels - 1]));
+    return num_levels - 1;
+}
+
+double AdaptiveSGM::PredictLatency(const QualityLevel& level) const {
+    if (aggregation_per_unit_ < 0) {
+        return -1;
+    }
+
+    // 未运行过的census窗口类型，取已知census类型中最大的单位耗时
+    double cost_per_unit = cost_per_unit_[level.census_size];
+    if (cost_per_unit < 0) {
+        cost_per_unit = *std::max_element(cost_per_unit_.begin(), cost_per_unit_.end());
+    }
+
+    const double pixels = PixelCount(level.scale);
+    const double disp_range = DisparityRange(level.scale);
+
+    double latency = cost_per_unit * pixels * disp_range
+                     + aggregation_per_unit_ * pixels * disp_range * level.num_paths
+                     + disparity_per_unit_ * pixels * disp_range
+                     + median_filter_per_unit_ * pixels;
+    if (level.is_check_lr) {
+        latency += lr_check_per_unit_ * pixels * disp_range;
+    }
+    if (level.is_remove_speckles) {
+        latency += remove_speckles_per_unit_ * pixels;
+    }
+    if (level.is_fill_holes) {
+        latency += fill_holes_per_unit_ * pixels;
+    }
+    if (level.scale != 1.0f) {
+        latency += std::max(0.0, resize_per_unit_) * height_ * width_;
+    }
+
+    return latency;
+}
+
+void AdaptiveSGM::UpdateModel(const Engine& engine, const QualityLevel& level,
+                              const SemiGlobalMatching::StageTiming& timing, const double& resize_time) {
+    const double& weight = option_.history_weight;
+    const double pixels = PixelCount(engine.scale);
+    const double disp_range = DisparityRange(engine.scale);
+
+    UpdateHistory(cost_per_unit_[level.census_size], timing.cost / (pixels * disp_range), weight);
+    UpdateHistory(aggregation_per_unit_, timing.aggregation / (pixels * disp_range * level.num_paths), weight);
+    UpdateHistory(disparity_per_unit_, timing.disparity / (pixels * disp_range), weight);
+    UpdateHistory(median_filter_per_unit_, timing.median_filter / pixels, weight);
+    if (level.is_check_lr) {
+        UpdateHistory(lr_check_per_unit_, timing.lr_check / (pixels * disp_range), weight);
+    }
+    if (level.is_remove_speckles) {
+        UpdateHistory(remove_speckles_per_unit_, timing.remove_speckles / pixels, weight);
+    }
+    if (level.is_fill_holes) {
+        UpdateHistory(fill_holes_per_unit_, timing.fill_holes / pixels, weight);
+    }
+    if (level.scale != 1.0f) {
+        UpdateHistory(resize_per_unit_, resize_time / (static_cast<double>(height_) * width_), weight);
+    }
+
+    // 后处理阶段可能在基础参数中被关闭而从未运行，按0计
+    lr_check_per_unit_ = std::max(0.0, lr_check_per_unit_);
+    remove_speckles_per_unit_ = std::max(0.0, remove_speckles_per_unit_);
+    fill_holes_per_unit_ = std::max(0.0, fill_holes_per_unit_);
+}
+
+AdaptiveSGM::Engine* AdaptiveSGM::FindEngine(const QualityLevel& level) const {
+    for (const auto& engine : engines_) {
+        if (engine->scale == level.scale && engine->census_size == level.census_size) {
+            return engine.get();
+        }
+    }
+    return nullptr;
+}
+
+double AdaptiveSGM::PixelCount(const float& scale) const {
+    const auto& sgm_option = option_.sgm_option;
+    const bool has_roi = sgm_option.roi_width > 0 && sgm_option.roi_height > 0;
+    const double area = has_roi ? static_cast<double>(sgm_option.roi_width) * sgm_option.roi_height
+                                : static_cast<double>(width_) * height_;
+    return std::max(1.0, area * scale * scale);
+}
+
+int AdaptiveSGM::DisparityRange(const float& scale) const {
+    const auto& sgm_option = option_.sgm_option;
+    const int min_disparity = static_cast<int>(std::floor(sgm_option.min_disparity * scale));
+    const int max_disparity = std::max(min_disparity + 3, static_cast<int>(std::ceil(sgm_option.max_disparity * scale)));
+    return max_disparity - min_disparity;
+}
@@ -0,0 +1,162 @@
+/*
+ * =====================================================================================
+ *
+ *       Filename:  sgm_adaptive.h
+ *
+ *    Description:  deadline-aware adaptive quality sgm
+ *
+ *        Version:  1.0
+ *        Created:  10/19/2026 10:12:40 AM
+ *       Revision:  none
+ *       Compiler:  g++
+ *
+ *         Author:  yipeng
+ *   Organization:
+ *
+ * =====================================================================================
+ */
+
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <fstream>
+#include <memory>
+#include <vector>
+
+#include "semi_global_matching.h"
+
+/**
+ * \brief 按每帧目标耗时自适应选择质量档位的SGM
+ *        根据各阶段的历史耗时估计每个档位的耗时，逐帧选择能满足目标耗时的最高质量档位
+ *        （影像缩放系数、聚合路径数、census窗口类型、后处理阶段）
+ */
+class AdaptiveSGM {
+public:
+	AdaptiveSGM();
+	~AdaptiveSGM();
+
+	/** \brief 自适应参数结构体 */
+	struct AdaptiveOption {
+		double target_latency;		// 每帧目标耗时（毫秒）
+		double safety_margin;		// 安全余量，预测耗时需小于 目标耗时*(1-安全余量)
+		double history_weight;		// 耗时历史的滑动平均权重（新一帧所占比例）
+
+		// 最高质量档位的SGM参数（视差范围、census窗口类型、惩罚项、后处理开关等）
+		// 低质量档位在此基础上缩小影像、减少路径数、关闭部分后处理，不会打开此处关闭的后处理
+		SemiGlobalMatching::SGMOption sgm_option;
+
+		AdaptiveOption(): target_latency(33.0), safety_margin(0.1), history_weight(0.3) { }
+	};
+
+	/** \brief 质量档位 */
+	struct QualityLevel {
+		float scale;								// 影像缩放系数
+		std::uint8_t num_paths;						// 聚合路径数
+		SemiGlobalMatching::CensusSize census_size;	// census窗口类型
+		bool is_check_lr;							// 是否检查左右一致性
+		bool is_remove_speckles;					// 是否移除小的连通区
+		bool is_fill_holes;							// 是否填充视差空洞
+	};
+
+	/** \brief 单帧匹配报告 */
+	struct FrameReport {
+		int level;										// 选用的质量档位（0为最高质量）
+		QualityLevel config;							// 实际运行的配置
+		double predicted_latency;						// 预测耗时（毫秒），无耗时历史时为0
+		double latency;									// 实际耗时（毫秒）
+		SemiGlobalMatching::StageTiming stage_timing;	// SGM各阶段耗时
+	};
+
+public:
+	/**
+	 * \brief 初始化，为所有质量档位预分配内存，匹配过程中不再分配
+	 * \param height	输入，核线像对影像高
+	 * \param width		输入，核线像对影像宽
+	 * \param option	输入，自适应参数
+	 */
+	bool Initialize(const int& height, const int& width, const AdaptiveOption& option);
+
+	/**
+	 * \brief 执行匹配，首帧以最低档位运行全部阶段以获取耗时历史
+	 * \param left_image	输入，左影像数据指针
+	 * \param right_image	输入，右影像数据指针
+	 * \param left_disp		输出，左影像视差图指针，预先分配和影像等尺寸的内存空间
+	 * \param report		输出，本帧选用的配置及耗时，可为nullptr
+	 */
+	bool Match(const std::uint8_t* left_image, const std::uint8_t* right_image, float* left_disp, FrameReport* report);
+
+	/** \brief 质量档位列表，由高到低 */
+	const std::vector<QualityLevel>& GetQualityLevels() const { return levels_; }
+
+private:
+	/** \brief 某一缩放系数和census窗口类型下的SGM实例及缩放后的影像缓存 */
+	struct Engine {
+		float scale;
+		SemiGlobalMatching::CensusSize census_size;
+		int height;
+		int width;
+		SemiGlobalMatching sgm;
+		std::vector<std::uint8_t> left_image;
+		std::vector<std::uint8_t> right_image;
+		std::vector<float> disparity;
+	};
+
+	/** \brief 选择预测耗时满足目标的最高质量档位 */
+	int ChooseLevel(double* predicted_latency) const;
+
+	/** \brief 预测某档位的耗时（毫秒），尚无耗时历史时返回负值 */
+	double PredictLatency(const QualityLevel& level) const;
+
+	/** \brief 以本帧各阶段耗时更新耗时模型 */
+	void UpdateModel(const Engine& engine, const QualityLevel& level,
+	                 const SemiGlobalMatching::StageTiming& timing, const double& resize_time);
+
+	/** \brief 查找档位对应的SGM实例 */
+	Engine* FindEngine(const QualityLevel& level) const;
+
+	/** \brief 档位下参与计算的像素数 */
+	double PixelCount(const float& scale) const;
+
+	/** \brief 档位下的视差范围 */
+	int DisparityRange(const float& scale) const;
+
+private:
+	/** \brief 自适应参数 */
+	AdaptiveOption option_;
+
+	/** \brief 影像高 */
+	int height_;
+
+	/** \brief 影像宽 */
+	int width_;
+
+	/** \brief 质量档位，由高到低 */
+	std::vector<QualityLevel> levels_;
+
+	/** \brief 各缩放系数/census窗口类型的SGM实例 */
+	std::vector<std::unique_ptr<Engine>> engines_;
+
+	// 耗时模型：各阶段单位工作量的耗时（毫秒），按滑动平均更新，负值表示尚无历史
+	/** \brief census变换+代价计算，每像素每视差，按census窗口类型区分 */
+	std::vector<double> cost_per_unit_;
+	/** \brief 代价聚合，每像素每视差每路径 */
+	double aggregation_per_unit_;
+	/** \brief 视差计算，每像素每视差 */
+	double disparity_per_unit_;
+	/** \brief 右影像视差计算+一致性检查，每像素每视差 */
+	double lr_check_per_unit_;
+	/** \brief 剔除小连通区，每像素 */
+	double remove_speckles_per_unit_;
+	/** \brief 视差填充，每像素 */
+	double fill_holes_per_unit_;
+	/** \brief 中值滤波，每像素 */
+	double median_filter_per_unit_;
+	/** \brief 影像缩放与视差图还原，每原始像素 */
+	double resize_per_unit_;
+
+	/** \brief SGM日志输出（不写文件） */
+	std::ofstream null_stream_;
+
+	/** \brief 是否初始化标志 */
+	bool is_initialized_;
+};
@@ -0,0 +1,595 @@
+/*
+ * =====================================================================================
+ *
+ *       Filename:  sgm_benchmark.cpp
+ *
+ *    Description:  accuracy and throughput benchmark of sgm presets on stereo datasets with ground truth
+ *
+ *        Version:  1.0
+ *        Created:  10/19/2026 05:12:36 PM
+ *       Revision:  none
+ *       Compiler:  g++
+ *
+ *         Author:  yipeng
+ *   Organization:
+ *
+ * =====================================================================================
+ */
+
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+#include <limits>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <random>
+#include <algorithm>
+
+#include <glog/logging.h>
+#include <gflags/gflags.h>
+#include <opencv2/core.hpp>
+#include <opencv2/highgui.hpp>
+#include <opencv2/imgproc.hpp>
+
+#include "sgm_util.h"
+#include "semi_global_matching.h"
+
+DEFINE_string(datasets,                     "",                             "dataset folders separated by ',', each with left/right images, ground truth and optionally drange.txt or calib.txt");
+DEFINE_int32(synthetic,                     2,                              "number of synthetic pairs with exact ground truth");
+DEFINE_int32(synthetic_height,              375,                            "synthetic pair height");
+DEFINE_int32(synthetic_width,               450,                            "synthetic pair width");
+DEFINE_string(presets,                      "default,paths4,row_planar,fixed_point", "sgm option presets separated by ',', see --list_presets");
+DEFINE_bool(list_presets,                   false,                          "list sgm option presets and exit");
+DEFINE_int32(repeat,                        3,                              "matching runs per dataset and preset, median time is reported");
+DEFINE_int32(min_disp,                      0,                              "min disparity of datasets without a range file");
+DEFINE_int32(max_disp,                      64,                             "max disparity of datasets without a range file");
+DEFINE_double(gt_scale,                     0.0,                            "png ground truth divisor, 0 means 4 for 8-bit(middlebury 2003) and 256 for 16-bit(kitti)");
+DEFINE_string(output_json,                  "results/benchmark.json",       "benchmark result json path");
+
+static constexpr float Invalid_Float = std::numeric_limits<float>::infinity();
+
+// 一个带真值的像对，真值中无效像素为无穷大
+struct StereoSample {
+    std::string name;
+    int height;
+    int width;
+    int min_disparity;
+    int max_disparity;
+    std::vector<std::uint8_t> left;
+    std::vector<std::uint8_t> right;
+    std::vector<float> ground_truth;
+};
+
+// 参数预设：在基础参数上修改，is_fixed_point为true时输出16位定点视差
+struct Preset {
+    const char* name;
+    const char* description;
+    void (*apply)(SemiGlobalMatching::SGMOption& option);
+    bool is_fixed_point;
+};
+
+static const Preset Presets[] = {
+    { "default",        "8 paths, census 5x5, full postprocessing",
+      [](SemiGlobalMatching::SGMOption&) { }, false },
+    { "paths4",         "4 paths",
+      [](SemiGlobalMatching::SGMOption& option) { option.num_paths = 4; }, false },
+    { "census9x7",      "census 9x7(64 bits)",
+      [](SemiGlobalMatching::SGMOption& option) { option.census_size = SemiGlobalMatching::Census9x7; }, false },
+    { "cs9x7",          "center-symmetric census 9x7",
+      [](SemiGlobalMatching::SGMOption& option) { option.census_size = SemiGlobalMatching::CensusCS9x7; }, false },
+    { "sparse9x7",      "sparse census 9x7",
+      [](SemiGlobalMatching::SGMOption& option) { option.census_size = SemiGlobalMatching::CensusSparse9x7; }, false },
+    { "sparse11x11",    "sparse center-symmetric census 11x11",
+      [](SemiGlobalMatching::SGMOption& option) { option.census_size = SemiGlobalMatching::CensusSparse11x11; }, false },
+    { "row_planar",     "row planar cost volume layout",
+      [](SemiGlobalMatching::SGMOption& option) { option.cost_layout = SemiGlobalMatching::CostRowPlanar; }, false },
+    { "threads4",       "4 threads aggregating paths",
+      [](SemiGlobalMatching::SGMOption& option) { option.num_threads = 4; }, false },
+    { "numa4",          "4 threads, numa-aware row blocks on node-pinned workers",
+      [](SemiGlobalMatching::SGMOption& option) {
+          option.num_threads = 4;
+          option.is_numa_aware = true;
+      }, false },
+    { "fused",          "fused execution, path costs summed as soon as aggregated",
+      [](SemiGlobalMatching::SGMOption& option) { option.execution_strategy = SemiGlobalMatching::ExecutionFused; }, false },
+    { "striped",        "striped execution",
+      [](SemiGlobalMatching::SGMOption& option) { option.execution_strategy = SemiGlobalMatching::ExecutionStriped; }, false },
+    { "streaming",      "streaming execution, minimum memory",
+      [](SemiGlobalMatching::SGMOption& option) { option.execution_strategy = SemiGlobalMatching::ExecutionStreaming; }, false },
+    { "scanline2",      "2 paths(left/right) scanline mode, rows matched independently",
+      [](SemiGlobalMatching::SGMOption& option) { option.num_paths = 2; }, false },
+    { "scanline3",      "3 paths(left/right/down) scanline mode",
+      [](SemiGlobalMatching::SGMOption& option) { option.num_paths = 3; }, false },
+    { "pixel12",        "12-bit input(8-bit images shifted left by 4), uint16 census and aggregation",
+      [](SemiGlobalMatching::SGMOption& option) { option.pixel_bits = 12; }, false },
+    { "path_cost16",    "uint16 path costs(no saturation)",
+      [](SemiGlobalMatching::SGMOption& option) { option.path_cost_type = SemiGlobalMatching::PathCostUint16; }, false },
+    { "large_p2",       "P2 = 1000, uint8 path costs saturated at 255",
+      [](SemiGlobalMatching::SGMOption& option) { option.p2_init = 1000; }, false },
+    { "large_p2_cost16", "P2 = 1000, uint16 path costs",
+      [](SemiGlobalMatching::SGMOption& option) {
+          option.p2_init = 1000;
+          option.path_cost_type = SemiGlobalMatching::PathCostUint16;
+      }, false },
+    { "fixed_point",    "16-bit fixed point disparity",
+      [](SemiGlobalMatching::SGMOption&) { }, true },
+    { "no_postprocess", "no lr check, speckle removal or hole filling",
+      [](SemiGlobalMatching::SGMOption& option) {
+          option.is_check_lr = false;
+          option.is_remove_speckles = false;
+          option.is_fill_holes = false;
+      }, false },
+};
+
+// 一次评测结果
+struct BenchmarkResult {
+    std::string dataset;
+    std::string preset;
+    int height;
+    int width;
+    int disp_range;
+    double time_ms;         // 匹配耗时中位数
+    double throughput;      // Mpix·D/s
+    double bad_1;           // 有效视差中误差大于1的比例
+    double bad_2;           // 有效视差中误差大于2的比例
+    double invalid;         // 真值有效像素中输出无效视差的比例
+    double mae;             // 有效视差的平均绝对误差
+    bool is_ok;
+};
+
+// 与main.cpp一致的基础参数
+static SemiGlobalMatching::SGMOption BaseOption(const StereoSample& sample) {
+    SemiGlobalMatching::SGMOption option;
+    option.num_paths = 8;
+    option.min_disparity = sample.min_disparity;
+    option.max_disparity = sample.max_disparity;
+    option.census_size = SemiGlobalMatching::Census5x5;
+    option.is_check_lr = true;
+    option.lr_check_thresh = 1.0f;
+    option.is_check_unique = true;
+    option.uniqueness_ratio = 0.99;
+    option.is_remove_speckles = true;
+    option.min_speckle_aera = 50;
+    option.p1 = 10;
+    option.p2_init = 150;
+    option.is_fill_holes = true;
+    return option;
+}
+
+static bool FileExists(const std::string& path) {
+    std::ifstream file(path);
+    return file.good();
+}
+
+// 目录中第一个存在的文件，都不存在时为空
+static std::string FindFile(const std::string& dir, const std::vector<std::string>& names) {
+    for (const auto& name : names) {
+        if (FileExists(dir + "/" + name)) {
+            return dir + "/" + name;
+        }
+    }
+    return std::string();
+}
+
+// 读取PFM浮点视差图（middlebury 2014），行自下而上存储，无穷大为无效
+static bool ReadPFM(const std::string& path, int& height, int& width, std::vector<float>& data) {
+    std::ifstream file(path, std::ios::binary);
+    std::string type;
+    double scale = 0;
+    if (!(file >> type >> width >> height >> scale) || type != "Pf" || width <= 0 || height <= 0) {
+        return false;
+    }
+    file.get();
+    data.resize(static_cast<std::size_t>(height) * width);
+    for (int i = height - 1; i >= 0; i--) {
+        if (!file.read(reinterpret_cast<char*>(data.data() + static_cast<std::size_t>(i) * width), width * sizeof(float))) {
+            return false;
+        }
+    }
+    // 比例为负表示小端存储
+    const std::uint16_t probe = 1;
+    const bool is_little_endian = *reinterpret_cast<const std::uint8_t*>(&probe) == 1;
+    if ((scale < 0) != is_little_endian) {
+        for (auto& value : data) {
+            std::uint8_t* bytes = reinterpret_cast<std::uint8_t*>(&value);
+            std::swap(bytes[0], bytes[3]);
+            std::swap(bytes[1], bytes[2]);
+        }
+    }
+    for (auto& value : data) {
+        if (!std::isfinite(value) || value <= 0) {
+            value = Invalid_Float;
+        }
+    }
+    return true;
+}
+
+// 读取PNG视差真值，0为无效
+static bool ReadPNGDisparity(const std::string& path, const int& height, const int& width, std::vector<float>& data) {
+    cv::Mat image = cv::imread(path, cv::IMREAD_UNCHANGED);
+    if (image.data == nullptr || image.rows != height || image.cols != width || image.channels() != 1) {
+        return false;
+    }
+    const bool is_16bit = image.depth() == CV_16U;
+    const double scale = FLAGS_gt_scale > 0 ? FLAGS_gt_scale : (is_16bit ? 256.0 : 4.0);
+    data.resize(static_cast<std::size_t>(height) * width);
+    for (int i = 0; i < height; i++) {
+        for (int j = 0; j < width; j++) {
+            const int value = is_16bit ? image.at<std::uint16_t>(i, j) : image.at<std::uint8_t>(i, j);
+            data[i * width + j] = (value == 0) ? Invalid_Float : static_cast<float>(value / scale);
+        }
+    }
+    return true;
+}
+
+// 视差范围：drange.txt(dmin=, dmax=)或calib.txt(vmin=, ndisp=)，都没有时用命令行参数
+static void ReadDisparityRange(const std::string& dir, int& min_disparity, int& max_disparity) {
+    min_disparity = FLAGS_min_disp;
+    max_disparity = FLAGS_max_disp;
+    const std::string range_path = FindFile(dir, { "drange.txt", "calib.txt" });
+    std::ifstream file(range_path);
+    std::string line;
+    int ndisp = 0, vmin = -1;
+    bool has_min = false, has_max = false;
+    while (std::getline(file, line)) {
+        const std::size_t eq = line.find('=');
+        if (eq == std::string::npos) {
+            continue;
+        }
+        const std::string key = line.substr(0, eq);
+        const double value = atof(line.c_str() + eq + 1);
+        if (key == "dmin") {
+            min_disparity = static_cast<int>(std::floor(value));
+            has_min = true;
+        } else if (key == "dmax") {
+            max_disparity = static_cast<int>(std::ceil(value));
+            has_max = true;
+        } else if (key == "ndisp") {
+            ndisp = static_cast<int>(value);
+        } else if (key == "vmin") {
+            vmin = static_cast<int>(std::floor(value));
+        }
+    }
+    if (!has_max && ndisp > 0) {
+        max_disparity = ndisp;
+    }
+    if (!has_min && vmin >= 0 && ndisp == 0) {
+        min_disparity = vmin;
+    }
+}
+
+// 读取middlebury风格的数据集目录
+static bool LoadDataset(const std::string& dir, StereoSample& sample) {
+    const std::string left_path = FindFile(dir, { "im0.png", "img0.png", "im2.png", "view1.png" });
+    const std::string right_path = FindFile(dir, { "im1.png", "img1.png", "im6.png", "view5.png" });
+    const std::string gt_path = FindFile(dir, { "disp0.pfm", "disp0GT.pfm", "disp0.png", "disp2.png", "disp1.png" });
+    if (left_path.empty() || right_path.empty() || gt_path.empty()) {
+        LOG(ERROR) << "benchmark: " << dir << " needs left, right and ground truth images";
+        return false;
+    }
+    cv::Mat left = cv::imread(left_path, cv::IMREAD_GRAYSCALE);
+    cv::Mat right = cv::imread(right_path, cv::IMREAD_GRAYSCALE);
+    if (left.data == nullptr || right.data == nullptr || left.rows != right.rows || left.cols != right.cols) {
+        LOG(ERROR) << "benchmark: failed to read " << left_path << " / " << right_path;
+        return false;
+    }
+
+    sample.name = dir;
+    sample.height = left.rows;
+    sample.width = left.cols;
+    sample.left.resize(sample.height * sample.width);
+    sample.right.resize(sample.height * sample.width);
+    for (int i = 0; i < sample.height; i++) {
+        memcpy(sample.left.data() + i * sample.width, left.ptr<std::uint8_t>(i), sample.width);
+        memcpy(sample.right.data() + i * sample.width, right.ptr<std::uint8_t>(i), sample.width);
+    }
+
+    bool is_read = false;
+    if (gt_path.size() > 4 && gt_path.compare(gt_path.size() - 4, 4, ".pfm") == 0) {
+        int gt_height = 0, gt_width = 0;
+        is_read = ReadPFM(gt_path, gt_height, gt_width, sample.ground_truth)
+                  && gt_height == sample.height && gt_width == sample.width;
+    } else {
+        is_read = ReadPNGDisparity(gt_path, sample.height, sample.width, sample.ground_truth);
+    }
+    if (!is_read) {
+        LOG(ERROR) << "benchmark: failed to read ground truth " << gt_path;
+        return false;
+    }
+    ReadDisparityRange(dir, sample.min_disparity, sample.max_disparity);
+    return true;
+}
+
+// 合成像对：平滑随机纹理作为右影像，视差为倾斜背景平面加若干前景矩形，
+// 左影像按真值视差从右影像线性插值采样，真值精确，采样超出右影像的像素真值无效
+static StereoSample MakeSyntheticSample(const int& index, const int& height, const int& width) {
+    StereoSample sample;
+    sample.name = "synthetic_" + std::to_string(index);
+    sample.height = height;
+    sample.width = width;
+    sample.min_disparity = 0;
+    sample.max_disparity = 64;
+
+    std::mt19937 random(1000 + index);
+    std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+    std::vector<float> noise(height * width);
+    for (auto& value : noise) {
+        value = uniform(random) * 255.0f;
+    }
+    sample.right.resize(height * width);
+    for (int i = 0; i < height; i++) {
+        for (int j = 0; j < width; j++) {
+            float sum = 0;
+            int count = 0;
+            for (int r = std::max(0, i - 1); r <= std::min(height - 1, i + 1); r++) {
+                for (int c = std::max(0, j - 1); c <= std::min(width - 1, j + 1); c++) {
+                    sum += noise[r * width + c];
+                    count++;
+                }
+            }
+            sample.right[i * width + j] = static_cast<std::uint8_t>(sum / count + 0.5f);
+        }
+    }
+
+    // 背景平面 d = a + b * x + c * y，前景矩形为常数视差
+    const float a = 8.0f + 8.0f * uniform(random);
+    const float b = 8.0f * uniform(random) / width;
+    const float c = 12.0f * uniform(random) / height;
+    struct Block { int x, y, w, h; float d; };
+    std::vector<Block> blocks(3);
+    for (auto& block : blocks) {
+        block.w = width / 8 + static_cast<int>(uniform(random) * width / 5);
+        block.h = height / 8 + static_cast<int>(uniform(random) * height / 5);
+        block.x = static_cast<int>(uniform(random) * (width - block.w));
+        block.y = static_cast<int>(uniform(random) * (height - block.h));
+        block.d = 30.0f + 25.0f * uniform(random);
+    }
+
+    sample.left.resize(height * width);
+    sample.ground_truth.resize(height * width);
+    for (int i = 0; i < height; i++) {
+        for (int j = 0; j < width; j++) {
+            float disparity = a + b * j + c * i;
+            for (const auto& block : blocks) {
+                if (j >= block.x && j < block.x + block.w && i >= block.y && i < block.y + block.h) {
+                    disparity = block.d;
+                }
+            }
+            const float x = j - disparity;
+            const int x0 = static_cast<int>(std::floor(x));
+            const float alpha = x - x0;
+            if (x0 < 0 || x0 + 1 >= width) {
+                sample.left[i * width + j] = sample.right[i * width + std::max(0, std::min(width - 1, x0))];
+                sample.ground_truth[i * width + j] = Invalid_Float;
+                continue;
+            }
+            const float value = (1 - alpha) * sample.right[i * width + x0] + alpha * sample.right[i * width + x0 + 1];
+            sample.left[i * width + j] = static_cast<std::uint8_t>(value + 0.5f);
+            sample.ground_truth[i * width + j] = disparity;
+        }
+    }
+    return sample;
+}
+
+// 按预设匹配一个像对，重复repeat次取耗时中位数，并与真值比较
+static BenchmarkResult RunBenchmark(const StereoSample& sample, const Preset& preset) {
+    BenchmarkResult result;
+    result.dataset = sample.name;
+    result.preset = preset.name;
+    result.height = sample.height;
+    result.width = sample.width;
+    result.disp_range = sample.max_disparity - sample.min_disparity;
+    result.time_ms = result.throughput = 0;
+    result.bad_1 = result.bad_2 = result.invalid = result.mae = 0;
+    result.is_ok = false;
+
+    SemiGlobalMatching::SGMOption option = BaseOption(sample);
+    preset.apply(option);
+    SemiGlobalMatching sgm;
+    if (!sgm.Initialize(sample.height, sample.width, option)) {
+        LOG(ERROR) << "benchmark: SGM initialize failed for " << sample.name << " / " << preset.name;
+        return result;
+    }
+
+    const int image_size = sample.height * sample.width;
+    std::vector<float> disparity(image_size);
+    std::vector<std::int16_t> disparity_16(preset.is_fixed_point ? image_size : 0);
+    // 高位深预设：8位影像左移到pixel_bits位，视差应与8位输入一致
+    const bool is_pixel_16 = option.pixel_bits > 8;
+    std::vector<std::uint16_t> left_16(is_pixel_16 ? image_size : 0), right_16(is_pixel_16 ? image_size : 0);
+    for (int k = 0; k < static_cast<int>(left_16.size()); k++) {
+        left_16[k] = static_cast<std::uint16_t>(sample.left[k] << (option.pixel_bits - 8));
+        right_16[k] = static_cast<std::uint16_t>(sample.right[k] << (option.pixel_bits - 8));
+    }
+    std::ofstream null_stream;
+    std::vector<double> times;
+    for (int k = 0; k < std::max(1, FLAGS_repeat); k++) {
+        const auto start = std::chrono::steady_clock::now();
+        bool is_matched = false;
+        if (is_pixel_16) {
+            is_matched = preset.is_fixed_point
+                ? sgm.Match(left_16.data(), right_16.data(), disparity_16.data(), null_stream)
+                : sgm.Match(left_16.data(), right_16.data(), disparity.data(), null_stream);
+        } else {
+            is_matched = preset.is_fixed_point
+                ? sgm.Match(sample.left.data(), sample.right.data(), disparity_16.data(), null_stream)
+                : sgm.Match(sample.left.data(), sample.right.data(), disparity.data(), null_stream);
+        }
+        if (!is_matched) {
+            LOG(ERROR) << "benchmark: match failed for " << sample.name << " / " << preset.name;
+            return result;
+        }
+        times.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+    }
+    if (preset.is_fixed_point) {
+        for (int k = 0; k < image_size; k++) {
+            disparity[k] = (disparity_16[k] == sgm_util::Invalid_Int16)
+                           ? Invalid_Float : static_cast<float>(disparity_16[k]) / sgm_util::Disp_Scale;
+        }
+    }
+    std::sort(times.begin(), times.end());
+    result.time_ms = times[times.size() / 2];
+    result.throughput = static_cast<double>(image_size) * result.disp_range / 1e6 / (result.time_ms / 1000.0);
+
+    // 只统计真值有效的像素
+    int num_gt = 0, num_valid = 0, num_bad_1 = 0, num_bad_2 = 0;
+    double error_sum = 0;
+    for (int k = 0; k < image_size; k++) {
+        if (sample.ground_truth[k] == Invalid_Float) {
+            continue;
+        }
+        num_gt++;
+        if (!std::isfinite(disparity[k])) {
+            continue;
+        }
+        num_valid++;
+        const double error = std::fabs(disparity[k] - sample.ground_truth[k]);
+        error_sum += error;
+        num_bad_1 += error > 1.0 ? 1 : 0;
+        num_bad_2 += error > 2.0 ? 1 : 0;
+    }
+    result.bad_1 = num_valid > 0 ? static_cast<double>(num_bad_1) / num_valid : 0;
+    result.bad_2 = num_valid > 0 ? static_cast<double>(num_bad_2) / num_valid : 0;
+    result.invalid = num_gt > 0 ? 1.0 - static_cast<double>(num_valid) / num_gt : 0;
+    result.mae = num_valid > 0 ? error_sum / num_valid : 0;
+    result.is_ok = true;
+    return result;
+}
+
+static std::string JsonString(const std::string& str) {
+    std::string escaped = "\"";
+    for (const char& c : str) {
+        if (c == '"' || c == '\\') {
+            escaped += '\\';
+        }
+        escaped += c;
+    }
+    return escaped + "\"";
+}
+
+// 结果按数据集、预设的固定顺序逐行输出，便于不同版本间直接diff
+static bool WriteJson(const std::string& path, const std::vector<BenchmarkResult>& results,
+                      const std::vector<const Preset*>& presets) {
+    std::ofstream file(path);
+    if (!file.is_open()) {
+        return false;
+    }
+    file << std::fixed;
+    file << "{\n  \"repeat\": " << std::max(1, FLAGS_repeat) << ",\n  \"results\": [\n";
+    for (std::size_t k = 0; k < results.size(); k++) {
+        const auto& result = results[k];
+        file << "    {\"dataset\": " << JsonString(result.dataset) << ", \"preset\": " << JsonString(result.preset)
+             << ", \"ok\": " << (result.is_ok ? "true" : "false")
+             << ", \"width\": " << result.width << ", \"height\": " << result.height << ", \"disp_range\": " << result.disp_range
+             << std::setprecision(3) << ", \"time_ms\": " << result.time_ms << ", \"mpix_d_per_s\": " << result.throughput
+             << std::setprecision(5) << ", \"bad_1\": " << result.bad_1 << ", \"bad_2\": " << result.bad_2
+             << ", \"invalid\": " << result.invalid << ", \"mae\": " << result.mae << "}"
+             << (k + 1 < results.size() ? ",\n" : "\n");
+    }
+    file << "  ],\n  \"summary\": [\n";
+    for (std::size_t p = 0; p < presets.size(); p++) {
+        // 各数据集的平均值
+        double time_ms = 0, throughput = 0, bad_2 = 0, invalid = 0;
+        int count = 0;
+        for (const auto& result : results) {
+            if (result.preset == presets[p]->name && result.is_ok) {
+                time_ms += result.time_ms;
+                throughput += result.throughput;
+                bad_2 += result.bad_2;
+                invalid += result.invalid;
+                count++;
+            }
+        }
+        const double n = std::max(count, 1);
+        file << "    {\"preset\": " << JsonString(presets[p]->name) << ", \"datasets\": " << count
+             << std::setprecision(3) << ", \"time_ms\": " << time_ms / n << ", \"mpix_d_per_s\": " << throughput / n
+             << std::setprecision(5) << ", \"bad_2\": " << bad_2 / n << ", \"invalid\": " << invalid / n << "}"
+             << (p + 1 < presets.size() ? ",\n" : "\n");
+    }
+    file << "  ]\n}\n";
+    return file.good();
+}
+
+int main(int argc, char* argv[]) {
+    google::ParseCommandLineFlags(&argc, &argv, true);
+    google::InitGoogleLogging(argv[0]);
+    FLAGS_logtostderr = true;
+
+    if (FLAGS_list_presets) {
+        for (const auto& preset : Presets) {
+            std::cout << std::left << std::setw(16) << preset.name << preset.description << "\n";
+        }
+        return 0;
+    }
+
+    // 预设
+    std::vector<const Preset*> presets;
+    std::stringstream preset_stream(FLAGS_presets);
+    std::string name;
+    while (std::getline(preset_stream, name, ',')) {
+        const Preset* found = nullptr;
+        for (const auto& preset : Presets) {
+            if (name == preset.name) {
+                found = &preset;
+            }
+        }
+        if (found == nullptr) {
+            LOG(ERROR) << "benchmark: unknown preset " << name << ", see --list_presets";
+            return -1;
+        }
+        presets.push_back(found);
+    }
+
+    // 数据集及合成像对
+    std::vector<StereoSample> samples;
+    std::stringstream dataset_stream(FLAGS_datasets);
+    std::string dir;
+    while (std::getline(dataset_stream, dir, ',')) {
+        StereoSample sample;
+        if (!LoadDataset(dir, sample)) {
+            return -1;
+        }
+        samples.push_back(std::move(sample));
+    }
+    for (int k = 0; k < FLAGS_synthetic; k++) {
+        samples.push_back(MakeSyntheticSample(k, FLAGS_synthetic_height, FLAGS_synthetic_width));
+    }
+    if (samples.empty() || presets.empty()) {
+        LOG(ERROR) << "benchmark: no dataset or preset";
+        return -1;
+    }
+
+    // 匹配日志只保留警告以上
+    const int log_level = FLAGS_minloglevel;
+    std::vector<BenchmarkResult> results;
+    bool is_all_ok = true;
+    for (const auto& sample : samples) {
+        for (const auto preset : presets) {
+            FLAGS_minloglevel = google::GLOG_WARNING;
+            const BenchmarkResult result = RunBenchmark(sample, *preset);
+            FLAGS_minloglevel = log_level;
+            is_all_ok = is_all_ok && result.is_ok;
+            results.push_back(result);
+            LOG(INFO) << std::fixed << std::setprecision(2) << sample.name << " / " << preset->name
+                      << ": " << result.time_ms << "ms, " << result.throughput << " Mpix*D/s, bad1 "
+                      << 100 * result.bad_1 << "%, bad2 " << 100 * result.bad_2 << "%, invalid "
+                      << 100 * result.invalid << "%, mae " << result.mae;
+        }
+    }
+
+    if (!WriteJson(FLAGS_output_json, results, presets)) {
+        LOG(ERROR) << "benchmark: failed to write " << FLAGS_output_json;
+        return -1;
+    }
+    LOG(INFO) << "benchmark: results saved to " << FLAGS_output_json;
+
+    google::ShutDownCommandLineFlags();
+    google::ShutdownGoogleLogging();
+    return is_all_ok ? 0 : -1;
+}
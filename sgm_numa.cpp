@@ -0,0 +1,112 @@
+/*
+ * =====================================================================================
+ *
+ *       Filename:  sgm_numa.cpp
+ *
+ *    Description:  numa topology and thread binding of sgm workers impl
+ *
+ *        Version:  1.0
+ *        Created:  10/19/2026 06:12:37 PM
+ *       Revision:  none
+ *       Compiler:  g++
+ *
+ *         Author:  yipeng
+ *   Organization:
+ *
+ * =====================================================================================
+ */
+
+#include "sgm_numa.h"
+
+#include <cstdio>
+#include <vector>
+#include <string>
+#include <sstream>
+#include <fstream>
+#include <algorithm>
+
+#ifdef SGM_USE_LIBNUMA
+#include <numa.h>
+#elif defined(__linux__)
+#include <sched.h>
+#endif
+
+#if !defined(SGM_USE_LIBNUMA) && defined(__linux__)
+// 读取sysfs中的编号列表（如"0-3,8-11"）
+static std::vector<int> ReadIdList(const std::string& path) {
+    std::vector<int> ids;
+    std::ifstream ifs(path);
+    std::string text;
+    if (!std::getline(ifs, text)) {
+        return ids;
+    }
+    std::stringstream stream(text);
+    std::string range;
+    while (std::getline(stream, range, ',')) {
+        int first = 0, last = 0;
+        const int num = sscanf(range.c_str(), "%d-%d", &first, &last);
+        if (num < 1) {
+            continue;
+        }
+        for (int id = first; id <= (num == 1 ? first : last); id++) {
+            ids.push_back(id);
+        }
+    }
+    return ids;
+}
+#endif
+
+// 在线节点的系统节点号，进程内只获取一次
+static const std::vector<int>& OnlineNodes() {
+    static const std::vector<int> nodes = []() {
+        std::vector<int> ids;
+#ifdef SGM_USE_LIBNUMA
+        if (numa_available() >= 0) {
+            for (int id = 0; id <= numa_max_node(); id++) {
+                if (numa_bitmask_isbitset(numa_all_nodes_ptr, id)) {
+                    ids.push_back(id);
+                }
+            }
+        }
+#elif defined(__linux__)
+        ids = ReadIdList("/sys/devices/system/node/online");
+#endif
+        return ids;
+    }();
+    return nodes;
+}
+
+int sgm_numa::NumNodes() {
+    return std::max(1, static_cast<int>(OnlineNodes().size()));
+}
+
+bool sgm_numa::BindThreadToNode(const int& node) {
+    const auto& nodes = OnlineNodes();
+    if (nodes.size() < 2 || node < 0) {
+        return false;
+    }
+    const int id = nodes[node % nodes.size()];
+#ifdef SGM_USE_LIBNUMA
+    // 绑定到节点的CPU，并优先在本节点分配内存
+    if (numa_run_on_node(id) != 0) {
+        return false;
+    }
+    numa_set_preferred(id);
+    return true;
+#elif defined(__linux__)
+    const std::vector<int> cpus = ReadIdList("/sys/devices/system/node/node" + std::to_string(id) + "/cpulist");
+    cpu_set_t cpu_set;
+    CPU_ZERO(&cpu_set);
+    int num_cpus = 0;
+    for (const int& cpu : cpus) {
+        if (cpu >= 0 && cpu < CPU_SETSIZE) {
+            CPU_SET(cpu, &cpu_set);
+            num_cpus++;
+        }
+    }
+    // 只影响调用线程
+    return num_cpus > 0 && sched_setaffinity(0, sizeof(cpu_set), &cpu_set) == 0;
+#else
+    return false;
+#endif
+}
@@ -0,0 +1,37 @@
+/*
+ * =====================================================================================
+ *
+ *       Filename:  sgm_numa.h
+ *
+ *    Description:  numa topology and thread binding of sgm workers
+ *
+ *        Version:  1.0
+ *        Created:  10/19/2026 06:12:37 PM
+ *       Revision:  none
+ *       Compiler:  g++
+ *
+ *         Author:  yipeng
+ *   Organization:
+ *
+ * =====================================================================================
+ */
+
+#pragma once
+
+/**
+ * \brief NUMA拓扑与线程绑定：编译时定义SGM_USE_LIBNUMA（并链接libnuma）时使用libnuma，
+ *        否则在Linux上读取/sys/devices/system/node并用sched_setaffinity绑定，其他平台视为单节点
+ *        节点按在线节点的顺序编号为0~NumNodes()-1，与系统节点号不一定相同
+ */
+namespace sgm_numa {
+	/** \brief 在线NUMA节点数，无法获取时为1 */
+	int NumNodes();
+
+	/** \brief 把调用线程绑定到第node个节点的CPU上，单节点或绑定失败时返回false（线程照常运行） */
+	bool BindThreadToNode(const int& node);
+
+	/** \brief num_workers个工作线程按编号连续分配到num_nodes个节点，返回第worker个线程所在的节点 */
+	inline int WorkerNode(const int& worker, const int& num_workers, const int& num_nodes) {
+		return worker * num_nodes / num_workers;
+	}
+}
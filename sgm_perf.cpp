@@ -0,0 +1,172 @@
+/*
+ * =====================================================================================
+ *
+ *       Filename:  sgm_perf.cpp
+ *
+ *    Description:  hardware performance counters of sgm stages impl
+ *
+ *        Version:  1.0
+ *        Created:  10/19/2026 03:05:41 PM
+ *       Revision:  none
+ *       Compiler:  g++
+ *
+ *         Author:  yipeng
+ *   Organization:
+ *
+ * =====================================================================================
+ */
+
+#include "sgm_perf.h"
+
+#include <cstring>
+#include <sstream>
+#include <iomanip>
+
+#ifdef __linux__
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+// 末级缓存缺失按缓存行大小换算为字节数
+static constexpr int Cache_Line_Bytes = 64;
+
+#ifdef __linux__
+// 打开调用线程在任意CPU上的用户态计数器
+// inherit：计数器打开后调用线程创建的线程继承计数器，开关、清零随父计数器，读数包含这些线程（存活的和已退出的）的计数，
+// 各阶段内创建的聚合、一致性检查、NUMA工作线程的计数因此计入该阶段
+static int OpenCounter(const std::uint32_t& type, const std::uint64_t& config) {
+    perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.inherit = 1;
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    return static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+}
+#endif
+
+double PerfCounters::Sample::IPC() const {
+    if (value[Cycles] <= 0 || value[Instructions] < 0) {
+        return -1;
+    }
+    return static_cast<double>(value[Instructions]) / value[Cycles];
+}
+
+PerfCounters::PerfCounters() {
+    for (auto& fd : fds_) {
+        fd = -1;
+    }
+}
+
+PerfCounters::~PerfCounters() {
+    Close();
+}
+
+bool PerfCounters::Open() {
+    Close();
+#ifdef __linux__
+    const std::uint64_t dtlb_read_miss = PERF_COUNT_HW_CACHE_DTLB
+                                         | (PERF_COUNT_HW_CACHE_OP_READ << 8)
+                                         | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    fds_[Cycles] = OpenCounter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+    fds_[Instructions] = OpenCounter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+    fds_[LLC_Misses] = OpenCounter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+    fds_[Branch_Misses] = OpenCounter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES);
+    fds_[DTLB_Misses] = OpenCounter(PERF_TYPE_HW_CACHE, dtlb_read_miss);
+    for (auto& fd : fds_) {
+        fd = (fd < 0) ? -1 : fd;
+    }
+#endif
+    return IsOpen();
+}
+
+void PerfCounters::Close() {
+    for (auto& fd : fds_) {
+#ifdef __linux__
+        if (fd >= 0) {
+            close(fd);
+        }
+#endif
+        fd = -1;
+    }
+}
+
+bool PerfCounters::IsOpen() const {
+    for (const auto& fd : fds_) {
+        if (fd >= 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void PerfCounters::Start() {
+#ifdef __linux__
+    for (const auto& fd : fds_) {
+        if (fd >= 0) {
+            ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+            ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+#endif
+}
+
+void PerfCounters::Stop(Sample* sample) {
+    *sample = Sample();
+#ifdef __linux__
+    for (int k = 0; k < Num_Counters; k++) {
+        if (fds_[k] < 0) {
+            continue;
+        }
+        ioctl(fds_[k], PERF_EVENT_IOC_DISABLE, 0);
+        // 计数值、启用时间、实际运行时间
+        std::uint64_t values[3] = { 0, 0, 0 };
+        if (read(fds_[k], values, sizeof(values)) != static_cast<ssize_t>(sizeof(values))) {
+            continue;
+        }
+        if (values[2] == 0) {
+            // 未被调度到PMU上，无有效计数
+            continue;
+        }
+        sample->value[k] = (values[2] < values[1])
+                           ? static_cast<std::int64_t>(static_cast<double>(values[0]) * values[1] / values[2])
+                           : static_cast<std::int64_t>(values[0]);
+    }
+#endif
+}
+
+const char* PerfCounters::Name(const Counter& counter) {
+    static const char* names[Num_Counters] = { "cycles", "instructions", "llc_misses", "branch_misses", "dtlb_misses" };
+    return names[counter];
+}
+
+std::string PerfCounters::Format(const Sample& sample, const double& pixels) {
+    std::ostringstream stream;
+    stream << std::fixed << std::setprecision(3);
+    auto per_pixel = [&](const char* label, const Counter& counter, const double& scale) {
+        stream << ", " << label << " ";
+        if (sample.value[counter] < 0 || pixels <= 0) {
+            stream << "n/a";
+        } else {
+            stream << sample.value[counter] * scale / pixels;
+        }
+    };
+
+    stream << "IPC ";
+    if (sample.IPC() < 0) {
+        stream << "n/a";
+    } else {
+        stream << sample.IPC();
+    }
+    per_pixel("cycles/px", Cycles, 1.0);
+    per_pixel("llc_miss_bytes/px", LLC_Misses, Cache_Line_Bytes);
+    per_pixel("branch_misses/px", Branch_Misses, 1.0);
+    per_pixel("dtlb_misses/px", DTLB_Misses, 1.0);
+    return stream.str();
+}
@@ -0,0 +1,88 @@
+/*
+ * =====================================================================================
+ *
+ *       Filename:  sgm_perf.h
+ *
+ *    Description:  hardware performance counters of sgm stages (linux perf_event_open)
+ *
+ *        Version:  1.0
+ *        Created:  10/19/2026 03:05:41 PM
+ *       Revision:  none
+ *       Compiler:  g++
+ *
+ *         Author:  yipeng
+ *   Organization:
+ *
+ * =====================================================================================
+ */
+
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <string>
+
+/**
+ * \brief 调用线程及其在Open之后创建的线程的硬件性能计数器（周期、指令、末级缓存缺失、分支预测失败、dTLB缺失）
+ *        Open之前已存在的其他线程不计入；在Start/Stop之间仍在运行的线程计入其运行期间的各段计数，跨段运行的线程需在段内结束
+ *        各计数器单独打开，部分计数器不可用（非Linux、权限不足、虚拟机未暴露PMU）时其余计数器照常工作
+ *        只统计用户态，perf_event_paranoid不高于2时普通用户即可使用
+ */
+class PerfCounters {
+public:
+	/** \brief 计数器类型 */
+	enum Counter {
+		Cycles = 0,
+		Instructions,
+		LLC_Misses,
+		Branch_Misses,
+		DTLB_Misses,
+		Num_Counters
+	};
+
+	/** \brief 一段代码的计数值，不可用的计数器为-1 */
+	struct Sample {
+		std::int64_t value[Num_Counters];
+
+		Sample() { for (auto& v : value) { v = -1; } }
+
+		/** \brief 每周期指令数，不可用时为负值 */
+		double IPC() const;
+	};
+
+	PerfCounters();
+	~PerfCounters();
+
+	PerfCounters(const PerfCounters&) = delete;
+	PerfCounters& operator=(const PerfCounters&) = delete;
+
+public:
+	/** \brief 打开计数器，至少一个计数器可用时返回true */
+	bool Open();
+
+	/** \brief 关闭计数器 */
+	void Close();
+
+	/** \brief 是否有可用的计数器 */
+	bool IsOpen() const;
+
+	/** \brief 计数器清零并开始计数 */
+	void Start();
+
+	/** \brief 停止计数并读取计数值（计数器分时复用时按实际运行时间比例放大） */
+	void Stop(Sample* sample);
+
+	/** \brief 计数器名称 */
+	static const char* Name(const Counter& counter);
+
+	/**
+	 * \brief 格式化计数值：IPC、每像素周期数、每像素末级缓存缺失字节数（缺失次数*缓存行大小）、
+	 *        每像素分支预测失败和dTLB缺失次数，不可用的项输出n/a
+	 * \param sample	输入，计数值
+	 * \param pixels	输入，该阶段处理的像素数
+	 */
+	static std::string Format(const Sample& sample, const double& pixels);
+
+private:
+	/** \brief 各计数器的文件描述符，-1为不可用 */
+	int fds_[Num_Counters];
+};
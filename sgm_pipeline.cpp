@@ -0,0 +1,111 @@
+/*
+ * =====================================================================================
+ *
+ *       Filename:  sgm_pipeline.cpp
+ *
+ *    Description:  frame pipeline of sgm task graphs on a work-stealing pool impl
+ *
+ *        Version:  1.0
+ *        Created:  10/19/2026 07:58:21 PM
+ *       Revision:  none
+ *       Compiler:  g++
+ *
+ *         Author:  yipeng
+ *   Organization:
+ *
+ * =====================================================================================
+ */
+
+#include "sgm_pipeline.h"
+
+#include <glog/logging.h>
+
+// 流水线深度上限
+static constexpr int Max_Pipeline_Depth = 8;
+
+SGMPipeline::SGMPipeline(): next_frame_(0), next_delivery_(0) { }
+
+SGMPipeline::~SGMPipeline() {
+    Flush();
+    scheduler_.reset();
+}
+
+bool SGMPipeline::Initialize(const int& height, const int& width, const SemiGlobalMatching::SGMOption& option,
+                             const int& num_workers, const int& depth, const FrameCallback& callback) {
+    Flush();
+    scheduler_.reset();
+    slots_.clear();
+    if (depth < 1 || depth > Max_Pipeline_Depth || num_workers < 1) {
+        LOG(ERROR) << "流水线初始化失败：深度需为1~" << Max_Pipeline_Depth << "，工作线程数需大于0";
+        return false;
+    }
+
+    // 任务图中的并行由线程池完成，实例内不再开线程
+    SemiGlobalMatching::SGMOption slot_option = option;
+    slot_option.num_threads = 1;
+    for (int k = 0; k < depth; k++) {
+        std::unique_ptr<Slot> slot(new Slot());
+        if (!slot->sgm.Initialize(height, width, slot_option)) {
+            slots_.clear();
+            return false;
+        }
+        slots_.push_back(std::move(slot));
+    }
+    scheduler_.reset(new TaskScheduler(num_workers));
+    callback_ = callback;
+    next_frame_ = 0;
+    next_delivery_ = 0;
+    return true;
+}
+
+int SGMPipeline::Submit(const std::uint8_t* left_image, const std::uint8_t* right_image, float* left_disp,
+                        const std::uint8_t* valid_mask) {
+    if (slots_.empty()) {
+        return -1;
+    }
+
+    // 帧按编号轮流使用各实例，实例上一帧的回调返回后才可复用
+    std::unique_lock<std::mutex> lock(mutex_);
+    const int frame = next_frame_;
+    Slot* slot = slots_[frame % slots_.size()].get();
+    slot_free_.wait(lock, [slot]() { return !slot->is_busy; });
+
+    std::shared_ptr<TaskGraph> graph(new TaskGraph());
+    if (!slot->sgm.BuildMatchGraph(left_image, right_image, left_disp, valid_mask, graph.get(), &slot->is_success)) {
+        return -1;
+    }
+    slot->is_busy = true;
+    slot->is_done = false;
+    slot->frame = frame;
+    slot->submit_time = std::chrono::steady_clock::now();
+    next_frame_++;
+    lock.unlock();
+
+    scheduler_->Submit(graph, [this, slot]() { OnFrameDone(slot); });
+    return frame;
+}
+
+void SGMPipeline::OnFrameDone(Slot* slot) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    slot->latency = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - slot->submit_time).count();
+    slot->is_done = true;
+
+    // 按帧号顺序回调，后提交的帧先完成时等前面的帧完成后一并回调
+    while (next_delivery_ < next_frame_) {
+        Slot* next = slots_[next_delivery_ % slots_.size()].get();
+        if (!next->is_busy || !next->is_done || next->frame != next_delivery_) {
+            break;
+        }
+        if (callback_) {
+            callback_(next->frame, next->is_success, next->latency);
+        }
+        next->is_busy = false;
+        next_delivery_++;
+    }
+    slot_free_.notify_all();
+}
+
+void SGMPipeline::Flush() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    slot_free_.wait(lock, [this]() { return next_delivery_ == next_frame_; });
+}
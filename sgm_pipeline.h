@@ -0,0 +1,108 @@
+/*
+ * =====================================================================================
+ *
+ *       Filename:  sgm_pipeline.h
+ *
+ *    Description:  frame pipeline of sgm task graphs on a work-stealing pool
+ *
+ *        Version:  1.0
+ *        Created:  10/19/2026 07:58:21 PM
+ *       Revision:  none
+ *       Compiler:  g++
+ *
+ *         Author:  yipeng
+ *   Organization:
+ *
+ * =====================================================================================
+ */
+
+#pragma once
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "semi_global_matching.h"
+#include "sgm_scheduler.h"
+
+/**
+ * \brief 视频流匹配流水线：每帧建成任务图（见SemiGlobalMatching::BuildMatchGraph），在同一个工作窃取线程池上执行，
+ *        下一帧的census、代价与上一帧的聚合、后处理交错执行
+ *        每个在途帧占用一个SGM实例（帧状态按流水线深度多缓冲，内存为单实例的depth倍），
+ *        在途帧数达到深度时Submit阻塞，帧延迟不超过depth帧的处理时间
+ */
+class SGMPipeline {
+public:
+	/**
+	 * \brief 帧完成回调，在工作线程中按帧号顺序调用，回调中不能调用Submit/Flush
+	 *        frame为帧号（从0开始），is_success为匹配是否成功，latency为提交到完成的耗时（毫秒）
+	 */
+	typedef std::function<void(const int& frame, const bool& is_success, const double& latency)> FrameCallback;
+
+	SGMPipeline();
+
+	/** \brief 等待在途帧完成 */
+	~SGMPipeline();
+
+	SGMPipeline(const SGMPipeline&) = delete;
+	SGMPipeline& operator=(const SGMPipeline&) = delete;
+
+	/**
+	 * \brief 初始化，创建depth个SGM实例和线程池，已初始化时先等待在途帧完成
+	 * \param height		输入，核线像对影像高
+	 * \param width			输入，核线像对影像宽
+	 * \param option		输入，SemiGlobalMatching参数（num_threads不使用，并行度由线程池决定）
+	 * \param num_workers	输入，线程池的工作线程数
+	 * \param depth			输入，流水线深度（同时在途的帧数），1~8
+	 * \param callback		输入，帧完成回调，可为空
+	 */
+	bool Initialize(const int& height, const int& width, const SemiGlobalMatching::SGMOption& option,
+	                const int& num_workers, const int& depth, const FrameCallback& callback);
+
+	/**
+	 * \brief 提交一帧，在途帧数达到流水线深度时阻塞到最早的帧完成
+	 *        影像、掩膜和视差图需保持有效，直到该帧的回调返回（或Flush返回）
+	 * \param left_image	输入，左影像数据指针
+	 * \param right_image	输入，右影像数据指针
+	 * \param left_disp		输出，左影像视差图指针，预先分配输出视差图尺寸（见SemiGlobalMatching::SGMOption::output_stride）的内存空间
+	 * \param valid_mask	输入，有效像素掩膜指针，可为nullptr
+	 * \return 帧号，失败时为-1
+	 */
+	int Submit(const std::uint8_t* left_image, const std::uint8_t* right_image, float* left_disp,
+	           const std::uint8_t* valid_mask = nullptr);
+
+	/** \brief 等待所有已提交的帧完成 */
+	void Flush();
+
+	/** \brief 流水线深度 */
+	int Depth() const { return static_cast<int>(slots_.size()); }
+
+private:
+	/** \brief 一个在途帧的状态 */
+	struct Slot {
+		SemiGlobalMatching sgm;
+		bool is_busy;			// 已提交、回调尚未返回
+		bool is_done;			// 任务图已执行完
+		bool is_success;
+		int frame;
+		std::chrono::steady_clock::time_point submit_time;
+		double latency;			// 毫秒
+
+		Slot(): is_busy(false), is_done(false), is_success(false), frame(-1), latency(0) { }
+	};
+
+	/** \brief 一帧的任务图执行完：按帧号顺序回调已完成的帧并释放其实例 */
+	void OnFrameDone(Slot* slot);
+
+	std::unique_ptr<TaskScheduler> scheduler_;
+	std::vector<std::unique_ptr<Slot>> slots_;
+	FrameCallback callback_;
+
+	std::mutex mutex_;
+	std::condition_variable slot_free_;
+	int next_frame_;		// 下一个提交的帧号
+	int next_delivery_;		// 下一个回调的帧号
+};
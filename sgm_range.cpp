@@ -0,0 +1,170 @@
+/*
+ * =====================================================================================
+ *
+ *       Filename:  sgm_range.cpp
+ *
+ *    Description:  disparity range estimation from a quick decimated sgm pass impl
+ *
+ *        Version:  1.0
+ *        Created:  10/19/2026 09:36:52 PM
+ *       Revision:  none
+ *       Compiler:  g++
+ *
+ *         Author:  yipeng
+ *   Organization:
+ *
+ * =====================================================================================
+ */
+
+#include "sgm_range.h"
+
+#include <cmath>
+#include <chrono>
+#include <fstream>
+#include <vector>
+#include <algorithm>
+
+#include <glog/logging.h>
+
+// 影像缩小倍数上限
+static constexpr int Max_Decimation = 8;
+
+// 影像按factor x factor块取均值缩小，比双线性缩放少混叠，缩小后的census更稳定
+static void DecimateImage(const std::uint8_t* src, const int& src_width, const int& factor,
+                          std::uint8_t* dst, const int& dst_height, const int& dst_width) {
+    const int area = factor * factor;
+    std::vector<int> row_sum(dst_width);
+    for (int i = 0; i < dst_height; i++) {
+        std::fill(row_sum.begin(), row_sum.end(), 0);
+        for (int r = 0; r < factor; r++) {
+            const std::uint8_t* src_row = src + (i * factor + r) * src_width;
+            for (int j = 0; j < dst_width; j++) {
+                for (int c = 0; c < factor; c++) {
+                    row_sum[j] += src_row[j * factor + c];
+                }
+            }
+        }
+        for (int j = 0; j < dst_width; j++) {
+            dst[i * dst_width + j] = static_cast<std::uint8_t>((row_sum[j] + area / 2) / area);
+        }
+    }
+}
+
+namespace sgm_range {
+
+bool EstimateDisparityRange(const std::uint8_t* left_image, const std::uint8_t* right_image,
+                            const int& height, const int& width, const RangeOption& option, RangeEstimate* estimate) {
+    const auto start = std::chrono::steady_clock::now();
+    const auto& base_option = option.sgm_option;
+    const int min_allowed = base_option.min_disparity;
+    const int max_allowed = base_option.max_disparity;
+    estimate->min_disparity = min_allowed;
+    estimate->max_disparity = max_allowed;
+    estimate->valid_ratio = 0;
+    if (left_image == nullptr || right_image == nullptr || height <= 0 || width <= 0 || max_allowed <= min_allowed) {
+        return false;
+    }
+    if (option.decimation < 1 || option.decimation > Max_Decimation || base_option.pixel_bits != 8) {
+        LOG(ERROR) << "视差范围估计失败：缩小倍数需为1~" << Max_Decimation << "，影像需为8位";
+        return false;
+    }
+    if (height < option.decimation || width < option.decimation) {
+        LOG(WARNING) << "视差范围估计：影像" << width << "x" << height << "小于缩小倍数" << option.decimation
+                     << "，沿用[" << min_allowed << ", " << max_allowed << ")";
+        return false;
+    }
+
+    // 缩小影像，视差范围和ROI随之缩小
+    const int small_height = height / option.decimation;
+    const int small_width = width / option.decimation;
+    const float scale = static_cast<float>(small_width) / width;
+    SemiGlobalMatching::SGMOption small_option = base_option;
+    small_option.min_disparity = static_cast<int>(std::floor(min_allowed * scale));
+    small_option.max_disparity = std::max(small_option.min_disparity + 1, static_cast<int>(std::ceil(max_allowed * scale)));
+    small_option.roi_x = static_cast<int>(base_option.roi_x * scale);
+    small_option.roi_y = static_cast<int>(base_option.roi_y * scale);
+    small_option.roi_width = std::min(static_cast<int>(base_option.roi_width * scale), small_width - small_option.roi_x);
+    small_option.roi_height = std::min(static_cast<int>(base_option.roi_height * scale), small_height - small_option.roi_y);
+    // 只需要可靠的视差，不填充、不剔除小连通区
+    small_option.num_paths = 4;
+    small_option.is_check_lr = true;
+    small_option.is_check_unique = true;
+    small_option.is_remove_speckles = false;
+    small_option.is_fill_holes = false;
+    small_option.execution_strategy = SemiGlobalMatching::ExecutionAuto;
+    small_option.is_numa_aware = false;
+    small_option.output_stride = 1;
+
+    std::vector<std::uint8_t> small_left(small_height * small_width), small_right(small_height * small_width);
+    const std::uint8_t* match_left = left_image;
+    const std::uint8_t* match_right = right_image;
+    if (small_height != height || small_width != width) {
+        DecimateImage(left_image, width, option.decimation, small_left.data(), small_height, small_width);
+        DecimateImage(right_image, width, option.decimation, small_right.data(), small_height, small_width);
+        match_left = small_left.data();
+        match_right = small_right.data();
+    }
+
+    SemiGlobalMatching sgm;
+    std::vector<float> disparity(small_height * small_width);
+    std::ofstream null_stream;
+    if (!sgm.Initialize(small_height, small_width, small_option)
+            || !sgm.Match(match_left, match_right, disparity.data(), null_stream)) {
+        LOG(ERROR) << "视差范围估计失败：快速匹配失败";
+        return false;
+    }
+
+    // 有效视差换算到全分辨率后按整像素统计直方图，ROI外为无效值
+    const int num_bins = max_allowed - min_allowed;
+    std::vector<int> histogram(num_bins, 0);
+    int num_valid = 0;
+    for (const float& disp : disparity) {
+        if (std::isinf(disp)) {
+            continue;
+        }
+        const int bin = static_cast<int>(std::floor(disp / scale)) - min_allowed;
+        histogram[std::max(0, std::min(num_bins - 1, bin))]++;
+        num_valid++;
+    }
+    const int roi_pixels = (small_option.roi_width > 0 ? small_option.roi_width : small_width)
+                           * (small_option.roi_height > 0 ? small_option.roi_height : small_height);
+    estimate->valid_ratio = static_cast<float>(num_valid) / std::max(1, roi_pixels);
+    estimate->time = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    if (num_valid == 0 || estimate->valid_ratio < option.min_valid_ratio) {
+        LOG(WARNING) << "视差范围估计：有效视差比例" << estimate->valid_ratio << "过低，沿用["
+                     << min_allowed << ", " << max_allowed << ")";
+        return false;
+    }
+
+    // 两端各舍弃outlier_ratio的离群视差
+    const int num_outliers = static_cast<int>(num_valid * option.outlier_ratio);
+    int lower = 0, count = 0;
+    while (lower < num_bins - 1 && count + histogram[lower] <= num_outliers) {
+        count += histogram[lower++];
+    }
+    int upper = num_bins - 1;
+    count = 0;
+    while (upper > lower && count + histogram[upper] <= num_outliers) {
+        count += histogram[upper--];
+    }
+
+    // 加上余量，不足最小宽度时两端对称扩展，不超出允许范围
+    int min_disparity = std::max(min_allowed, min_allowed + lower - option.margin);
+    int max_disparity = std::min(max_allowed, min_allowed + upper + 1 + option.margin);
+    const int min_range = std::min(option.min_range, num_bins);
+    if (max_disparity - min_disparity < min_range) {
+        const int center = (min_disparity + max_disparity) / 2;
+        min_disparity = std::max(min_allowed, std::min(center - min_range / 2, max_allowed - min_range));
+        max_disparity = min_disparity + min_range;
+    }
+    estimate->min_disparity = min_disparity;
+    estimate->max_disparity = max_disparity;
+    estimate->time = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    LOG(INFO) << "视差范围估计：[" << min_disparity << ", " << max_disparity << ")，允许范围["
+              << min_allowed << ", " << max_allowed << ")，有效视差比例" << estimate->valid_ratio
+              << "，耗时" << estimate->time << "ms";
+    return true;
+}
+
+}
@@ -0,0 +1,66 @@
+/*
+ * =====================================================================================
+ *
+ *       Filename:  sgm_range.h
+ *
+ *    Description:  disparity range estimation from a quick decimated sgm pass
+ *
+ *        Version:  1.0
+ *        Created:  10/19/2026 09:36:52 PM
+ *       Revision:  none
+ *       Compiler:  g++
+ *
+ *         Author:  yipeng
+ *   Organization:
+ *
+ * =====================================================================================
+ */
+
+#pragma once
+#include <cstdint>
+
+#include "semi_global_matching.h"
+
+/**
+ * \brief 视差范围自动估计：在缩小的影像上以允许的最大视差范围快速匹配一次（4路径、一致性检查、唯一性约束，无填充），
+ *        按有效视差的直方图去掉两端少量离群值后加上余量，作为正式Initialize/Match的视差范围
+ *        缩小倍数为d时，快速匹配的计算量约为全分辨率匹配的1/(2*d^3)
+ */
+namespace sgm_range {
+	/** \brief 视差范围估计参数 */
+	struct RangeOption {
+		// 快速匹配的SGM参数，min_disparity~max_disparity为允许的最大视差范围，估计结果不超出此范围
+		// 沿用census窗口类型、惩罚项、ROI、线程数等，路径数、后处理和执行策略由估计过程决定
+		SemiGlobalMatching::SGMOption sgm_option;
+
+		int decimation;				// 影像缩小倍数，1~8
+		float outlier_ratio;		// 直方图两端各舍弃的有效视差比例
+		int margin;					// 估计范围两端各扩展的视差（全分辨率像素），应不小于缩小倍数
+		int min_range;				// 估计范围的最小宽度
+		float min_valid_ratio;		// 有效视差占ROI像素的最小比例，低于此比例时认为估计不可靠
+
+		RangeOption(): decimation(4), outlier_ratio(0.005f), margin(8), min_range(16), min_valid_ratio(0.05f) { }
+	};
+
+	/** \brief 视差范围估计结果 */
+	struct RangeEstimate {
+		int min_disparity;			// 估计的最小视差
+		int max_disparity;			// 估计的最大视差（不含），与SGMOption一致
+		float valid_ratio;			// 快速匹配的有效视差占ROI像素的比例
+		double time;				// 估计耗时（毫秒）
+
+		RangeEstimate(): min_disparity(0), max_disparity(0), valid_ratio(0), time(0) { }
+	};
+
+	/**
+	 * \brief 由核线像对估计视差范围，失败或有效视差过少时返回false，estimate中仍为允许的最大视差范围
+	 * \param left_image	输入，左影像数据指针（uint8）
+	 * \param right_image	输入，右影像数据指针（uint8）
+	 * \param height		输入，影像高
+	 * \param width			输入，影像宽
+	 * \param option		输入，估计参数
+	 * \param estimate		输出，估计结果
+	 */
+	bool EstimateDisparityRange(const std::uint8_t* left_image, const std::uint8_t* right_image,
+	                            const int& height, const int& width, const RangeOption& option, RangeEstimate* estimate);
+}
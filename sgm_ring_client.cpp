@@ -0,0 +1,149 @@
+/*
+ * =====================================================================================
+ *
+ *       Filename:  sgm_ring_client.cpp
+ *
+ *    Description:  local test producer for sgm daemon shared-memory ring
+ *
+ *        Version:  1.0
+ *        Created:  10/19/2026 02:20:15 PM
+ *       Revision:  none
+ *       Compiler:  g++
+ *
+ *         Author:  yipeng
+ *   Organization:
+ *
+ * =====================================================================================
+ */
+
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+#include <chrono>
+#include <vector>
+#include <random>
+#include <algorithm>
+
+#include <glog/logging.h>
+#include <gflags/gflags.h>
+
+#include "sgm_shm_ring.h"
+
+DEFINE_string(ring,                         "/sgm_ring",                    "shared-memory ring name of the sgm daemon");
+DEFINE_int32(num_frames,                    100,                            "number of frames to submit");
+DEFINE_int32(shift,                         16,                             "disparity of the synthetic stereo pair");
+DEFINE_bool(shutdown,                       false,                          "ask the daemon to exit after all frames are done");
+
+// 合成像对：随机纹理平滑后作为右影像，左影像为右影像整体平移shift像素，真实视差处处为shift
+static void MakeStereoPair(const int& height, const int& width, const int& shift,
+                           std::vector<std::uint8_t>& left, std::vector<std::uint8_t>& right) {
+    std::mt19937 random(7);
+    std::vector<int> noise(height * width);
+    for (auto& value : noise) {
+        value = static_cast<int>(random() % 256);
+    }
+    right.assign(height * width, 0);
+    left.assign(height * width, 0);
+    for (int i = 0; i < height; i++) {
+        for (int j = 0; j < width; j++) {
+            int sum = 0, count = 0;
+            for (int r = std::max(0, i - 1); r <= std::min(height - 1, i + 1); r++) {
+                for (int c = std::max(0, j - 1); c <= std::min(width - 1, j + 1); c++) {
+                    sum += noise[r * width + c];
+                    count++;
+                }
+            }
+            right[i * width + j] = static_cast<std::uint8_t>(sum / count);
+        }
+    }
+    for (int i = 0; i < height; i++) {
+        for (int j = 0; j < width; j++) {
+            left[i * width + j] = right[i * width + std::max(0, j - shift)];
+        }
+    }
+}
+
+// 视差图有效像素中与真实视差相差不超过1的比例
+static double CorrectRatio(const float* disparity, const int& size, const int& shift) {
+    int num_valid = 0, num_correct = 0;
+    for (int k = 0; k < size; k++) {
+        if (std::isfinite(disparity[k])) {
+            num_valid++;
+            num_correct += std::fabs(disparity[k] - shift) <= 1.0f ? 1 : 0;
+        }
+    }
+    return num_valid > 0 ? static_cast<double>(num_correct) / num_valid : 0.0;
+}
+
+int main(int argc, char* argv[]) {
+    google::ParseCommandLineFlags(&argc, &argv, true);
+    google::InitGoogleLogging(argv[0]);
+    FLAGS_logtostderr = true;
+
+    SharedFrameRing ring;
+    if (!ring.Open(FLAGS_ring)) {
+        LOG(ERROR) << "打开共享内存环形缓冲区失败：" << FLAGS_ring;
+        return -1;
+    }
+    const int height = ring.Height();
+    const int width = ring.Width();
+    const int num_slots = ring.NumSlots();
+    LOG(INFO) << "client: ring " << FLAGS_ring << ", " << width << "x" << height << ", " << num_slots << " slots";
+
+    std::vector<std::uint8_t> left, right;
+    MakeStereoPair(height, width, FLAGS_shift, left, right);
+
+    // 所有槽位保持在途：帧f写入槽位f%num_slots，写入前先取走该槽位上一帧的结果
+    std::vector<std::chrono::steady_clock::time_point> submit_time(num_slots);
+    double latency_sum = 0, latency_max = 0, match_time_sum = 0, correct_sum = 0;
+    int num_done = 0, num_failed = 0;
+    const auto start = std::chrono::steady_clock::now();
+    for (int frame = 0; frame < FLAGS_num_frames + num_slots; frame++) {
+        const int slot = frame % num_slots;
+        if (frame >= num_slots) {
+            if (!ring.WaitState(slot, SharedFrameRing::Slot_Done, -1)) {
+                LOG(ERROR) << "client: daemon exited";
+                return -1;
+            }
+            const auto header = ring.Header(slot);
+            const double latency = std::chrono::duration<double, std::milli>(
+                                       std::chrono::steady_clock::now() - submit_time[slot]).count();
+            latency_sum += latency;
+            latency_max = std::max(latency_max, latency);
+            match_time_sum += header->match_time;
+            if (header->is_matched) {
+                correct_sum += CorrectRatio(ring.Disparity(slot), height * width, FLAGS_shift);
+            } else {
+                num_failed++;
+            }
+            num_done++;
+            ring.SetState(slot, SharedFrameRing::Slot_Free);
+        }
+        if (frame < FLAGS_num_frames) {
+            if (!ring.WaitState(slot, SharedFrameRing::Slot_Free, -1)) {
+                LOG(ERROR) << "client: daemon exited";
+                return -1;
+            }
+            memcpy(ring.LeftImage(slot), left.data(), left.size());
+            memcpy(ring.RightImage(slot), right.data(), right.size());
+            ring.Header(slot)->frame_id = frame;
+            submit_time[slot] = std::chrono::steady_clock::now();
+            ring.SetState(slot, SharedFrameRing::Slot_Ready);
+        }
+    }
+    const double total_time = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    LOG(INFO) << "client: " << num_done << " frames, " << num_failed << " failed, "
+              << num_done / std::max(total_time, 1e-9) << " frames/s, latency avg "
+              << latency_sum / std::max(num_done, 1) << "ms max " << latency_max << "ms, match avg "
+              << match_time_sum / std::max(num_done, 1) << "ms, correct "
+              << 100.0 * correct_sum / std::max(num_done - num_failed, 1) << "%";
+
+    if (FLAGS_shutdown) {
+        ring.Shutdown();
+    }
+
+    google::ShutDownCommandLineFlags();
+    google::ShutdownGoogleLogging();
+    return num_failed == 0 ? 0 : -1;
+}
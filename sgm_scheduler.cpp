@@ -0,0 +1,163 @@
+/*
+ * =====================================================================================
+ *
+ *       Filename:  sgm_scheduler.cpp
+ *
+ *    Description:  task graph and work-stealing thread pool for pipelined sgm stages impl
+ *
+ *        Version:  1.0
+ *        Created:  10/19/2026 07:26:04 PM
+ *       Revision:  none
+ *       Compiler:  g++
+ *
+ *         Author:  yipeng
+ *   Organization:
+ *
+ * =====================================================================================
+ */
+
+#include "sgm_scheduler.h"
+
+#include <cassert>
+#include <string>
+#include <algorithm>
+
+#include "sgm_trace.h"
+
+TaskGraph::TaskGraph(): num_remaining_(0) { }
+
+int TaskGraph::AddTask(const char* name, const int& arg, const std::function<void()>& function) {
+    std::unique_ptr<Task> task(new Task());
+    task->name = name;
+    task->arg = arg;
+    task->function = function;
+    task->num_predecessors = 0;
+    task->num_pending.store(0);
+    tasks_.push_back(std::move(task));
+    return static_cast<int>(tasks_.size()) - 1;
+}
+
+void TaskGraph::AddDependency(const int& before, const int& after) {
+    assert(before >= 0 && before < NumTasks() && after >= 0 && after < NumTasks() && before != after);
+    tasks_[before]->successors.push_back(after);
+    tasks_[after]->num_predecessors++;
+}
+
+TaskScheduler::TaskScheduler(const int& num_workers)
+    : num_queued_(0), next_queue_(0), is_stopping_(false) {
+    const int count = std::max(1, num_workers);
+    for (int k = 0; k < count; k++) {
+        queues_.emplace_back(new WorkerQueue());
+    }
+    for (int k = 0; k < count; k++) {
+        workers_.emplace_back([this, k]() { WorkerLoop(k); });
+    }
+}
+
+TaskScheduler::~TaskScheduler() {
+    {
+        std::lock_guard<std::mutex> lock(sleep_mutex_);
+        is_stopping_ = true;
+    }
+    wake_.notify_all();
+    for (auto& thread : workers_) {
+        thread.join();
+    }
+}
+
+void TaskScheduler::Submit(const std::shared_ptr<TaskGraph>& graph, const std::function<void()>& on_complete) {
+    if (graph->tasks_.empty()) {
+        if (on_complete) {
+            on_complete();
+        }
+        return;
+    }
+    graph->on_complete_ = on_complete;
+    graph->self_ = graph;
+    graph->num_remaining_.store(graph->NumTasks());
+    for (auto& task : graph->tasks_) {
+        task->num_pending.store(task->num_predecessors);
+    }
+    // 无前驱的任务轮流放入各队列，由各工作线程分头执行
+    for (int k = 0; k < graph->NumTasks(); k++) {
+        if (graph->tasks_[k]->num_predecessors == 0) {
+            Push(static_cast<int>(next_queue_++ % queues_.size()), Item{ graph.get(), k });
+        }
+    }
+}
+
+void TaskScheduler::WorkerLoop(const int& worker) {
+    if (sgm_trace::IsEnabled()) {
+        sgm_trace::SetThreadName("sgm scheduler worker " + std::to_string(worker));
+    }
+    Item item;
+    while (true) {
+        if (Pop(worker, &item)) {
+            num_queued_--;
+            Execute(worker, item);
+            continue;
+        }
+        // 没有可取的任务时休眠，Push在加锁后唤醒，不会漏掉唤醒
+        std::unique_lock<std::mutex> lock(sleep_mutex_);
+        wake_.wait(lock, [this]() { return is_stopping_ || num_queued_.load() > 0; });
+        if (is_stopping_ && num_queued_.load() == 0) {
+            return;
+        }
+    }
+}
+
+void TaskScheduler::Push(const int& worker, const Item& item) {
+    {
+        std::lock_guard<std::mutex> lock(queues_[worker]->mutex);
+        queues_[worker]->items.push_back(item);
+    }
+    num_queued_++;
+    {
+        std::lock_guard<std::mutex> lock(sleep_mutex_);
+    }
+    wake_.notify_one();
+}
+
+bool TaskScheduler::Pop(const int& worker, Item* item) {
+    {
+        WorkerQueue& queue = *queues_[worker];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (!queue.items.empty()) {
+            *item = queue.items.back();
+            queue.items.pop_back();
+            return true;
+        }
+    }
+    const int num_queues = static_cast<int>(queues_.size());
+    for (int k = 1; k < num_queues; k++) {
+        WorkerQueue& victim = *queues_[(worker + k) % num_queues];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.items.empty()) {
+            *item = victim.items.front();
+            victim.items.pop_front();
+            return true;
+        }
+    }
+    return false;
+}
+
+void TaskScheduler::Execute(const int& worker, const Item& item) {
+    TaskGraph* graph = item.graph;
+    TaskGraph::Task& task = *graph->tasks_[item.task];
+    {
+        sgm_trace::Scope trace(task.name, task.arg);
+        task.function();
+    }
+    for (const int& successor : task.successors) {
+        if (--graph->tasks_[successor]->num_pending == 0) {
+            Push(worker, Item{ graph, successor });
+        }
+    }
+    if (--graph->num_remaining_ == 0) {
+        // 最后一个任务：回调后释放任务图
+        std::shared_ptr<TaskGraph> keep = std::move(graph->self_);
+        if (keep->on_complete_) {
+            keep->on_complete_();
+        }
+    }
+}
@@ -0,0 +1,130 @@
+/*
+ * =====================================================================================
+ *
+ *       Filename:  sgm_scheduler.h
+ *
+ *    Description:  task graph and work-stealing thread pool for pipelined sgm stages
+ *
+ *        Version:  1.0
+ *        Created:  10/19/2026 07:26:04 PM
+ *       Revision:  none
+ *       Compiler:  g++
+ *
+ *         Author:  yipeng
+ *   Organization:
+ *
+ * =====================================================================================
+ */
+
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * \brief 任务图：任务及任务间的依赖，所有前驱任务完成后任务才可执行
+ *        任务图提交后不能再修改，一个任务图只能提交一次
+ */
+class TaskGraph {
+public:
+	TaskGraph();
+
+	TaskGraph(const TaskGraph&) = delete;
+	TaskGraph& operator=(const TaskGraph&) = delete;
+
+	/**
+	 * \brief 添加任务，返回任务编号
+	 * \param name		输入，任务名（时间线跟踪的事件名），必须是静态字符串
+	 * \param arg		输入，跟踪事件参数（如行号、路径编号），负值表示无参数
+	 * \param function	输入，任务函数
+	 */
+	int AddTask(const char* name, const int& arg, const std::function<void()>& function);
+
+	/** \brief 添加依赖：before完成后才能执行after */
+	void AddDependency(const int& before, const int& after);
+
+	/** \brief 任务数 */
+	int NumTasks() const { return static_cast<int>(tasks_.size()); }
+
+private:
+	friend class TaskScheduler;
+
+	struct Task {
+		const char* name;
+		int arg;
+		std::function<void()> function;
+		std::vector<int> successors;
+		int num_predecessors;
+		std::atomic<int> num_pending;	// 尚未完成的前驱数
+	};
+
+	std::vector<std::unique_ptr<Task>> tasks_;
+	std::atomic<int> num_remaining_;		// 尚未完成的任务数
+	std::function<void()> on_complete_;
+	std::shared_ptr<TaskGraph> self_;		// 执行期间由调度器持有，全部任务完成后释放
+};
+
+/**
+ * \brief 工作窃取线程池：每个工作线程有自己的任务队列，后继任务就绪时放入完成前驱的线程的队列尾（缓存中的数据就近复用），
+ *        本线程从队列尾取任务，空闲线程从其他线程的队列头窃取；多个任务图可同时执行，任务在各图间交错
+ */
+class TaskScheduler {
+public:
+	/** \param num_workers	输入，工作线程数，小于1时为1 */
+	explicit TaskScheduler(const int& num_workers);
+
+	/** \brief 等待已提交的任务执行完后停止工作线程 */
+	~TaskScheduler();
+
+	TaskScheduler(const TaskScheduler&) = delete;
+	TaskScheduler& operator=(const TaskScheduler&) = delete;
+
+	/** \brief 工作线程数 */
+	int NumWorkers() const { return static_cast<int>(workers_.size()); }
+
+	/**
+	 * \brief 提交任务图，无前驱的任务立即可被执行，不等待
+	 * \param graph			输入，任务图，执行期间由调度器持有
+	 * \param on_complete	输入，全部任务完成后在完成最后一个任务的工作线程中调用，可为空
+	 */
+	void Submit(const std::shared_ptr<TaskGraph>& graph, const std::function<void()>& on_complete);
+
+private:
+	/** \brief 队列中的一个就绪任务 */
+	struct Item {
+		TaskGraph* graph;
+		int task;
+	};
+
+	/** \brief 工作线程的任务队列，所属线程在队列尾存取，其他线程从队列头窃取 */
+	struct WorkerQueue {
+		std::mutex mutex;
+		std::deque<Item> items;
+	};
+
+	/** \brief 工作线程主循环 */
+	void WorkerLoop(const int& worker);
+
+	/** \brief 把就绪任务放入第worker个队列并唤醒一个空闲线程 */
+	void Push(const int& worker, const Item& item);
+
+	/** \brief 取任务：先取自己队列尾的任务，再依次从其他队列头窃取 */
+	bool Pop(const int& worker, Item* item);
+
+	/** \brief 执行任务，把就绪的后继任务放入自己的队列 */
+	void Execute(const int& worker, const Item& item);
+
+	std::vector<std::unique_ptr<WorkerQueue>> queues_;
+	std::vector<std::thread> workers_;
+
+	std::mutex sleep_mutex_;
+	std::condition_variable wake_;
+	std::atomic<int> num_queued_;			// 各队列中的就绪任务总数
+	std::atomic<unsigned> next_queue_;		// 外部提交的任务轮流放入各队列
+	bool is_stopping_;
+};
@@ -0,0 +1,240 @@
+/*
+ * =====================================================================================
+ *
+ *       Filename:  sgm_shm_ring.cpp
+ *
+ *    Description:  shared-memory stereo frame ring impl
+ *
+ *        Version:  1.0
+ *        Created:  10/19/2026 02:20:15 PM
+ *       Revision:  none
+ *       Compiler:  g++
+ *
+ *         Author:  yipeng
+ *   Organization:
+ *
+ * =====================================================================================
+ */
+
+#include "sgm_shm_ring.h"
+
+#include <climits>
+#include <chrono>
+#include <algorithm>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+// 共享内存中的数据均按缓存行对齐
+static constexpr std::size_t Cache_Line = 64;
+static constexpr std::uint32_t Ring_Magic = 0x53474d52;    // "SGMR"
+static constexpr std::uint32_t Ring_Version = 1;
+// 等待时检查退出标志的间隔（毫秒）
+static constexpr int Shutdown_Poll_Ms = 100;
+
+// 共享内存开头的缓冲区头
+struct RingHeader {
+    std::uint32_t magic;
+    std::uint32_t version;
+    std::int32_t height;
+    std::int32_t width;
+    std::int32_t num_slots;
+    std::uint32_t shutdown;
+    std::uint64_t slot_size;
+};
+
+static std::size_t AlignUp(const std::size_t& size) {
+    return (size + Cache_Line - 1) / Cache_Line * Cache_Line;
+}
+
+// 槽位：槽位头、左影像、右影像、视差图
+static std::size_t SlotSize(const int& height, const int& width) {
+    const std::size_t image_size = static_cast<std::size_t>(height) * width;
+    return AlignUp(sizeof(SharedFrameRing::SlotHeader)) + 2 * AlignUp(image_size) + AlignUp(image_size * sizeof(float));
+}
+
+// 共享映射上的futex，不能使用FUTEX_PRIVATE_FLAG
+static long Futex(std::uint32_t* address, const int& op, const std::uint32_t& value, const timespec* timeout) {
+    return syscall(SYS_futex, address, op, value, timeout, nullptr, 0);
+}
+
+SharedFrameRing::SharedFrameRing()
+    : is_owner_(false), memory_(nullptr), memory_size_(0),
+      height_(0), width_(0), num_slots_(0), slot_size_(0) {
+}
+
+SharedFrameRing::~SharedFrameRing() {
+    Close();
+}
+
+bool SharedFrameRing::Create(const std::string& name, const int& height, const int& width, const int& num_slots) {
+    Close();
+    if (name.empty() || height <= 0 || width <= 0 || num_slots <= 0) {
+        return false;
+    }
+
+    const std::size_t slot_size = SlotSize(height, width);
+    const std::size_t size = AlignUp(sizeof(RingHeader)) + slot_size * num_slots;
+
+    shm_unlink(name.c_str());
+    const int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (fd < 0) {
+        return false;
+    }
+    if (ftruncate(fd, static_cast<off_t>(size)) != 0 || !Map(fd, size)) {
+        close(fd);
+        shm_unlink(name.c_str());
+        return false;
+    }
+    close(fd);
+
+    name_ = name;
+    is_owner_ = true;
+    height_ = height;
+    width_ = width;
+    num_slots_ = num_slots;
+    slot_size_ = slot_size;
+
+    // ftruncate后内容为0，槽位均为空闲；magic最后写入，打开者据此判断缓冲区已就绪
+    auto header = static_cast<RingHeader*>(memory_);
+    header->version = Ring_Version;
+    header->height = height;
+    header->width = width;
+    header->num_slots = num_slots;
+    header->slot_size = slot_size;
+    __atomic_store_n(&header->shutdown, 0u, __ATOMIC_RELAXED);
+    __atomic_store_n(&header->magic, Ring_Magic, __ATOMIC_RELEASE);
+
+    return true;
+}
+
+bool SharedFrameRing::Open(const std::string& name) {
+    Close();
+    const int fd = shm_open(name.c_str(), O_RDWR, 0600);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) != 0 || static_cast<std::size_t>(file_stat.st_size) < sizeof(RingHeader)
+            || !Map(fd, static_cast<std::size_t>(file_stat.st_size))) {
+        close(fd);
+        return false;
+    }
+    close(fd);
+
+    // 缓冲区头来自其他进程，尺寸、槽位数须为正，槽位大小须与按尺寸计算的布局一致，且所有槽位在映射范围内
+    const auto header = static_cast<const RingHeader*>(memory_);
+    const std::size_t slots_bytes = memory_size_ - std::min(memory_size_, AlignUp(sizeof(RingHeader)));
+    if (__atomic_load_n(&header->magic, __ATOMIC_ACQUIRE) != Ring_Magic || header->version != Ring_Version
+            || header->height <= 0 || header->width <= 0 || header->num_slots <= 0
+            || header->slot_size != SlotSize(header->height, header->width)
+            || header->slot_size > slots_bytes / static_cast<std::size_t>(header->num_slots)) {
+        Close();
+        return false;
+    }
+
+    name_ = name;
+    is_owner_ = false;
+    height_ = header->height;
+    width_ = header->width;
+    num_slots_ = header->num_slots;
+    slot_size_ = header->slot_size;
+
+    return true;
+}
+
+void SharedFrameRing::Close() {
+    if (memory_ != nullptr) {
+        munmap(memory_, memory_size_);
+        memory_ = nullptr;
+        memory_size_ = 0;
+    }
+    if (is_owner_) {
+        shm_unlink(name_.c_str());
+        is_owner_ = false;
+    }
+    height_ = width_ = num_slots_ = 0;
+    slot_size_ = 0;
+}
+
+bool SharedFrameRing::WaitState(const int& slot, const SlotState& state, const int& timeout_ms) const {
+    std::uint32_t* state_word = &Header(slot)->state;
+    const auto start = std::chrono::steady_clock::now();
+    while (true) {
+        const std::uint32_t current = __atomic_load_n(state_word, __ATOMIC_ACQUIRE);
+        if (current == state) {
+            return true;
+        }
+        if (IsShutdown()) {
+            return false;
+        }
+
+        // 分段等待，以便及时发现退出请求
+        int wait_ms = Shutdown_Poll_Ms;
+        if (timeout_ms >= 0) {
+            const auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+                                     std::chrono::steady_clock::now() - start).count();
+            if (elapsed >= timeout_ms) {
+                return false;
+            }
+            wait_ms = std::min<int>(wait_ms, timeout_ms - static_cast<int>(elapsed));
+        }
+        timespec timeout;
+        timeout.tv_sec = wait_ms / 1000;
+        timeout.tv_nsec = (wait_ms % 1000) * 1000000L;
+        Futex(state_word, FUTEX_WAIT, current, &timeout);
+    }
+}
+
+void SharedFrameRing::SetState(const int& slot, const SlotState& state) {
+    std::uint32_t* state_word = &Header(slot)->state;
+    __atomic_store_n(state_word, static_cast<std::uint32_t>(state), __ATOMIC_RELEASE);
+    Futex(state_word, FUTEX_WAKE, INT_MAX, nullptr);
+}
+
+void SharedFrameRing::Shutdown() {
+    auto header = static_cast<RingHeader*>(memory_);
+    __atomic_store_n(&header->shutdown, 1u, __ATOMIC_RELEASE);
+    for (int k = 0; k < num_slots_; k++) {
+        Futex(&Header(k)->state, FUTEX_WAKE, INT_MAX, nullptr);
+    }
+}
+
+bool SharedFrameRing::IsShutdown() const {
+    const auto header = static_cast<const RingHeader*>(memory_);
+    return __atomic_load_n(&header->shutdown, __ATOMIC_ACQUIRE) != 0;
+}
+
+SharedFrameRing::SlotHeader* SharedFrameRing::Header(const int& slot) const {
+    return reinterpret_cast<SlotHeader*>(SlotBase(slot));
+}
+
+std::uint8_t* SharedFrameRing::LeftImage(const int& slot) const {
+    return SlotBase(slot) + AlignUp(sizeof(SlotHeader));
+}
+
+std::uint8_t* SharedFrameRing::RightImage(const int& slot) const {
+    return LeftImage(slot) + AlignUp(static_cast<std::size_t>(height_) * width_);
+}
+
+float* SharedFrameRing::Disparity(const int& slot) const {
+    return reinterpret_cast<float*>(RightImage(slot) + AlignUp(static_cast<std::size_t>(height_) * width_));
+}
+
+bool SharedFrameRing::Map(const int& fd, const std::size_t& size) {
+    void* memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (memory == MAP_FAILED) {
+        return false;
+    }
+    memory_ = memory;
+    memory_size_ = size;
+    return true;
+}
+
+std::uint8_t* SharedFrameRing::SlotBase(const int& slot) const {
+    return static_cast<std::uint8_t*>(memory_) + AlignUp(sizeof(RingHeader)) + slot_size_ * slot;
+}
@@ -0,0 +1,125 @@
+/*
+ * =====================================================================================
+ *
+ *       Filename:  sgm_shm_ring.h
+ *
+ *    Description:  shared-memory stereo frame ring between producer processes and sgm daemon
+ *
+ *        Version:  1.0
+ *        Created:  10/19/2026 02:20:15 PM
+ *       Revision:  none
+ *       Compiler:  g++
+ *
+ *         Author:  yipeng
+ *   Organization:
+ *
+ * =====================================================================================
+ */
+
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <string>
+
+/**
+ * \brief 基于POSIX共享内存的立体像对环形缓冲区，槽位状态以futex通知
+ *        每个槽位依次经历 空闲 -> 待匹配（生产者写入左右影像） -> 匹配中 -> 完成（守护进程写入视差图） -> 空闲（生产者取走结果）
+ *        守护进程直接读取槽位中的影像并把视差图写回同一槽位，影像和视差图均不经过额外的拷贝
+ */
+class SharedFrameRing {
+public:
+	/** \brief 槽位状态 */
+	enum SlotState : std::uint32_t {
+		Slot_Free = 0,			// 空闲，生产者可写入
+		Slot_Ready,				// 左右影像已写入，等待匹配
+		Slot_Matching,			// 守护进程匹配中
+		Slot_Done				// 视差图已写入，等待生产者取走
+	};
+
+	/** \brief 槽位头，与影像数据一起位于共享内存中 */
+	struct SlotHeader {
+		std::uint32_t state;		// 槽位状态（futex字）
+		std::uint32_t is_matched;	// 匹配是否成功
+		std::uint64_t frame_id;		// 生产者设置的帧号，原样返回
+		double match_time;			// 匹配耗时（毫秒）
+	};
+
+	SharedFrameRing();
+	~SharedFrameRing();
+
+	SharedFrameRing(const SharedFrameRing&) = delete;
+	SharedFrameRing& operator=(const SharedFrameRing&) = delete;
+
+public:
+	/**
+	 * \brief 创建共享内存环形缓冲区（守护进程），同名的旧缓冲区会被替换
+	 * \param name		输入，共享内存名，以'/'开头
+	 * \param height	输入，影像高
+	 * \param width		输入，影像宽
+	 * \param num_slots	输入，槽位数
+	 */
+	bool Create(const std::string& name, const int& height, const int& width, const int& num_slots);
+
+	/**
+	 * \brief 打开已创建的共享内存环形缓冲区（生产者）
+	 * \param name		输入，共享内存名
+	 */
+	bool Open(const std::string& name);
+
+	/** \brief 解除映射，创建者同时删除共享内存 */
+	void Close();
+
+	/**
+	 * \brief 等待槽位进入指定状态
+	 * \param slot			输入，槽位号
+	 * \param state			输入，等待的状态
+	 * \param timeout_ms	输入，超时（毫秒），负值表示一直等待
+	 * \return 超时或缓冲区已关闭时返回false
+	 */
+	bool WaitState(const int& slot, const SlotState& state, const int& timeout_ms) const;
+
+	/** \brief 设置槽位状态并唤醒等待该槽位的进程 */
+	void SetState(const int& slot, const SlotState& state);
+
+	/** \brief 请求守护进程退出，并唤醒所有等待的进程 */
+	void Shutdown();
+
+	/** \brief 是否已请求退出 */
+	bool IsShutdown() const;
+
+	/** \brief 槽位头 */
+	SlotHeader* Header(const int& slot) const;
+	/** \brief 槽位中的左影像 */
+	std::uint8_t* LeftImage(const int& slot) const;
+	/** \brief 槽位中的右影像 */
+	std::uint8_t* RightImage(const int& slot) const;
+	/** \brief 槽位中的视差图 */
+	float* Disparity(const int& slot) const;
+
+	int Height() const { return height_; }
+	int Width() const { return width_; }
+	int NumSlots() const { return num_slots_; }
+
+private:
+	/** \brief 以读写共享方式映射共享内存的前size字节 */
+	bool Map(const int& fd, const std::size_t& size);
+
+	/** \brief 槽位起始地址 */
+	std::uint8_t* SlotBase(const int& slot) const;
+
+private:
+	/** \brief 共享内存名 */
+	std::string name_;
+	/** \brief 是否为创建者 */
+	bool is_owner_;
+
+	/** \brief 映射地址及大小 */
+	void* memory_;
+	std::size_t memory_size_;
+
+	/** \brief 影像尺寸、槽位数及每个槽位的字节数 */
+	int height_;
+	int width_;
+	int num_slots_;
+	std::size_t slot_size_;
+};
@@ -0,0 +1,215 @@
+/*
+ * =====================================================================================
+ *
+ *       Filename:  sgm_trace.cpp
+ *
+ *    Description:  low-overhead timeline tracing of sgm stages impl
+ *
+ *        Version:  1.0
+ *        Created:  10/19/2026 03:48:12 PM
+ *       Revision:  none
+ *       Compiler:  g++
+ *
+ *         Author:  yipeng
+ *   Organization:
+ *
+ * =====================================================================================
+ */
+
+#include "sgm_trace.h"
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <fstream>
+#include <iomanip>
+
+// 一个开始/结束事件
+struct TraceEvent {
+    const char* name;
+    std::int64_t time;      // 纳秒，相对跟踪零点
+    std::int32_t arg;
+    char phase;             // 'B'开始，'E'结束
+};
+
+// 线程的事件缓冲区，只有所属线程写入：先写事件再以release发布计数，导出时以acquire读计数
+struct TraceBuffer {
+    int tid;
+    std::string name;                   // 受注册表互斥量保护
+    std::unique_ptr<TraceEvent[]> events;
+    std::atomic<int> count;
+    std::atomic<int> dropped;
+
+    explicit TraceBuffer(const int& id)
+        : tid(id), events(new TraceEvent[sgm_trace::Thread_Capacity]), count(0), dropped(0) { }
+};
+
+// 线程缓冲区注册表，只在线程首次记录事件、线程退出、设置线程名、导出和清空时加锁
+// 线程退出时缓冲区放回空闲表，由下一个注册的线程接着写入，缓冲区个数不超过同时记录事件的线程数；
+// 缓冲区在进程结束前不释放，线程退出后其事件仍可导出
+struct TraceRegistry {
+    std::mutex mutex;
+    std::vector<std::unique_ptr<TraceBuffer>> buffers;
+    std::vector<TraceBuffer*> idle_buffers;
+};
+
+static TraceRegistry& GetRegistry() {
+    // 不析构，避免进程退出时仍在运行的线程访问已析构的注册表
+    static TraceRegistry* registry = new TraceRegistry();
+    return *registry;
+}
+
+// 线程持有的缓冲区，线程退出时归还注册表
+struct LocalSlot {
+    TraceBuffer* buffer = nullptr;
+
+    ~LocalSlot() {
+        if (buffer != nullptr) {
+            auto& registry = GetRegistry();
+            std::lock_guard<std::mutex> lock(registry.mutex);
+            registry.idle_buffers.push_back(buffer);
+        }
+    }
+};
+
+static std::atomic<bool> is_enabled(false);
+static std::atomic<std::int64_t> zero_time(-1);
+static thread_local LocalSlot local_slot;
+
+static std::int64_t SteadyNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static TraceBuffer* LocalBuffer() {
+    if (local_slot.buffer == nullptr) {
+        auto& registry = GetRegistry();
+        std::lock_guard<std::mutex> lock(registry.mutex);
+        if (!registry.idle_buffers.empty()) {
+            // 复用已退出线程的缓冲区，保留其事件，线程名由新线程重新设置
+            local_slot.buffer = registry.idle_buffers.back();
+            registry.idle_buffers.pop_back();
+            local_slot.buffer->name.clear();
+        } else {
+            registry.buffers.emplace_back(new TraceBuffer(static_cast<int>(registry.buffers.size()) + 1));
+            local_slot.buffer = registry.buffers.back().get();
+        }
+    }
+    return local_slot.buffer;
+}
+
+static void Record(const char* name, const int& arg, const char& phase) {
+    if (!is_enabled.load(std::memory_order_relaxed)) {
+        return;
+    }
+    TraceBuffer* buffer = LocalBuffer();
+    const int count = buffer->count.load(std::memory_order_relaxed);
+    if (count >= sgm_trace::Thread_Capacity) {
+        buffer->dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    TraceEvent& event = buffer->events[count];
+    event.name = name;
+    event.time = SteadyNs() - zero_time.load(std::memory_order_relaxed);
+    event.arg = arg;
+    event.phase = phase;
+    buffer->count.store(count + 1, std::memory_order_release);
+}
+
+static void WriteString(std::ofstream& ofs, const std::string& str) {
+    ofs << '"';
+    for (const char& c : str) {
+        if (c == '"' || c == '\\') {
+            ofs << '\\' << c;
+        } else if (static_cast<unsigned char>(c) >= 0x20) {
+            ofs << c;
+        }
+    }
+    ofs << '"';
+}
+
+void sgm_trace::Enable(const bool& is_enable) {
+    if (is_enable) {
+        std::int64_t unset = -1;
+        zero_time.compare_exchange_strong(unset, SteadyNs());
+    }
+    is_enabled.store(is_enable, std::memory_order_relaxed);
+}
+
+bool sgm_trace::IsEnabled() {
+    return is_enabled.load(std::memory_order_relaxed);
+}
+
+void sgm_trace::SetThreadName(const std::string& name) {
+    TraceBuffer* buffer = LocalBuffer();
+    auto& registry = GetRegistry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    buffer->name = name;
+}
+
+void sgm_trace::Begin(const char* name, const int& arg) {
+    Record(name, arg, 'B');
+}
+
+void sgm_trace::End(const char* name, const int& arg) {
+    Record(name, arg, 'E');
+}
+
+bool sgm_trace::DumpChromeTrace(const std::string& path) {
+    std::ofstream ofs(path);
+    if (!ofs.is_open()) {
+        return false;
+    }
+
+    auto& registry = GetRegistry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    ofs << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    bool is_first = true;
+    auto separator = [&]() {
+        if (!is_first) {
+            ofs << ",\n";
+        }
+        is_first = false;
+    };
+    ofs << std::fixed << std::setprecision(3);
+    for (const auto& buffer : registry.buffers) {
+        // 线程名元数据
+        separator();
+        ofs << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << buffer->tid << ",\"args\":{\"name\":";
+        WriteString(ofs, buffer->name.empty() ? "thread " + std::to_string(buffer->tid) : buffer->name);
+        ofs << "}}";
+        if (buffer->dropped.load(std::memory_order_relaxed) > 0) {
+            separator();
+            ofs << "{\"name\":\"dropped_events\",\"ph\":\"C\",\"ts\":0,\"pid\":1,\"tid\":" << buffer->tid
+                << ",\"args\":{\"count\":" << buffer->dropped.load(std::memory_order_relaxed) << "}}";
+        }
+
+        const int count = buffer->count.load(std::memory_order_acquire);
+        for (int k = 0; k < count; k++) {
+            const TraceEvent& event = buffer->events[k];
+            separator();
+            ofs << "{\"name\":";
+            WriteString(ofs, event.name);
+            ofs << ",\"cat\":\"sgm\",\"ph\":\"" << event.phase << "\",\"ts\":" << event.time / 1000.0
+                << ",\"pid\":1,\"tid\":" << buffer->tid;
+            if (event.arg >= 0) {
+                ofs << ",\"args\":{\"arg\":" << event.arg << "}";
+            }
+            ofs << "}";
+        }
+    }
+    ofs << "\n]}\n";
+
+    return ofs.good();
+}
+
+void sgm_trace::Clear() {
+    auto& registry = GetRegistry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    for (auto& buffer : registry.buffers) {
+        buffer->count.store(0, std::memory_order_relaxed);
+        buffer->dropped.store(0, std::memory_order_relaxed);
+    }
+}
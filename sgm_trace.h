@@ -0,0 +1,84 @@
+/*
+ * =====================================================================================
+ *
+ *       Filename:  sgm_trace.h
+ *
+ *    Description:  low-overhead timeline tracing of sgm stages, exported as chrome trace json
+ *
+ *        Version:  1.0
+ *        Created:  10/19/2026 03:48:12 PM
+ *       Revision:  none
+ *       Compiler:  g++
+ *
+ *         Author:  yipeng
+ *   Organization:
+ *
+ * =====================================================================================
+ */
+
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <string>
+
+/**
+ * \brief 时间线跟踪：各线程把开始/结束事件写入自己的缓冲区（单写者，无锁），
+ *        导出为Chrome trace JSON，可在chrome://tracing或Perfetto中查看各阶段、各路径、各工作线程的耗时
+ *        关闭时每个事件只有一次原子读的开销
+ */
+namespace sgm_trace {
+	/** \brief 每个线程缓冲区最多记录的事件数，超出的事件被丢弃并计数；线程退出后缓冲区由新线程复用，事件继续累计 */
+	constexpr int Thread_Capacity = 1 << 16;
+
+	/** \brief 开关跟踪，开启时记录的时间以首次开启的时刻为零点 */
+	void Enable(const bool& is_enable);
+
+	/** \brief 是否开启跟踪 */
+	bool IsEnabled();
+
+	/** \brief 设置调用线程在时间线中显示的名称 */
+	void SetThreadName(const std::string& name);
+
+	/**
+	 * \brief 记录开始/结束事件
+	 * \param name		输入，事件名，必须是静态字符串（只保存指针）
+	 * \param arg		输入，事件参数（如路径编号、行号），负值表示无参数
+	 */
+	void Begin(const char* name, const int& arg = -1);
+	void End(const char* name, const int& arg = -1);
+
+	/**
+	 * \brief 导出所有线程已记录的事件为Chrome trace JSON
+	 *        其他线程可在导出时继续记录，只导出调用时已完成写入的事件
+	 * \param path		输入，JSON文件路径
+	 */
+	bool DumpChromeTrace(const std::string& path);
+
+	/** \brief 清空所有线程的事件，需在没有线程记录事件时调用 */
+	void Clear();
+
+	/** \brief 作用域内的开始/结束事件 */
+	class Scope {
+	public:
+		explicit Scope(const char* name, const int& arg = -1)
+			: name_(name), arg_(arg), is_active_(IsEnabled()) {
+			if (is_active_) {
+				Begin(name_, arg_);
+			}
+		}
+		~Scope() {
+			if (is_active_) {
+				End(name_, arg_);
+			}
+		}
+
+		Scope(const Scope&) = delete;
+		Scope& operator=(const Scope&) = delete;
+
+	private:
+		const char* name_;
+		int arg_;
+		/** \brief 开始时跟踪开启才记录结束，保证事件成对 */
+		bool is_active_;
+	};
+}
@@ -0,0 +1,151 @@
+/*
+ * =====================================================================================
+ *
+ *       Filename:  sgm_unit_test.cpp
+ *
+ *    Description:  unit tests of sgm memory planning, disparity range estimation and reprojection, no image io needed
+ *
+ *        Version:  1.0
+ *        Created:  10/19/2026 11:02:17 PM
+ *       Revision:  none
+ *       Compiler:  g++
+ *
+ *         Author:  yipeng
+ *   Organization:
+ *
+ * =====================================================================================
+ */
+
+#include <cmath>
+#include <string>
+#include <fstream>
+#include <vector>
+#include <functional>
+
+#include <glog/logging.h>
+
+#include "semi_global_matching.h"
+#include "sgm_range.h"
+
+// 单个测试用例，返回是否通过
+struct TestCase {
+    std::string name;
+    std::function<bool()> run;
+};
+
+#define EXPECT(condition) \
+    if (!(condition)) { LOG(ERROR) << "  " << __FILE__ << ":" << __LINE__ << " 断言失败: " #condition; return false; }
+
+// uint16路径代价的条带规划在预算内，Auto在最小条带放得下时不退回Streaming（1000x1000、128视差时约需192MB）
+static bool TestStripedPlanPathCost16() {
+    SemiGlobalMatching::SGMOption option;
+    option.min_disparity = 0;
+    option.max_disparity = 128;
+    option.num_threads = 4;
+    option.path_cost_type = SemiGlobalMatching::PathCostUint16;
+    const std::size_t mb = 1024 * 1024;
+    for (const std::size_t budget : { 250 * mb, 400 * mb }) {
+        option.memory_budget = budget;
+        SemiGlobalMatching::MemoryPlan plan;
+        option.execution_strategy = SemiGlobalMatching::ExecutionStriped;
+        EXPECT(SemiGlobalMatching::PlanMemory(1000, 1000, option, &plan));
+        EXPECT(plan.Total() <= budget);
+        option.execution_strategy = SemiGlobalMatching::ExecutionAuto;
+        EXPECT(SemiGlobalMatching::PlanMemory(1000, 1000, option, &plan));
+        EXPECT(plan.strategy == SemiGlobalMatching::ExecutionStriped);
+        EXPECT(plan.Total() <= budget);
+        LOG(INFO) << "  " << SemiGlobalMatching::FormatMemoryPlan(plan);
+    }
+    return true;
+}
+
+// 影像小于缩小倍数时视差范围估计返回false，估计结果为允许的视差范围，不越界读影像
+static bool TestRangeTinyImage() {
+    sgm_range::RangeOption option;
+    option.sgm_option.min_disparity = 0;
+    option.sgm_option.max_disparity = 16;
+    option.decimation = 4;
+    for (const int size : { 1, 3 }) {
+        // 只分配size x size，越界读由AddressSanitizer等工具发现
+        std::vector<std::uint8_t> left(size * size, 100), right(size * size, 100);
+        sgm_range::RangeEstimate estimate;
+        EXPECT(!sgm_range::EstimateDisparityRange(left.data(), right.data(), size, size, option, &estimate));
+        EXPECT(!sgm_range::EstimateDisparityRange(left.data(), right.data(), size, 64, option, &estimate));
+        EXPECT(estimate.min_disparity == 0 && estimate.max_disparity == 16);
+    }
+    return true;
+}
+
+// ROI略小于影像（处理窗口仍为整幅影像）时，ROI外的深度/三维坐标为无穷大，不保留调用者的数据
+static bool TestReprojectionOutsideRoi() {
+    const int height = 48, width = 96;
+    std::vector<std::uint8_t> left(height * width), right(height * width);
+    std::uint32_t seed = 12345;
+    for (auto& pixel : right) {
+        seed = seed * 1103515245u + 12345u;
+        pixel = static_cast<std::uint8_t>(seed >> 24);
+    }
+    // 左影像为右影像右移8像素
+    for (int i = 0; i < height; i++) {
+        for (int j = 0; j < width; j++) {
+            left[i * width + j] = right[i * width + std::max(0, j - 8)];
+        }
+    }
+
+    SemiGlobalMatching::SGMOption option;
+    option.min_disparity = 0;
+    option.max_disparity = 16;
+    option.roi_x = 3;
+    option.roi_y = 2;
+    option.roi_width = width - 6;
+    option.roi_height = height - 4;
+    SemiGlobalMatching sgm;
+    EXPECT(sgm.Initialize(height, width, option));
+
+    const float sentinel = -12345.0f;
+    std::vector<float> depth(height * width, sentinel), xyz(height * width * 3, sentinel);
+    SemiGlobalMatching::Reprojection reprojection;
+    const float q_matrix[16] = { 1, 0, 0, -width / 2.0f, 0, 1, 0, -height / 2.0f, 0, 0, 0, 500, 0, 0, 10, 0 };
+    std::copy(q_matrix, q_matrix + 16, reprojection.q_matrix);
+    reprojection.depth = depth.data();
+    reprojection.xyz = xyz.data();
+    sgm.SetReprojection(reprojection);
+
+    std::vector<float> disparity(height * width);
+    std::ofstream null_stream;
+    EXPECT(sgm.Match(left.data(), right.data(), disparity.data(), null_stream));
+    for (int i = 0; i < height; i++) {
+        for (int j = 0; j < width; j++) {
+            if (i >= option.roi_y && i < option.roi_y + option.roi_height
+                    && j >= option.roi_x && j < option.roi_x + option.roi_width) {
+                continue;
+            }
+            const int idx = i * width + j;
+            EXPECT(std::isinf(disparity[idx]));
+            EXPECT(std::isinf(depth[idx]) && depth[idx] > 0);
+            for (int k = 0; k < 3; k++) {
+                EXPECT(std::isinf(xyz[idx * 3 + k]) && xyz[idx * 3 + k] > 0);
+            }
+        }
+    }
+    return true;
+}
+
+int main(int argc, char** argv) {
+    google::InitGoogleLogging(argv[0]);
+    FLAGS_logtostderr = true;
+
+    const std::vector<TestCase> cases = {
+        { "striped plan with uint16 path cost", TestStripedPlanPathCost16 },
+        { "range estimation on an image smaller than the decimation", TestRangeTinyImage },
+        { "reprojection outside an roi slightly smaller than the image", TestReprojectionOutsideRoi },
+    };
+    int num_failed = 0;
+    for (const auto& test : cases) {
+        const bool passed = test.run();
+        LOG(INFO) << (passed ? "[PASS] " : "[FAIL] ") << test.name;
+        num_failed += passed ? 0 : 1;
+    }
+    LOG(INFO) << cases.size() - num_failed << "/" << cases.size() << " passed";
+    return num_failed == 0 ? 0 : 1;
+}
@@ -17,111 +17,494 @@
  */
 
 #include "sgm_util.h"
+#include "sgm_trace.h"
 
 #include <cassert>
+#include <cmath>
 #include <cstdint>
 #include <cstddef>
 #include <cstring>
 #include <vector>
+#include <limits>
 #include <algorithm>
 
 namespace sgm_util {
 
-void census_transform_5x5(const std::uint8_t* source, std::uint32_t* census, 
-                          const int& height, const int& width) {
+// census比较对：(r1, c1)处像素小于(r2, c2)处像素时该位置1，偏移均相对于中心像素
+struct CensusPair {
+	int r1, c1;
+	int r2, c2;
+};
+
+// 按给定比较对做census变换，比较对个数不超过census值的位数
+// 逐行计算，行内所有像素同时累积同一比较位，内层循环无分支便于编译器向量化，uint8/uint16影像共用
+template <typename P, typename C>
+static void census_transform_pairs(const P* source, C* census,
+                                   const int& height, const int& width,
+                                   const std::vector<CensusPair>& pairs, 
+                                   const int& radius_row, const int& radius_col) {
 	if (source == nullptr 
             || census == nullptr 
-            || height <= 5 
-            || width <= 5) {
+            || height <= 2 * radius_row 
+            || width <= 2 * radius_col) {
 		return;
 	}
+	assert(pairs.size() <= sizeof(C) * 8);
 
-	// 逐像素计算census值
-	for (int i = 2; i < height - 2; i++) {
-		for (int j = 2; j < width - 2; j++) {
-			// 中心像素值
-			const std::uint8_t center_gray = source[i * width + j];
-			
-			// 遍历大小为5x5的窗口内邻域像素，逐一比较像素值与中心像素值的的大小，计算census值
-			std::uint32_t census_val = 0u;
-			for (int r = -2; r <= 2; r++) {
-				for (int c = -2; c <= 2; c++) {
-					census_val <<= 1;
-					const std::uint8_t gray = source[(i + r) * width + j + c];
-					if (gray < center_gray) {
-						census_val += 1;
-					}
-				}
+	for (int i = radius_row; i < height - radius_row; i++) {
+		C* census_row = census + i * width;
+		for (int j = radius_col; j < width - radius_col; j++) {
+			census_row[j] = 0u;
+		}
+		for (const auto& pair : pairs) {
+			const P* row_1 = source + (i + pair.r1) * width + pair.c1;
+			const P* row_2 = source + (i + pair.r2) * width + pair.c2;
+			for (int j = radius_col; j < width - radius_col; j++) {
+				census_row[j] = (census_row[j] << 1) | static_cast<C>(row_1[j] < row_2[j]);
 			}
+		}
+	}
+}
 
-			// 中心像素的census值
-			census[i * width + j] = census_val;		
+// 窗口内全部像素（按行扫描，含中心）依次与中心像素比较
+static std::vector<CensusPair> window_pairs(const int& radius_row, const int& radius_col) {
+	std::vector<CensusPair> pairs;
+	for (int r = -radius_row; r <= radius_row; r++) {
+		for (int c = -radius_col; c <= radius_col; c++) {
+			pairs.push_back({ r, c, 0, 0 });
 		}
 	}
+	return pairs;
 }
 
-void census_transform_9x7(const std::uint8_t* source, std::uint64_t* census, 
-                          const int& height, const int& width) {
-	if (source == nullptr || census == nullptr || width <= 9 || height <= 7) {
+// 中心对称比较对：窗口内扫描顺序位于中心之前的像素p+o与其对称像素p-o比较
+// is_sparse为true时只取行列偏移之和为奇数的像素（棋盘格采样）
+static std::vector<CensusPair> symmetric_pairs(const int& radius_row, const int& radius_col, bool is_sparse) {
+	std::vector<CensusPair> pairs;
+	for (int r = -radius_row; r <= 0; r++) {
+		for (int c = -radius_col; c <= radius_col; c++) {
+			if (r == 0 && c >= 0) {
+				break;
+			}
+			if (is_sparse && (r + c) % 2 == 0) {
+				continue;
+			}
+			pairs.push_back({ r, c, -r, -c });
+		}
+	}
+	return pairs;
+}
+
+template <typename P>
+static void census_transform_5x5_impl(const P* source, std::uint32_t* census, 
+                                      const int& height, const int& width) {
+	if (height <= 5 || width <= 5) {
 		return;
 	}
+	// 5x5窗口内25个像素与中心像素比较（中心位恒为0）
+	static const std::vector<CensusPair> pairs = window_pairs(2, 2);
+	census_transform_pairs(source, census, height, width, pairs, 2, 2);
+}
 
-	// 逐像素计算census值
-	for (int i = 4; i < height - 4; i++) {
-		for (int j = 3; j < width - 3; j++) {
+template <typename P>
+static void census_transform_9x7_impl(const P* source, std::uint64_t* census, 
+                                      const int& height, const int& width) {
+	if (width <= 9 || height <= 7) {
+		return;
+	}
+	// 9行7列窗口内63个像素与中心像素比较
+	static const std::vector<CensusPair> pairs = window_pairs(4, 3);
+	census_transform_pairs(source, census, height, width, pairs, 4, 3);
+}
 
-			// 中心像素值
-			const std::uint8_t gray_center = source[i * width + j];
+template <typename P>
+static void census_transform_cs_9x7_impl(const P* source, std::uint32_t* census, 
+                                         const int& height, const int& width) {
+	// 9行7列窗口，共31对
+	static const std::vector<CensusPair> pairs = symmetric_pairs(4, 3, false);
+	census_transform_pairs(source, census, height, width, pairs, 4, 3);
+}
 
-			// 遍历大小为5x5的窗口内邻域像素，逐一比较像素值与中心像素值的的大小，计算census值
-			std::uint64_t census_val = 0u;
-			for (int r = -4; r <= 4; r++) {
-				for (int c = -3; c <= 3; c++) {
-					census_val <<= 1;
-					const std::uint8_t gray = source[(i + r) * width + j + c];
-					if (gray < gray_center) {
-						census_val += 1;
-					}
+template <typename P>
+static void census_transform_sparse_9x7_impl(const P* source, std::uint32_t* census, 
+                                             const int& height, const int& width) {
+	// 9行7列窗口，棋盘格采样（行列偏移之和为奇数，不含中心）的32个像素与中心像素比较
+	static const std::vector<CensusPair> pairs = [] {
+		std::vector<CensusPair> pairs;
+		for (int r = -4; r <= 4; r++) {
+			for (int c = -3; c <= 3; c++) {
+				if ((r + c) % 2 != 0) {
+					pairs.push_back({ r, c, 0, 0 });
 				}
 			}
-
-			// 中心像素的census值
-			census[i * width + j] = census_val;
 		}
-	}
+		return pairs;
+	}();
+	census_transform_pairs(source, census, height, width, pairs, 4, 3);
+}
+
+template <typename P>
+static void census_transform_sparse_11x11_impl(const P* source, std::uint32_t* census, 
+                                               const int& height, const int& width) {
+	// 11x11窗口，棋盘格采样的60个像素组成30个中心对称对
+	static const std::vector<CensusPair> pairs = symmetric_pairs(5, 5, true);
+	census_transform_pairs(source, census, height, width, pairs, 5, 5);
+}
+
+void census_transform_5x5(const std::uint8_t* source, std::uint32_t* census, 
+                          const int& height, const int& width) {
+	census_transform_5x5_impl(source, census, height, width);
+}
+
+void census_transform_5x5(const std::uint16_t* source, std::uint32_t* census, 
+                          const int& height, const int& width) {
+	census_transform_5x5_impl(source, census, height, width);
+}
+
+void census_transform_9x7(const std::uint8_t* source, std::uint64_t* census, 
+                          const int& height, const int& width) {
+	census_transform_9x7_impl(source, census, height, width);
+}
+
+void census_transform_9x7(const std::uint16_t* source, std::uint64_t* census, 
+                          const int& height, const int& width) {
+	census_transform_9x7_impl(source, census, height, width);
+}
+
+void census_transform_cs_9x7(const std::uint8_t* source, std::uint32_t* census, 
+                             const int& height, const int& width) {
+	census_transform_cs_9x7_impl(source, census, height, width);
+}
+
+void census_transform_cs_9x7(const std::uint16_t* source, std::uint32_t* census, 
+                             const int& height, const int& width) {
+	census_transform_cs_9x7_impl(source, census, height, width);
+}
+
+void census_transform_sparse_9x7(const std::uint8_t* source, std::uint32_t* census, 
+                                 const int& height, const int& width) {
+	census_transform_sparse_9x7_impl(source, census, height, width);
+}
+
+void census_transform_sparse_9x7(const std::uint16_t* source, std::uint32_t* census, 
+                                 const int& height, const int& width) {
+	census_transform_sparse_9x7_impl(source, census, height, width);
+}
+
+void census_transform_sparse_11x11(const std::uint8_t* source, std::uint32_t* census, 
+                                   const int& height, const int& width) {
+	census_transform_sparse_11x11_impl(source, census, height, width);
+}
+
+void census_transform_sparse_11x11(const std::uint16_t* source, std::uint32_t* census, 
+                                   const int& height, const int& width) {
+	census_transform_sparse_11x11_impl(source, census, height, width);
 }
 
 std::uint8_t HammingDistance(const std::uint32_t& x, const std::uint32_t& y) {
 	// 计算两个等长二进制串不相同位的个数
-	std::uint32_t dist = 0;
     // 先x和y进行异或 val中位是1的个数就是汉明距离
-    std::uint32_t val = x ^ y;
+	return static_cast<std::uint8_t>(__builtin_popcount(x ^ y));
+}
+
+std::uint8_t HammingDistance(const std::uint64_t& x, const std::uint64_t& y) {
+	return static_cast<std::uint8_t>(__builtin_popcountll(x ^ y));
+}
+
+// 第j列左影像像素的同名点列号j-d落在census有效列[col_begin, col_end)内的视差范围[d_begin, d_end)，
+// 再与[min_disparity, max_disparity)求交
+static void valid_disparity_range(const int& j, const int& col_begin, const int& col_end,
+                                  const int& min_disparity, const int& max_disparity, int& d_begin, int& d_end) {
+	d_begin = std::min(max_disparity, std::max(min_disparity, j - col_end + 1));
+	d_end = std::max(d_begin, std::min(max_disparity, j - col_begin + 1));
+}
 
-	while (val) {
-		++dist;
-		val &= val - 1;
+template <typename T>
+static void compute_census_cost(const T* left_census, const T* right_census,
+                                const int& height, const int& width,
+                                const int& min_disparity, const int& max_disparity, std::uint8_t* cost_init,
+                                const CensusRegion& region, const std::uint8_t* valid_mask) {
+	const int disp_range = max_disparity - min_disparity;
+	if (disp_range <= 0) {
+		return;
 	}
+	sgm_trace::Scope trace("census cost");
+
+	// 列分为三段：左边界[col_begin, interior_begin)、内部[interior_begin, interior_end)、右边界[interior_end, col_end)
+	// 内部像素的同名点对所有视差均在census有效列内，逐视差无分支计算；边界像素只计算预先求出的部分视差范围
+	const int col_begin = std::min(width, std::max(0, region.col_begin));
+	const int col_end = std::max(col_begin, std::min(width, region.col_end));
+	const int interior_begin = std::min(col_end, std::max(col_begin, col_begin + max_disparity - 1));
+	const int interior_end = std::max(interior_begin, std::min(col_end, col_end + min_disparity));
+	const int row_begin = std::min(height, std::max(0, region.row_begin));
+	const int row_end = std::max(row_begin, std::min(height, region.row_end));
+
+	for (int i = 0; i < height; i++) {
+		const T* left_row = left_census + i * width;
+		const T* right_row = right_census + i * width;
+		const std::uint8_t* mask_row = (valid_mask != nullptr) ? valid_mask + i * width : nullptr;
+		std::uint8_t* cost_row = cost_init + i * width * disp_range;
+
+		// 无census值的行、列：所有视差取Invalid_Cost，无效像素跳过
+		auto fill_invalid = [&](const int& begin, const int& end) {
+			for (int j = begin; j < end; j++) {
+				if (mask_row == nullptr || mask_row[j]) {
+					memset(cost_row + j * disp_range, Invalid_Cost, disp_range);
+				}
+			}
+		};
+		if (i < row_begin || i >= row_end) {
+			fill_invalid(0, width);
+			continue;
+		}
+		fill_invalid(0, col_begin);
+		fill_invalid(col_end, width);
+
+		// 边界像素：同名点在有效列外的视差取Invalid_Cost
+		auto border = [&](const int& begin, const int& end) {
+			for (int j = begin; j < end; j++) {
+				if (mask_row != nullptr && !mask_row[j]) {
+					continue;
+				}
+				int d_begin, d_end;
+				valid_disparity_range(j, col_begin, col_end, min_disparity, max_disparity, d_begin, d_end);
+				std::uint8_t* cost = cost_row + j * disp_range - min_disparity;
+				const T left_census_val = left_row[j];
+				memset(cost + min_disparity, Invalid_Cost, d_begin - min_disparity);
+				for (int d = d_begin; d < d_end; d++) {
+					cost[d] = HammingDistance(left_census_val, right_row[j - d]);
+				}
+				memset(cost + d_end, Invalid_Cost, max_disparity - d_end);
+			}
+		};
+		border(col_begin, interior_begin);
 
-	return static_cast<std::uint8_t>(dist);
+		// 内部像素
+		for (int j = interior_begin; j < interior_end; j++) {
+			if (mask_row != nullptr && !mask_row[j]) {
+				continue;
+			}
+			const T left_census_val = left_row[j];
+			const T* right_col = right_row + j - min_disparity;
+			std::uint8_t* cost = cost_row + j * disp_range;
+			for (int d = 0; d < disp_range; d++) {
+				// 与右影像对应像点census值的Hamming距离
+				cost[d] = HammingDistance(left_census_val, right_col[-d]);
+			}
+		}
+
+		border(interior_end, col_end);
+	}
 }
 
-std::uint8_t HammingDistance(const std::uint64_t& x, const std::uint64_t& y) {
-	std::uint64_t dist = 0, val = x ^ y;
+void ComputeCensusCost(const std::uint32_t* left_census, const std::uint32_t* right_census,
+                       const int& height, const int& width,
+                       const int& min_disparity, const int& max_disparity, std::uint8_t* cost_init,
+                       const CensusRegion& region, const std::uint8_t* valid_mask) {
+	compute_census_cost(left_census, right_census, height, width, min_disparity, max_disparity, cost_init, region, valid_mask);
+}
 
-	// Count the number of set bits
-	while (val) {
-		++dist;
-		val &= val - 1;
+void ComputeCensusCost(const std::uint64_t* left_census, const std::uint64_t* right_census,
+                       const int& height, const int& width,
+                       const int& min_disparity, const int& max_disparity, std::uint8_t* cost_init,
+                       const CensusRegion& region, const std::uint8_t* valid_mask) {
+	compute_census_cost(left_census, right_census, height, width, min_disparity, max_disparity, cost_init, region, valid_mask);
+}
+
+template <typename T>
+static void compute_census_cost_row_planar(const T* left_census, const T* right_census,
+                                           const int& height, const int& width,
+                                           const int& min_disparity, const int& max_disparity, std::uint8_t* cost_init,
+                                           const CensusRegion& region) {
+	const int disp_range = max_disparity - min_disparity;
+	if (disp_range <= 0) {
+		return;
 	}
+	sgm_trace::Scope trace("census cost (row planar)");
 
-	return static_cast<std::uint8_t>(dist);
+	const int census_col_begin = std::min(width, std::max(0, region.col_begin));
+	const int census_col_end = std::max(census_col_begin, std::min(width, region.col_end));
+	const int row_begin = std::min(height, std::max(0, region.row_begin));
+	const int row_end = std::max(row_begin, std::min(height, region.row_end));
+	for (int i = 0; i < height; i++) {
+		const T* left_row = left_census + i * width;
+		const T* right_row = right_census + i * width;
+		std::uint8_t* cost_row = cost_init + i * disp_range * width;
+		// 无census值的行
+		if (i < row_begin || i >= row_end) {
+			memset(cost_row, Invalid_Cost, disp_range * width);
+			continue;
+		}
+		for (int d = min_disparity; d < max_disparity; d++) {
+			std::uint8_t* cost = cost_row + (d - min_disparity) * width;
+			// 左像素及右影像对应列j-d均在census有效列内的列范围为[col_begin, col_end)，范围外取Invalid_Cost
+			const int col_begin = std::min(census_col_end, std::max(census_col_begin, census_col_begin + d));
+			const int col_end = std::max(col_begin, std::min(census_col_end, census_col_end + d));
+			memset(cost, Invalid_Cost, col_begin);
+			for (int j = col_begin; j < col_end; j++) {
+				cost[j] = HammingDistance(left_row[j], right_row[j - d]);
+			}
+			memset(cost + col_end, Invalid_Cost, width - col_end);
+		}
+	}
 }
 
+void ComputeCensusCostRowPlanar(const std::uint32_t* left_census, const std::uint32_t* right_census,
+                                const int& height, const int& width,
+                                const int& min_disparity, const int& max_disparity, std::uint8_t* cost_init,
+                                const CensusRegion& region) {
+	compute_census_cost_row_planar(left_census, right_census, height, width, min_disparity, max_disparity, cost_init, region);
+}
 
-void CostAggregateLeftRight(const std::uint8_t* img_data, const int& height, const int& width, 
-                            const int& min_disparity, const int& max_disparity,
-	                        const int& p1, const int& p2_init, 
-                            const std::uint8_t* cost_init, std::uint8_t* cost_aggr, bool is_forward) {
+void ComputeCensusCostRowPlanar(const std::uint64_t* left_census, const std::uint64_t* right_census,
+                                const int& height, const int& width,
+                                const int& min_disparity, const int& max_disparity, std::uint8_t* cost_init,
+                                const CensusRegion& region) {
+	compute_census_cost_row_planar(left_census, right_census, height, width, min_disparity, max_disparity, cost_init, region);
+}
+
+template <typename T>
+static void accumulate_census_cost(const T* left_census, const T* right_census,
+                                   const int& height, const int& width,
+                                   const int& min_disparity, const int& max_disparity, const float& disparity_scale,
+                                   std::uint16_t* cost_sum, const bool& is_first, const CensusRegion& region,
+                                   const bool& is_row_planar, const std::uint8_t* valid_mask) {
+	const int disp_range = max_disparity - min_disparity;
+	if (disp_range <= 0) {
+		return;
+	}
+	sgm_trace::Scope trace("census cost (multi-baseline)");
+
+	// 每个参考视差在次影像上的整数视差及插值权重：次影像视差 = shift + weight / One
+	const int One = 1 << Multi_Cost_Frac_Bits;
+	std::vector<int> shifts(disp_range), weights(disp_range);
+	for (int d = 0; d < disp_range; d++) {
+		const float disparity = (min_disparity + d) * disparity_scale;
+		int shift = static_cast<int>(std::floor(disparity));
+		int weight = static_cast<int>(std::lround((disparity - shift) * One));
+		if (weight == One) {
+			shift++;
+			weight = 0;
+		}
+		shifts[d] = shift;
+		weights[d] = weight;
+	}
+
+	// 超出次影像census有效列的列取与单基线相同的代价
+	const int col_begin = std::min(width, std::max(0, region.col_begin));
+	const int col_end = std::max(col_begin, std::min(width, region.col_end));
+	auto column_cost = [&](const T& left_census_val, const T* right_row, const int& col) -> int {
+		return (col < col_begin || col >= col_end) ? Invalid_Cost : HammingDistance(left_census_val, right_row[col]);
+	};
+
+	// 代价体中相邻像素、相邻视差的间隔
+	const int pixel_stride = is_row_planar ? 1 : disp_range;
+	const int disp_stride = is_row_planar ? width : 1;
+
+	for (int i = 0; i < height; i++) {
+		const T* right_row = right_census + i * width;
+		for (int j = 0; j < width; j++) {
+			if (valid_mask != nullptr && !valid_mask[i * width + j]) {
+				continue;
+			}
+			const T left_census_val = left_census[i * width + j];
+			std::uint16_t* cost = cost_sum + i * width * disp_range + j * pixel_stride;
+			// 参考影像无census值的像素各视差取Invalid_Cost
+			if (i < region.row_begin || i >= region.row_end || j < col_begin || j >= col_end) {
+				for (int d = 0; d < disp_range; d++) {
+					std::uint16_t& sum = cost[d * disp_stride];
+					sum = static_cast<std::uint16_t>((is_first ? 0 : sum) + One * Invalid_Cost);
+				}
+				continue;
+			}
+			for (int d = 0; d < disp_range; d++) {
+				// 次影像视差在shift与shift+1之间，对应列j-shift与j-shift-1
+				const int col = j - shifts[d];
+				const int weight = weights[d];
+				int value = (One - weight) * column_cost(left_census_val, right_row, col);
+				if (weight != 0) {
+					value += weight * column_cost(left_census_val, right_row, col - 1);
+				}
+				std::uint16_t& sum = cost[d * disp_stride];
+				sum = static_cast<std::uint16_t>(is_first ? value : sum + value);
+			}
+		}
+	}
+}
+
+void AccumulateCensusCost(const std::uint32_t* left_census, const std::uint32_t* right_census,
+                          const int& height, const int& width,
+                          const int& min_disparity, const int& max_disparity, const float& disparity_scale,
+                          std::uint16_t* cost_sum, const bool& is_first, const CensusRegion& region,
+                          const bool& is_row_planar, const std::uint8_t* valid_mask) {
+	accumulate_census_cost(left_census, right_census, height, width, min_disparity, max_disparity, disparity_scale,
+	                       cost_sum, is_first, region, is_row_planar, valid_mask);
+}
+
+void AccumulateCensusCost(const std::uint64_t* left_census, const std::uint64_t* right_census,
+                          const int& height, const int& width,
+                          const int& min_disparity, const int& max_disparity, const float& disparity_scale,
+                          std::uint16_t* cost_sum, const bool& is_first, const CensusRegion& region,
+                          const bool& is_row_planar, const std::uint8_t* valid_mask) {
+	accumulate_census_cost(left_census, right_census, height, width, min_disparity, max_disparity, disparity_scale,
+	                       cost_sum, is_first, region, is_row_planar, valid_mask);
+}
+
+void AverageAccumulatedCost(const std::uint16_t* cost_sum, const int& num_views, const int& size, std::uint8_t* cost_init) {
+	const int divisor = num_views << Multi_Cost_Frac_Bits;
+	const int half = divisor / 2;
+	for (int k = 0; k < size; k++) {
+		cost_init[k] = static_cast<std::uint8_t>((cost_sum[k] + half) / divisor);
+	}
+}
+
+
+// 路径代价类型的上限及递推的中间类型：uint8路径代价按uint16递推，uint16路径代价按uint32递推
+template <typename A>
+struct PathCostTraits;
+
+template <>
+struct PathCostTraits<std::uint8_t> {
+	typedef std::uint16_t Wide;
+	static std::uint8_t Max() { return UINT8_MAX; }
+};
+
+template <>
+struct PathCostTraits<std::uint16_t> {
+	typedef std::uint32_t Wide;
+	static std::uint16_t Max() { return UINT16_MAX; }
+};
+
+// 路径代价饱和到路径代价类型的上限，而不是回绕
+template <typename A>
+static inline A saturate_path_cost(const typename PathCostTraits<A>::Wide& cost) {
+	return static_cast<A>(std::min<typename PathCostTraits<A>::Wide>(cost, PathCostTraits<A>::Max()));
+}
+
+// 掩膜处理：无效像素处中断路径，中断后遇到的首个有效像素作为新的路径头（聚合代价等于初始代价）
+// 返回true表示当前像素已处理（无效像素或新的路径头），无需再按递推公式聚合
+template <typename A>
+static bool restart_path_at_mask(const bool& is_valid, bool& is_path_broken,
+                                 const std::uint8_t* cost_init, A* cost_aggr, const int& disp_range,
+                                 std::vector<A>& cost_last_path, A& mincost_last_path) {
+	if (is_valid && !is_path_broken) {
+		return false;
+	}
+	if (is_valid) {
+		std::copy(cost_init, cost_init + disp_range, cost_aggr);
+		memcpy(&cost_last_path[1], cost_aggr, disp_range * sizeof(A));
+		mincost_last_path = *std::min_element(cost_aggr, cost_aggr + disp_range);
+	}
+	is_path_broken = !is_valid;
+	return true;
+}
+
+template <typename P, typename A>
+static void cost_aggregate_left_right(const P* img_data, const int& height, const int& width, 
+                                      const int& min_disparity, const int& max_disparity,
+                                      const int& p1, const int& p2_init, 
+                                      const std::uint8_t* cost_init, A* cost_aggr, bool is_forward,
+                                      const std::uint8_t* valid_mask, const int& gray_shift) {
 	assert(width > 0 && height > 0 && max_disparity > min_disparity);
 
 	// 视差范围
@@ -130,6 +513,7 @@ void CostAggregateLeftRight(const std::uint8_t* img_data, const int& height, con
 	// P1,P2
 	const auto& P1 = p1;
 	const auto& P2_Init = p2_init;
+	typedef typename PathCostTraits<A>::Wide W;
 
 	// 正向(左->右) ：is_forward = true ; direction = 1
 	// 反向(右->左) ：is_forward = false; direction = -1;
@@ -143,21 +527,24 @@ void CostAggregateLeftRight(const std::uint8_t* img_data, const int& height, con
 		auto img_row = (is_forward) ? (img_data + i * width) : (img_data + i * width + width - 1);
 
 		// 路径上当前灰度值和上一个灰度值
-		std::uint8_t gray = *img_row;
-		std::uint8_t gray_last = *img_row;
+		P gray = *img_row;
+		P gray_last = *img_row;
 
 		// 路径上上个像素的代价数组，多两个元素是为了避免边界溢出（首尾各多一个）
-		std::vector<std::uint8_t> cost_last_path(disp_range + 2, UINT8_MAX);
+		std::vector<A> cost_last_path(disp_range + 2, PathCostTraits<A>::Max());
 
 		// 初始化：第一个像素的聚合代价值等于初始代价值
-		memcpy(cost_aggr_row, cost_init_row, disp_range * sizeof(std::uint8_t));
-		memcpy(&cost_last_path[1], cost_aggr_row, disp_range * sizeof(std::uint8_t));
+		std::copy(cost_init_row, cost_init_row + disp_range, cost_aggr_row);
+		memcpy(&cost_last_path[1], cost_aggr_row, disp_range * sizeof(A));
+
+		// 掩膜：路径头为无效像素时，路径从下一个有效像素重新开始
+		bool is_path_broken = valid_mask != nullptr && !valid_mask[img_row - img_data];
 		cost_init_row += direction * disp_range;
 		cost_aggr_row += direction * disp_range;
 		img_row += direction;
 
 		// 路径上上个像素的最小代价值
-		std::uint8_t mincost_last_path = UINT8_MAX;
+		A mincost_last_path = PathCostTraits<A>::Max();
 		for (auto cost : cost_last_path) {
 			mincost_last_path = std::min(mincost_last_path, cost);
 		}
@@ -165,24 +552,28 @@ void CostAggregateLeftRight(const std::uint8_t* img_data, const int& height, con
 		// 自方向上第2个像素开始按顺序聚合
 		for (int j = 0; j < width - 1; j++) {
 			gray = *img_row;
-			std::uint8_t min_cost = UINT8_MAX;
-			for (int d = 0; d < disp_range; d++){
-				// Lr(p,d) = C(p,d) + min( Lr(p-r,d), Lr(p-r,d-1) + P1, Lr(p-r,d+1) + P1, min(Lr(p-r))+P2 ) - min(Lr(p-r))
-				const std::uint8_t  cost = cost_init_row[d];
-				const std::uint16_t l1 = cost_last_path[d + 1];
-				const std::uint16_t l2 = cost_last_path[d] + P1;
-				const std::uint16_t l3 = cost_last_path[d + 2] + P1;
-				const std::uint16_t l4 = mincost_last_path + std::max(P1, P2_Init / (abs(gray - gray_last) + 1));
+			if (valid_mask == nullptr 
+			        || !restart_path_at_mask(valid_mask[img_row - img_data] != 0, is_path_broken, cost_init_row, cost_aggr_row, 
+			                                 disp_range, cost_last_path, mincost_last_path)) {
+				A min_cost = PathCostTraits<A>::Max();
+				for (int d = 0; d < disp_range; d++){
+					// Lr(p,d) = C(p,d) + min( Lr(p-r,d), Lr(p-r,d-1) + P1, Lr(p-r,d+1) + P1, min(Lr(p-r))+P2 ) - min(Lr(p-r))
+					const std::uint8_t  cost = cost_init_row[d];
+					const W l1 = cost_last_path[d + 1];
+					const W l2 = cost_last_path[d] + P1;
+					const W l3 = cost_last_path[d + 2] + P1;
+					const W l4 = mincost_last_path + std::max(P1, P2_Init / ((abs(gray - gray_last) >> gray_shift) + 1));
 				
-				const std::uint8_t cost_s = cost + static_cast<std::uint8_t>(std::min(std::min(l1, l2), std::min(l3, l4)) - mincost_last_path);
+					const A cost_s = saturate_path_cost<A>(cost + (std::min(std::min(l1, l2), std::min(l3, l4)) - mincost_last_path));
 				
-				cost_aggr_row[d] = cost_s;
-				min_cost = std::min(min_cost, cost_s);
-			}
+					cost_aggr_row[d] = cost_s;
+					min_cost = std::min(min_cost, cost_s);
+				}
 
-			// 重置上个像素的最小代价值和代价数组
-			mincost_last_path = min_cost;
-			memcpy(&cost_last_path[1], cost_aggr_row, disp_range * sizeof(std::uint8_t));
+				// 重置上个像素的最小代价值和代价数组
+				mincost_last_path = min_cost;
+				memcpy(&cost_last_path[1], cost_aggr_row, disp_range * sizeof(A));
+			}
 
 			// 下一个像素
 			cost_init_row += direction * disp_range;
@@ -195,10 +586,48 @@ void CostAggregateLeftRight(const std::uint8_t* img_data, const int& height, con
 	}
 }
 
-void CostAggregateUpDown(const std::uint8_t* img_data, const int& height, const int& width,
-	                     const int& min_disparity, const int& max_disparity, 
-                         const int& p1, const int& p2_init,
-	                     const std::uint8_t* cost_init, std::uint8_t* cost_aggr, bool is_forward) {
+void CostAggregateLeftRight(const std::uint8_t* img_data, const int& height, const int& width, 
+                            const int& min_disparity, const int& max_disparity,
+                            const int& p1, const int& p2_init, 
+                            const std::uint8_t* cost_init, std::uint8_t* cost_aggr, bool is_forward,
+                            const std::uint8_t* valid_mask, const int& gray_shift) {
+	cost_aggregate_left_right(img_data, height, width, min_disparity, max_disparity, p1, p2_init,
+	                          cost_init, cost_aggr, is_forward, valid_mask, gray_shift);
+}
+
+void CostAggregateLeftRight(const std::uint16_t* img_data, const int& height, const int& width, 
+                            const int& min_disparity, const int& max_disparity,
+                            const int& p1, const int& p2_init, 
+                            const std::uint8_t* cost_init, std::uint8_t* cost_aggr, bool is_forward,
+                            const std::uint8_t* valid_mask, const int& gray_shift) {
+	cost_aggregate_left_right(img_data, height, width, min_disparity, max_disparity, p1, p2_init,
+	                          cost_init, cost_aggr, is_forward, valid_mask, gray_shift);
+}
+
+void CostAggregateLeftRight(const std::uint8_t* img_data, const int& height, const int& width, 
+                            const int& min_disparity, const int& max_disparity,
+                            const int& p1, const int& p2_init, 
+                            const std::uint8_t* cost_init, std::uint16_t* cost_aggr, bool is_forward,
+                            const std::uint8_t* valid_mask, const int& gray_shift) {
+	cost_aggregate_left_right(img_data, height, width, min_disparity, max_disparity, p1, p2_init,
+	                          cost_init, cost_aggr, is_forward, valid_mask, gray_shift);
+}
+
+void CostAggregateLeftRight(const std::uint16_t* img_data, const int& height, const int& width, 
+                            const int& min_disparity, const int& max_disparity,
+                            const int& p1, const int& p2_init, 
+                            const std::uint8_t* cost_init, std::uint16_t* cost_aggr, bool is_forward,
+                            const std::uint8_t* valid_mask, const int& gray_shift) {
+	cost_aggregate_left_right(img_data, height, width, min_disparity, max_disparity, p1, p2_init,
+	                          cost_init, cost_aggr, is_forward, valid_mask, gray_shift);
+}
+
+template <typename P, typename A>
+static void cost_aggregate_up_down(const P* img_data, const int& height, const int& width,
+                                   const int& min_disparity, const int& max_disparity, 
+                                   const int& p1, const int& p2_init,
+                                   const std::uint8_t* cost_init, A* cost_aggr, bool is_forward,
+                                   const std::uint8_t* valid_mask, const int& gray_shift) {
 	assert(width > 0 && height > 0 && max_disparity > min_disparity);
 
 	// 视差范围
@@ -207,6 +636,7 @@ void CostAggregateUpDown(const std::uint8_t* img_data, const int& height, const
 	// P1,P2
 	const auto& P1 = p1;
 	const auto& P2_Init = p2_init;
+	typedef typename PathCostTraits<A>::Wide W;
 
 	// 正向(上->下) ：is_forward = true ; direction = 1
 	// 反向(下->上) ：is_forward = false; direction = -1;
@@ -220,21 +650,24 @@ void CostAggregateUpDown(const std::uint8_t* img_data, const int& height, const
 		auto img_col = (is_forward) ? (img_data + j) : (img_data + (height - 1) * width + j);
 
 		// 路径上当前灰度值和上一个灰度值
-		std::uint8_t gray = *img_col;
-		std::uint8_t gray_last = *img_col;
+		P gray = *img_col;
+		P gray_last = *img_col;
 
 		// 路径上上个像素的代价数组，多两个元素是为了避免边界溢出（首尾各多一个）
-		std::vector<std::uint8_t> cost_last_path(disp_range + 2, UINT8_MAX);
+		std::vector<A> cost_last_path(disp_range + 2, PathCostTraits<A>::Max());
 
 		// 初始化：第一个像素的聚合代价值等于初始代价值
-		memcpy(cost_aggr_col, cost_init_col, disp_range * sizeof(std::uint8_t));
-		memcpy(&cost_last_path[1], cost_aggr_col, disp_range * sizeof(std::uint8_t));
+		std::copy(cost_init_col, cost_init_col + disp_range, cost_aggr_col);
+		memcpy(&cost_last_path[1], cost_aggr_col, disp_range * sizeof(A));
+
+		// 掩膜：路径头为无效像素时，路径从下一个有效像素重新开始
+		bool is_path_broken = valid_mask != nullptr && !valid_mask[img_col - img_data];
 		cost_init_col += direction * width * disp_range;
 		cost_aggr_col += direction * width * disp_range;
 		img_col += direction * width;
 
 		// 路径上上个像素的最小代价值
-		std::uint8_t mincost_last_path = UINT8_MAX;
+		A mincost_last_path = PathCostTraits<A>::Max();
 		for (auto cost : cost_last_path) {
 			mincost_last_path = std::min(mincost_last_path, cost);
 		}
@@ -242,25 +675,29 @@ void CostAggregateUpDown(const std::uint8_t* img_data, const int& height, const
 		// 自方向上第2个像素开始按顺序聚合
 		for (int i = 0; i < height - 1; i ++) {
 			gray = *img_col;
-			std::uint8_t min_cost = UINT8_MAX;
-			for (int d = 0; d < disp_range; d++) {
-				// Lr(p,d) = C(p,d) + min( Lr(p-r,d), Lr(p-r,d-1) + P1, Lr(p-r,d+1) + P1, min(Lr(p-r))+P2 ) - min(Lr(p-r))
-				const std::uint8_t  cost = cost_init_col[d];
-				const std::uint16_t l1 = cost_last_path[d + 1];
-				const std::uint16_t l2 = cost_last_path[d] + P1;
-				const std::uint16_t l3 = cost_last_path[d + 2] + P1;
-				const std::uint16_t l4 = mincost_last_path + std::max(P1, P2_Init / (abs(gray - gray_last) + 1));
-
-				const std::uint8_t cost_s = cost + static_cast<std::uint8_t>(std::min(std::min(l1, l2), std::min(l3, l4)) - mincost_last_path);
+			if (valid_mask == nullptr 
+			        || !restart_path_at_mask(valid_mask[img_col - img_data] != 0, is_path_broken, cost_init_col, cost_aggr_col, 
+			                                 disp_range, cost_last_path, mincost_last_path)) {
+				A min_cost = PathCostTraits<A>::Max();
+				for (int d = 0; d < disp_range; d++) {
+					// Lr(p,d) = C(p,d) + min( Lr(p-r,d), Lr(p-r,d-1) + P1, Lr(p-r,d+1) + P1, min(Lr(p-r))+P2 ) - min(Lr(p-r))
+					const std::uint8_t  cost = cost_init_col[d];
+					const W l1 = cost_last_path[d + 1];
+					const W l2 = cost_last_path[d] + P1;
+					const W l3 = cost_last_path[d + 2] + P1;
+					const W l4 = mincost_last_path + std::max(P1, P2_Init / ((abs(gray - gray_last) >> gray_shift) + 1));
+
+					const A cost_s = saturate_path_cost<A>(cost + (std::min(std::min(l1, l2), std::min(l3, l4)) - mincost_last_path));
+
+					cost_aggr_col[d] = cost_s;
+					min_cost = std::min(min_cost, cost_s);
+				}
 
-				cost_aggr_col[d] = cost_s;
-				min_cost = std::min(min_cost, cost_s);
+				// 重置上个像素的最小代价值和代价数组
+				mincost_last_path = min_cost;
+				memcpy(&cost_last_path[1], cost_aggr_col, disp_range * sizeof(A));
 			}
 
-			// 重置上个像素的最小代价值和代价数组
-			mincost_last_path = min_cost;
-			memcpy(&cost_last_path[1], cost_aggr_col, disp_range * sizeof(std::uint8_t));
-
 			// 下一个像素
 			cost_init_col += direction * width * disp_range;
 			cost_aggr_col += direction * width * disp_range;
@@ -272,10 +709,48 @@ void CostAggregateUpDown(const std::uint8_t* img_data, const int& height, const
 	}
 }
 
-void CostAggregateDagonal_1(const std::uint8_t* img_data, const int& height, const int& width,
-	                        const int& min_disparity, const int& max_disparity, 
-                            const int& p1, const int& p2_init,
-	                        const std::uint8_t* cost_init, std::uint8_t* cost_aggr, bool is_forward) {
+void CostAggregateUpDown(const std::uint8_t* img_data, const int& height, const int& width, 
+                         const int& min_disparity, const int& max_disparity,
+                         const int& p1, const int& p2_init, 
+                         const std::uint8_t* cost_init, std::uint8_t* cost_aggr, bool is_forward,
+                         const std::uint8_t* valid_mask, const int& gray_shift) {
+	cost_aggregate_up_down(img_data, height, width, min_disparity, max_disparity, p1, p2_init,
+	                       cost_init, cost_aggr, is_forward, valid_mask, gray_shift);
+}
+
+void CostAggregateUpDown(const std::uint16_t* img_data, const int& height, const int& width, 
+                         const int& min_disparity, const int& max_disparity,
+                         const int& p1, const int& p2_init, 
+                         const std::uint8_t* cost_init, std::uint8_t* cost_aggr, bool is_forward,
+                         const std::uint8_t* valid_mask, const int& gray_shift) {
+	cost_aggregate_up_down(img_data, height, width, min_disparity, max_disparity, p1, p2_init,
+	                       cost_init, cost_aggr, is_forward, valid_mask, gray_shift);
+}
+
+void CostAggregateUpDown(const std::uint8_t* img_data, const int& height, const int& width, 
+                         const int& min_disparity, const int& max_disparity,
+                         const int& p1, const int& p2_init, 
+                         const std::uint8_t* cost_init, std::uint16_t* cost_aggr, bool is_forward,
+                         const std::uint8_t* valid_mask, const int& gray_shift) {
+	cost_aggregate_up_down(img_data, height, width, min_disparity, max_disparity, p1, p2_init,
+	                       cost_init, cost_aggr, is_forward, valid_mask, gray_shift);
+}
+
+void CostAggregateUpDown(const std::uint16_t* img_data, const int& height, const int& width, 
+                         const int& min_disparity, const int& max_disparity,
+                         const int& p1, const int& p2_init, 
+                         const std::uint8_t* cost_init, std::uint16_t* cost_aggr, bool is_forward,
+                         const std::uint8_t* valid_mask, const int& gray_shift) {
+	cost_aggregate_up_down(img_data, height, width, min_disparity, max_disparity, p1, p2_init,
+	                       cost_init, cost_aggr, is_forward, valid_mask, gray_shift);
+}
+
+template <typename P, typename A>
+static void cost_aggregate_dagonal_1(const P* img_data, const int& height, const int& width,
+                                     const int& min_disparity, const int& max_disparity, 
+                                     const int& p1, const int& p2_init,
+                                     const std::uint8_t* cost_init, A* cost_aggr, bool is_forward,
+                                     const std::uint8_t* valid_mask, const int& gray_shift) {
 	assert(width > 1 && height > 1 && max_disparity > min_disparity);
 
 	// 视差范围
@@ -284,6 +759,7 @@ void CostAggregateDagonal_1(const std::uint8_t* img_data, const int& height, con
 	// P1,P2
 	const auto& P1 = p1;
 	const auto& P2_Init = p2_init;
+	typedef typename PathCostTraits<A>::Wide W;
 
 	// 正向(左上->右下) ：is_forward = true ; direction = 1
 	// 反向(右下->左上) ：is_forward = false; direction = -1;
@@ -302,15 +778,18 @@ void CostAggregateDagonal_1(const std::uint8_t* img_data, const int& height, con
 		auto img_col = (is_forward) ? (img_data + j) : (img_data + (height - 1) * width + j);
 
 		// 路径上上个像素的代价数组，多两个元素是为了避免边界溢出（首尾各多一个）
-		std::vector<std::uint8_t> cost_last_path(disp_range + 2, UINT8_MAX);
+		std::vector<A> cost_last_path(disp_range + 2, PathCostTraits<A>::Max());
 
 		// 初始化：第一个像素的聚合代价值等于初始代价值
-		memcpy(cost_aggr_col, cost_init_col, disp_range * sizeof(std::uint8_t));
-		memcpy(&cost_last_path[1], cost_aggr_col, disp_range * sizeof(std::uint8_t));
+		std::copy(cost_init_col, cost_init_col + disp_range, cost_aggr_col);
+		memcpy(&cost_last_path[1], cost_aggr_col, disp_range * sizeof(A));
+
+		// 掩膜：路径头为无效像素时，路径从下一个有效像素重新开始
+		bool is_path_broken = valid_mask != nullptr && !valid_mask[img_col - img_data];
 
 		// 路径上当前灰度值和上一个灰度值
-		std::uint8_t gray = *img_col;
-		std::uint8_t gray_last = *img_col;
+		P gray = *img_col;
+		P gray_last = *img_col;
 
 		// 对角线路径上的下一个像素，中间间隔width+1个像素
 		// 这里要多一个边界处理
@@ -336,7 +815,7 @@ void CostAggregateDagonal_1(const std::uint8_t* img_data, const int& height, con
 		}
 
 		// 路径上上个像素的最小代价值
-		std::uint8_t mincost_last_path = UINT8_MAX;
+		A mincost_last_path = PathCostTraits<A>::Max();
 		for (auto cost : cost_last_path) {
 			mincost_last_path = std::min(mincost_last_path, cost);
 		}
@@ -344,25 +823,29 @@ void CostAggregateDagonal_1(const std::uint8_t* img_data, const int& height, con
 		// 自方向上第2个像素开始按顺序聚合
 		for (int i = 0; i < height - 1; i ++) {
 			gray = *img_col;
-			std::uint8_t min_cost = UINT8_MAX;
-			for (int d = 0; d < disp_range; d++) {
-				// Lr(p,d) = C(p,d) + min( Lr(p-r,d), Lr(p-r,d-1) + P1, Lr(p-r,d+1) + P1, min(Lr(p-r))+P2 ) - min(Lr(p-r))
-				const std::uint8_t  cost = cost_init_col[d];
-				const std::uint16_t l1 = cost_last_path[d + 1];
-				const std::uint16_t l2 = cost_last_path[d] + P1;
-				const std::uint16_t l3 = cost_last_path[d + 2] + P1;
-				const std::uint16_t l4 = mincost_last_path + std::max(P1, P2_Init / (abs(gray - gray_last) + 1));
-
-				const std::uint8_t cost_s = cost + static_cast<std::uint8_t>(std::min(std::min(l1, l2), std::min(l3, l4)) - mincost_last_path);
+			if (valid_mask == nullptr 
+			        || !restart_path_at_mask(valid_mask[img_col - img_data] != 0, is_path_broken, cost_init_col, cost_aggr_col, 
+			                                 disp_range, cost_last_path, mincost_last_path)) {
+				A min_cost = PathCostTraits<A>::Max();
+				for (int d = 0; d < disp_range; d++) {
+					// Lr(p,d) = C(p,d) + min( Lr(p-r,d), Lr(p-r,d-1) + P1, Lr(p-r,d+1) + P1, min(Lr(p-r))+P2 ) - min(Lr(p-r))
+					const std::uint8_t  cost = cost_init_col[d];
+					const W l1 = cost_last_path[d + 1];
+					const W l2 = cost_last_path[d] + P1;
+					const W l3 = cost_last_path[d + 2] + P1;
+					const W l4 = mincost_last_path + std::max(P1, P2_Init / ((abs(gray - gray_last) >> gray_shift) + 1));
+
+					const A cost_s = saturate_path_cost<A>(cost + (std::min(std::min(l1, l2), std::min(l3, l4)) - mincost_last_path));
+
+					cost_aggr_col[d] = cost_s;
+					min_cost = std::min(min_cost, cost_s);
+				}
 
-				cost_aggr_col[d] = cost_s;
-				min_cost = std::min(min_cost, cost_s);
+				// 重置上个像素的最小代价值和代价数组
+				mincost_last_path = min_cost;
+				memcpy(&cost_last_path[1], cost_aggr_col, disp_range * sizeof(A));
 			}
 
-			// 重置上个像素的最小代价值和代价数组
-			mincost_last_path = min_cost;
-			memcpy(&cost_last_path[1], cost_aggr_col, disp_range * sizeof(std::uint8_t));
-
 			// 当前像素的行列号
 			current_row += direction;
 			current_col += direction;
@@ -394,10 +877,48 @@ void CostAggregateDagonal_1(const std::uint8_t* img_data, const int& height, con
 	}
 }
 
-void CostAggregateDagonal_2(const std::uint8_t* img_data, const int& height, const int& width,
-	                        const int& min_disparity, const int& max_disparity, 
-                            const int& p1, const int& p2_init,
-	                        const std::uint8_t* cost_init, std::uint8_t* cost_aggr, bool is_forward) {
+void CostAggregateDagonal_1(const std::uint8_t* img_data, const int& height, const int& width, 
+                            const int& min_disparity, const int& max_disparity,
+                            const int& p1, const int& p2_init, 
+                            const std::uint8_t* cost_init, std::uint8_t* cost_aggr, bool is_forward,
+                            const std::uint8_t* valid_mask, const int& gray_shift) {
+	cost_aggregate_dagonal_1(img_data, height, width, min_disparity, max_disparity, p1, p2_init,
+	                         cost_init, cost_aggr, is_forward, valid_mask, gray_shift);
+}
+
+void CostAggregateDagonal_1(const std::uint16_t* img_data, const int& height, const int& width, 
+                            const int& min_disparity, const int& max_disparity,
+                            const int& p1, const int& p2_init, 
+                            const std::uint8_t* cost_init, std::uint8_t* cost_aggr, bool is_forward,
+                            const std::uint8_t* valid_mask, const int& gray_shift) {
+	cost_aggregate_dagonal_1(img_data, height, width, min_disparity, max_disparity, p1, p2_init,
+	                         cost_init, cost_aggr, is_forward, valid_mask, gray_shift);
+}
+
+void CostAggregateDagonal_1(const std::uint8_t* img_data, const int& height, const int& width, 
+                            const int& min_disparity, const int& max_disparity,
+                            const int& p1, const int& p2_init, 
+                            const std::uint8_t* cost_init, std::uint16_t* cost_aggr, bool is_forward,
+                            const std::uint8_t* valid_mask, const int& gray_shift) {
+	cost_aggregate_dagonal_1(img_data, height, width, min_disparity, max_disparity, p1, p2_init,
+	                         cost_init, cost_aggr, is_forward, valid_mask, gray_shift);
+}
+
+void CostAggregateDagonal_1(const std::uint16_t* img_data, const int& height, const int& width, 
+                            const int& min_disparity, const int& max_disparity,
+                            const int& p1, const int& p2_init, 
+                            const std::uint8_t* cost_init, std::uint16_t* cost_aggr, bool is_forward,
+                            const std::uint8_t* valid_mask, const int& gray_shift) {
+	cost_aggregate_dagonal_1(img_data, height, width, min_disparity, max_disparity, p1, p2_init,
+	                         cost_init, cost_aggr, is_forward, valid_mask, gray_shift);
+}
+
+template <typename P, typename A>
+static void cost_aggregate_dagonal_2(const P* img_data, const int& height, const int& width,
+                                     const int& min_disparity, const int& max_disparity, 
+                                     const int& p1, const int& p2_init,
+                                     const std::uint8_t* cost_init, A* cost_aggr, bool is_forward,
+                                     const std::uint8_t* valid_mask, const int& gray_shift) {
 	assert(width > 1 && height > 1 && max_disparity > min_disparity);
 
 	// 视差范围
@@ -406,6 +927,7 @@ void CostAggregateDagonal_2(const std::uint8_t* img_data, const int& height, con
 	// P1,P2
 	const auto& P1 = p1;
 	const auto& P2_Init = p2_init;
+	typedef typename PathCostTraits<A>::Wide W;
 
 	// 正向(右上->左下) ：is_forward = true ; direction = 1
 	// 反向(左下->右上) ：is_forward = false; direction = -1;
@@ -424,15 +946,18 @@ void CostAggregateDagonal_2(const std::uint8_t* img_data, const int& height, con
 		auto img_col = (is_forward) ? (img_data + j) : (img_data + (height - 1) * width + j);
 
 		// 路径上上个像素的代价数组，多两个元素是为了避免边界溢出（首尾各多一个）
-		std::vector<std::uint8_t> cost_last_path(disp_range + 2, UINT8_MAX);
+		std::vector<A> cost_last_path(disp_range + 2, PathCostTraits<A>::Max());
 
 		// 初始化：第一个像素的聚合代价值等于初始代价值
-		memcpy(cost_aggr_col, cost_init_col, disp_range * sizeof(std::uint8_t));
-		memcpy(&cost_last_path[1], cost_aggr_col, disp_range * sizeof(std::uint8_t));
+		std::copy(cost_init_col, cost_init_col + disp_range, cost_aggr_col);
+		memcpy(&cost_last_path[1], cost_aggr_col, disp_range * sizeof(A));
+
+		// 掩膜：路径头为无效像素时，路径从下一个有效像素重新开始
+		bool is_path_broken = valid_mask != nullptr && !valid_mask[img_col - img_data];
 
 		// 路径上当前灰度值和上一个灰度值
-		std::uint8_t gray = *img_col;
-		std::uint8_t gray_last = *img_col;
+		P gray = *img_col;
+		P gray_last = *img_col;
 
 		// 对角线路径上的下一个像素，中间间隔width-1个像素
 		// 这里要多一个边界处理
@@ -458,7 +983,7 @@ void CostAggregateDagonal_2(const std::uint8_t* img_data, const int& height, con
 		}
 
 		// 路径上上个像素的最小代价值
-		std::uint8_t mincost_last_path = UINT8_MAX;
+		A mincost_last_path = PathCostTraits<A>::Max();
 		for (auto cost : cost_last_path) {
 			mincost_last_path = std::min(mincost_last_path, cost);
 		}
@@ -466,25 +991,29 @@ void CostAggregateDagonal_2(const std::uint8_t* img_data, const int& height, con
 		// 自路径上第2个像素开始按顺序聚合
 		for (int i = 0; i < height - 1; i++) {
 			gray = *img_col;
-			std::uint8_t min_cost = UINT8_MAX;
-			for (int d = 0; d < disp_range; d++) {
-				// Lr(p,d) = C(p,d) + min( Lr(p-r,d), Lr(p-r,d-1) + P1, Lr(p-r,d+1) + P1, min(Lr(p-r))+P2 ) - min(Lr(p-r))
-				const std::uint8_t  cost = cost_init_col[d];
-				const std::uint16_t l1 = cost_last_path[d + 1];
-				const std::uint16_t l2 = cost_last_path[d] + P1;
-				const std::uint16_t l3 = cost_last_path[d + 2] + P1;
-				const std::uint16_t l4 = mincost_last_path + std::max(P1, P2_Init / (abs(gray - gray_last) + 1));
-
-				const std::uint8_t cost_s = cost + static_cast<std::uint8_t>(std::min(std::min(l1, l2), std::min(l3, l4)) - mincost_last_path);
+			if (valid_mask == nullptr 
+			        || !restart_path_at_mask(valid_mask[img_col - img_data] != 0, is_path_broken, cost_init_col, cost_aggr_col, 
+			                                 disp_range, cost_last_path, mincost_last_path)) {
+				A min_cost = PathCostTraits<A>::Max();
+				for (int d = 0; d < disp_range; d++) {
+					// Lr(p,d) = C(p,d) + min( Lr(p-r,d), Lr(p-r,d-1) + P1, Lr(p-r,d+1) + P1, min(Lr(p-r))+P2 ) - min(Lr(p-r))
+					const std::uint8_t  cost = cost_init_col[d];
+					const W l1 = cost_last_path[d + 1];
+					const W l2 = cost_last_path[d] + P1;
+					const W l3 = cost_last_path[d + 2] + P1;
+					const W l4 = mincost_last_path + std::max(P1, P2_Init / ((abs(gray - gray_last) >> gray_shift) + 1));
+
+					const A cost_s = saturate_path_cost<A>(cost + (std::min(std::min(l1, l2), std::min(l3, l4)) - mincost_last_path));
+
+					cost_aggr_col[d] = cost_s;
+					min_cost = std::min(min_cost, cost_s);
+				}
 
-				cost_aggr_col[d] = cost_s;
-				min_cost = std::min(min_cost, cost_s);
+				// 重置上个像素的最小代价值和代价数组
+				mincost_last_path = min_cost;
+				memcpy(&cost_last_path[1], cost_aggr_col, disp_range * sizeof(A));
 			}
 
-			// 重置上个像素的最小代价值和代价数组
-			mincost_last_path = min_cost;
-			memcpy(&cost_last_path[1], cost_aggr_col, disp_range * sizeof(std::uint8_t));
-
 			// 当前像素的行列号
 			current_row += direction;
 			current_col -= direction;
@@ -516,14 +1045,480 @@ void CostAggregateDagonal_2(const std::uint8_t* img_data, const int& height, con
 	}
 }
 
-void MedianFilter(const float* in, float* out, 
-                  const int& height, const int& width, 
-                  const int window_size) {
+void CostAggregateDagonal_2(const std::uint8_t* img_data, const int& height, const int& width, 
+                            const int& min_disparity, const int& max_disparity,
+                            const int& p1, const int& p2_init, 
+                            const std::uint8_t* cost_init, std::uint8_t* cost_aggr, bool is_forward,
+                            const std::uint8_t* valid_mask, const int& gray_shift) {
+	cost_aggregate_dagonal_2(img_data, height, width, min_disparity, max_disparity, p1, p2_init,
+	                         cost_init, cost_aggr, is_forward, valid_mask, gray_shift);
+}
+
+void CostAggregateDagonal_2(const std::uint16_t* img_data, const int& height, const int& width, 
+                            const int& min_disparity, const int& max_disparity,
+                            const int& p1, const int& p2_init, 
+                            const std::uint8_t* cost_init, std::uint8_t* cost_aggr, bool is_forward,
+                            const std::uint8_t* valid_mask, const int& gray_shift) {
+	cost_aggregate_dagonal_2(img_data, height, width, min_disparity, max_disparity, p1, p2_init,
+	                         cost_init, cost_aggr, is_forward, valid_mask, gray_shift);
+}
+
+void CostAggregateDagonal_2(const std::uint8_t* img_data, const int& height, const int& width, 
+                            const int& min_disparity, const int& max_disparity,
+                            const int& p1, const int& p2_init, 
+                            const std::uint8_t* cost_init, std::uint16_t* cost_aggr, bool is_forward,
+                            const std::uint8_t* valid_mask, const int& gray_shift) {
+	cost_aggregate_dagonal_2(img_data, height, width, min_disparity, max_disparity, p1, p2_init,
+	                         cost_init, cost_aggr, is_forward, valid_mask, gray_shift);
+}
+
+void CostAggregateDagonal_2(const std::uint16_t* img_data, const int& height, const int& width, 
+                            const int& min_disparity, const int& max_disparity,
+                            const int& p1, const int& p2_init, 
+                            const std::uint8_t* cost_init, std::uint16_t* cost_aggr, bool is_forward,
+                            const std::uint8_t* valid_mask, const int& gray_shift) {
+	cost_aggregate_dagonal_2(img_data, height, width, min_disparity, max_disparity, p1, p2_init,
+	                         cost_init, cost_aggr, is_forward, valid_mask, gray_shift);
+}
+
+template <typename P, typename A>
+static void cost_aggregate_left_right_row_planar(const P* img_data, const int& height, const int& width, 
+                                                 const int& min_disparity, const int& max_disparity,
+                                                 const int& p1, const int& p2_init, 
+                                                 const std::uint8_t* cost_init, A* cost_aggr, bool is_forward,
+                                                 const std::uint8_t* valid_mask, const int& gray_shift) {
+	assert(width > 0 && height > 0 && max_disparity > min_disparity);
+
+	const int disp_range = max_disparity - min_disparity;
+	const auto& P1 = p1;
+	const auto& P2_Init = p2_init;
+	const int direction = is_forward ? 1 : -1;
+	typedef typename PathCostTraits<A>::Wide W;
+
+	// 路径上上个像素的代价数组，首尾各多一个元素避免边界溢出
+	std::vector<A> cost_last_path(disp_range + 2, PathCostTraits<A>::Max());
+
+	for (int i = 0; i < height; i++) {
+		// 同一像素不同视差的代价间隔width
+		const std::uint8_t* cost_init_row = cost_init + i * width * disp_range;
+		A* cost_aggr_row = cost_aggr + i * width * disp_range;
+		const P* img_row = img_data + i * width;
+		const std::uint8_t* mask_row = (valid_mask != nullptr) ? valid_mask + i * width : nullptr;
+
+		// 路径头及路径重新开始的像素：聚合代价等于初始代价
+		auto restart = [&](const int& j) {
+			A min_cost = PathCostTraits<A>::Max();
+			for (int d = 0; d < disp_range; d++) {
+				const A cost = cost_init_row[d * width + j];
+				cost_aggr_row[d * width + j] = cost;
+				cost_last_path[d + 1] = cost;
+				min_cost = std::min(min_cost, cost);
+			}
+			return min_cost;
+		};
+
+		int j = is_forward ? 0 : width - 1;
+		A mincost_last_path = restart(j);
+		bool is_path_broken = mask_row != nullptr && !mask_row[j];
+		P gray_last = img_row[j];
+
+		for (int k = 1; k < width; k++) {
+			j += direction;
+			const P gray = img_row[j];
+			if (mask_row != nullptr && !mask_row[j]) {
+				is_path_broken = true;
+			} else if (is_path_broken) {
+				mincost_last_path = restart(j);
+				is_path_broken = false;
+			} else {
+				const W l4 = mincost_last_path + std::max(P1, P2_Init / ((abs(gray - gray_last) >> gray_shift) + 1));
+				A min_cost = PathCostTraits<A>::Max();
+				for (int d = 0; d < disp_range; d++) {
+					const W l1 = cost_last_path[d + 1];
+					const W l2 = cost_last_path[d] + P1;
+					const W l3 = cost_last_path[d + 2] + P1;
+					const A cost_s = saturate_path_cost<A>(cost_init_row[d * width + j] 
+					                                       + (std::min(std::min(l1, l2), std::min(l3, l4)) - mincost_last_path));
+					cost_aggr_row[d * width + j] = cost_s;
+					min_cost = std::min(min_cost, cost_s);
+				}
+				// 逐视差递推需要上个像素全部视差的旧值，算完后再更新
+				for (int d = 0; d < disp_range; d++) {
+					cost_last_path[d + 1] = cost_aggr_row[d * width + j];
+				}
+				mincost_last_path = min_cost;
+			}
+			gray_last = gray;
+		}
+	}
+}
+
+void CostAggregateLeftRightRowPlanar(const std::uint8_t* img_data, const int& height, const int& width, 
+                                     const int& min_disparity, const int& max_disparity,
+                                     const int& p1, const int& p2_init, 
+                                     const std::uint8_t* cost_init, std::uint8_t* cost_aggr, bool is_forward,
+                                     const std::uint8_t* valid_mask, const int& gray_shift) {
+	cost_aggregate_left_right_row_planar(img_data, height, width, min_disparity, max_disparity, p1, p2_init,
+	                                     cost_init, cost_aggr, is_forward, valid_mask, gray_shift);
+}
+
+void CostAggregateLeftRightRowPlanar(const std::uint16_t* img_data, const int& height, const int& width, 
+                                     const int& min_disparity, const int& max_disparity,
+                                     const int& p1, const int& p2_init, 
+                                     const std::uint8_t* cost_init, std::uint8_t* cost_aggr, bool is_forward,
+                                     const std::uint8_t* valid_mask, const int& gray_shift) {
+	cost_aggregate_left_right_row_planar(img_data, height, width, min_disparity, max_disparity, p1, p2_init,
+	                                     cost_init, cost_aggr, is_forward, valid_mask, gray_shift);
+}
+
+void CostAggregateLeftRightRowPlanar(const std::uint8_t* img_data, const int& height, const int& width, 
+                                     const int& min_disparity, const int& max_disparity,
+                                     const int& p1, const int& p2_init, 
+                                     const std::uint8_t* cost_init, std::uint16_t* cost_aggr, bool is_forward,
+                                     const std::uint8_t* valid_mask, const int& gray_shift) {
+	cost_aggregate_left_right_row_planar(img_data, height, width, min_disparity, max_disparity, p1, p2_init,
+	                                     cost_init, cost_aggr, is_forward, valid_mask, gray_shift);
+}
+
+void CostAggregateLeftRightRowPlanar(const std::uint16_t* img_data, const int& height, const int& width, 
+                                     const int& min_disparity, const int& max_disparity,
+                                     const int& p1, const int& p2_init, 
+                                     const std::uint8_t* cost_init, std::uint16_t* cost_aggr, bool is_forward,
+                                     const std::uint8_t* valid_mask, const int& gray_shift) {
+	cost_aggregate_left_right_row_planar(img_data, height, width, min_disparity, max_disparity, p1, p2_init,
+	                                     cost_init, cost_aggr, is_forward, valid_mask, gray_shift);
+}
+
+// 把上一行的数据按上个像素的列号对齐：aligned[j] = src[(j + col_offset) mod width]
+template <typename T>
+static void align_row(const T* src, T* aligned, const int& width, const int& col_offset) {
+	if (col_offset == 0) {
+		memcpy(aligned, src, width * sizeof(T));
+	} else if (col_offset < 0) {
+		aligned[0] = src[width - 1];
+		memcpy(aligned + 1, src, (width - 1) * sizeof(T));
+	} else {
+		memcpy(aligned, src + 1, (width - 1) * sizeof(T));
+		aligned[width - 1] = src[0];
+	}
+}
+
+// 行平面布局下按行递推的路径聚合：像素(i, j)在路径上的上个像素为(i - direction, (j + col_offset) mod width)
+// col_offset为0时是上下路径，为±1时是对角线路径（列号越界时从另一边界继续，与按像素布局的对角线聚合一致）
+template <typename P, typename A>
+static void cost_aggregate_rows_row_planar(const P* img_data, const int& height, const int& width, 
+                                           const int& min_disparity, const int& max_disparity,
+                                           const int& p1, const int& p2_init, 
+                                           const std::uint8_t* cost_init, A* cost_aggr, 
+                                           const bool& is_forward, const int& col_offset,
+                                           const std::uint8_t* valid_mask, const int& gray_shift) {
+	assert(width > 0 && height > 0 && max_disparity > min_disparity);
+
+	const int disp_range = max_disparity - min_disparity;
+	// 列数拷贝到局部变量，避免与uint8写入的别名使循环次数无法确定而不能向量化
+	const int cols = width;
+	const int row_size = cols * disp_range;
+	typedef typename PathCostTraits<A>::Wide W;
+	const W P1 = static_cast<W>(p1);
+	const int direction = is_forward ? 1 : -1;
+
+	// 上一行按上个像素对齐后的聚合代价，首尾各多一个视差平面（路径代价上限）避免边界溢出
+	std::vector<A> last(row_size + 2 * width, PathCostTraits<A>::Max());
+	// 上个像素的最小聚合代价、P2惩罚项、当前行的最小聚合代价
+	std::vector<A> min_last(width);
+	std::vector<W> penalty(width);
+	std::vector<P> gray_last(width);
+	std::vector<std::uint8_t> mask_last(width);
+
+	// 路径头所在的行：聚合代价等于初始代价
+	const int first_row = is_forward ? 0 : height - 1;
+	std::copy(cost_init + first_row * row_size, cost_init + (first_row + 1) * row_size, cost_aggr + first_row * row_size);
+
+	for (int k = 1; k < height; k++) {
+		const int i = first_row + k * direction;
+		const int i_last = i - direction;
+		const std::uint8_t* cost_init_row = cost_init + i * row_size;
+		const A* cost_aggr_last = cost_aggr + i_last * row_size;
+		A* cost_aggr_row = cost_aggr + i * row_size;
+		const P* img_row = img_data + i * width;
+
+		// 对齐上一行的聚合代价，并求上个像素的最小聚合代价
+		A* last_planes = last.data() + width;
+		for (int d = 0; d < disp_range; d++) {
+			align_row(cost_aggr_last + d * width, last_planes + d * width, width, col_offset);
+		}
+		memcpy(min_last.data(), last_planes, width * sizeof(A));
+		for (int d = 1; d < disp_range; d++) {
+			const A* __restrict plane = last_planes + d * cols;
+			A* __restrict min_prev = min_last.data();
+			for (int j = 0; j < cols; j++) {
+				min_prev[j] = std::min(min_prev[j], plane[j]);
+			}
+		}
+
+		// P2随路径上相邻像素的灰度差自适应
+		align_row(img_data + i_last * width, gray_last.data(), width, col_offset);
+		for (int j = 0; j < cols; j++) {
+			penalty[j] = static_cast<W>(min_last[j] + std::max(p1, p2_init / ((abs(img_row[j] - gray_last[j]) >> gray_shift) + 1)));
+		}
+
+		// Lr(p,d) = C(p,d) + min( Lr(p-r,d), Lr(p-r,d-1) + P1, Lr(p-r,d+1) + P1, min(Lr(p-r))+P2 ) - min(Lr(p-r))
+		// 同一视差平面上各列互不依赖，沿列向量化
+		for (int d = 0; d < disp_range; d++) {
+			const std::uint8_t* __restrict cost = cost_init_row + d * cols;
+			const A* __restrict l_prev = last_planes + (d - 1) * cols;
+			const A* __restrict l_same = last_planes + d * cols;
+			const A* __restrict l_next = last_planes + (d + 1) * cols;
+			const A* __restrict min_prev = min_last.data();
+			const W* __restrict p2 = penalty.data();
+			A* __restrict cost_s = cost_aggr_row + d * cols;
+			for (int j = 0; j < cols; j++) {
+				const W l1 = l_same[j];
+				const W l2 = l_prev[j] + P1;
+				const W l3 = l_next[j] + P1;
+				const W l4 = p2[j];
+				cost_s[j] = saturate_path_cost<A>(cost[j] + (std::min(std::min(l1, l2), std::min(l3, l4)) - min_prev[j]));
+			}
+		}
+
+		// 掩膜：上个像素无效时路径在当前像素重新开始
+		if (valid_mask != nullptr) {
+			const std::uint8_t* mask_row = valid_mask + i * width;
+			align_row(valid_mask + i_last * width, mask_last.data(), width, col_offset);
+			for (int j = 0; j < cols; j++) {
+				if (mask_row[j] && !mask_last[j]) {
+					for (int d = 0; d < disp_range; d++) {
+						cost_aggr_row[d * width + j] = cost_init_row[d * width + j];
+					}
+				}
+			}
+		}
+	}
+}
+
+void CostAggregateUpDownRowPlanar(const std::uint8_t* img_data, const int& height, const int& width, 
+                                  const int& min_disparity, const int& max_disparity,
+                                  const int& p1, const int& p2_init, 
+                                  const std::uint8_t* cost_init, std::uint8_t* cost_aggr, bool is_forward,
+                                  const std::uint8_t* valid_mask, const int& gray_shift) {
+	cost_aggregate_rows_row_planar(img_data, height, width, min_disparity, max_disparity, p1, p2_init,
+	                               cost_init, cost_aggr, is_forward, 0, valid_mask, gray_shift);
+}
+
+void CostAggregateUpDownRowPlanar(const std::uint16_t* img_data, const int& height, const int& width, 
+                                  const int& min_disparity, const int& max_disparity,
+                                  const int& p1, const int& p2_init, 
+                                  const std::uint8_t* cost_init, std::uint8_t* cost_aggr, bool is_forward,
+                                  const std::uint8_t* valid_mask, const int& gray_shift) {
+	cost_aggregate_rows_row_planar(img_data, height, width, min_disparity, max_disparity, p1, p2_init,
+	                               cost_init, cost_aggr, is_forward, 0, valid_mask, gray_shift);
+}
+
+void CostAggregateUpDownRowPlanar(const std::uint8_t* img_data, const int& height, const int& width, 
+                                  const int& min_disparity, const int& max_disparity,
+                                  const int& p1, const int& p2_init, 
+                                  const std::uint8_t* cost_init, std::uint16_t* cost_aggr, bool is_forward,
+                                  const std::uint8_t* valid_mask, const int& gray_shift) {
+	cost_aggregate_rows_row_planar(img_data, height, width, min_disparity, max_disparity, p1, p2_init,
+	                               cost_init, cost_aggr, is_forward, 0, valid_mask, gray_shift);
+}
+
+void CostAggregateUpDownRowPlanar(const std::uint16_t* img_data, const int& height, const int& width, 
+                                  const int& min_disparity, const int& max_disparity,
+                                  const int& p1, const int& p2_init, 
+                                  const std::uint8_t* cost_init, std::uint16_t* cost_aggr, bool is_forward,
+                                  const std::uint8_t* valid_mask, const int& gray_shift) {
+	cost_aggregate_rows_row_planar(img_data, height, width, min_disparity, max_disparity, p1, p2_init,
+	                               cost_init, cost_aggr, is_forward, 0, valid_mask, gray_shift);
+}
+
+void CostAggregateDagonal_1RowPlanar(const std::uint8_t* img_data, const int& height, const int& width, 
+                                     const int& min_disparity, const int& max_disparity,
+                                     const int& p1, const int& p2_init, 
+                                     const std::uint8_t* cost_init, std::uint8_t* cost_aggr, bool is_forward,
+                                     const std::uint8_t* valid_mask, const int& gray_shift) {
+	// 左上->右下的上个像素在左上方，右下->左上的上个像素在右下方
+	cost_aggregate_rows_row_planar(img_data, height, width, min_disparity, max_disparity, p1, p2_init,
+	                               cost_init, cost_aggr, is_forward, is_forward ? -1 : 1, valid_mask, gray_shift);
+}
+
+void CostAggregateDagonal_1RowPlanar(const std::uint16_t* img_data, const int& height, const int& width, 
+                                     const int& min_disparity, const int& max_disparity,
+                                     const int& p1, const int& p2_init, 
+                                     const std::uint8_t* cost_init, std::uint8_t* cost_aggr, bool is_forward,
+                                     const std::uint8_t* valid_mask, const int& gray_shift) {
+	// 左上->右下的上个像素在左上方，右下->左上的上个像素在右下方
+	cost_aggregate_rows_row_planar(img_data, height, width, min_disparity, max_disparity, p1, p2_init,
+	                               cost_init, cost_aggr, is_forward, is_forward ? -1 : 1, valid_mask, gray_shift);
+}
+
+void CostAggregateDagonal_1RowPlanar(const std::uint8_t* img_data, const int& height, const int& width, 
+                                     const int& min_disparity, const int& max_disparity,
+                                     const int& p1, const int& p2_init, 
+                                     const std::uint8_t* cost_init, std::uint16_t* cost_aggr, bool is_forward,
+                                     const std::uint8_t* valid_mask, const int& gray_shift) {
+	// 左上->右下的上个像素在左上方，右下->左上的上个像素在右下方
+	cost_aggregate_rows_row_planar(img_data, height, width, min_disparity, max_disparity, p1, p2_init,
+	                               cost_init, cost_aggr, is_forward, is_forward ? -1 : 1, valid_mask, gray_shift);
+}
+
+void CostAggregateDagonal_1RowPlanar(const std::uint16_t* img_data, const int& height, const int& width, 
+                                     const int& min_disparity, const int& max_disparity,
+                                     const int& p1, const int& p2_init, 
+                                     const std::uint8_t* cost_init, std::uint16_t* cost_aggr, bool is_forward,
+                                     const std::uint8_t* valid_mask, const int& gray_shift) {
+	// 左上->右下的上个像素在左上方，右下->左上的上个像素在右下方
+	cost_aggregate_rows_row_planar(img_data, height, width, min_disparity, max_disparity, p1, p2_init,
+	                               cost_init, cost_aggr, is_forward, is_forward ? -1 : 1, valid_mask, gray_shift);
+}
+
+void CostAggregateDagonal_2RowPlanar(const std::uint8_t* img_data, const int& height, const int& width, 
+                                     const int& min_disparity, const int& max_disparity,
+                                     const int& p1, const int& p2_init, 
+                                     const std::uint8_t* cost_init, std::uint8_t* cost_aggr, bool is_forward,
+                                     const std::uint8_t* valid_mask, const int& gray_shift) {
+	// 右上->左下的上个像素在右上方，左下->右上的上个像素在左下方
+	cost_aggregate_rows_row_planar(img_data, height, width, min_disparity, max_disparity, p1, p2_init,
+	                               cost_init, cost_aggr, is_forward, is_forward ? 1 : -1, valid_mask, gray_shift);
+}
+
+void CostAggregateDagonal_2RowPlanar(const std::uint16_t* img_data, const int& height, const int& width, 
+                                     const int& min_disparity, const int& max_disparity,
+                                     const int& p1, const int& p2_init, 
+                                     const std::uint8_t* cost_init, std::uint8_t* cost_aggr, bool is_forward,
+                                     const std::uint8_t* valid_mask, const int& gray_shift) {
+	// 右上->左下的上个像素在右上方，左下->右上的上个像素在左下方
+	cost_aggregate_rows_row_planar(img_data, height, width, min_disparity, max_disparity, p1, p2_init,
+	                               cost_init, cost_aggr, is_forward, is_forward ? 1 : -1, valid_mask, gray_shift);
+}
+
+void CostAggregateDagonal_2RowPlanar(const std::uint8_t* img_data, const int& height, const int& width, 
+                                     const int& min_disparity, const int& max_disparity,
+                                     const int& p1, const int& p2_init, 
+                                     const std::uint8_t* cost_init, std::uint16_t* cost_aggr, bool is_forward,
+                                     const std::uint8_t* valid_mask, const int& gray_shift) {
+	// 右上->左下的上个像素在右上方，左下->右上的上个像素在左下方
+	cost_aggregate_rows_row_planar(img_data, height, width, min_disparity, max_disparity, p1, p2_init,
+	                               cost_init, cost_aggr, is_forward, is_forward ? 1 : -1, valid_mask, gray_shift);
+}
+
+void CostAggregateDagonal_2RowPlanar(const std::uint16_t* img_data, const int& height, const int& width, 
+                                     const int& min_disparity, const int& max_disparity,
+                                     const int& p1, const int& p2_init, 
+                                     const std::uint8_t* cost_init, std::uint16_t* cost_aggr, bool is_forward,
+                                     const std::uint8_t* valid_mask, const int& gray_shift) {
+	// 右上->左下的上个像素在右上方，左下->右上的上个像素在左下方
+	cost_aggregate_rows_row_planar(img_data, height, width, min_disparity, max_disparity, p1, p2_init,
+	                               cost_init, cost_aggr, is_forward, is_forward ? 1 : -1, valid_mask, gray_shift);
+}
+
+template <typename P, typename A>
+static void cost_aggregate_down_row(const P* img_row, const P* img_last_row, const int& width,
+                                    const int& min_disparity, const int& max_disparity,
+                                    const int& p1, const int& p2_init,
+                                    const std::uint8_t* cost_init_row, const A* cost_aggr_last_row,
+                                    A* cost_aggr_row, const bool& is_row_planar,
+                                    const std::uint8_t* mask_row, const std::uint8_t* mask_last_row, const int& gray_shift) {
+	assert(width > 0 && max_disparity > min_disparity);
+
+	const int disp_range = max_disparity - min_disparity;
+	const auto& P1 = p1;
+	const auto& P2_Init = p2_init;
+	typedef typename PathCostTraits<A>::Wide W;
+	// 同一行中相邻像素、相邻视差的代价间隔
+	const int pixel_stride = is_row_planar ? 1 : disp_range;
+	const int disp_stride = is_row_planar ? width : 1;
+
+	// 路径头所在的行：聚合代价等于初始代价
+	if (cost_aggr_last_row == nullptr) {
+		std::copy(cost_init_row, cost_init_row + width * disp_range, cost_aggr_row);
+		return;
+	}
+
+	for (int j = 0; j < width; j++) {
+		// 无效像素处路径中断，不聚合
+		if (mask_row != nullptr && !mask_row[j]) {
+			continue;
+		}
+		const std::uint8_t* cost = cost_init_row + j * pixel_stride;
+		const A* last = cost_aggr_last_row + j * pixel_stride;
+		A* cost_s = cost_aggr_row + j * pixel_stride;
+
+		// 上个像素无效时路径在当前像素重新开始
+		if (mask_last_row != nullptr && !mask_last_row[j]) {
+			for (int d = 0; d < disp_range; d++) {
+				cost_s[d * disp_stride] = cost[d * disp_stride];
+			}
+			continue;
+		}
+
+		A mincost_last_path = PathCostTraits<A>::Max();
+		for (int d = 0; d < disp_range; d++) {
+			mincost_last_path = std::min(mincost_last_path, last[d * disp_stride]);
+		}
+		const W l4 = mincost_last_path + std::max(P1, P2_Init / ((abs(img_row[j] - img_last_row[j]) >> gray_shift) + 1));
+
+		// Lr(p,d) = C(p,d) + min( Lr(p-r,d), Lr(p-r,d-1) + P1, Lr(p-r,d+1) + P1, min(Lr(p-r))+P2 ) - min(Lr(p-r))
+		// 视差范围两端越界的相邻视差取自身，加P1后不小于l1，与越界取路径代价上限的结果相同
+		for (int d = 0; d < disp_range; d++) {
+			const W l1 = last[d * disp_stride];
+			const W l2 = last[std::max(d - 1, 0) * disp_stride] + P1;
+			const W l3 = last[std::min(d + 1, disp_range - 1) * disp_stride] + P1;
+			cost_s[d * disp_stride] = saturate_path_cost<A>(cost[d * disp_stride]
+			                                                + (std::min(std::min(l1, l2), std::min(l3, l4)) - mincost_last_path));
+		}
+	}
+}
+
+void CostAggregateDownRow(const std::uint8_t* img_row, const std::uint8_t* img_last_row, const int& width,
+                          const int& min_disparity, const int& max_disparity,
+                          const int& p1, const int& p2_init,
+                          const std::uint8_t* cost_init_row, const std::uint8_t* cost_aggr_last_row,
+                          std::uint8_t* cost_aggr_row, const bool& is_row_planar,
+                          const std::uint8_t* mask_row, const std::uint8_t* mask_last_row, const int& gray_shift) {
+	cost_aggregate_down_row(img_row, img_last_row, width, min_disparity, max_disparity, p1, p2_init,
+	                        cost_init_row, cost_aggr_last_row, cost_aggr_row, is_row_planar, mask_row, mask_last_row, gray_shift);
+}
+
+void CostAggregateDownRow(const std::uint16_t* img_row, const std::uint16_t* img_last_row, const int& width,
+                          const int& min_disparity, const int& max_disparity,
+                          const int& p1, const int& p2_init,
+                          const std::uint8_t* cost_init_row, const std::uint8_t* cost_aggr_last_row,
+                          std::uint8_t* cost_aggr_row, const bool& is_row_planar,
+                          const std::uint8_t* mask_row, const std::uint8_t* mask_last_row, const int& gray_shift) {
+	cost_aggregate_down_row(img_row, img_last_row, width, min_disparity, max_disparity, p1, p2_init,
+	                        cost_init_row, cost_aggr_last_row, cost_aggr_row, is_row_planar, mask_row, mask_last_row, gray_shift);
+}
+
+void CostAggregateDownRow(const std::uint8_t* img_row, const std::uint8_t* img_last_row, const int& width,
+                          const int& min_disparity, const int& max_disparity,
+                          const int& p1, const int& p2_init,
+                          const std::uint8_t* cost_init_row, const std::uint16_t* cost_aggr_last_row,
+                          std::uint16_t* cost_aggr_row, const bool& is_row_planar,
+                          const std::uint8_t* mask_row, const std::uint8_t* mask_last_row, const int& gray_shift) {
+	cost_aggregate_down_row(img_row, img_last_row, width, min_disparity, max_disparity, p1, p2_init,
+	                        cost_init_row, cost_aggr_last_row, cost_aggr_row, is_row_planar, mask_row, mask_last_row, gray_shift);
+}
+
+void CostAggregateDownRow(const std::uint16_t* img_row, const std::uint16_t* img_last_row, const int& width,
+                          const int& min_disparity, const int& max_disparity,
+                          const int& p1, const int& p2_init,
+                          const std::uint8_t* cost_init_row, const std::uint16_t* cost_aggr_last_row,
+                          std::uint16_t* cost_aggr_row, const bool& is_row_planar,
+                          const std::uint8_t* mask_row, const std::uint8_t* mask_last_row, const int& gray_shift) {
+	cost_aggregate_down_row(img_row, img_last_row, width, min_disparity, max_disparity, p1, p2_init,
+	                        cost_init_row, cost_aggr_last_row, cost_aggr_row, is_row_planar, mask_row, mask_last_row, gray_shift);
+}
+
+template <typename T>
+static void median_filter(const T* in, T* out, 
+                          const int& height, const int& width, 
+                          const int window_size) {
 	const int radius = window_size / 2;
 	const int size = window_size * window_size;
 
 	// 存储局部窗口内的数据
-	std::vector<float> window_data;
+	std::vector<T> window_data;
 	window_data.reserve(size);
 
 	for (int i = 0; i < height; i++) {
@@ -549,8 +1544,249 @@ void MedianFilter(const float* in, float* out,
 	}
 }
 
-void RemoveSpeckles(float* disparity_map, const int& height, const int& width,
-	                const int& diff_insame, const std::uint32_t& min_speckle_aera, const float& invalid_val) {
+void MedianFilter(const float* in, float* out, 
+                  const int& height, const int& width, 
+                  const int window_size) {
+	median_filter(in, out, height, width, window_size);
+}
+
+void MedianFilter(const std::int16_t* in, std::int16_t* out, 
+                  const int& height, const int& width, 
+                  const int window_size) {
+	median_filter(in, out, height, width, window_size);
+}
+
+void ResizeImage(const std::uint8_t* src, const int& src_height, const int& src_width,
+                 std::uint8_t* dst, const int& dst_height, const int& dst_width) {
+	assert(src_height > 0 && src_width > 0 && dst_height > 0 && dst_width > 0);
+
+	// 目标像素中心对应的源影像坐标，按8位定点数做双线性插值
+	const float scale_y = static_cast<float>(src_height) / dst_height;
+	const float scale_x = static_cast<float>(src_width) / dst_width;
+
+	// 预先计算每一列的插值位置和权重
+	std::vector<int> col_0(dst_width), col_1(dst_width), weight_x(dst_width);
+	for (int j = 0; j < dst_width; j++) {
+		const float x = std::max(0.0f, (j + 0.5f) * scale_x - 0.5f);
+		col_0[j] = std::min(static_cast<int>(x), src_width - 1);
+		col_1[j] = std::min(col_0[j] + 1, src_width - 1);
+		weight_x[j] = static_cast<int>((x - col_0[j]) * 256);
+	}
+
+	for (int i = 0; i < dst_height; i++) {
+		const float y = std::max(0.0f, (i + 0.5f) * scale_y - 0.5f);
+		const int row_0 = std::min(static_cast<int>(y), src_height - 1);
+		const int row_1 = std::min(row_0 + 1, src_height - 1);
+		const int weight_y = static_cast<int>((y - row_0) * 256);
+		const std::uint8_t* src_row_0 = src + row_0 * src_width;
+		const std::uint8_t* src_row_1 = src + row_1 * src_width;
+		for (int j = 0; j < dst_width; j++) {
+			const int top = src_row_0[col_0[j]] * (256 - weight_x[j]) + src_row_0[col_1[j]] * weight_x[j];
+			const int bottom = src_row_1[col_0[j]] * (256 - weight_x[j]) + src_row_1[col_1[j]] * weight_x[j];
+			dst[i * dst_width + j] = static_cast<std::uint8_t>((top * (256 - weight_y) + bottom * weight_y + (1 << 15)) >> 16);
+		}
+	}
+}
+
+template <typename P>
+static void remap_row(const P* src, const int& src_height, const int& src_width,
+                      const std::int16_t* map_xy, const std::uint16_t* map_frac, const int& width, P* dst) {
+	const int frac_mask = (1 << Remap_Frac_Bits) - 1;
+	const int one = 1 << Remap_Frac_Bits;
+	const int round = 1 << (2 * Remap_Frac_Bits - 1);
+
+	for (int j = 0; j < width; j++) {
+		const int x = map_xy[j * 2];
+		const int y = map_xy[j * 2 + 1];
+		const int weight_x = map_frac[j] & frac_mask;
+		const int weight_y = (map_frac[j] >> Remap_Frac_Bits) & frac_mask;
+
+		int p00, p01, p10, p11;
+		if (x >= 0 && y >= 0 && x < src_width - 1 && y < src_height - 1) {
+			const P* src_ptr = src + y * src_width + x;
+			p00 = src_ptr[0];
+			p01 = src_ptr[1];
+			p10 = src_ptr[src_width];
+			p11 = src_ptr[src_width + 1];
+		} else {
+			// 靠近或超出影像边界，逐点判断
+			auto sample = [&](const int& row, const int& col) {
+				return (row >= 0 && row < src_height && col >= 0 && col < src_width) ? src[row * src_width + col] : 0;
+			};
+			p00 = sample(y, x);
+			p01 = sample(y, x + 1);
+			p10 = sample(y + 1, x);
+			p11 = sample(y + 1, x + 1);
+		}
+
+		const int top = p00 * (one - weight_x) + p01 * weight_x;
+		const int bottom = p10 * (one - weight_x) + p11 * weight_x;
+		dst[j] = static_cast<P>((top * (one - weight_y) + bottom * weight_y + round) >> (2 * Remap_Frac_Bits));
+	}
+}
+
+void RemapRow(const std::uint8_t* src, const int& src_height, const int& src_width,
+              const std::int16_t* map_xy, const std::uint16_t* map_frac, const int& width, std::uint8_t* dst) {
+	remap_row(src, src_height, src_width, map_xy, map_frac, width, dst);
+}
+
+void RemapRow(const std::uint16_t* src, const int& src_height, const int& src_width,
+              const std::int16_t* map_xy, const std::uint16_t* map_frac, const int& width, std::uint16_t* dst) {
+	remap_row(src, src_height, src_width, map_xy, map_frac, width, dst);
+}
+
+void ResizeDisparity(const float* src, const int& src_height, const int& src_width,
+                     float* dst, const int& dst_height, const int& dst_width, const float& invalid_val) {
+	assert(src_height > 0 && src_width > 0 && dst_height > 0 && dst_width > 0);
+
+	// 视差值随影像宽度等比例缩放
+	const float disp_scale = static_cast<float>(dst_width) / src_width;
+
+	for (int i = 0; i < dst_height; i++) {
+		const int row = std::min(i * src_height / dst_height, src_height - 1);
+		for (int j = 0; j < dst_width; j++) {
+			const int col = std::min(j * src_width / dst_width, src_width - 1);
+			const float disp = src[row * src_width + col];
+			dst[i * dst_width + j] = (disp == invalid_val) ? invalid_val : disp * disp_scale;
+		}
+	}
+}
+
+template <typename T>
+static void reproject_row(const T* __restrict disp_row, const int& row, const int& col_begin, const int& col_end,
+                          const float* q_matrix, const int& disp_scale, const T& invalid_val, 
+                          float* __restrict depth_row, float* __restrict xyz_row) {
+	const float infinity = std::numeric_limits<float>::infinity();
+	const float inv_scale = 1.0f / disp_scale;
+	const T invalid = invalid_val;
+	const int begin = col_begin, end = col_end;
+
+	// Q矩阵中与列、视差相关的系数，及每行不变的部分
+	const float x_col = q_matrix[0], x_disp = q_matrix[2], x_row = q_matrix[1] * row + q_matrix[3];
+	const float y_col = q_matrix[4], y_disp = q_matrix[6], y_row = q_matrix[5] * row + q_matrix[7];
+	const float z_col = q_matrix[8], z_disp = q_matrix[10], z_row = q_matrix[9] * row + q_matrix[11];
+	const float w_col = q_matrix[12], w_disp = q_matrix[14], w_row = q_matrix[13] * row + q_matrix[15];
+
+	// 先不分有效无效全部计算，再把无效视差和W为0（结果非有限值）的像素置为无穷大
+	// 两个循环均无分支和可能陷入的条件除法，便于编译器向量化，一行数据仍在缓存中
+	if (depth_row != nullptr) {
+		for (int j = begin; j < end; j++) {
+			const float disp = disp_row[j] * inv_scale;
+			const float w = w_col * j + w_disp * disp + w_row;
+			depth_row[j] = (z_col * j + z_disp * disp + z_row) / w;
+		}
+		for (int j = begin; j < end; j++) {
+			const float z = depth_row[j];
+			depth_row[j] = (disp_row[j] == invalid || !(std::fabs(z) < infinity)) ? infinity : z;
+		}
+	}
+	if (xyz_row != nullptr) {
+		for (int j = begin; j < end; j++) {
+			const float disp = disp_row[j] * inv_scale;
+			const float inv_w = 1.0f / (w_col * j + w_disp * disp + w_row);
+			xyz_row[j * 3] = (x_col * j + x_disp * disp + x_row) * inv_w;
+			xyz_row[j * 3 + 1] = (y_col * j + y_disp * disp + y_row) * inv_w;
+			xyz_row[j * 3 + 2] = (z_col * j + z_disp * disp + z_row) * inv_w;
+		}
+		for (int j = begin; j < end; j++) {
+			const bool is_invalid = disp_row[j] == invalid || !(std::fabs(xyz_row[j * 3 + 2]) < infinity);
+			xyz_row[j * 3] = is_invalid ? infinity : xyz_row[j * 3];
+			xyz_row[j * 3 + 1] = is_invalid ? infinity : xyz_row[j * 3 + 1];
+			xyz_row[j * 3 + 2] = is_invalid ? infinity : xyz_row[j * 3 + 2];
+		}
+	}
+}
+
+void ReprojectRow(const float* disp_row, const int& row, const int& col_begin, const int& col_end,
+                  const float* q_matrix, const int& disp_scale, const float& invalid_val, float* depth_row, float* xyz_row) {
+	reproject_row(disp_row, row, col_begin, col_end, q_matrix, disp_scale, invalid_val, depth_row, xyz_row);
+}
+
+void ReprojectRow(const std::int16_t* disp_row, const int& row, const int& col_begin, const int& col_end,
+                  const float* q_matrix, const int& disp_scale, const std::int16_t& invalid_val, float* depth_row, float* xyz_row) {
+	reproject_row(disp_row, row, col_begin, col_end, q_matrix, disp_scale, invalid_val, depth_row, xyz_row);
+}
+
+template <typename T>
+static void lr_check_row(T* __restrict left_row, const T* __restrict right_row, const std::uint8_t* __restrict mask_row,
+                         const int& width, const float& threshold, const int& disp_scale, const T& invalid_val,
+                         std::uint8_t* __restrict class_codes, std::uint8_t* __restrict class_row,
+                         std::uint8_t* __restrict confidence_row) {
+	const int cols = width;
+	const float inv_scale = 1.0f / disp_scale;
+	const float thresh = threshold;
+	const T invalid = invalid_val;
+
+	// 第一遍：判断每个像素是否被剔除，先都记为误匹配；有置信度时乘以左右一致度，剔除的像素在第二遍置0
+	// 无效视差按0计算同名点列号（避免无穷大转整数），超出影像的列号改读本列，结果都由条件选择丢弃
+	const float agreement_scale = thresh > 0 ? 0.5f / thresh : 0.0f;
+	for (int j = 0; j < cols; j++) {
+		const T disp = left_row[j];
+		const bool is_invalid = disp == invalid;
+		const float disp_val = is_invalid ? 0.0f : disp * inv_scale;
+		const int col_right = static_cast<int>(static_cast<double>(j - disp_val) + 0.5);
+		const bool is_in_range = col_right >= 0 && col_right < cols;
+		const T disp_r = right_row[is_in_range ? col_right : j];
+		const float diff = std::fabs(static_cast<float>(disp) - static_cast<float>(disp_r));
+		const bool is_inconsistent = diff > thresh;
+		const bool is_checked = mask_row == nullptr || mask_row[j] != 0;
+		class_codes[j] = (is_checked && (is_invalid || !is_in_range || is_inconsistent)) ? LR_Mismatch : LR_Valid;
+		if (confidence_row != nullptr) {
+			// 无效视差的差为无穷大或NaN，min的参数顺序保证取0.5
+			const float agreement = 1.0f - std::min(0.5f, diff * agreement_scale);
+			confidence_row[j] = static_cast<std::uint8_t>(confidence_row[j] * agreement + 0.5f);
+		}
+	}
+
+	// 第二遍：按列序区分遮挡和误匹配，并把视差置为无效
+	// 通过右影像视差反投影回左影像，该处视差大于本像素视差为遮挡，否则为误匹配
+	// 反投影列在左侧时读到的是本行已置为无效的视差（无效值大于任何视差），与逐像素原地检查的结果一致
+	for (int j = 0; j < cols; j++) {
+		if (class_codes[j] == LR_Valid) {
+			continue;
+		}
+		const T disp = left_row[j];
+		if (disp == invalid) {
+			continue;
+		}
+		const int col_right = static_cast<int>(static_cast<double>(j - disp * inv_scale) + 0.5);
+		if (col_right >= 0 && col_right < cols && right_row[col_right] != invalid) {
+			const int col_rl = static_cast<int>(static_cast<double>(col_right + right_row[col_right] * inv_scale) + 0.5);
+			if (col_rl > 0 && col_rl < cols && left_row[col_rl] > disp) {
+				class_codes[j] = LR_Occluded;
+			}
+		}
+		left_row[j] = invalid;
+		if (confidence_row != nullptr) {
+			confidence_row[j] = 0;
+		}
+	}
+
+	// 每4个像素的类别打包为一个字节
+	for (int j = 0; j < cols; j += 4) {
+		std::uint8_t packed = 0;
+		for (int k = 0; k < 4 && j + k < cols; k++) {
+			packed |= class_codes[j + k] << (2 * k);
+		}
+		class_row[j >> 2] = packed;
+	}
+}
+
+void LRCheckRow(float* left_row, const float* right_row, const std::uint8_t* mask_row, const int& width,
+                const float& threshold, const int& disp_scale, const float& invalid_val,
+                std::uint8_t* class_codes, std::uint8_t* class_row, std::uint8_t* confidence_row) {
+	lr_check_row(left_row, right_row, mask_row, width, threshold, disp_scale, invalid_val, class_codes, class_row, confidence_row);
+}
+
+void LRCheckRow(std::int16_t* left_row, const std::int16_t* right_row, const std::uint8_t* mask_row, const int& width,
+                const float& threshold, const int& disp_scale, const std::int16_t& invalid_val,
+                std::uint8_t* class_codes, std::uint8_t* class_row, std::uint8_t* confidence_row) {
+	lr_check_row(left_row, right_row, mask_row, width, threshold, disp_scale, invalid_val, class_codes, class_row, confidence_row);
+}
+
+template <typename T>
+static void remove_speckles(T* disparity_map, const int& height, const int& width,
+	                        const int& diff_insame, const std::uint32_t& min_speckle_aera, const T& invalid_val) {
 	assert(width > 0 && height > 0);
 	if (width < 0 || height < 0) {
 		return;
@@ -611,5 +1847,15 @@ void RemoveSpeckles(float* disparity_map, const int& height, const int& width,
 	}
 }
 
+void RemoveSpeckles(float* disparity_map, const int& height, const int& width,
+	                const int& diff_insame, const std::uint32_t& min_speckle_aera, const float& invalid_val) {
+	remove_speckles(disparity_map, height, width, diff_insame, min_speckle_aera, invalid_val);
+}
+
+void RemoveSpeckles(std::int16_t* disparity_map, const int& height, const int& width,
+	                const int& diff_insame, const std::uint32_t& min_speckle_aera, const std::int16_t& invalid_val) {
+	remove_speckles(disparity_map, height, width, diff_insame, min_speckle_aera, invalid_val);
+}
+
 }   // namespace sgm_util
 
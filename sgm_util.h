@@ -25,8 +25,27 @@
 #endif
 
 namespace sgm_util {
+	/** \brief 定点视差的小数位数，定点视差 = 视差 * Disp_Scale */
+	constexpr int Disp_Frac_Bits = 4;
+	constexpr int Disp_Scale = 1 << Disp_Frac_Bits;
+	/** \brief 定点视差的无效值，取最大值使其在中值滤波排序中与float的无穷大一致 */
+	constexpr std::int16_t Invalid_Int16 = INT16_MAX;
+
+	/** \brief 左右一致性检查的像素类别，每像素2位，每字节4个像素（低位为左侧像素） */
+	constexpr std::uint8_t LR_Valid = 0;		// 通过检查或不参与检查
+	constexpr std::uint8_t LR_Occluded = 1;		// 遮挡
+	constexpr std::uint8_t LR_Mismatch = 2;		// 误匹配（含原本无效、同名点超出影像）
+
+	/** \brief 类别掩膜一行的字节数 */
+	inline int LRClassStride(const int& width) { return (width + 3) / 4; }
+
+	/** \brief 读取类别掩膜一行中第col个像素的类别 */
+	inline std::uint8_t LRClass(const std::uint8_t* class_row, const int& col) {
+		return (class_row[col >> 2] >> ((col & 3) * 2)) & 3;
+	}
+
 	/**
-	 * \brief census变换
+	 * \brief census变换，逐行按比较位无分支计算，uint8与uint16（10/12/16位）影像结果的位序相同
 	 * \param source	输入，影像数据
 	 * \param census	输出，census值数组
 	 * \param height	输入，影像高
@@ -34,12 +53,122 @@ namespace sgm_util {
 	 */
 	void census_transform_5x5(const std::uint8_t* source, std::uint32_t* census, 
                               const int& height, const int& width);
+	void census_transform_5x5(const std::uint16_t* source, std::uint32_t* census, 
+                              const int& height, const int& width);
 	void census_transform_9x7(const std::uint8_t* source, std::uint64_t* census, 
                               const int& height, const int& width);
+	void census_transform_9x7(const std::uint16_t* source, std::uint64_t* census, 
+                              const int& height, const int& width);
+
+	/**
+	 * \brief 中心对称census变换（CS-Census 9x7）
+	 *        窗口内关于中心对称的像素两两比较，9x7窗口共31对，31位存于uint32
+	 * \param source	输入，影像数据
+	 * \param census	输出，census值数组
+	 * \param height	输入，影像高
+	 * \param width		输入，影像宽
+	 */
+	void census_transform_cs_9x7(const std::uint8_t* source, std::uint32_t* census, 
+                                 const int& height, const int& width);
+	void census_transform_cs_9x7(const std::uint16_t* source, std::uint32_t* census, 
+                                 const int& height, const int& width);
+
+	/**
+	 * \brief 稀疏census变换（棋盘格采样9x7）
+	 *        只取窗口内行列偏移之和为奇数的像素与中心比较，共32位存于uint32
+	 */
+	void census_transform_sparse_9x7(const std::uint8_t* source, std::uint32_t* census, 
+                                     const int& height, const int& width);
+	void census_transform_sparse_9x7(const std::uint16_t* source, std::uint32_t* census, 
+                                     const int& height, const int& width);
+
+	/**
+	 * \brief 稀疏census变换（棋盘格采样11x11）
+	 *        棋盘格采样的60个像素再按中心对称两两比较，共30位存于uint32
+	 */
+	void census_transform_sparse_11x11(const std::uint8_t* source, std::uint32_t* census, 
+                                       const int& height, const int& width);
+	void census_transform_sparse_11x11(const std::uint16_t* source, std::uint32_t* census, 
+                                       const int& height, const int& width);
+
 	// Hamming距离
 	std::uint8_t HammingDistance(const std::uint32_t& x, const std::uint32_t& y);
 	std::uint8_t HammingDistance(const std::uint64_t& x, const std::uint64_t& y);
 
+	/** \brief 没有匹配信息（无census值或同名点超出影像）时的代价，不偏向任何视差 */
+	constexpr std::uint8_t Invalid_Cost = UINT8_MAX / 2;
+
+	/**
+	 * \brief census值有效的区域（census窗口完全落在影像内）[row_begin, row_end) x [col_begin, col_end)，
+	 *        行号相对于传入代价计算的census首行。census变换不写区域外的像素，代价计算不读取这些census值：
+	 *        区域外的左影像像素各视差、同名点落在区域外的视差的代价均为Invalid_Cost
+	 */
+	struct CensusRegion {
+		int row_begin, row_end;
+		int col_begin, col_end;
+	};
+
+	/**
+	 * \brief 基于census的代价计算（Hamming距离）
+	 *        左边界（及最小视差为负时的右边界）列按预先求出的部分视差范围计算，其余列对全部视差无分支计算
+	 * \param left_census		输入，左影像census值数组
+	 * \param right_census		输入，右影像census值数组
+	 * \param height			输入，影像高
+	 * \param width				输入，影像宽
+	 * \param min_disparity		输入，最小视差
+	 * \param max_disparity		输入，最大视差
+	 * \param cost_init			输出，初始代价数据
+	 * \param region			输入，census值有效的区域
+	 * \param valid_mask		输入，有效像素掩膜（非0为有效），无效像素跳过不计算，为nullptr时全部有效
+	 */
+	void ComputeCensusCost(const std::uint32_t* left_census, const std::uint32_t* right_census,
+                           const int& height, const int& width,
+                           const int& min_disparity, const int& max_disparity, std::uint8_t* cost_init,
+                           const CensusRegion& region, const std::uint8_t* valid_mask = nullptr);
+	void ComputeCensusCost(const std::uint64_t* left_census, const std::uint64_t* right_census,
+                           const int& height, const int& width,
+                           const int& min_disparity, const int& max_disparity, std::uint8_t* cost_init,
+                           const CensusRegion& region, const std::uint8_t* valid_mask = nullptr);
+
+	/** \brief 多基线代价累加时非整数视差插值权重的小数位数 */
+	constexpr int Multi_Cost_Frac_Bits = 4;
+
+	/**
+	 * \brief 多基线代价累加：参考视差d在次影像上的视差为d*disparity_scale，
+	 *        非整数视差在相邻两列的Hamming距离间线性插值，代价放大(1 << Multi_Cost_Frac_Bits)倍后累加
+	 * \param left_census		输入，参考影像census值数组
+	 * \param right_census		输入，次影像census值数组
+	 * \param height			输入，影像高
+	 * \param width				输入，影像宽
+	 * \param min_disparity		输入，参考视差的最小视差
+	 * \param max_disparity		输入，参考视差的最大视差
+	 * \param disparity_scale	输入，次影像与参考视差的比例（基线长度之比，次影像在参考影像左侧时为负）
+	 * \param cost_sum			输入/输出，累加代价数据，与初始代价等尺寸
+	 * \param is_first			输入，是否为第一个次影像（覆盖而非累加）
+	 * \param region			输入，census值有效的区域（参考影像与次影像相同）
+	 * \param is_row_planar		输入，累加代价是否为行平面布局
+	 * \param valid_mask		输入，有效像素掩膜，无效像素跳过不计算，为nullptr时全部有效
+	 */
+	void AccumulateCensusCost(const std::uint32_t* left_census, const std::uint32_t* right_census,
+                              const int& height, const int& width,
+                              const int& min_disparity, const int& max_disparity, const float& disparity_scale,
+                              std::uint16_t* cost_sum, const bool& is_first, const CensusRegion& region,
+                              const bool& is_row_planar = false, const std::uint8_t* valid_mask = nullptr);
+	void AccumulateCensusCost(const std::uint64_t* left_census, const std::uint64_t* right_census,
+                              const int& height, const int& width,
+                              const int& min_disparity, const int& max_disparity, const float& disparity_scale,
+                              std::uint16_t* cost_sum, const bool& is_first, const CensusRegion& region,
+                              const bool& is_row_planar = false, const std::uint8_t* valid_mask = nullptr);
+
+	/**
+	 * \brief 多基线累加代价取平均作为初始代价，保持与单基线代价相同的取值范围（惩罚项参数无需调整）
+	 * \param cost_sum			输入，累加代价数据
+	 * \param num_views			输入，累加的次影像数
+	 * \param size				输入，代价数据个数
+	 * \param cost_init			输出，初始代价数据
+	 */
+	void AverageAccumulatedCost(const std::uint16_t* cost_sum, const int& num_views, const int& size, std::uint8_t* cost_init);
+
 	/**
 	 * \brief 左右路径聚合 → ←
 	 * \param img_data			输入，影像数据
@@ -50,13 +179,32 @@ namespace sgm_util {
 	 * \param p1				输入，惩罚项P1
 	 * \param p2_init			输入，惩罚项P2_Init
 	 * \param cost_init			输入，初始代价数据
-	 * \param cost_aggr			输出，路径聚合代价数据
+	 * \param cost_aggr			输出，路径聚合代价数据，uint8时超过255饱和为255，uint16时可容纳大的P2和64位census代价
 	 * \param is_forward		输入，是否为正方向（正方向为从左到右，反方向为从右到左）
+	 * \param valid_mask		输入，有效像素掩膜（非0为有效），路径在无效像素处中断并在下一个有效像素重新开始，为nullptr时全部有效
+	 * \param gray_shift		输入，灰度差右移gray_shift位后计算自适应P2，uint16影像取有效位数-8，使惩罚项参数与8位影像通用
+	 *							以下各路径聚合函数均有uint8/uint16影像、uint8/uint16路径代价的重载，参数含义相同
 	 */
 	void CostAggregateLeftRight(const std::uint8_t* img_data, const int& height, const int& width, 
                                 const int& min_disparity, const int& max_disparity,
 		                        const int& p1,const int& p2_init, 
-                                const std::uint8_t* cost_init, std::uint8_t* cost_aggr, bool is_forward = true);
+                                const std::uint8_t* cost_init, std::uint8_t* cost_aggr, bool is_forward = true,
+                             const std::uint8_t* valid_mask = nullptr, const int& gray_shift = 0);
+	void CostAggregateLeftRight(const std::uint16_t* img_data, const int& height, const int& width, 
+                                const int& min_disparity, const int& max_disparity,
+		                        const int& p1,const int& p2_init, 
+                                const std::uint8_t* cost_init, std::uint8_t* cost_aggr, bool is_forward = true,
+                             const std::uint8_t* valid_mask = nullptr, const int& gray_shift = 0);
+	void CostAggregateLeftRight(const std::uint8_t* img_data, const int& height, const int& width, 
+                                const int& min_disparity, const int& max_disparity,
+		                        const int& p1,const int& p2_init, 
+                                const std::uint8_t* cost_init, std::uint16_t* cost_aggr, bool is_forward = true,
+                             const std::uint8_t* valid_mask = nullptr, const int& gray_shift = 0);
+	void CostAggregateLeftRight(const std::uint16_t* img_data, const int& height, const int& width, 
+                                const int& min_disparity, const int& max_disparity,
+		                        const int& p1,const int& p2_init, 
+                                const std::uint8_t* cost_init, std::uint16_t* cost_aggr, bool is_forward = true,
+                             const std::uint8_t* valid_mask = nullptr, const int& gray_shift = 0);
 
 	/**
 	 * \brief 上下路径聚合 ↓ ↑
@@ -70,11 +218,28 @@ namespace sgm_util {
 	 * \param cost_init			输入，初始代价数据
 	 * \param cost_aggr			输出，路径聚合代价数据
 	 * \param is_forward		输入，是否为正方向（正方向为从上到下，反方向为从下到上）
+	 * \param valid_mask		输入，有效像素掩膜（非0为有效），为nullptr时全部有效
 	 */
 	void CostAggregateUpDown(const std::uint8_t* img_data, const int& height, const int& width, 
                              const int& min_disparity, const int& max_disparity,
 		                     const int& p1, const int& p2_init, 
-                             const std::uint8_t* cost_init, std::uint8_t* cost_aggr, bool is_forward = true);
+                             const std::uint8_t* cost_init, std::uint8_t* cost_aggr, bool is_forward = true,
+                             const std::uint8_t* valid_mask = nullptr, const int& gray_shift = 0);
+	void CostAggregateUpDown(const std::uint16_t* img_data, const int& height, const int& width, 
+                             const int& min_disparity, const int& max_disparity,
+		                     const int& p1, const int& p2_init, 
+                             const std::uint8_t* cost_init, std::uint8_t* cost_aggr, bool is_forward = true,
+                             const std::uint8_t* valid_mask = nullptr, const int& gray_shift = 0);
+	void CostAggregateUpDown(const std::uint8_t* img_data, const int& height, const int& width, 
+                             const int& min_disparity, const int& max_disparity,
+		                     const int& p1, const int& p2_init, 
+                             const std::uint8_t* cost_init, std::uint16_t* cost_aggr, bool is_forward = true,
+                             const std::uint8_t* valid_mask = nullptr, const int& gray_shift = 0);
+	void CostAggregateUpDown(const std::uint16_t* img_data, const int& height, const int& width, 
+                             const int& min_disparity, const int& max_disparity,
+		                     const int& p1, const int& p2_init, 
+                             const std::uint8_t* cost_init, std::uint16_t* cost_aggr, bool is_forward = true,
+                             const std::uint8_t* valid_mask = nullptr, const int& gray_shift = 0);
 
 	/**
 	 * \brief 对角线1路径聚合（左上<->右下）↘ ↖
@@ -88,11 +253,28 @@ namespace sgm_util {
 	 * \param cost_init			输入，初始代价数据
 	 * \param cost_aggr			输出，路径聚合代价数据
 	 * \param is_forward		输入，是否为正方向（正方向为从左上到右下，反方向为从右下到左上）
+	 * \param valid_mask		输入，有效像素掩膜（非0为有效），为nullptr时全部有效
 	 */
 	void CostAggregateDagonal_1(const std::uint8_t* img_data, const int& height, const int& width, 
                                 const int& min_disparity, const int& max_disparity,
 		                        const int& p1, const int& p2_init, 
-                                const std::uint8_t* cost_init, std::uint8_t* cost_aggr, bool is_forward = true);
+                                const std::uint8_t* cost_init, std::uint8_t* cost_aggr, bool is_forward = true,
+                             const std::uint8_t* valid_mask = nullptr, const int& gray_shift = 0);
+	void CostAggregateDagonal_1(const std::uint16_t* img_data, const int& height, const int& width, 
+                                const int& min_disparity, const int& max_disparity,
+		                        const int& p1, const int& p2_init, 
+                                const std::uint8_t* cost_init, std::uint8_t* cost_aggr, bool is_forward = true,
+                             const std::uint8_t* valid_mask = nullptr, const int& gray_shift = 0);
+	void CostAggregateDagonal_1(const std::uint8_t* img_data, const int& height, const int& width, 
+                                const int& min_disparity, const int& max_disparity,
+		                        const int& p1, const int& p2_init, 
+                                const std::uint8_t* cost_init, std::uint16_t* cost_aggr, bool is_forward = true,
+                             const std::uint8_t* valid_mask = nullptr, const int& gray_shift = 0);
+	void CostAggregateDagonal_1(const std::uint16_t* img_data, const int& height, const int& width, 
+                                const int& min_disparity, const int& max_disparity,
+		                        const int& p1, const int& p2_init, 
+                                const std::uint8_t* cost_init, std::uint16_t* cost_aggr, bool is_forward = true,
+                             const std::uint8_t* valid_mask = nullptr, const int& gray_shift = 0);
 
 	/**
 	 * \brief 对角线2路径聚合（右上<->左下）↙ ↗
@@ -106,12 +288,188 @@ namespace sgm_util {
 	 * \param cost_init			输入，初始代价数据
 	 * \param cost_aggr			输出，路径聚合代价数据
 	 * \param is_forward		输入，是否为正方向（正方向为从上到下，反方向为从下到上）
+	 * \param valid_mask		输入，有效像素掩膜（非0为有效），为nullptr时全部有效
 	 */
 	void CostAggregateDagonal_2(const std::uint8_t* img_data, const int& height, const int& width, 
                                 const int& min_disparity, const int& max_disparity,
 		                        const int& p1, const int& p2_init, 
-                                const std::uint8_t* cost_init, std::uint8_t* cost_aggr, bool is_forward = true);
-	
+                                const std::uint8_t* cost_init, std::uint8_t* cost_aggr, bool is_forward = true,
+                             const std::uint8_t* valid_mask = nullptr, const int& gray_shift = 0);
+	void CostAggregateDagonal_2(const std::uint16_t* img_data, const int& height, const int& width, 
+                                const int& min_disparity, const int& max_disparity,
+		                        const int& p1, const int& p2_init, 
+                                const std::uint8_t* cost_init, std::uint8_t* cost_aggr, bool is_forward = true,
+                             const std::uint8_t* valid_mask = nullptr, const int& gray_shift = 0);
+	void CostAggregateDagonal_2(const std::uint8_t* img_data, const int& height, const int& width, 
+                                const int& min_disparity, const int& max_disparity,
+		                        const int& p1, const int& p2_init, 
+                                const std::uint8_t* cost_init, std::uint16_t* cost_aggr, bool is_forward = true,
+                             const std::uint8_t* valid_mask = nullptr, const int& gray_shift = 0);
+	void CostAggregateDagonal_2(const std::uint16_t* img_data, const int& height, const int& width, 
+                                const int& min_disparity, const int& max_disparity,
+		                        const int& p1, const int& p2_init, 
+                                const std::uint8_t* cost_init, std::uint16_t* cost_aggr, bool is_forward = true,
+                             const std::uint8_t* valid_mask = nullptr, const int& gray_shift = 0);
+
+	// 行平面代价体布局：第i行视差d列j的代价位于[i * width * disp_range + d * width + j]
+	// 每行每个视差的代价在内存中连续，上下、对角线路径在同一行的相邻像素间相互独立，可沿列向量化，适合视差范围较小的情形
+
+	/**
+	 * \brief 基于census的代价计算（Hamming距离），行平面布局，参数同ComputeCensusCost
+	 *        无效像素也计算代价（不被聚合和视差计算使用），以保持内层循环无分支
+	 */
+	void ComputeCensusCostRowPlanar(const std::uint32_t* left_census, const std::uint32_t* right_census,
+                                    const int& height, const int& width,
+                                    const int& min_disparity, const int& max_disparity, std::uint8_t* cost_init,
+                                    const CensusRegion& region);
+	void ComputeCensusCostRowPlanar(const std::uint64_t* left_census, const std::uint64_t* right_census,
+                                    const int& height, const int& width,
+                                    const int& min_disparity, const int& max_disparity, std::uint8_t* cost_init,
+                                    const CensusRegion& region);
+
+	/**
+	 * \brief 左右路径聚合 → ←，行平面布局，参数同CostAggregateLeftRight
+	 *        路径沿行前进，同一像素不同视差的代价间隔width，无法沿列向量化
+	 */
+	void CostAggregateLeftRightRowPlanar(const std::uint8_t* img_data, const int& height, const int& width, 
+                                         const int& min_disparity, const int& max_disparity,
+                                         const int& p1, const int& p2_init, 
+                                         const std::uint8_t* cost_init, std::uint8_t* cost_aggr, bool is_forward = true,
+                                         const std::uint8_t* valid_mask = nullptr, const int& gray_shift = 0);
+	void CostAggregateLeftRightRowPlanar(const std::uint16_t* img_data, const int& height, const int& width, 
+                                         const int& min_disparity, const int& max_disparity,
+                                         const int& p1, const int& p2_init, 
+                                         const std::uint8_t* cost_init, std::uint8_t* cost_aggr, bool is_forward = true,
+                                         const std::uint8_t* valid_mask = nullptr, const int& gray_shift = 0);
+	void CostAggregateLeftRightRowPlanar(const std::uint8_t* img_data, const int& height, const int& width, 
+                                         const int& min_disparity, const int& max_disparity,
+                                         const int& p1, const int& p2_init, 
+                                         const std::uint8_t* cost_init, std::uint16_t* cost_aggr, bool is_forward = true,
+                                         const std::uint8_t* valid_mask = nullptr, const int& gray_shift = 0);
+	void CostAggregateLeftRightRowPlanar(const std::uint16_t* img_data, const int& height, const int& width, 
+                                         const int& min_disparity, const int& max_disparity,
+                                         const int& p1, const int& p2_init, 
+                                         const std::uint8_t* cost_init, std::uint16_t* cost_aggr, bool is_forward = true,
+                                         const std::uint8_t* valid_mask = nullptr, const int& gray_shift = 0);
+
+	/**
+	 * \brief 上下路径聚合 ↓ ↑，行平面布局，逐行递推、沿列向量化，参数同CostAggregateUpDown
+	 */
+	void CostAggregateUpDownRowPlanar(const std::uint8_t* img_data, const int& height, const int& width, 
+                                      const int& min_disparity, const int& max_disparity,
+                                      const int& p1, const int& p2_init, 
+                                      const std::uint8_t* cost_init, std::uint8_t* cost_aggr, bool is_forward = true,
+                                      const std::uint8_t* valid_mask = nullptr, const int& gray_shift = 0);
+	void CostAggregateUpDownRowPlanar(const std::uint16_t* img_data, const int& height, const int& width, 
+                                      const int& min_disparity, const int& max_disparity,
+                                      const int& p1, const int& p2_init, 
+                                      const std::uint8_t* cost_init, std::uint8_t* cost_aggr, bool is_forward = true,
+                                      const std::uint8_t* valid_mask = nullptr, const int& gray_shift = 0);
+	void CostAggregateUpDownRowPlanar(const std::uint8_t* img_data, const int& height, const int& width, 
+                                      const int& min_disparity, const int& max_disparity,
+                                      const int& p1, const int& p2_init, 
+                                      const std::uint8_t* cost_init, std::uint16_t* cost_aggr, bool is_forward = true,
+                                      const std::uint8_t* valid_mask = nullptr, const int& gray_shift = 0);
+	void CostAggregateUpDownRowPlanar(const std::uint16_t* img_data, const int& height, const int& width, 
+                                      const int& min_disparity, const int& max_disparity,
+                                      const int& p1, const int& p2_init, 
+                                      const std::uint8_t* cost_init, std::uint16_t* cost_aggr, bool is_forward = true,
+                                      const std::uint8_t* valid_mask = nullptr, const int& gray_shift = 0);
+
+	/**
+	 * \brief 对角线1路径聚合 ↘ ↖，行平面布局，逐行递推、沿列向量化，参数同CostAggregateDagonal_1
+	 *        路径碰到列边界时与CostAggregateDagonal_1一样从另一边界的下一行继续
+	 */
+	void CostAggregateDagonal_1RowPlanar(const std::uint8_t* img_data, const int& height, const int& width, 
+                                         const int& min_disparity, const int& max_disparity,
+                                         const int& p1, const int& p2_init, 
+                                         const std::uint8_t* cost_init, std::uint8_t* cost_aggr, bool is_forward = true,
+                                         const std::uint8_t* valid_mask = nullptr, const int& gray_shift = 0);
+	void CostAggregateDagonal_1RowPlanar(const std::uint16_t* img_data, const int& height, const int& width, 
+                                         const int& min_disparity, const int& max_disparity,
+                                         const int& p1, const int& p2_init, 
+                                         const std::uint8_t* cost_init, std::uint8_t* cost_aggr, bool is_forward = true,
+                                         const std::uint8_t* valid_mask = nullptr, const int& gray_shift = 0);
+	void CostAggregateDagonal_1RowPlanar(const std::uint8_t* img_data, const int& height, const int& width, 
+                                         const int& min_disparity, const int& max_disparity,
+                                         const int& p1, const int& p2_init, 
+                                         const std::uint8_t* cost_init, std::uint16_t* cost_aggr, bool is_forward = true,
+                                         const std::uint8_t* valid_mask = nullptr, const int& gray_shift = 0);
+	void CostAggregateDagonal_1RowPlanar(const std::uint16_t* img_data, const int& height, const int& width, 
+                                         const int& min_disparity, const int& max_disparity,
+                                         const int& p1, const int& p2_init, 
+                                         const std::uint8_t* cost_init, std::uint16_t* cost_aggr, bool is_forward = true,
+                                         const std::uint8_t* valid_mask = nullptr, const int& gray_shift = 0);
+
+	/**
+	 * \brief 对角线2路径聚合 ↙ ↗，行平面布局，逐行递推、沿列向量化，参数同CostAggregateDagonal_2
+	 */
+	void CostAggregateDagonal_2RowPlanar(const std::uint8_t* img_data, const int& height, const int& width, 
+                                         const int& min_disparity, const int& max_disparity,
+                                         const int& p1, const int& p2_init, 
+                                         const std::uint8_t* cost_init, std::uint8_t* cost_aggr, bool is_forward = true,
+                                         const std::uint8_t* valid_mask = nullptr, const int& gray_shift = 0);
+	void CostAggregateDagonal_2RowPlanar(const std::uint16_t* img_data, const int& height, const int& width, 
+                                         const int& min_disparity, const int& max_disparity,
+                                         const int& p1, const int& p2_init, 
+                                         const std::uint8_t* cost_init, std::uint8_t* cost_aggr, bool is_forward = true,
+                                         const std::uint8_t* valid_mask = nullptr, const int& gray_shift = 0);
+	void CostAggregateDagonal_2RowPlanar(const std::uint8_t* img_data, const int& height, const int& width, 
+                                         const int& min_disparity, const int& max_disparity,
+                                         const int& p1, const int& p2_init, 
+                                         const std::uint8_t* cost_init, std::uint16_t* cost_aggr, bool is_forward = true,
+                                         const std::uint8_t* valid_mask = nullptr, const int& gray_shift = 0);
+	void CostAggregateDagonal_2RowPlanar(const std::uint16_t* img_data, const int& height, const int& width, 
+                                         const int& min_disparity, const int& max_disparity,
+                                         const int& p1, const int& p2_init, 
+                                         const std::uint8_t* cost_init, std::uint16_t* cost_aggr, bool is_forward = true,
+                                         const std::uint8_t* valid_mask = nullptr, const int& gray_shift = 0);
+
+	/**
+	 * \brief 扫描线模式的上->下路径聚合 ↓，只递推一行，递推公式及掩膜处理与CostAggregateUpDown正方向一致
+	 * \param img_row				输入，当前行影像数据
+	 * \param img_last_row			输入，上一行影像数据，首行为nullptr
+	 * \param width					输入，影像宽
+	 * \param min_disparity			输入，最小视差
+	 * \param max_disparity			输入，最大视差
+	 * \param p1					输入，惩罚项P1
+	 * \param p2_init				输入，惩罚项P2_Init
+	 * \param cost_init_row			输入，当前行初始代价
+	 * \param cost_aggr_last_row	输入，上一行路径聚合代价，为nullptr时当前行为路径头
+	 * \param cost_aggr_row			输出，当前行路径聚合代价
+	 * \param is_row_planar			输入，代价是否为行平面布局
+	 * \param mask_row				输入，当前行有效像素掩膜，为nullptr时全部有效
+	 * \param mask_last_row			输入，上一行有效像素掩膜，为nullptr时全部有效
+	 */
+	void CostAggregateDownRow(const std::uint8_t* img_row, const std::uint8_t* img_last_row, const int& width,
+                              const int& min_disparity, const int& max_disparity,
+                              const int& p1, const int& p2_init,
+                              const std::uint8_t* cost_init_row, const std::uint8_t* cost_aggr_last_row,
+                              std::uint8_t* cost_aggr_row, const bool& is_row_planar = false,
+                              const std::uint8_t* mask_row = nullptr, const std::uint8_t* mask_last_row = nullptr,
+                              const int& gray_shift = 0);
+	void CostAggregateDownRow(const std::uint16_t* img_row, const std::uint16_t* img_last_row, const int& width,
+                              const int& min_disparity, const int& max_disparity,
+                              const int& p1, const int& p2_init,
+                              const std::uint8_t* cost_init_row, const std::uint8_t* cost_aggr_last_row,
+                              std::uint8_t* cost_aggr_row, const bool& is_row_planar = false,
+                              const std::uint8_t* mask_row = nullptr, const std::uint8_t* mask_last_row = nullptr,
+                              const int& gray_shift = 0);
+	void CostAggregateDownRow(const std::uint8_t* img_row, const std::uint8_t* img_last_row, const int& width,
+                              const int& min_disparity, const int& max_disparity,
+                              const int& p1, const int& p2_init,
+                              const std::uint8_t* cost_init_row, const std::uint16_t* cost_aggr_last_row,
+                              std::uint16_t* cost_aggr_row, const bool& is_row_planar = false,
+                              const std::uint8_t* mask_row = nullptr, const std::uint8_t* mask_last_row = nullptr,
+                              const int& gray_shift = 0);
+	void CostAggregateDownRow(const std::uint16_t* img_row, const std::uint16_t* img_last_row, const int& width,
+                              const int& min_disparity, const int& max_disparity,
+                              const int& p1, const int& p2_init,
+                              const std::uint8_t* cost_init_row, const std::uint16_t* cost_aggr_last_row,
+                              std::uint16_t* cost_aggr_row, const bool& is_row_planar = false,
+                              const std::uint8_t* mask_row = nullptr, const std::uint8_t* mask_last_row = nullptr,
+                              const int& gray_shift = 0);
+
 	/**
 	 * \brief 中值滤波
 	 * \param in				输入，源数据 
@@ -123,17 +481,106 @@ namespace sgm_util {
 	void MedianFilter(const float* in, float* out, 
                       const int& height, const int& width, 
                       const int window_size);
+	void MedianFilter(const std::int16_t* in, std::int16_t* out, 
+                      const int& height, const int& width, 
+                      const int window_size);
+
+
+	/**
+	 * \brief 影像双线性缩放
+	 * \param src				输入，源影像
+	 * \param src_height		输入，源影像高
+	 * \param src_width			输入，源影像宽
+	 * \param dst				输出，目标影像
+	 * \param dst_height		输入，目标影像高
+	 * \param dst_width			输入，目标影像宽
+	 */
+	void ResizeImage(const std::uint8_t* src, const int& src_height, const int& src_width,
+                     std::uint8_t* dst, const int& dst_height, const int& dst_width);
 
+	/** \brief 校正查找表坐标的小数位数（与OpenCV的INTER_BITS一致） */
+	constexpr int Remap_Frac_Bits = 5;
+
+	/**
+	 * \brief 按定点查找表对一行像素做双线性重采样（与cv::convertMaps输出的CV_16SC2 + CV_16UC1映射一致）
+	 *        源影像外的采样点取0
+	 * \param src				输入，源影像
+	 * \param src_height		输入，源影像高
+	 * \param src_width			输入，源影像宽
+	 * \param map_xy			输入，该行每个像素在源影像中的整数坐标(x, y)交错
+	 * \param map_frac			输入，该行每个像素坐标的小数部分，(y小数 << Remap_Frac_Bits) + x小数
+	 * \param width				输入，该行像素数
+	 * \param dst				输出，重采样结果
+	 */
+	void RemapRow(const std::uint8_t* src, const int& src_height, const int& src_width,
+                  const std::int16_t* map_xy, const std::uint16_t* map_frac, const int& width, std::uint8_t* dst);
+	void RemapRow(const std::uint16_t* src, const int& src_height, const int& src_width,
+                  const std::int16_t* map_xy, const std::uint16_t* map_frac, const int& width, std::uint16_t* dst);
+
+	/**
+	 * \brief 视差图最近邻缩放，视差值按宽度比例缩放，无效值保持不变
+	 * \param src				输入，源视差图
+	 * \param src_height		输入，源视差图高
+	 * \param src_width			输入，源视差图宽
+	 * \param dst				输出，目标视差图
+	 * \param dst_height		输入，目标视差图高
+	 * \param dst_width			输入，目标视差图宽
+	 * \param invalid_val		输入，无效值
+	 */
+	void ResizeDisparity(const float* src, const int& src_height, const int& src_width,
+                         float* dst, const int& dst_height, const int& dst_width, const float& invalid_val);
+
+	/**
+	 * \brief 视差图的一行重投影到三维空间，[X Y Z W]^T = Q * [col row disp 1]^T，三维坐标为(X/W, Y/W, Z/W)
+	 *        无效视差及W为0的像素输出无穷大，各行数据均以列号索引
+	 * \param disp_row			输入，视差图的一行
+	 * \param row				输入，行号
+	 * \param col_begin			输入，起始列
+	 * \param col_end			输入，结束列（不含）
+	 * \param q_matrix			输入，4x4 Q矩阵（行优先）
+	 * \param disp_scale		输入，视差图数值与视差的比值（浮点视差为1，定点视差为Disp_Scale）
+	 * \param invalid_val		输入，视差图无效值
+	 * \param depth_row		输出，深度图（Z）的一行，可为nullptr
+	 * \param xyz_row			输出，三维坐标图（XYZ交错）的一行，可为nullptr
+	 */
+	void ReprojectRow(const float* disp_row, const int& row, const int& col_begin, const int& col_end,
+                      const float* q_matrix, const int& disp_scale, const float& invalid_val, float* depth_row, float* xyz_row);
+	void ReprojectRow(const std::int16_t* disp_row, const int& row, const int& col_begin, const int& col_end,
+                      const float* q_matrix, const int& disp_scale, const std::int16_t& invalid_val, float* depth_row, float* xyz_row);
+
+	/**
+	 * \brief 一行的左右一致性检查：不一致的视差置为无效，并输出遮挡/误匹配类别
+	 *        第一遍无分支地判断每个像素是否被剔除（按同名点列号收集右影像视差，便于编译器向量化），
+	 *        第二遍只处理被剔除的像素，区分遮挡与误匹配并置为无效；各行互不依赖，可按行并行
+	 * \param left_row		输入/输出，左影像视差图的一行
+	 * \param right_row		输入，右影像视差图的一行
+	 * \param mask_row		输入，有效像素掩膜的一行，无效像素不参与检查，可为nullptr
+	 * \param width			输入，宽度
+	 * \param threshold		输入，一致性阈值，与视差图单位相同
+	 * \param disp_scale	输入，视差图数值与视差的比值
+	 * \param invalid_val	输入，无效值
+	 * \param class_codes	输出，每像素一字节的类别（临时缓存，宽度个字节）
+	 * \param class_row		输出，类别掩膜的一行（LRClassStride(width)字节）
+	 * \param confidence_row	输入/输出，置信度的一行，保留的像素乘以左右一致度1-0.5*|左右视差差|/阈值，剔除的像素置0，可为nullptr
+	 */
+	void LRCheckRow(float* left_row, const float* right_row, const std::uint8_t* mask_row, const int& width,
+                    const float& threshold, const int& disp_scale, const float& invalid_val,
+                    std::uint8_t* class_codes, std::uint8_t* class_row, std::uint8_t* confidence_row = nullptr);
+	void LRCheckRow(std::int16_t* left_row, const std::int16_t* right_row, const std::uint8_t* mask_row, const int& width,
+                    const float& threshold, const int& disp_scale, const std::int16_t& invalid_val,
+                    std::uint8_t* class_codes, std::uint8_t* class_row, std::uint8_t* confidence_row = nullptr);
 
 	/**
 	 * \brief 剔除小连通区
 	 * \param disparity_map		输入，视差图 
 	 * \param height			输入，高度
 	 * \param width				输入，宽度
-	 * \param diff_insame		输入，同一连通区内的局部像素差异
+	 * \param diff_insame		输入，同一连通区内的局部像素差异，与视差图单位相同
 	 * \param min_speckle_aera	输入，最小连通区面积
 	 * \param invalid_val		输入，无效值
 	 */
 	void RemoveSpeckles(float* disparity_map, const int& height, const int& width, 
                         const int& diff_insame,const std::uint32_t& min_speckle_aera, const float& invalid_val);
+	void RemoveSpeckles(std::int16_t* disparity_map, const int& height, const int& width, 
+                        const int& diff_insame,const std::uint32_t& min_speckle_aera, const std::int16_t& invalid_val);
 }